@@ -0,0 +1,167 @@
+#!/bin/env python
+
+"""
+Read the header index of a directory of KCor FITS files.
+
+The index is the `.kcor_header_index` file written in a directory by
+`kcor_header_index` in the pipeline. It holds the size, modification time,
+CRC-32 checksum, and primary header of each `.fts` and `.fts.gz` file of the
+directory. The index is only updated by the pipeline, so files that changed
+since, or were never indexed, are flagged as stale and their headers are read
+from the files directly.
+"""
+
+import argparse
+import gzip
+import os
+
+
+INDEX_FILENAME = ".kcor_header_index"
+INDEX_MAGIC = "# kcor header index 1"
+CARD_SIZE = 80
+BLOCK_SIZE = 2880
+
+
+class IndexEntry:
+    def __init__(self, name, size, mtime, checksum, cards, stale=False):
+        self.name = name
+        self.size = size
+        self.mtime = mtime
+        self.checksum = checksum
+        self.cards = cards
+        self.stale = stale
+
+    def __getitem__(self, keyword):
+        value = self.get(keyword)
+        if value is None:
+            raise KeyError(keyword)
+        return value
+
+    def __contains__(self, keyword):
+        return self.get(keyword) is not None
+
+    def get(self, keyword, default=None):
+        """Return the value of the first card with the given keyword, converted
+        like sxpar does.
+        """
+        keyword = keyword.upper()
+        for card in self.cards:
+            if card[0:8].rstrip() == keyword and card[8:10] == "= ":
+                return parse_value(card[10:])
+        return default
+
+
+def parse_value(text):
+    text = text.strip()
+    if text.startswith("'"):
+        # string, with '' as an escaped quote
+        value = []
+        i = 1
+        while i < len(text):
+            if text[i] == "'":
+                if text[i + 1:i + 2] == "'":
+                    value.append("'")
+                    i += 2
+                    continue
+                break
+            value.append(text[i])
+            i += 1
+        return "".join(value)
+
+    text = text.split("/", 1)[0].strip()
+    if text == "T":
+        return True
+    if text == "F":
+        return False
+    try:
+        return int(text)
+    except ValueError:
+        pass
+    try:
+        return float(text.replace("D", "E").replace("d", "e"))
+    except ValueError:
+        return text
+
+
+def read_header(filename):
+    """Read the cards of the primary header of a FITS file, gzipped or not.
+    """
+    opener = gzip.open if filename.endswith(".gz") else open
+    cards = []
+    with opener(filename, "rb") as f:
+        while True:
+            block = f.read(BLOCK_SIZE)
+            if len(block) < BLOCK_SIZE:
+                raise ValueError(f"truncated header in {filename}")
+            for c in range(0, BLOCK_SIZE, CARD_SIZE):
+                card = block[c:c + CARD_SIZE].decode("ascii", "replace").rstrip()
+                cards.append(card)
+                if card[0:8].rstrip() == "END":
+                    return cards
+
+
+def read_index(dir):
+    """Read the index of a directory, returning a dict of entries by basename.
+    Entries for files that changed since they were indexed, or are not
+    indexed, are marked stale and have their headers read from the file.
+    Entries for files that no longer exist are dropped.
+    """
+    entries = {}
+    try:
+        with open(os.path.join(dir, INDEX_FILENAME), "r") as f:
+            lines = f.read().split("\n")
+    except FileNotFoundError:
+        lines = []
+
+    if len(lines) > 0 and lines[0] == INDEX_MAGIC:
+        i = 1
+        while i < len(lines):
+            fields = lines[i].split("\t")
+            if len(fields) != 5:
+                break
+            name = fields[0]
+            size, mtime, n_cards = int(fields[1]), int(fields[2]), int(fields[4])
+            cards = lines[i + 1:i + 1 + n_cards]
+            if len(cards) < n_cards:
+                break
+            entries[name] = IndexEntry(name, size, mtime, int(fields[3], 16),
+                                       cards)
+            i += 1 + n_cards
+
+    names = sorted(n for n in os.listdir(dir)
+                   if not n.startswith(".") and (n.endswith(".fts") or n.endswith(".fts.gz")))
+    index = {}
+    for name in names:
+        filename = os.path.join(dir, name)
+        try:
+            st = os.stat(filename)
+        except FileNotFoundError:
+            continue
+        entry = entries.get(name)
+        if entry is None or entry.size != st.st_size or entry.mtime != int(st.st_mtime):
+            try:
+                cards = read_header(filename)
+            except (OSError, ValueError, EOFError):
+                continue
+            entry = IndexEntry(name, st.st_size, int(st.st_mtime), None, cards,
+                               stale=True)
+        index[name] = entry
+
+    return index
+
+
+if __name__ == "__main__":
+    name = "KCor header index reader"
+    parser = argparse.ArgumentParser(description=name)
+
+    parser.add_argument("dir", help="directory of FITS files")
+    parser.add_argument("keywords", nargs="*", metavar="KEYWORD",
+        help="FITS keywords to list, default is to list the files")
+
+    args = parser.parse_args()
+
+    index = read_index(args.dir)
+    for name, entry in index.items():
+        checksum = "stale" if entry.stale else f"{entry.checksum:08x}"
+        values = [str(entry.get(k, "")) for k in args.keywords]
+        print("\t".join([name, str(entry.size), checksum] + values))
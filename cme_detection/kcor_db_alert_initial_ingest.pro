@@ -19,7 +19,8 @@ pro kcor_db_alert_initial_ingest, alert_json
                   sw_index=sw_index, $
                   log_name='kcor/cme'
 
-  ; create kcor_cme entry to get CME ID
+  ; create kcor_cme entry to get CME ID, not queued because LAST_INSERT_ID() is
+  ; only valid on the connection that did the insert
   db->execute, 'insert into kcor_cme (obs_day) values (%d)', obsday_index, $
                sql_statement=sql_query, $
                error_message=error_message, $
@@ -29,7 +30,8 @@ pro kcor_db_alert_initial_ingest, alert_json
   ; get current CMD ID (common block variable)
   current_cme_id = db->query('select last_insert_id()')
 
-  ; create kcor_cme_alert entry
+  ; create kcor_cme_alert entry, queued if "database/async_writes" is set; a
+  ; failure is logged when db is destroyed
   fields = [{name: 'obs_day', type: '%d'}, $
             {name: 'cme_id', type: '%d'}, $
             {name: 'alert_type', type: '''%s'''}, $
@@ -64,6 +66,7 @@ pro kcor_db_alert_initial_ingest, alert_json
                kcor_fitsfloat2db(alert.sep_forecast_submission.triggers.cme.time_at_height.height), $
                strmid(alert.sep_forecast_submission.triggers.cme.time_at_height.time, 0, 19), $
                sw_index, $
+               /async, $
                status=status, $
                error_message=error_message, $
                sql_statement=sql_cmd
@@ -53,7 +53,8 @@ pro kcor_db_alert_summary_ingest, summary_json, interim=interim
   velocity_history = velocity_history[good_indices]
   height_history   = height_history[good_indices]
 
-  ; create kcor_cme_alert entry
+  ; create kcor_cme_alert entry, queued if "database/async_writes" is set; a
+  ; failure is logged when db is destroyed
   fields = [{name: 'obs_day', type: '%d'}, $
             {name: 'cme_id', type: '%d'}, $
             {name: 'alert_type', type: '''%s'''}, $
@@ -101,6 +102,7 @@ pro kcor_db_alert_summary_ingest, summary_json, interim=interim
                db->escape_string(height_history), $
 
                sw_index, $
+               /async, $
                status=status, $
                error_message=error_message, $
                sql_statement=sql_cmd
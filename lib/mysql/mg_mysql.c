@@ -1,5 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
 
 #include <mysql_version.h>
 #include <mysql.h>
@@ -33,6 +37,586 @@ static IDL_STRUCT_TAG_DEF mg_mysql_field[] = {
   { 0 }
 };
 
+#pragma mark --- query statistics ---
+
+// Optional timing of queries: when enabled, every statement executed through
+// MG_MYSQL_QUERY, MG_MYSQL_REAL_QUERY, or an asynchronous write queue is timed
+// and accumulated by its fingerprint, i.e., the statement with literals
+// replaced by "?" and whitespace collapsed. MG_MYSQL_STORE_RESULT calls are
+// timed and attributed to the last statement executed on the same connection.
+
+#define MG_MYSQL_STATS_N_BINS     24
+#define MG_MYSQL_STATS_TABLE_SIZE 256
+#define MG_MYSQL_FINGERPRINT_SIZE 256
+
+typedef struct mg_mysql_stats_entry {
+  char fingerprint[MG_MYSQL_FINGERPRINT_SIZE];
+  IDL_ULONG64 count;
+  IDL_ULONG64 n_errors;
+  IDL_ULONG64 n_rows;
+  double total_time;
+  double min_time;
+  double max_time;
+  double store_time;
+  IDL_ULONG64 histogram[MG_MYSQL_STATS_N_BINS];
+  struct mg_mysql_stats_entry *next;
+} MG_MYSQL_STATS_ENTRY;
+
+static IDL_MEMINT mg_mysql_stats_histogram_dims[] = { 1, MG_MYSQL_STATS_N_BINS };
+
+static IDL_STRUCT_TAG_DEF mg_mysql_stats[] = {
+  { "FINGERPRINT", 0,                             (void *) IDL_TYP_STRING,  0 },
+  { "COUNT",       0,                             (void *) IDL_TYP_ULONG64, 0 },
+  { "N_ERRORS",    0,                             (void *) IDL_TYP_ULONG64, 0 },
+  { "N_ROWS",      0,                             (void *) IDL_TYP_ULONG64, 0 },
+  { "TOTAL_TIME",  0,                             (void *) IDL_TYP_DOUBLE,  0 },
+  { "MIN_TIME",    0,                             (void *) IDL_TYP_DOUBLE,  0 },
+  { "MAX_TIME",    0,                             (void *) IDL_TYP_DOUBLE,  0 },
+  { "STORE_TIME",  0,                             (void *) IDL_TYP_DOUBLE,  0 },
+  { "HISTOGRAM",   mg_mysql_stats_histogram_dims, (void *) IDL_TYP_ULONG64, 0 },
+  { 0 }
+};
+
+typedef struct {
+  IDL_STRING fingerprint;
+  IDL_ULONG64 count;
+  IDL_ULONG64 n_errors;
+  IDL_ULONG64 n_rows;
+  double total_time;
+  double min_time;
+  double max_time;
+  double store_time;
+  IDL_ULONG64 histogram[MG_MYSQL_STATS_N_BINS];
+} MG_MYSQL_STATS_STRUCT;
+
+static IDL_StructDefPtr mg_mysql_stats_sdef;
+
+static int mg_mysql_stats_enabled = 0;
+static MG_MYSQL_STATS_ENTRY *mg_mysql_stats_table[MG_MYSQL_STATS_TABLE_SIZE];
+static IDL_MEMINT mg_mysql_stats_n_entries = 0;
+static pthread_mutex_t mg_mysql_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// last statement executed from IDL, so store_result can be attributed to it
+static MYSQL *mg_mysql_stats_last_mysql = NULL;
+static MG_MYSQL_STATS_ENTRY *mg_mysql_stats_last_entry = NULL;
+
+
+static double mg_mysql_stats_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + 1.0e-9 * (double) ts.tv_nsec;
+}
+
+
+// normalize a statement so that statements differing only in their literal
+// values have the same fingerprint
+static void mg_mysql_fingerprint(const char *sql, unsigned long length,
+                                 char *fp) {
+  unsigned long i = 0;
+  int n = 0, space = 0;
+  char c, quote;
+
+  while (i < length && n < MG_MYSQL_FINGERPRINT_SIZE - 1) {
+    c = sql[i];
+    if (isspace((unsigned char) c)) {
+      space = n > 0;
+      i++;
+      continue;
+    }
+    if (space) {
+      fp[n++] = ' ';
+      space = 0;
+      if (n == MG_MYSQL_FINGERPRINT_SIZE - 1) break;
+    }
+
+    if (c == '\'' || c == '"') {
+      // skip quoted string, allowing for backslash escapes and doubled quotes
+      quote = c;
+      for (i++; i < length; i++) {
+        if (sql[i] == '\\') {
+          i++;
+        } else if (sql[i] == quote) {
+          if (i + 1 < length && sql[i + 1] == quote) {
+            i++;
+          } else {
+            break;
+          }
+        }
+      }
+      i++;
+      fp[n++] = '?';
+    } else if ((isdigit((unsigned char) c)
+                || (c == '-' && i + 1 < length && isdigit((unsigned char) sql[i + 1])))
+               && (n == 0 || !(isalnum((unsigned char) fp[n - 1]) || fp[n - 1] == '_'))) {
+      // skip numeric literal, but not digits that are part of an identifier
+      for (i++; i < length; i++) {
+        c = sql[i];
+        if (!(isalnum((unsigned char) c) || c == '.'
+              || ((c == '-' || c == '+') && (sql[i - 1] == 'e' || sql[i - 1] == 'E')))) break;
+      }
+      fp[n++] = '?';
+    } else {
+      fp[n++] = tolower((unsigned char) c);
+      i++;
+    }
+  }
+  fp[n] = '\0';
+}
+
+
+static unsigned int mg_mysql_stats_hash(const char *fp) {
+  unsigned int h = 2166136261u;
+  for (; *fp; fp++) h = (h ^ (unsigned char) *fp) * 16777619u;
+  return h % MG_MYSQL_STATS_TABLE_SIZE;
+}
+
+
+// histogram bin b counts statements taking [2^b, 2^(b+1)) microseconds, the
+// first and last bins also count anything faster/slower
+static int mg_mysql_stats_bin(double elapsed) {
+  double us = elapsed * 1.0e6;
+  int b = 0;
+
+  while (us >= 2.0 && b < MG_MYSQL_STATS_N_BINS - 1) {
+    us /= 2.0;
+    b++;
+  }
+  return b;
+}
+
+
+// record a statement, returning its entry; must not be called with the stats
+// lock held
+static MG_MYSQL_STATS_ENTRY *mg_mysql_stats_record(MYSQL *mysql,
+                                                   const char *sql,
+                                                   unsigned long length,
+                                                   double elapsed,
+                                                   int status) {
+  MG_MYSQL_STATS_ENTRY *entry;
+  char fp[MG_MYSQL_FINGERPRINT_SIZE];
+  IDL_ULONG64 n_rows = 0;
+  unsigned int h;
+
+  mg_mysql_fingerprint(sql, length, fp);
+
+  // rows returned by a SELECT are counted by store_result
+  if (status == 0 && mysql_field_count(mysql) == 0) {
+    n_rows = (IDL_ULONG64) mysql_affected_rows(mysql);
+  }
+
+  h = mg_mysql_stats_hash(fp);
+
+  pthread_mutex_lock(&mg_mysql_stats_lock);
+  for (entry = mg_mysql_stats_table[h]; entry; entry = entry->next) {
+    if (strcmp(entry->fingerprint, fp) == 0) break;
+  }
+  if (entry == NULL) {
+    entry = (MG_MYSQL_STATS_ENTRY *) calloc(1, sizeof(MG_MYSQL_STATS_ENTRY));
+    strcpy(entry->fingerprint, fp);
+    entry->min_time = elapsed;
+    entry->next = mg_mysql_stats_table[h];
+    mg_mysql_stats_table[h] = entry;
+    mg_mysql_stats_n_entries++;
+  }
+
+  entry->count++;
+  if (status != 0) entry->n_errors++;
+  entry->n_rows += n_rows;
+  entry->total_time += elapsed;
+  if (elapsed < entry->min_time) entry->min_time = elapsed;
+  if (elapsed > entry->max_time) entry->max_time = elapsed;
+  entry->histogram[mg_mysql_stats_bin(elapsed)]++;
+  pthread_mutex_unlock(&mg_mysql_stats_lock);
+
+  return entry;
+}
+
+
+static void mg_mysql_stats_record_query(MYSQL *mysql,
+                                        const char *sql,
+                                        unsigned long length,
+                                        double elapsed,
+                                        int status) {
+  MG_MYSQL_STATS_ENTRY *entry = mg_mysql_stats_record(mysql, sql, length,
+                                                      elapsed, status);
+  mg_mysql_stats_last_mysql = mysql;
+  mg_mysql_stats_last_entry = entry;
+}
+
+
+static void mg_mysql_stats_record_store(MYSQL *mysql,
+                                        MYSQL_RES *result,
+                                        double elapsed) {
+  pthread_mutex_lock(&mg_mysql_stats_lock);
+  if (mg_mysql_stats_last_entry && mg_mysql_stats_last_mysql == mysql) {
+    mg_mysql_stats_last_entry->store_time += elapsed;
+    if (result) {
+      mg_mysql_stats_last_entry->n_rows += (IDL_ULONG64) mysql_num_rows(result);
+    }
+  }
+  pthread_mutex_unlock(&mg_mysql_stats_lock);
+}
+
+
+static void mg_mysql_stats_reset(void) {
+  MG_MYSQL_STATS_ENTRY *entry, *next;
+  int h;
+
+  pthread_mutex_lock(&mg_mysql_stats_lock);
+  for (h = 0; h < MG_MYSQL_STATS_TABLE_SIZE; h++) {
+    for (entry = mg_mysql_stats_table[h]; entry; entry = next) {
+      next = entry->next;
+      free(entry);
+    }
+    mg_mysql_stats_table[h] = NULL;
+  }
+  mg_mysql_stats_n_entries = 0;
+  mg_mysql_stats_last_mysql = NULL;
+  mg_mysql_stats_last_entry = NULL;
+  pthread_mutex_unlock(&mg_mysql_stats_lock);
+}
+
+
+// turn timing of statements on (1) or off (0)
+static void IDL_mg_mysql_stats_enable(int argc, IDL_VPTR *argv) {
+  mg_mysql_stats_enabled = IDL_LongScalar(argv[0]) != 0;
+}
+
+
+// discard all statistics collected so far
+static void IDL_mg_mysql_stats_reset(int argc, IDL_VPTR *argv) {
+  mg_mysql_stats_reset();
+}
+
+
+// returns an array of MG_MYSQL_STATS structures, one per statement
+// fingerprint, or 0L if no statements have been timed
+static IDL_VPTR IDL_mg_mysql_stats(int argc, IDL_VPTR *argv) {
+  MG_MYSQL_STATS_ENTRY *entry;
+  MG_MYSQL_STATS_STRUCT *data;
+  IDL_MEMINT n_entries, e = 0;
+  IDL_VPTR result;
+  int h;
+
+  pthread_mutex_lock(&mg_mysql_stats_lock);
+  n_entries = mg_mysql_stats_n_entries;
+  if (n_entries == 0) {
+    pthread_mutex_unlock(&mg_mysql_stats_lock);
+    return IDL_GettmpLong(0);
+  }
+
+  data = (MG_MYSQL_STATS_STRUCT *) IDL_MakeTempStruct(mg_mysql_stats_sdef,
+                                                      1, &n_entries,
+                                                      &result, TRUE);
+  for (h = 0; h < MG_MYSQL_STATS_TABLE_SIZE; h++) {
+    for (entry = mg_mysql_stats_table[h]; entry; entry = entry->next, e++) {
+      IDL_StrStore(&data[e].fingerprint, entry->fingerprint);
+      data[e].count = entry->count;
+      data[e].n_errors = entry->n_errors;
+      data[e].n_rows = entry->n_rows;
+      data[e].total_time = entry->total_time;
+      data[e].min_time = entry->min_time;
+      data[e].max_time = entry->max_time;
+      data[e].store_time = entry->store_time;
+      memcpy(data[e].histogram, entry->histogram, sizeof(entry->histogram));
+    }
+  }
+  pthread_mutex_unlock(&mg_mysql_stats_lock);
+
+  return result;
+}
+
+
+#pragma mark --- connection pool ---
+
+// Connections kept open between uses, keyed by a string such as the config
+// file section they were made from. Acquiring a pooled connection that has
+// been idle checks it with mysql_ping and, if the server has dropped it,
+// transparently makes a new connection with the same parameters and options.
+// Options set with MG_MYSQL_OPTIONS are recorded for every handle so that
+// they can be applied again on reconnect.
+//
+// Several objects can hold the same pooled handle, so a reconnect must not
+// move or free it. Handles are therefore allocated here and initialized with
+// mysql_init(handle), which mysql_close does not free, and a pooled handle is
+// reconnected in place by closing and initializing it again.
+
+#define MG_MYSQL_POOL_DEFAULT_MAX_IDLE 30
+
+typedef struct mg_mysql_option {
+  enum mysql_option option;
+  UCHAR type;
+  UCHAR c;
+  IDL_ULONG ul;
+  char *s;
+  struct mg_mysql_option *next;
+} MG_MYSQL_OPTION;
+
+typedef struct mg_mysql_option_list {
+  MYSQL *mysql;
+  MG_MYSQL_OPTION *head;
+  MG_MYSQL_OPTION *tail;
+  struct mg_mysql_option_list *next;
+} MG_MYSQL_OPTION_LIST;
+
+typedef struct mg_mysql_pool_entry {
+  char *key;
+  MYSQL *mysql;
+  char *host;
+  char *user;
+  char *password;
+  char *database;
+  char *socket;
+  unsigned int port;
+  unsigned long flags;
+  MG_MYSQL_OPTION *options;
+  time_t last_used;
+  struct mg_mysql_pool_entry *next;
+} MG_MYSQL_POOL_ENTRY;
+
+// options of handles that are not pooled (yet), pool entries own theirs
+static MG_MYSQL_OPTION_LIST *mg_mysql_option_lists = NULL;
+static MG_MYSQL_POOL_ENTRY *mg_mysql_pool = NULL;
+
+
+static MYSQL *mg_mysql_handle_new(void) {
+  MYSQL *mysql = (MYSQL *) malloc(sizeof(MYSQL));
+
+  if (mysql == NULL) return NULL;
+  if (mysql_init(mysql) == NULL) {
+    free(mysql);
+    return NULL;
+  }
+  return mysql;
+}
+
+
+static void mg_mysql_handle_close(MYSQL *mysql) {
+  mysql_close(mysql);
+  free(mysql);
+}
+
+
+static const void *mg_mysql_option_value(MG_MYSQL_OPTION *opt) {
+  // options that are flags, like compression, take no argument
+  if (opt->option == MYSQL_OPT_COMPRESS) return NULL;
+
+  switch (opt->type) {
+    case IDL_TYP_BYTE:   return &opt->c;
+    case IDL_TYP_ULONG:  return &opt->ul;
+    case IDL_TYP_STRING: return opt->s;
+    default:             return NULL;
+  }
+}
+
+
+static void mg_mysql_free_options(MG_MYSQL_OPTION *opt) {
+  MG_MYSQL_OPTION *next;
+  for (; opt; opt = next) {
+    next = opt->next;
+    free(opt->s);
+    free(opt);
+  }
+}
+
+
+static void mg_mysql_record_option(MYSQL *mysql, MG_MYSQL_OPTION *opt) {
+  MG_MYSQL_OPTION_LIST *list;
+
+  for (list = mg_mysql_option_lists; list; list = list->next) {
+    if (list->mysql == mysql) break;
+  }
+  if (list == NULL) {
+    list = (MG_MYSQL_OPTION_LIST *) calloc(1, sizeof(MG_MYSQL_OPTION_LIST));
+    list->mysql = mysql;
+    list->next = mg_mysql_option_lists;
+    mg_mysql_option_lists = list;
+  }
+
+  if (list->tail) {
+    list->tail->next = opt;
+  } else {
+    list->head = opt;
+  }
+  list->tail = opt;
+}
+
+
+// remove the recorded options of a handle, returning them
+static MG_MYSQL_OPTION *mg_mysql_take_options(MYSQL *mysql) {
+  MG_MYSQL_OPTION_LIST **list, *found;
+  MG_MYSQL_OPTION *options;
+
+  for (list = &mg_mysql_option_lists; *list; list = &(*list)->next) {
+    if ((*list)->mysql == mysql) {
+      found = *list;
+      *list = found->next;
+      options = found->head;
+      free(found);
+      return options;
+    }
+  }
+  return NULL;
+}
+
+
+static MG_MYSQL_POOL_ENTRY *mg_mysql_pool_find(const char *key) {
+  MG_MYSQL_POOL_ENTRY *entry;
+  for (entry = mg_mysql_pool; entry; entry = entry->next) {
+    if (strcmp(entry->key, key) == 0) return entry;
+  }
+  return NULL;
+}
+
+
+static void mg_mysql_pool_free(MG_MYSQL_POOL_ENTRY *entry) {
+  if (entry->mysql) mg_mysql_handle_close(entry->mysql);
+  mg_mysql_free_options(entry->options);
+  free(entry->key);
+  free(entry->host);
+  free(entry->user);
+  free(entry->password);
+  free(entry->database);
+  free(entry->socket);
+  free(entry);
+}
+
+
+static void mg_mysql_pool_remove(MG_MYSQL_POOL_ENTRY *entry) {
+  MG_MYSQL_POOL_ENTRY **e;
+  for (e = &mg_mysql_pool; *e; e = &(*e)->next) {
+    if (*e == entry) {
+      *e = entry->next;
+      mg_mysql_pool_free(entry);
+      return;
+    }
+  }
+}
+
+
+static void mg_mysql_pool_clear(void) {
+  while (mg_mysql_pool) mg_mysql_pool_remove(mg_mysql_pool);
+}
+
+
+// reconnect the handle of a pool entry in place, with the same parameters and
+// options, so that everyone holding it keeps a valid handle; returns 0 for
+// success; on failure, the handle is left unconnected with its error
+static int mg_mysql_pool_reconnect(MG_MYSQL_POOL_ENTRY *entry) {
+  MG_MYSQL_OPTION *opt;
+  MYSQL *mysql = entry->mysql;
+  int status = 0;
+
+  mysql_close(mysql);
+  if (mysql_init(mysql) == NULL) return 1;
+
+  for (opt = entry->options; opt; opt = opt->next) {
+    mysql_options(mysql, opt->option, mg_mysql_option_value(opt));
+  }
+
+  if (!mysql_real_connect(mysql,
+                          entry->host, entry->user, entry->password,
+                          entry->database, entry->port,
+                          entry->socket, entry->flags)) {
+    status = 1;
+  }
+
+  entry->last_used = time(NULL);
+
+  return status;
+}
+
+
+static char *mg_mysql_strdup_or_null(IDL_VPTR arg) {
+  char *s = IDL_VarGetString(arg);
+  return (s[0] == '\0') ? NULL : strdup(s);
+}
+
+
+// int STDCALL mysql_ping(MYSQL *mysql);
+static IDL_VPTR IDL_mg_mysql_ping(int argc, IDL_VPTR *argv) {
+  int status = mysql_ping((MYSQL *) argv[0]->value.ptrint);
+  return IDL_GettmpLong(status);
+}
+
+
+// add a connected handle to the pool under the given key, along with the
+// parameters it was connected with:
+//
+//   mg_mysql_pool_add, key, mysql, host, user, password, database, port,
+//                      socket, flags
+static void IDL_mg_mysql_pool_add(int argc, IDL_VPTR *argv) {
+  char *key = IDL_VarGetString(argv[0]);
+  MYSQL *mysql = (MYSQL *) argv[1]->value.ptrint;
+  MG_MYSQL_POOL_ENTRY *entry = mg_mysql_pool_find(key);
+
+  if (entry) {
+    if (entry->mysql == mysql) return;
+    mg_mysql_pool_remove(entry);
+  }
+
+  entry = (MG_MYSQL_POOL_ENTRY *) calloc(1, sizeof(MG_MYSQL_POOL_ENTRY));
+  entry->key = strdup(key);
+  entry->mysql = mysql;
+  entry->host = mg_mysql_strdup_or_null(argv[2]);
+  entry->user = mg_mysql_strdup_or_null(argv[3]);
+  entry->password = mg_mysql_strdup_or_null(argv[4]);
+  entry->database = mg_mysql_strdup_or_null(argv[5]);
+  entry->port = IDL_ULongScalar(argv[6]);
+  entry->socket = mg_mysql_strdup_or_null(argv[7]);
+  entry->flags = IDL_ULong64Scalar(argv[8]);
+  entry->options = mg_mysql_take_options(mysql);
+  entry->last_used = time(NULL);
+
+  entry->next = mg_mysql_pool;
+  mg_mysql_pool = entry;
+}
+
+
+// return the pooled connection for a key, or 0 if there is none; if it has
+// been idle for at least max_idle seconds (default 30), it is pinged first and
+// reconnected if needed:
+//
+//   mysql = mg_mysql_pool_acquire(key [, max_idle])
+static IDL_VPTR IDL_mg_mysql_pool_acquire(int argc, IDL_VPTR *argv) {
+  MG_MYSQL_POOL_ENTRY *entry = mg_mysql_pool_find(IDL_VarGetString(argv[0]));
+  IDL_LONG max_idle = argc > 1 ? IDL_LongScalar(argv[1]) : MG_MYSQL_POOL_DEFAULT_MAX_IDLE;
+  time_t now = time(NULL);
+
+  if (entry == NULL) return IDL_GettmpMEMINT((IDL_MEMINT) 0);
+
+  if (now - entry->last_used >= max_idle) {
+    if (mysql_ping(entry->mysql) != 0) mg_mysql_pool_reconnect(entry);
+  }
+  entry->last_used = now;
+
+  return IDL_GettmpMEMINT((IDL_MEMINT) entry->mysql);
+}
+
+
+// force a new connection for a pooled key, returns 0 for success
+static IDL_VPTR IDL_mg_mysql_pool_reconnect(int argc, IDL_VPTR *argv) {
+  MG_MYSQL_POOL_ENTRY *entry = mg_mysql_pool_find(IDL_VarGetString(argv[0]));
+  if (entry == NULL) return IDL_GettmpLong(1);
+  return IDL_GettmpLong(mg_mysql_pool_reconnect(entry));
+}
+
+
+// close the pooled connection for a key and remove it from the pool
+static void IDL_mg_mysql_pool_remove(int argc, IDL_VPTR *argv) {
+  MG_MYSQL_POOL_ENTRY *entry = mg_mysql_pool_find(IDL_VarGetString(argv[0]));
+  if (entry) mg_mysql_pool_remove(entry);
+}
+
+
+// close all pooled connections
+static void IDL_mg_mysql_pool_clear(int argc, IDL_VPTR *argv) {
+  mg_mysql_pool_clear();
+}
+
+
+#pragma mark --- MySQL API ---
+
 // const char * STDCALL mysql_get_client_info(void);
 static IDL_VPTR IDL_mg_mysql_get_client_info(int argc, IDL_VPTR *argv) {
   const char *info = mysql_get_client_info();
@@ -84,28 +668,42 @@ static IDL_VPTR IDL_mg_mysql_info(int argc, IDL_VPTR *argv) {
 
 // MYSQL * STDCALL mysql_init(MYSQL *mysql);
 static IDL_VPTR IDL_mg_mysql_init(int argc, IDL_VPTR *argv) {
-  MYSQL *mysql = mysql_init(NULL);
+  MYSQL *mysql = mg_mysql_handle_new();
   return IDL_GettmpMEMINT((IDL_MEMINT) mysql);
 }
 
 
 // int mysql_options(MYSQL *mysql, enum mysql_option option, const char *arg)
 static IDL_VPTR IDL_mg_mysql_options(int argc, IDL_VPTR *argv) {
-  char *value;
+  MYSQL *mysql = (MYSQL *)argv[0]->value.ptrint;
+  MG_MYSQL_OPTION *opt;
+  int status;
+
+  opt = (MG_MYSQL_OPTION *) calloc(1, sizeof(MG_MYSQL_OPTION));
+  opt->option = IDL_ULongScalar(argv[1]);
+  opt->type = argv[2]->type;
   switch (argv[2]->type) {
     case IDL_TYP_BYTE:
-      value = (char *) &argv[2]->value.c;
+      opt->c = argv[2]->value.c;
       break;
     case IDL_TYP_ULONG:
-      value = (char *) &argv[2]->value.ul;
+      opt->ul = argv[2]->value.ul;
       break;
     case IDL_TYP_STRING:
-      value = IDL_VarGetString(argv[2]);
+      opt->s = strdup(IDL_VarGetString(argv[2]));
       break;
   }
-  int status = mysql_options((MYSQL *)argv[0]->value.ptrint,
-                             IDL_ULongScalar(argv[1]),
-                             value);
+
+  status = mysql_options(mysql, opt->option, mg_mysql_option_value(opt));
+
+  // remember the option in case the connection is pooled and needs to be
+  // made again
+  if (status == 0) {
+    mg_mysql_record_option(mysql, opt);
+  } else {
+    mg_mysql_free_options(opt);
+  }
+
   return IDL_GettmpLong(status);
 }
 
@@ -140,7 +738,19 @@ static IDL_VPTR IDL_mg_mysql_list_dbs(int argc, IDL_VPTR *argv) {
 
 // void STDCALL mysql_close(MYSQL *sock);
 static void IDL_mg_mysql_close(int argc, IDL_VPTR *argv) {
-  mysql_close((MYSQL *)argv[0]->value.ptrint);
+  MYSQL *mysql = (MYSQL *)argv[0]->value.ptrint;
+  MG_MYSQL_POOL_ENTRY *entry;
+
+  // closing a pooled connection removes it from the pool
+  for (entry = mg_mysql_pool; entry; entry = entry->next) {
+    if (entry->mysql == mysql) {
+      mg_mysql_pool_remove(entry);
+      return;
+    }
+  }
+
+  mg_mysql_free_options(mg_mysql_take_options(mysql));
+  mg_mysql_handle_close(mysql);
 }
 
 
@@ -172,8 +782,17 @@ static IDL_VPTR IDL_mg_mysql_select_db(int argc, IDL_VPTR *argv) {
 
 // int STDCALL mysql_query(MYSQL *mysql, const char *q);
 static IDL_VPTR IDL_mg_mysql_query(int argc, IDL_VPTR *argv) {
-  int status = mysql_query((MYSQL *) argv[0]->value.ptrint,
-                           IDL_VarGetString(argv[1]));
+  MYSQL *mysql = (MYSQL *) argv[0]->value.ptrint;
+  char *sql = IDL_VarGetString(argv[1]);
+  double start;
+  int status;
+
+  if (!mg_mysql_stats_enabled) return IDL_GettmpLong(mysql_query(mysql, sql));
+
+  start = mg_mysql_stats_now();
+  status = mysql_query(mysql, sql);
+  mg_mysql_stats_record_query(mysql, sql, strlen(sql),
+                              mg_mysql_stats_now() - start, status);
   return IDL_GettmpLong(status);
 }
 
@@ -194,7 +813,17 @@ static IDL_VPTR IDL_mg_mysql_errno(int argc, IDL_VPTR *argv) {
 
 // MYSQL_RES * STDCALL mysql_store_result(MYSQL *mysql);
 static IDL_VPTR IDL_mg_mysql_store_result(int argc, IDL_VPTR *argv) {
-  MYSQL_RES *result = mysql_store_result((MYSQL *)argv[0]->value.ptrint);
+  MYSQL *mysql = (MYSQL *)argv[0]->value.ptrint;
+  MYSQL_RES *result;
+  double start;
+
+  if (!mg_mysql_stats_enabled) {
+    return IDL_GettmpMEMINT((IDL_MEMINT) mysql_store_result(mysql));
+  }
+
+  start = mg_mysql_stats_now();
+  result = mysql_store_result(mysql);
+  mg_mysql_stats_record_store(mysql, result, mg_mysql_stats_now() - start);
   return IDL_GettmpMEMINT((IDL_MEMINT) result);
 }
 
@@ -377,9 +1006,20 @@ static IDL_VPTR IDL_mg_mysql_real_escape_string(int argc, IDL_VPTR *argv) {
 // int STDCALL mysql_real_query(MYSQL *mysql, const char *q,
 //                              unsigned long length);
 static IDL_VPTR IDL_mg_mysql_real_query(int argc, IDL_VPTR *argv) {
-  int status = mysql_real_query((MYSQL *)argv[0]->value.ptrint,
-                                IDL_VarGetString(argv[1]),
-                                IDL_ULong64Scalar(argv[2]));
+  MYSQL *mysql = (MYSQL *)argv[0]->value.ptrint;
+  char *sql = IDL_VarGetString(argv[1]);
+  unsigned long length = IDL_ULong64Scalar(argv[2]);
+  double start;
+  int status;
+
+  if (!mg_mysql_stats_enabled) {
+    return IDL_GettmpLong(mysql_real_query(mysql, sql, length));
+  }
+
+  start = mg_mysql_stats_now();
+  status = mysql_real_query(mysql, sql, length);
+  mg_mysql_stats_record_query(mysql, sql, length,
+                              mg_mysql_stats_now() - start, status);
   return IDL_GettmpLong(status);
 }
 
@@ -422,10 +1062,410 @@ static IDL_VPTR IDL_mg_mysql_fetch_lengths(int argc, IDL_VPTR *argv) {
 }
 
 
+#pragma mark --- asynchronous writes ---
+
+// Asynchronous write queues: statements are queued from IDL and executed in
+// order by a background thread on its own connection, so that IDL does not
+// wait on the round trip to the server. Each queued statement is given a
+// ticket which can be polled or waited on.
+//
+// Failures are kept twice: in a capped list, with their messages and SQL, for
+// MG_MYSQL_ASYNC_FAILURES to report, and as just their ticket and status until
+// the ticket is waited on, so that MG_MYSQL_ASYNC_WAIT never reports a failed
+// statement as a success, however many failed or were already reported.
+
+#define MG_MYSQL_ASYNC_MAX_FAILURES 1000
+
+// MySQL client error code returned by waits whose status could not be kept
+#define MG_MYSQL_ASYNC_CR_OUT_OF_MEMORY 2008
+
+typedef struct mg_mysql_async_job {
+  IDL_ULONG64 ticket;
+  char *sql;
+  unsigned long length;
+  struct mg_mysql_async_job *next;
+} MG_MYSQL_ASYNC_JOB;
+
+typedef struct mg_mysql_async_failure {
+  IDL_ULONG64 ticket;
+  IDL_ULONG status;
+  char *message;
+  char *sql;
+  struct mg_mysql_async_failure *next;
+} MG_MYSQL_ASYNC_FAILURE;
+
+typedef struct {
+  IDL_ULONG64 ticket;
+  IDL_ULONG status;
+} MG_MYSQL_ASYNC_STATUS;
+
+typedef struct mg_mysql_async_queue {
+  MYSQL *mysql;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t job_available;
+  pthread_cond_t job_done;
+  MG_MYSQL_ASYNC_JOB *head;
+  MG_MYSQL_ASYNC_JOB *tail;
+  IDL_ULONG64 last_ticket;
+  IDL_ULONG64 completed_ticket;
+  MG_MYSQL_ASYNC_FAILURE *failures;
+  MG_MYSQL_ASYNC_FAILURE *failures_tail;
+  IDL_ULONG n_failures;
+  MG_MYSQL_ASYNC_STATUS *failed;    // failed tickets not waited on, in order
+  IDL_MEMINT n_failed;
+  IDL_MEMINT failed_capacity;
+  int failed_lost;                  // a failed ticket could not be kept
+  int running;
+  struct mg_mysql_async_queue *next;
+} MG_MYSQL_ASYNC_QUEUE;
+
+static IDL_STRUCT_TAG_DEF mg_mysql_async_failure[] = {
+  { "TICKET",  0, (void *) IDL_TYP_ULONG64, 0 },
+  { "STATUS",  0, (void *) IDL_TYP_ULONG,   0 },
+  { "MESSAGE", 0, (void *) IDL_TYP_STRING,  0 },
+  { "SQL",     0, (void *) IDL_TYP_STRING,  0 },
+  { 0 }
+};
+
+typedef struct {
+  IDL_ULONG64 ticket;
+  IDL_ULONG status;
+  IDL_STRING message;
+  IDL_STRING sql;
+} MG_MYSQL_ASYNC_FAILURE_STRUCT;
+
+static IDL_StructDefPtr mg_mysql_async_failure_sdef;
+
+// all running queues, so that the exit handler can flush them
+static MG_MYSQL_ASYNC_QUEUE *mg_mysql_async_queues = NULL;
+static pthread_mutex_t mg_mysql_async_queues_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void mg_mysql_async_record_failure(MG_MYSQL_ASYNC_QUEUE *queue,
+                                          MG_MYSQL_ASYNC_JOB *job) {
+  MG_MYSQL_ASYNC_FAILURE *failure;
+  MG_MYSQL_ASYNC_STATUS *failed;
+
+  // the status is kept until waited on, jobs finish in ticket order
+  if (queue->n_failed == queue->failed_capacity) {
+    IDL_MEMINT capacity = queue->failed_capacity == 0 ? 64 : 2 * queue->failed_capacity;
+    failed = (MG_MYSQL_ASYNC_STATUS *) realloc(queue->failed,
+                                               capacity * sizeof(MG_MYSQL_ASYNC_STATUS));
+    if (failed) {
+      queue->failed = failed;
+      queue->failed_capacity = capacity;
+    }
+  }
+  if (queue->n_failed < queue->failed_capacity) {
+    queue->failed[queue->n_failed].ticket = job->ticket;
+    queue->failed[queue->n_failed].status = mysql_errno(queue->mysql);
+    queue->n_failed++;
+  } else {
+    queue->failed_lost = 1;
+  }
+
+  // drop failure reports nobody is collecting rather than growing without bound
+  if (queue->n_failures >= MG_MYSQL_ASYNC_MAX_FAILURES) return;
+
+  failure = (MG_MYSQL_ASYNC_FAILURE *) calloc(1, sizeof(MG_MYSQL_ASYNC_FAILURE));
+  failure->ticket = job->ticket;
+  failure->status = mysql_errno(queue->mysql);
+  failure->message = strdup(mysql_error(queue->mysql));
+  failure->sql = job->sql;
+  job->sql = NULL;
+
+  if (queue->failures_tail) {
+    queue->failures_tail->next = failure;
+  } else {
+    queue->failures = failure;
+  }
+  queue->failures_tail = failure;
+  queue->n_failures++;
+}
+
+
+static void *mg_mysql_async_worker(void *arg) {
+  MG_MYSQL_ASYNC_QUEUE *queue = (MG_MYSQL_ASYNC_QUEUE *) arg;
+  MG_MYSQL_ASYNC_JOB *job;
+  MYSQL_RES *result;
+  double start;
+  int status;
+
+  mysql_thread_init();
+
+  while (1) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->head == NULL && queue->running) {
+      pthread_cond_wait(&queue->job_available, &queue->lock);
+    }
+    if (queue->head == NULL) {
+      pthread_mutex_unlock(&queue->lock);
+      break;
+    }
+    job = queue->head;
+    queue->head = job->next;
+    if (queue->head == NULL) queue->tail = NULL;
+    pthread_mutex_unlock(&queue->lock);
+
+    if (mg_mysql_stats_enabled) {
+      start = mg_mysql_stats_now();
+      status = mysql_real_query(queue->mysql, job->sql, job->length);
+      mg_mysql_stats_record(queue->mysql, job->sql, job->length,
+                            mg_mysql_stats_now() - start, status);
+    } else {
+      status = mysql_real_query(queue->mysql, job->sql, job->length);
+    }
+
+    // discard any result sets so the connection is ready for the next job
+    if (status == 0) {
+      do {
+        result = mysql_store_result(queue->mysql);
+        if (result) mysql_free_result(result);
+      } while (mysql_next_result(queue->mysql) == 0);
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    if (status != 0) mg_mysql_async_record_failure(queue, job);
+    queue->completed_ticket = job->ticket;
+    pthread_cond_broadcast(&queue->job_done);
+    pthread_mutex_unlock(&queue->lock);
+
+    free(job->sql);
+    free(job);
+  }
+
+  mysql_thread_end();
+  return NULL;
+}
+
+
+static void mg_mysql_async_flush(MG_MYSQL_ASYNC_QUEUE *queue) {
+  pthread_mutex_lock(&queue->lock);
+  while (queue->completed_ticket < queue->last_ticket) {
+    pthread_cond_wait(&queue->job_done, &queue->lock);
+  }
+  pthread_mutex_unlock(&queue->lock);
+}
+
+
+// finish all queued statements, stop the worker thread, and close the queue's
+// connection
+static void mg_mysql_async_stop(MG_MYSQL_ASYNC_QUEUE *queue) {
+  MG_MYSQL_ASYNC_QUEUE **q;
+  MG_MYSQL_ASYNC_FAILURE *failure, *next;
+
+  pthread_mutex_lock(&mg_mysql_async_queues_lock);
+  for (q = &mg_mysql_async_queues; *q; q = &(*q)->next) {
+    if (*q == queue) {
+      *q = queue->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&mg_mysql_async_queues_lock);
+
+  pthread_mutex_lock(&queue->lock);
+  queue->running = 0;
+  pthread_cond_signal(&queue->job_available);
+  pthread_mutex_unlock(&queue->lock);
+
+  pthread_join(queue->thread, NULL);
+
+  mg_mysql_handle_close(queue->mysql);
+
+  free(queue->failed);
+  for (failure = queue->failures; failure; failure = next) {
+    next = failure->next;
+    free(failure->message);
+    free(failure->sql);
+    free(failure);
+  }
+
+  pthread_cond_destroy(&queue->job_available);
+  pthread_cond_destroy(&queue->job_done);
+  pthread_mutex_destroy(&queue->lock);
+  free(queue);
+}
+
+
+// start a background writer thread, which takes ownership of the given
+// connection; the connection must not be used from IDL afterwards
+static IDL_VPTR IDL_mg_mysql_async_start(int argc, IDL_VPTR *argv) {
+  MG_MYSQL_ASYNC_QUEUE *queue;
+
+  queue = (MG_MYSQL_ASYNC_QUEUE *) calloc(1, sizeof(MG_MYSQL_ASYNC_QUEUE));
+  queue->mysql = (MYSQL *) argv[0]->value.ptrint;
+  queue->running = 1;
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->job_available, NULL);
+  pthread_cond_init(&queue->job_done, NULL);
+
+  if (pthread_create(&queue->thread, NULL, mg_mysql_async_worker, queue) != 0) {
+    pthread_cond_destroy(&queue->job_available);
+    pthread_cond_destroy(&queue->job_done);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue);
+    return IDL_GettmpMEMINT((IDL_MEMINT) 0);
+  }
+
+  pthread_mutex_lock(&mg_mysql_async_queues_lock);
+  queue->next = mg_mysql_async_queues;
+  mg_mysql_async_queues = queue;
+  pthread_mutex_unlock(&mg_mysql_async_queues_lock);
+
+  return IDL_GettmpMEMINT((IDL_MEMINT) queue);
+}
+
+
+// queue a statement, returning its ticket
+static IDL_VPTR IDL_mg_mysql_async_query(int argc, IDL_VPTR *argv) {
+  MG_MYSQL_ASYNC_QUEUE *queue = (MG_MYSQL_ASYNC_QUEUE *) argv[0]->value.ptrint;
+  MG_MYSQL_ASYNC_JOB *job;
+  char *sql = IDL_VarGetString(argv[1]);
+
+  job = (MG_MYSQL_ASYNC_JOB *) calloc(1, sizeof(MG_MYSQL_ASYNC_JOB));
+  job->sql = strdup(sql);
+  job->length = strlen(sql);
+
+  pthread_mutex_lock(&queue->lock);
+  job->ticket = ++queue->last_ticket;
+  if (queue->tail) {
+    queue->tail->next = job;
+  } else {
+    queue->head = job;
+  }
+  queue->tail = job;
+  pthread_cond_signal(&queue->job_available);
+  pthread_mutex_unlock(&queue->lock);
+
+  return IDL_GettmpULong64(job->ticket);
+}
+
+
+// returns 1 if the statement with the given ticket has been executed
+static IDL_VPTR IDL_mg_mysql_async_poll(int argc, IDL_VPTR *argv) {
+  MG_MYSQL_ASYNC_QUEUE *queue = (MG_MYSQL_ASYNC_QUEUE *) argv[0]->value.ptrint;
+  IDL_ULONG64 ticket = IDL_ULong64Scalar(argv[1]);
+  int done;
+
+  pthread_mutex_lock(&queue->lock);
+  done = queue->completed_ticket >= ticket;
+  pthread_mutex_unlock(&queue->lock);
+
+  return IDL_GettmpLong(done);
+}
+
+
+// wait for the statement with the given ticket to execute, returning its MySQL
+// error code, 0 for success
+static IDL_VPTR IDL_mg_mysql_async_wait(int argc, IDL_VPTR *argv) {
+  MG_MYSQL_ASYNC_QUEUE *queue = (MG_MYSQL_ASYNC_QUEUE *) argv[0]->value.ptrint;
+  IDL_ULONG64 ticket = IDL_ULong64Scalar(argv[1]);
+  IDL_MEMINT lo = 0, hi, mid;
+  IDL_ULONG status = 0;
+
+  pthread_mutex_lock(&queue->lock);
+  while (queue->completed_ticket < ticket) {
+    pthread_cond_wait(&queue->job_done, &queue->lock);
+  }
+
+  // binary search of the failed tickets, removing the ticket if found
+  hi = queue->n_failed;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (queue->failed[mid].ticket < ticket) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < queue->n_failed && queue->failed[lo].ticket == ticket) {
+    status = queue->failed[lo].status;
+    memmove(&queue->failed[lo], &queue->failed[lo + 1],
+            (queue->n_failed - lo - 1) * sizeof(MG_MYSQL_ASYNC_STATUS));
+    queue->n_failed--;
+  } else if (queue->failed_lost) {
+    // the ticket may have failed without its status being kept
+    status = MG_MYSQL_ASYNC_CR_OUT_OF_MEMORY;
+  }
+  pthread_mutex_unlock(&queue->lock);
+
+  return IDL_GettmpULong(status);
+}
+
+
+// number of statements queued, but not yet executed
+static IDL_VPTR IDL_mg_mysql_async_pending(int argc, IDL_VPTR *argv) {
+  MG_MYSQL_ASYNC_QUEUE *queue = (MG_MYSQL_ASYNC_QUEUE *) argv[0]->value.ptrint;
+  IDL_ULONG64 n_pending;
+
+  pthread_mutex_lock(&queue->lock);
+  n_pending = queue->last_ticket - queue->completed_ticket;
+  pthread_mutex_unlock(&queue->lock);
+
+  return IDL_GettmpULong64(n_pending);
+}
+
+
+// retrieve and clear the statements that have failed, returns an array of
+// MG_MYSQL_ASYNC_FAILURE structures or 0L if there were no failures
+static IDL_VPTR IDL_mg_mysql_async_failures(int argc, IDL_VPTR *argv) {
+  MG_MYSQL_ASYNC_QUEUE *queue = (MG_MYSQL_ASYNC_QUEUE *) argv[0]->value.ptrint;
+  MG_MYSQL_ASYNC_FAILURE *failures, *failure, *next;
+  MG_MYSQL_ASYNC_FAILURE_STRUCT *data;
+  IDL_MEMINT n_failures, f;
+  IDL_VPTR result;
+
+  pthread_mutex_lock(&queue->lock);
+  failures = queue->failures;
+  n_failures = queue->n_failures;
+  queue->failures = queue->failures_tail = NULL;
+  queue->n_failures = 0;
+  pthread_mutex_unlock(&queue->lock);
+
+  if (n_failures == 0) return IDL_GettmpLong(0);
+
+  data = (MG_MYSQL_ASYNC_FAILURE_STRUCT *) IDL_MakeTempStruct(mg_mysql_async_failure_sdef,
+                                                              1, &n_failures,
+                                                              &result, TRUE);
+  for (f = 0, failure = failures; failure; f++, failure = next) {
+    next = failure->next;
+    data[f].ticket = failure->ticket;
+    data[f].status = failure->status;
+    IDL_StrStore(&data[f].message, failure->message);
+    IDL_StrStore(&data[f].sql, failure->sql);
+    free(failure->message);
+    free(failure->sql);
+    free(failure);
+  }
+
+  return result;
+}
+
+
+// block until all queued statements have been executed
+static void IDL_mg_mysql_async_flush(int argc, IDL_VPTR *argv) {
+  mg_mysql_async_flush((MG_MYSQL_ASYNC_QUEUE *) argv[0]->value.ptrint);
+}
+
+
+// execute any remaining statements, then stop the queue and close its
+// connection
+static void IDL_mg_mysql_async_stop(int argc, IDL_VPTR *argv) {
+  mg_mysql_async_stop((MG_MYSQL_ASYNC_QUEUE *) argv[0]->value.ptrint);
+}
+
+
 #pragma mark --- lifecycle ---
 
 // handle any cleanup required
 static void mg_mysql_exit_handler(void) {
+  // make sure queued writes are not lost when IDL exits
+  while (mg_mysql_async_queues) {
+    mg_mysql_async_stop(mg_mysql_async_queues);
+  }
+  mg_mysql_pool_clear();
+  mg_mysql_stats_reset();
   mysql_library_end();
 }
 
@@ -469,14 +1509,34 @@ int IDL_Load(void) {
     { IDL_mg_mysql_real_query,         "MG_MYSQL_REAL_QUERY",         3, 3, 0, 0 },
     { IDL_mg_mysql_affected_rows,      "MG_MYSQL_AFFECTED_ROWS",      1, 1, 0, 0 },
     { IDL_mg_mysql_warning_count,      "MG_MYSQL_WARNING_COUNT",      1, 1, 0, 0 },
+    { IDL_mg_mysql_async_start,        "MG_MYSQL_ASYNC_START",        1, 1, 0, 0 },
+    { IDL_mg_mysql_async_query,        "MG_MYSQL_ASYNC_QUERY",        2, 2, 0, 0 },
+    { IDL_mg_mysql_async_poll,         "MG_MYSQL_ASYNC_POLL",         2, 2, 0, 0 },
+    { IDL_mg_mysql_async_wait,         "MG_MYSQL_ASYNC_WAIT",         2, 2, 0, 0 },
+    { IDL_mg_mysql_async_pending,      "MG_MYSQL_ASYNC_PENDING",      1, 1, 0, 0 },
+    { IDL_mg_mysql_async_failures,     "MG_MYSQL_ASYNC_FAILURES",     1, 1, 0, 0 },
+    { IDL_mg_mysql_stats,              "MG_MYSQL_STATS",              0, 0, 0, 0 },
+    { IDL_mg_mysql_ping,               "MG_MYSQL_PING",               1, 1, 0, 0 },
+    { IDL_mg_mysql_pool_acquire,       "MG_MYSQL_POOL_ACQUIRE",       1, 2, 0, 0 },
+    { IDL_mg_mysql_pool_reconnect,     "MG_MYSQL_POOL_RECONNECT",     1, 1, 0, 0 },
   };
 
   static IDL_SYSFUN_DEF2 procedure_addr[] = {
     { (IDL_SYSRTN_GENERIC) IDL_mg_mysql_close,       "MG_MYSQL_CLOSE",        1, 1, 0, 0 },
     { (IDL_SYSRTN_GENERIC) IDL_mg_mysql_free_result, "MG_MYSQL_FREE_RESULT",  1, 1, 0, 0 },
+    { (IDL_SYSRTN_GENERIC) IDL_mg_mysql_async_flush, "MG_MYSQL_ASYNC_FLUSH",  1, 1, 0, 0 },
+    { (IDL_SYSRTN_GENERIC) IDL_mg_mysql_async_stop,  "MG_MYSQL_ASYNC_STOP",   1, 1, 0, 0 },
+    { (IDL_SYSRTN_GENERIC) IDL_mg_mysql_stats_enable, "MG_MYSQL_STATS_ENABLE", 1, 1, 0, 0 },
+    { (IDL_SYSRTN_GENERIC) IDL_mg_mysql_stats_reset,  "MG_MYSQL_STATS_RESET",  0, 0, 0, 0 },
+    { (IDL_SYSRTN_GENERIC) IDL_mg_mysql_pool_add,     "MG_MYSQL_POOL_ADD",     9, 9, 0, 0 },
+    { (IDL_SYSRTN_GENERIC) IDL_mg_mysql_pool_remove,  "MG_MYSQL_POOL_REMOVE",  1, 1, 0, 0 },
+    { (IDL_SYSRTN_GENERIC) IDL_mg_mysql_pool_clear,   "MG_MYSQL_POOL_CLEAR",   0, 0, 0, 0 },
   };
 
   mg_mysql_field_sdef = IDL_MakeStruct("MG_MYSQL_FIELD", mg_mysql_field);
+  mg_mysql_async_failure_sdef = IDL_MakeStruct("MG_MYSQL_ASYNC_FAILURE",
+                                               mg_mysql_async_failure);
+  mg_mysql_stats_sdef = IDL_MakeStruct("MG_MYSQL_STATS", mg_mysql_stats);
 
   if (mysql_library_init(0, NULL, NULL)) {
     // initialization failed
@@ -378,6 +378,54 @@ function mgdbmysql::last_error_message
 end
 
 
+;+
+; Send a statement to the server. A pooled connection is checked before use
+; and reconnected if the server has dropped it. If the server goes away while
+; a read-only statement is sent, it is reconnected and the statement sent
+; again; other statements may have been executed already, so they are not
+; retried, but their connection is always pinged first.
+;
+; :Private:
+;
+; :Returns:
+;   status of `MG_MYSQL_QUERY`, 0 for success
+;
+; :Params:
+;   sql_query : in, required, type=string
+;     complete SQL statement
+;-
+function mgdbmysql::_query, sql_query
+  compile_opt strictarr
+
+  if (self.pool_key eq '') then return, mg_mysql_query(self.connection, sql_query)
+
+  read_only = stregex(sql_query, '^[[:space:]]*(select|show|describe|desc|explain)[[:space:]]', $
+                       /boolean, /fold_case)
+
+  ; check the connection of a statement that can't be retried before sending
+  ; it, however recently it was used
+  if (read_only) then begin
+    self.connection = mg_mysql_pool_acquire(self.pool_key)
+  endif else begin
+    self.connection = mg_mysql_pool_acquire(self.pool_key, 0L)
+  endelse
+  status = mg_mysql_query(self.connection, sql_query)
+
+  ; 2006 is "MySQL server has gone away", but the statement may have reached
+  ; the server before the connection was lost
+  if (status ne 0 && read_only && mg_mysql_errno(self.connection) eq 2006) then begin
+    if (mg_mysql_pool_reconnect(self.pool_key) eq 0) then begin
+      self.connection = mg_mysql_pool_acquire(self.pool_key)
+      status = mg_mysql_query(self.connection, sql_query)
+    endif else begin
+      self.connection = mg_mysql_pool_acquire(self.pool_key)
+    endelse
+  endif
+
+  return, status
+end
+
+
 ;+
 ; Perform a query and retrieve the results.
 ;
@@ -452,7 +500,7 @@ function mgdbmysql::query, sql_query, $
   endcase
 
   self->report_statement, _sql_query
-  status = mg_mysql_query(self.connection, _sql_query)
+  status = self->_query(_sql_query)
   if (status ne 0) then begin
     error_message = self->last_error_message()
     if (self.quiet || arg_present(status) || arg_present(error_message)) then begin
@@ -531,6 +579,23 @@ end
 ;   n_warnings : out, optional, type=ulong
 ;     set to a named variable to retrieve the number of warnings generated
 ;     during the query
+;   async : in, optional, type=boolean
+;     set to queue the statement on the asynchronous write connection (see the
+;     `ASYNC` keyword to `::connect`) instead of waiting for it to execute;
+;     `STATUS` only reflects queuing the statement, use `::wait` or `::flush`
+;     to find out if it succeeded; ignored if there is no asynchronous
+;     connection
+;   ticket : out, optional, type=ulong64
+;     set to a named variable to retrieve the ticket of an asynchronous
+;     statement to pass to `::wait`, 0 if the statement was executed
+;     synchronously
+;   local_infile : in, optional, type=boolean
+;     set to execute the statement on a separate connection that allows
+;     `LOAD DATA LOCAL INFILE`, opened the first time it is needed, so that
+;     the main connection does not allow the server to read local files
+;   errno : out, optional, type=ulong
+;     set to a named variable to retrieve the MySQL error number, 0 for
+;     success
 ;-
 pro mgdbmysql::execute, sql_query, $
                         arg1, arg2, arg3, arg4, arg5, $
@@ -551,12 +616,18 @@ pro mgdbmysql::execute, sql_query, $
                         status=status, $
                         error_message=error_message, $
                         n_affected_rows=n_affected_rows, $
-                        n_warnings=n_warnings
+                        n_warnings=n_warnings, $
+                        async=async, $
+                        ticket=ticket, $
+                        local_infile=local_infile, $
+                        errno=errno
   compile_opt strictarr
   on_error, 2
   on_ioerror, bad_fmt
 
   n_warnings = 0UL
+  ticket = 0ULL
+  errno = 0UL
   sql_query_fmt = '(%"' + sql_query + '")'
   case n_params() of
      0: _sql_query = ''
@@ -1005,10 +1076,45 @@ pro mgdbmysql::execute, sql_query, $
   endcase
 
   self->report_statement, _sql_query
-  status = mg_mysql_query(self.connection, _sql_query)
+
+  if (keyword_set(async) && self.async_queue ne 0ULL) then begin
+    ticket = mg_mysql_async_query(self.async_queue, _sql_query)
+    status = 0L
+    error_message = 'Success'
+    n_affected_rows = 0ULL
+    return
+  endif
+
+  ; run the statement, and report on it, on the LOAD DATA LOCAL INFILE
+  ; connection in place of the main connection
+  if (keyword_set(local_infile)) then begin
+    if (self.local_infile_connection eq 0ULL) then begin
+      self.local_infile_connection = self->_open_connection(/local_infile, $
+                                                            errno=errno, $
+                                                            error_message=error_message)
+      if (self.local_infile_connection eq 0ULL) then begin
+        status = 1L
+        self->report_error, sql_statement=_sql_query, $
+                            status=status, $
+                            error_message=error_message
+        return
+      endif
+    endif
+    main_connection = self.connection
+    main_pool_key = self.pool_key
+    self.connection = self.local_infile_connection
+    self.pool_key = ''
+  endif
+
+  status = self->_query(_sql_query)
   if (status ne 0) then begin
+    errno = mg_mysql_errno(self.connection)
     error_message = self->last_error_message()
     if (~self.quiet && ~arg_present(status) && ~arg_present(error_message)) then begin
+      if (keyword_set(local_infile)) then begin
+        self.connection = main_connection
+        self.pool_key = main_pool_key
+      endif
       message, error_message
     endif
   endif else begin
@@ -1025,6 +1131,11 @@ pro mgdbmysql::execute, sql_query, $
                       error_message=error_message
   self->report_warnings, sql_statement=_sql_query, n_warnings=n_warnings
 
+  if (keyword_set(local_infile)) then begin
+    self.connection = main_connection
+    self.pool_key = main_pool_key
+  endif
+
   return
 
   bad_fmt:
@@ -1036,6 +1147,97 @@ pro mgdbmysql::execute, sql_query, $
 end
 
 
+;+
+; Wait for an asynchronous statement to execute.
+;
+; :Returns:
+;   MySQL error code of the statement, 0 for success
+;
+; :Params:
+;   ticket : in, required, type=ulong64
+;     ticket returned by `::execute` for an asynchronous statement
+;-
+function mgdbmysql::wait, ticket
+  compile_opt strictarr
+
+  if (self.async_queue eq 0ULL || ticket eq 0ULL) then return, 0UL
+  return, mg_mysql_async_wait(self.async_queue, ticket)
+end
+
+
+;+
+; Wait for all queued asynchronous statements to execute, reporting any that
+; failed through `::report_error`.
+;
+; :Keywords:
+;   n_errors : out, optional, type=long
+;     set to a named variable to retrieve the number of asynchronous
+;     statements that failed since the last flush
+;-
+pro mgdbmysql::flush, n_errors=n_errors
+  compile_opt strictarr
+
+  n_errors = 0L
+  if (self.async_queue eq 0ULL) then return
+
+  mg_mysql_async_flush, self.async_queue
+  failures = mg_mysql_async_failures(self.async_queue)
+  if (size(failures, /type) ne 8) then return
+
+  n_errors = n_elements(failures)
+  for f = 0L, n_errors - 1L do begin
+    self->report_error, sql_statement=failures[f].sql, $
+                        status=long(failures[f].status), $
+                        error_message=failures[f].message
+  endfor
+end
+
+
+;+
+; Open another connection to the server of the main connection, with the
+; same credentials and compression.
+;
+; :Private:
+;
+; :Returns:
+;   connection pointer, 0 if the connection failed
+;
+; :Keywords:
+;   local_infile : in, optional, type=boolean
+;     set to allow `LOAD DATA LOCAL INFILE` on the connection
+;   errno : out, optional, type=ulong
+;     set to a named variable to retrieve the MySQL error number, 0 for
+;     success
+;   error_message : out, optional, type=string
+;     set to a named variable to retrieve the MySQL error message
+;-
+function mgdbmysql::_open_connection, local_infile=local_infile, $
+                                      errno=errno, $
+                                      error_message=error_message
+  compile_opt strictarr
+
+  errno = 0UL
+  error_message = 'Success'
+
+  connection = mg_mysql_init()
+  if (self.compress) then status = mg_mysql_options(connection, 1UL, 0UL)
+  if (keyword_set(local_infile)) then status = mg_mysql_options(connection, 8UL, 1UL)
+
+  tmp = mg_mysql_real_connect(connection, $
+                              self.host, self.user, self.password, $
+                              self.database, $
+                              self.port, self.socket, self.client_flags)
+  if (tmp eq 0UL) then begin
+    errno = mg_mysql_errno(connection)
+    error_message = mg_mysql_error(connection)
+    mg_mysql_close, connection
+    return, 0ULL
+  endif
+
+  return, connection
+end
+
+
 ;+
 ; Return a list of tables available.
 ;
@@ -1152,6 +1354,18 @@ end
 ;     for `host`, `database`, `port`, and `socket`
 ;   multi_statements : in, optional, type=boolean
 ;     set to allow multiple statements separated by ";"
+;   async : in, optional, type=boolean
+;     set to open a second connection with a background thread that executes
+;     statements passed to `::execute` with `/ASYNC` in order, without
+;     blocking; if the second connection fails, statements are executed
+;     synchronously
+;   pool : in, optional, type=boolean
+;     set to reuse a connection kept open by the DLM for the same config file
+;     section (or host, user, port, and database if not using a config file),
+;     making a new one and adding it to the pool if there is none; pooled
+;     connections are not closed when the object is destroyed, are checked
+;     with a ping before use if they have been idle, and are reconnected if
+;     the server has dropped them
 ;   status : out, optional, type=integer
 ;     set to a named variable to retrieve the status of the connection, 0 for
 ;     success; if not 0, `ERROR_MESSAGE` should be set to a non-empty message
@@ -1167,6 +1381,8 @@ pro mgdbmysql::connect, host=host, $
                         config_filename=config_filename, $
                         config_section=config_section, $
                         multi_statements=multi_statements, $
+                        async=async, $
+                        pool=pool, $
                         status=status, $
                         error_message=error_message
   compile_opt strictarr
@@ -1175,6 +1391,7 @@ pro mgdbmysql::connect, host=host, $
   status = 0L
   error_message = 'Success'
   self.connected = 0B
+  self.pool_key = ''
 
   if (n_elements(config_filename) gt 0) then begin
     c = mg_read_config(config_filename)
@@ -1239,23 +1456,67 @@ pro mgdbmysql::connect, host=host, $
   flags = 0ULL
   if (keyword_set(multi_statements)) then flags or= ishft(1ULL, 16)
 
-  tmp = mg_mysql_real_connect(self.connection, $
-                              self.host, _user, _password, $
-                              self.database, $
-                              _port, _socket, flags)
-  if (tmp eq 0UL) then begin
-    error_message = self->last_error_message()
+  pooled_connection = 0ULL
+  if (keyword_set(pool)) then begin
+    pool_key = n_elements(config_filename) gt 0L $
+                 ? string(config_filename, $
+                          n_elements(config_section) eq 0L ? '' : config_section, $
+                          format='(%"%s[%s]")') $
+                 : string(_user, self.host, _port, self.database, $
+                          format='(%"%s@%s:%d/%s")')
+    pooled_connection = mg_mysql_pool_acquire(pool_key)
+  endif
+
+  if (pooled_connection ne 0ULL) then begin
+    ; the connection made by ::init is not needed
     mg_mysql_close, self.connection
-    self.connection = 0UL
-    status = 1L
-    if (self.quiet || arg_present(status) || arg_present(error_message)) then begin
-      return
+    self.connection = pooled_connection
+  endif else begin
+    tmp = mg_mysql_real_connect(self.connection, $
+                                self.host, _user, _password, $
+                                self.database, $
+                                _port, _socket, flags)
+    if (tmp eq 0UL) then begin
+      error_message = self->last_error_message()
+      mg_mysql_close, self.connection
+      self.connection = 0UL
+      status = 1L
+      if (self.quiet || arg_present(status) || arg_present(error_message)) then begin
+        return
+      endif else begin
+        message, error_message
+      endelse
+    endif
+
+    if (keyword_set(pool)) then begin
+      mg_mysql_pool_add, pool_key, self.connection, $
+                         self.host, _user, _password, self.database, $
+                         _port, _socket, flags
+    endif
+  endelse
+
+  if (keyword_set(pool)) then self.pool_key = pool_key
+  self.connected = 1B
+
+  ; kept to open further connections, e.g., for asynchronous writes or LOAD
+  ; DATA LOCAL INFILE
+  self.user = _user
+  self.password = _password
+  self.port = _port
+  self.socket = _socket
+  self.client_flags = flags
+
+  if (keyword_set(async) && self.async_queue eq 0ULL) then begin
+    async_connection = self->_open_connection(error_message=async_error_message)
+    if (async_connection eq 0ULL) then begin
+      self->report_error, sql_statement='<asynchronous connection>', $
+                          status=1L, $
+                          error_message=async_error_message
     endif else begin
-      message, error_message
+      self.async_queue = mg_mysql_async_start(async_connection)
+      if (self.async_queue eq 0ULL) then mg_mysql_close, async_connection
     endelse
   endif
-
-  self.connected = 1B
 end
 
 
@@ -1314,11 +1575,24 @@ end
 pro mgdbmysql::setProperty, quiet=quiet, $
                             mysql_secure_auth=mysql_secure_auth, $
                             mysql_opt_protocol=mysql_opt_protocol, $
+                            mysql_opt_local_infile=mysql_opt_local_infile, $
+                            mysql_opt_compress=mysql_opt_compress, $
                             database=database
   compile_opt strictarr
 
   if (n_elements(quiet)) then self.quiet = quiet
 
+  ; must be set before connecting to compress traffic with the server
+  if (keyword_set(mysql_opt_compress)) then begin
+    status = mg_mysql_options(self.connection, 1UL, 0UL)
+    self.compress = 1B
+  endif
+
+  ; must be set before connecting to allow LOAD DATA LOCAL INFILE
+  if (n_elements(mysql_opt_local_infile) gt 0) then begin
+    status = mg_mysql_options(self.connection, 8UL, ulong(mysql_opt_local_infile[0]))
+  endif
+
   if (n_elements(mysql_opt_protocol) gt 0) then begin
     status = mg_mysql_options(self.connection, 9UL, ulong(mysql_opt_protocol[0]))
   endif
@@ -1348,7 +1622,9 @@ pro mgdbmysql::getProperty, quiet=quiet, $
                             last_command_info=last_command_info, $
                             database=database, $
                             host_name=host_name, $
-                            connection=connection
+                            connection=connection, $
+                            async=async, $
+                            n_pending_writes=n_pending_writes
   compile_opt strictarr
 
   quiet = self.quiet
@@ -1363,6 +1639,10 @@ pro mgdbmysql::getProperty, quiet=quiet, $
   database = self.database
   host_name = self.host
   connection = self.connection
+  async = self.async_queue ne 0ULL
+  if (arg_present(n_pending_writes)) then begin
+    n_pending_writes = async ? mg_mysql_async_pending(self.async_queue) : 0ULL
+  endif
 end
 
 
@@ -1374,6 +1654,23 @@ end
 pro mgdbmysql::cleanup
   compile_opt strictarr
 
+  if (self.async_queue ne 0ULL) then begin
+    self->flush
+    mg_mysql_async_stop, self.async_queue
+    self.async_queue = 0ULL
+  endif
+
+  if (self.local_infile_connection ne 0ULL) then begin
+    mg_mysql_close, self.local_infile_connection
+    self.local_infile_connection = 0ULL
+  endif
+
+  ; pooled connections stay open for the next user
+  if (self.pool_key ne '') then begin
+    self.connection = 0UL
+    self.connected = 0B
+  endif
+
   if (self.connection ne 0UL) then begin
     mg_mysql_close, self.connection
     self.connection = 0UL
@@ -1440,6 +1737,15 @@ end
 ;     boolean whether to print error messages
 ;   enum_field_types
 ;     hash of codes to constant names
+;   async_queue
+;     pointer to asynchronous write queue, 0 if not writing asynchronously
+;   pool_key
+;     key of the connection in the DLM connection pool, '' if not pooled
+;   local_infile_connection
+;     connection allowing `LOAD DATA LOCAL INFILE`, 0 if not opened yet
+;   user, password, port, socket, client_flags, compress
+;     arguments and compression of the main connection, to open further
+;     connections
 ;-
 pro mgdbmysql__define
   compile_opt strictarr
@@ -1450,7 +1756,16 @@ pro mgdbmysql__define
              host: '', $
              database: '', $
              quiet: 0B, $
-             enum_field_types: obj_new() $
+             enum_field_types: obj_new(), $
+             async_queue: 0ULL, $
+             pool_key: '', $
+             local_infile_connection: 0ULL, $
+             user: '', $
+             password: '', $
+             port: 0UL, $
+             socket: '', $
+             client_flags: 0ULL, $
+             compress: 0B $
            }
 end
 
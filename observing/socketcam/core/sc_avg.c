@@ -0,0 +1,732 @@
+// sc_avg.c   the averaging program: threadsforavging.h and
+//            threadsforwriting.h without the BitFlow and Windows calls.
+//
+// Each camera thread co-adds n_integrations frames per modulator state into
+// its half of an accumulation buffer. The buffers form a ring of n_slots
+// slots, filled in order by both cameras and drained in order by a single
+// writer thread, which converts and writes the cube, zeroes the buffer and
+// hands it back.
+//
+// The hand-off is lock-free: each camera owns a count of the slots it has
+// filled and the writer owns a count of the slots it has drained. A camera
+// may fill a slot once the writer has drained it n_slots cubes ago, and the
+// writer may drain a slot once both cameras have filled it, so a completed
+// slot is only released when both cameras are done with it. Semaphores are
+// only used to sleep when there is nothing to do. A camera that finds the
+// ring full counts an overrun and waits for the writer, with the frames
+// piling up in the board buffers, instead of overwriting a cube that is
+// still being written as socketcam.c can.
+//
+// The writer thread holds a slot only while converting it: the conversion
+// to 16 bits and the zeroing of the slot are one pass, into a buffer of the
+// asynchronous sc_writer, whose I/O thread writes the file afterwards. With
+// the fits option the cube is converted big-endian and written with its FITS
+// header as a _kcor.fts file, or gzipped by the I/O thread as _kcor.fts.gz.
+//
+// With the clip option each camera also keeps, for its 4 state images, the
+// running mean and squared deviations of the frames kept in the current cube
+// and the reference mean and rejection limit from its previous cube. These
+// are only used by the camera thread and its band threads, so clipping needs
+// no more synchronization than co-adding. When a camera completes a cube it
+// replaces the sums of the clipped pixels with their means times
+// n_integrations and makes the statistics the next reference, while the
+// counts of frames kept stay in the slot for the writer, which turns them
+// into the rejected frame map written after the cube.
+
+#include <math.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sc_core.h"
+#include "sc_thread.h"
+
+#define SC_CUBE_BYTES (SC_CUBE_NVALUES * sizeof(uint32_t))
+
+// per camera clipping state, for its SC_NSTATES images
+#define SC_CLIP_NVALUES (SC_NSTATES * SC_NPIXELS)
+
+// writer tag of a rejected frame map, so it is not reported as a cube
+#define SC_AVG_REJECTED_TAG "rejected"
+
+typedef struct {
+    uint32_t *cube;                      // pAvgSpaceX/pAvgSpaceY
+    time_t    timestamp;                 // TimeStampX/TimeStampY
+    int       status[SC_NCAMERAS];
+    uint64_t  n_frames[SC_NCAMERAS];
+    uint64_t  n_lagged[SC_NCAMERAS];     // BuffQSzX0, BuffQSzX1, etc.
+    uint16_t *n_kept;                    // frames kept per value, if clipping
+    double    filled_time[SC_NCAMERAS];  // sc_time() when completed
+} sc_avg_slot;
+
+typedef struct {
+    float *ref_mean;                     // from the previous cube
+    float *ref_limit;                    // squared, INFINITY to keep all
+    float *mean;                         // of the frames kept in this cube
+    float *m2;                           // sum of their squared deviations
+} sc_avg_clip;
+
+typedef struct {
+    const uint32_t (*lut)[SC_LUT_SIZE];
+    const uint16_t *frame;
+    sc_avg_clip    *clip;
+    uint16_t       *n_kept;
+    uint32_t       *acc;
+    size_t          offset;              // of the state image
+} sc_avg_clip_arg;
+
+typedef struct {
+    sc_avg_clip    *clip;
+    uint16_t       *n_kept;
+    uint32_t       *acc;
+    float           clip2;               // clip^2
+    int             numsum;              // frames per state in a full cube
+    int             n_done;              // integrations actually co-added
+    int             min_kept;
+} sc_avg_finish_arg;
+
+typedef struct {
+    sc_avg *avg;
+    int     index;
+} sc_avg_thread_arg;
+
+struct sc_avg {
+    sc_source        *src;
+    sc_avg_options    options;
+    int               joined;
+
+    int               n_slots;
+    sc_avg_slot      *slots;
+    sc_writer        *writer;            // buffers replace pAvgSpace16
+    sc_avg_clip       clip[SC_NCAMERAS]; // only used by camera c's threads
+
+    // lock-free ring indices: filled[c] is only written by camera c,
+    // drained only by the writer
+    volatile uint64_t filled[SC_NCAMERAS];
+    volatile uint64_t drained;
+    volatile uint64_t quit;
+    volatile uint64_t finish_at;         // cameras stop once they fill this many
+
+    // wake-ups for a camera waiting on a full ring and for an idle writer
+    sc_sem            slot_free[SC_NCAMERAS];
+    sc_sem            slot_filled;
+
+    int               n_camera_threads;
+    sc_thread         camera_threads[SC_NCAMERAS];
+    sc_avg_thread_arg camera_args[SC_NCAMERAS];
+
+    int               writer_started;
+    sc_thread         writer_thread;
+
+    sc_mutex          stats_mutex;
+    sc_avg_stats      stats;
+    int               n_exited;          // camera threads finished
+};
+
+
+static void sc_avg_clip_band(void *arg, size_t offset, size_t n_pixels) {
+    sc_avg_clip_arg *a = (sc_avg_clip_arg *) arg;
+    size_t i = a->offset + offset;
+
+    sc_clip_accumulate(a->lut, a->frame + offset,
+                       a->clip->ref_mean + i, a->clip->ref_limit + i,
+                       a->clip->mean + i, a->clip->m2 + i,
+                       a->n_kept + i, a->acc + i, n_pixels);
+}
+
+// Finish a clipped cube for a band of each state image: clipped pixels get
+// the mean of the frames kept, scaled to a sum of numsum frames, and the
+// statistics become the reference for the next cube. A pixel that kept
+// every frame keeps its exact plain sum.
+static void sc_avg_finish_band(void *arg, size_t offset, size_t n_pixels) {
+    sc_avg_finish_arg *a = (sc_avg_finish_arg *) arg;
+    sc_avg_clip *clip = a->clip;
+    double value;
+    size_t i, end;
+    int q, n;
+
+    for (q = 0; q < SC_NSTATES; q++) {
+        i = (size_t) q * SC_NPIXELS + offset;
+        for (end = i + n_pixels; i < end; i++) {
+            n = a->n_kept[i];
+            if (n >= a->min_kept) {
+                if (n < a->numsum) {
+                    value = (double) clip->mean[i] * a->numsum + 0.5;
+                    a->acc[i] = value >= 4294967295.0 ? 0xffffffffu : (uint32_t) value;
+                }
+                clip->ref_mean[i] = clip->mean[i];
+                clip->ref_limit[i] = n > 1
+                    ? a->clip2 * clip->m2[i] / (float) (n - 1) + 1.0f
+                    : INFINITY;
+            } else {
+                clip->ref_mean[i] = (float) ((double) a->acc[i] / a->n_done);
+                clip->ref_limit[i] = INFINITY;
+            }
+            clip->mean[i] = 0.0f;
+            clip->m2[i] = 0.0f;
+        }
+    }
+}
+
+// Co-add one cube's worth of frames from a camera into acc, its 4 modulator
+// state images, i.e., GetImgAndApplyLut[01].h for each integration.
+static int sc_avg_integrate(sc_avg *avg, int camera, sc_avg_slot *slot,
+                            sc_band_pool *pool) {
+    sc_source *src = avg->src;
+    const sc_lut *lut = avg->options.lut;
+    int n_integrations = avg->options.n_integrations;
+    size_t offset = (size_t) camera * SC_CLIP_NVALUES;
+    uint32_t *acc = slot->cube + offset;
+    uint64_t n_frames = 0, n_lagged = 0, n_missed = 0;
+    uint32_t max_behind = 0;
+    sc_hist frame_latency, coadd_latency;
+    double t;
+    sc_avg_clip_arg clip_arg;
+    sc_avg_finish_arg finish_arg;
+    sc_frame frame;
+    int n, q, status = SC_OK;
+
+    sc_hist_init(&frame_latency);
+    sc_hist_init(&coadd_latency);
+
+    if (avg->options.clip > 0.0) {
+        clip_arg.lut = lut != NULL ? lut->table[camera] : NULL;
+        clip_arg.clip = &avg->clip[camera];
+        clip_arg.n_kept = slot->n_kept + offset;
+        clip_arg.acc = acc;
+    }
+
+    for (n = 0; n < n_integrations && status == SC_OK; n++) {
+        for (q = 0; q < SC_NSTATES; q++) {
+            status = src->next(src, camera, &frame);
+            if (status != SC_OK) {
+                if (status != SC_STOPPED) {
+                    sc_log("Camera %d: %s\n", camera, sc_status_name(status));
+                }
+                break;
+            }
+
+            n_lagged += frame.n_behind;
+            n_missed += frame.n_missed;
+            if (frame.n_behind > max_behind) max_behind = frame.n_behind;
+
+            t = sc_time();
+            if (avg->options.clip > 0.0) {
+                clip_arg.frame = frame.pixels;
+                clip_arg.offset = (size_t) q * SC_NPIXELS;
+                sc_band_pool_run(pool, sc_avg_clip_band, &clip_arg);
+            } else {
+                sc_band_pool_accumulate(pool, lut != NULL ? lut->table[camera] : NULL,
+                                        frame.pixels, acc + q * SC_NPIXELS);
+            }
+            sc_hist_add(&coadd_latency, sc_time() - t);
+            sc_hist_add(&frame_latency, sc_time() - frame.time);
+
+            src->release(src, camera, &frame);
+            n_frames++;
+        }
+    }
+
+    // also after a partial cube, so the next one starts from zero
+    if (avg->options.clip > 0.0 && n_frames > 0) {
+        finish_arg.clip = &avg->clip[camera];
+        finish_arg.n_kept = slot->n_kept + offset;
+        finish_arg.acc = acc;
+        finish_arg.clip2 = (float) (avg->options.clip * avg->options.clip);
+        finish_arg.numsum = n_integrations;
+        finish_arg.n_done = (int) ((n_frames + SC_NSTATES - 1) / SC_NSTATES);
+        finish_arg.min_kept = (int) (avg->options.clip_min_kept * n_integrations);
+        if (finish_arg.min_kept < avg->options.clip_min_kept * n_integrations) finish_arg.min_kept++;
+        if (finish_arg.min_kept < 1) finish_arg.min_kept = 1;
+        sc_band_pool_run(pool, sc_avg_finish_band, &finish_arg);
+    }
+
+    sc_mutex_lock(&avg->stats_mutex);
+    avg->stats.n_frames[camera] += n_frames;
+    avg->stats.n_lagged[camera] += n_lagged;
+    avg->stats.n_missed[camera] += n_missed;
+    if (max_behind > avg->stats.max_behind[camera]) avg->stats.max_behind[camera] = max_behind;
+    sc_hist_merge(&avg->stats.frame_latency, &frame_latency);
+    sc_hist_merge(&avg->stats.coadd_latency, &coadd_latency);
+    sc_mutex_unlock(&avg->stats_mutex);
+
+    slot->n_frames[camera] = n_frames;
+    slot->n_lagged[camera] = n_lagged;
+
+    return status;
+}
+
+static SC_THREAD_RETURN sc_avg_camera_thread(void *arg) {
+    sc_avg_thread_arg *a = (sc_avg_thread_arg *) arg;
+    sc_avg *avg = a->avg;
+    int camera = a->index, status = SC_OK;
+    sc_band_pool *pool = sc_band_pool_new(avg->options.n_band_threads);
+    uint64_t filled = 0;
+    sc_avg_slot *slot;
+
+    while (status != SC_STOPPED && status != SC_ABORTED) {
+        // a gentle stop ends after the cube being integrated
+        if (filled >= sc_atomic_load(&avg->finish_at)) break;
+
+        // wait for the writer if every slot is full
+        if (filled - sc_atomic_load(&avg->drained) >= (uint64_t) avg->n_slots) {
+            sc_mutex_lock(&avg->stats_mutex);
+            avg->stats.n_overruns[camera]++;
+            sc_mutex_unlock(&avg->stats_mutex);
+            while (filled - sc_atomic_load(&avg->drained) >= (uint64_t) avg->n_slots) {
+                sc_sem_wait(&avg->slot_free[camera]);
+            }
+        }
+
+        slot = &avg->slots[filled % avg->n_slots];
+        if (camera == 0) slot->timestamp = time(NULL);
+
+        status = sc_avg_integrate(avg, camera, slot, pool);
+        slot->status[camera] = status;
+        slot->filled_time[camera] = sc_time();
+
+        // publish the slot to the writer
+        sc_atomic_store(&avg->filled[camera], ++filled);
+        sc_sem_post(&avg->slot_filled);
+    }
+
+    sc_band_pool_free(pool);
+
+    sc_mutex_lock(&avg->stats_mutex);
+    avg->n_exited++;
+    sc_mutex_unlock(&avg->stats_mutex);
+
+    return SC_THREAD_RESULT;
+}
+
+// called on the I/O thread once a cube, or a rejected frame map, has been
+// written
+static void sc_avg_written(const char *filename, const char *tag,
+                           int status, double write_time, void *data) {
+    sc_avg *avg = (sc_avg *) data;
+    int rejected = strcmp(tag, SC_AVG_REJECTED_TAG) == 0;
+    char aStr[1400];
+
+    sc_mutex_lock(&avg->stats_mutex);
+    if (status != 0) {
+        avg->stats.n_write_errors++;
+    } else if (!rejected) {
+        avg->stats.n_cubes++;
+    }
+    avg->stats.write_time += write_time;
+    if (write_time > avg->stats.max_write_time) avg->stats.max_write_time = write_time;
+    if (status == 0 && avg->options.output_root != NULL) {
+        sc_hist_add(&avg->stats.write_latency, write_time);
+    }
+    sc_mutex_unlock(&avg->stats_mutex);
+
+    // send a message back to the client with lagging, i.e., missed frames
+    if (status == 0 && !rejected && avg->options.notify != NULL) {
+        snprintf(aStr, sizeof(aStr), "img %s %s", filename, tag);
+        avg->options.notify(aStr, avg->options.notify_data);
+    }
+}
+
+// Convert the counts of frames kept to counts of frames rejected, stored
+// as the cube is, and zero them; returns the total rejected.
+static uint64_t sc_avg_rejected_map(uint16_t *n_kept, int16_t *map, size_t n_values,
+                                    int numsum, int big_endian) {
+    uint64_t n_rejected = 0;
+    uint16_t v;
+    size_t i;
+
+    for (i = 0; i < n_values; i++) {
+        v = (uint16_t) (numsum - n_kept[i]);
+        n_rejected += v;
+        v = (uint16_t) (v - 0x8000);
+        if (big_endian) v = (uint16_t) ((v << 8) | (v >> 8));
+        map[i] = (int16_t) v;
+        n_kept[i] = 0;
+    }
+
+    return n_rejected;
+}
+
+// the suffix of cube files or, with rejected set, of rejected frame maps
+static const char *sc_avg_suffix(const sc_avg *avg, int rejected) {
+    if (!avg->options.fits) return rejected ? "_rejected.bin" : ".bin";
+    if (avg->options.gzip > 0) return rejected ? "_rejected.fts.gz" : ".fts.gz";
+    return rejected ? "_rejected.fts" : ".fts";
+}
+
+// convert and zero the slot for cube number `index` and queue it for writing
+static void sc_avg_drain(sc_avg *avg, uint64_t index) {
+    sc_avg_slot *slot = &avg->slots[index % avg->n_slots];
+    char afilenm[1024], rfilenm[1024];
+    char tag[256];
+    double t = sc_time(), drain_time, filled_time = 0.0;
+    uint64_t n_frames = 0, n_overruns[SC_NCAMERAS], n_rejected = 0;
+    int c, complete = 1, error = 0, clip = avg->options.clip > 0.0, sequence;
+    void *buffer = NULL, *map = NULL;
+    sc_fits_info info;
+
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        complete &= slot->status[c] == SC_OK;
+        n_frames += slot->n_frames[c];
+        if (slot->filled_time[c] > filled_time) filled_time = slot->filled_time[c];
+    }
+
+    if (complete) {
+        // the first SC_HEADER_SIZE bytes of the buffer are the header space,
+        // left blank for a .bin file
+        buffer = sc_writer_acquire(avg->writer);
+        if (!avg->options.fits) memset(buffer, 0, SC_HEADER_SIZE);
+        sc_convert_cube_zero(slot->cube, (int16_t *) ((char *) buffer + SC_HEADER_SIZE),
+                             SC_CUBE_NVALUES, avg->options.fits);
+        if (clip) {
+            map = sc_writer_acquire(avg->writer);
+            if (!avg->options.fits) memset(map, 0, SC_HEADER_SIZE);
+            n_rejected = sc_avg_rejected_map(slot->n_kept,
+                                             (int16_t *) ((char *) map + SC_HEADER_SIZE),
+                                             SC_CUBE_NVALUES, avg->options.n_integrations,
+                                             avg->options.fits);
+        }
+        if (avg->options.fits) {
+            info.date_obs = slot->timestamp;
+            info.date_end = time(NULL);
+            info.numsum = avg->options.n_integrations;
+            info.start_state = avg->options.start_state;
+            for (c = 0; c < SC_NCAMERAS; c++) {
+                info.camera_id[c] = avg->options.camera_id[c];
+                info.lut_id[c] = avg->options.lut != NULL ? avg->options.lut->id[c] : NULL;
+            }
+            info.clip = avg->options.clip;
+            info.rejected = 0;
+            sc_fits_header((char *) buffer, &info);
+            if (clip) {
+                info.rejected = 1;
+                sc_fits_header((char *) map, &info);
+            }
+        }
+        sequence = -1;
+        error = sc_cube_filename(afilenm, sizeof(afilenm),
+                                 avg->options.output_root, slot->timestamp,
+                                 sc_avg_suffix(avg, 0), &sequence);
+        if (clip && !error) {
+            error = sc_cube_filename(rfilenm, sizeof(rfilenm),
+                                     avg->options.output_root, slot->timestamp,
+                                     sc_avg_suffix(avg, 1), &sequence);
+        }
+    } else {
+        memset(slot->cube, 0, SC_CUBE_BYTES);
+        if (clip) memset(slot->n_kept, 0, SC_CUBE_NVALUES * sizeof(uint16_t));
+    }
+    drain_time = sc_time() - t;
+
+    sc_mutex_lock(&avg->stats_mutex);
+    // a buffer started after the source stopped is empty, not lost
+    if (!complete && n_frames > 0) avg->stats.n_discarded++;
+    if (complete && error) avg->stats.n_write_errors++;
+    avg->stats.n_rejected += n_rejected;
+    if (complete) {
+        avg->stats.drain_time += drain_time;
+        if (drain_time > avg->stats.max_drain_time) avg->stats.max_drain_time = drain_time;
+        sc_hist_add(&avg->stats.queue_latency, t - filled_time);
+        sc_hist_add(&avg->stats.drain_latency, drain_time);
+    }
+    for (c = 0; c < SC_NCAMERAS; c++) n_overruns[c] = avg->stats.n_overruns[c];
+    sc_mutex_unlock(&avg->stats_mutex);
+
+    if (!complete) return;
+    if (error) {
+        sc_writer_release(avg->writer, buffer);
+        if (map != NULL) sc_writer_release(avg->writer, map);
+        return;
+    }
+
+    // Lag and the number of times each camera has found every slot full; the
+    // X/Y letter still alternates from cube to cube.
+    snprintf(tag, sizeof(tag), "lagged%c %llu %llu overrun %llu %llu",
+             "XY"[index % 2],
+             (unsigned long long) slot->n_lagged[0],
+             (unsigned long long) slot->n_lagged[1],
+             (unsigned long long) n_overruns[0],
+             (unsigned long long) n_overruns[1]);
+
+    if (avg->options.output_root != NULL) {
+        sc_writer_submit(avg->writer, buffer, SC_HEADER_SIZE + SC_CUBE_NVALUES * sizeof(int16_t),
+                         afilenm, tag);
+        if (map != NULL) {
+            sc_writer_submit(avg->writer, map, SC_HEADER_SIZE + SC_CUBE_NVALUES * sizeof(int16_t),
+                             rfilenm, SC_AVG_REJECTED_TAG);
+        }
+    } else {
+        sc_writer_release(avg->writer, buffer);
+        if (map != NULL) sc_writer_release(avg->writer, map);
+        sc_avg_written(afilenm, tag, 0, 0.0, avg);
+    }
+}
+
+static SC_THREAD_RETURN sc_avg_writer_thread(void *arg) {
+    sc_avg *avg = (sc_avg *) arg;
+    uint64_t drained = 0, ready, filled;
+    int c, quit;
+
+    for (;;) {
+        // read quit first: it is set after the cameras have exited, so if it
+        // is seen, every slot they filled is seen too
+        quit = sc_atomic_load(&avg->quit) != 0;
+
+        ready = sc_atomic_load(&avg->filled[0]);
+        for (c = 1; c < SC_NCAMERAS; c++) {
+            filled = sc_atomic_load(&avg->filled[c]);
+            if (filled < ready) ready = filled;
+        }
+
+        if (drained < ready) {
+            sc_avg_drain(avg, drained);
+
+            // hand the slot back to the cameras
+            sc_atomic_store(&avg->drained, ++drained);
+            for (c = 0; c < SC_NCAMERAS; c++) sc_sem_post(&avg->slot_free[c]);
+            continue;
+        }
+
+        if (quit) break;
+        sc_sem_wait(&avg->slot_filled);
+    }
+
+    return SC_THREAD_RESULT;
+}
+
+
+void sc_avg_options_init(sc_avg_options *options) {
+    options->n_integrations = 512;
+    options->lut            = NULL;
+    options->n_band_threads = 1;
+    options->n_slots        = SC_DEFAULT_NSLOTS;
+    options->n_write_buffers = 2;
+    options->direct_io      = 1;
+    options->fits           = 0;
+    options->gzip           = 0;
+    options->start_state    = 0;
+    options->clip           = 0.0;
+    options->clip_min_kept  = 0.9;
+    options->camera_id[0]   = NULL;
+    options->camera_id[1]   = NULL;
+    options->output_root    = NULL;
+    options->pool           = NULL;
+    options->notify         = NULL;
+    options->notify_data    = NULL;
+}
+
+sc_avg *sc_avg_start(sc_source *src, const sc_avg_options *options) {
+    sc_avg *avg = (sc_avg *) calloc(1, sizeof(sc_avg));
+    int s, c, flags, n_buffers;
+    size_t v;
+
+    if (avg == NULL) return NULL;
+
+    avg->src = src;
+    avg->options = *options;
+    if (avg->options.n_integrations < 1) avg->options.n_integrations = 1;
+    if (avg->options.clip > 0.0 && avg->options.n_integrations > 65535) {
+        sc_log("Clipping at most 65535 integrations, not %d\n", avg->options.n_integrations);
+        avg->options.n_integrations = 65535;
+    }
+    avg->n_slots = avg->options.n_slots < 2 ? 2 : avg->options.n_slots;
+    avg->finish_at = UINT64_MAX;
+
+    sc_mutex_init(&avg->stats_mutex);
+    for (c = 0; c < SC_NCAMERAS; c++) sc_sem_init(&avg->slot_free[c], 0);
+    sc_sem_init(&avg->slot_filled, 0);
+
+    avg->slots = (sc_avg_slot *) calloc(avg->n_slots, sizeof(sc_avg_slot));
+    if (avg->slots == NULL) goto nomem;
+    for (s = 0; s < avg->n_slots; s++) {
+        avg->slots[s].cube = (uint32_t *) sc_pool_get(avg->options.pool, SC_CUBE_BYTES, 1);
+        if (avg->slots[s].cube == NULL) goto nomem;
+        if (avg->options.clip > 0.0) {
+            avg->slots[s].n_kept = (uint16_t *) sc_pool_get(avg->options.pool,
+                                                            SC_CUBE_NVALUES * sizeof(uint16_t), 1);
+            if (avg->slots[s].n_kept == NULL) goto nomem;
+        }
+    }
+
+    // nothing is clipped in the first cube
+    for (c = 0; c < SC_NCAMERAS && avg->options.clip > 0.0; c++) {
+        avg->clip[c].ref_mean = (float *) sc_pool_get(avg->options.pool, SC_CLIP_NVALUES * sizeof(float), 0);
+        avg->clip[c].ref_limit = (float *) sc_pool_get(avg->options.pool, SC_CLIP_NVALUES * sizeof(float), 0);
+        avg->clip[c].mean = (float *) sc_pool_get(avg->options.pool, SC_CLIP_NVALUES * sizeof(float), 0);
+        avg->clip[c].m2 = (float *) sc_pool_get(avg->options.pool, SC_CLIP_NVALUES * sizeof(float), 0);
+        if (avg->clip[c].ref_mean == NULL || avg->clip[c].ref_limit == NULL
+                || avg->clip[c].mean == NULL || avg->clip[c].m2 == NULL) {
+            goto nomem;
+        }
+        for (v = 0; v < SC_CLIP_NVALUES; v++) {
+            avg->clip[c].ref_mean[v] = 0.0f;
+            avg->clip[c].ref_limit[v] = INFINITY;
+            avg->clip[c].mean[v] = 0.0f;
+            avg->clip[c].m2[v] = 0.0f;
+        }
+    }
+
+    // gzipped FITS files are compressed on the writer's I/O thread
+    if (avg->options.fits && avg->options.gzip > 0) {
+        flags = SC_WRITE_GZIP | SC_WRITE_GZIP_LEVEL(avg->options.gzip);
+    } else {
+        flags = avg->options.direct_io ? SC_WRITE_DIRECT : 0;
+    }
+    // a clipped cube is written with its rejected frame map
+    n_buffers = avg->options.n_write_buffers * (avg->options.clip > 0.0 ? 2 : 1);
+    avg->writer = sc_writer_new(n_buffers,
+                                SC_HEADER_SIZE + SC_CUBE_NVALUES * sizeof(int16_t),
+                                flags, sc_avg_written, avg, avg->options.pool);
+    if (avg->writer == NULL) goto error;
+
+    if (sc_thread_create(&avg->writer_thread, sc_avg_writer_thread, avg) != 0) {
+        sc_log("Could not create writer thread\n");
+        goto error;
+    }
+    avg->writer_started = 1;
+
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        avg->camera_args[c].avg = avg;
+        avg->camera_args[c].index = c;
+        if (sc_thread_create(&avg->camera_threads[c], sc_avg_camera_thread,
+                             &avg->camera_args[c]) != 0) {
+            sc_log("Could not create camera thread\n");
+            goto error;
+        }
+        avg->n_camera_threads++;
+    }
+
+    return avg;
+
+  nomem:
+    sc_log("Could not allocate %d averaging buffers\n", avg->n_slots);
+  error:
+    sc_avg_stop(avg);
+    sc_avg_join(avg);
+    sc_avg_free(avg);
+    return NULL;
+}
+
+void sc_avg_stop(sc_avg *avg) {
+    avg->src->stop(avg->src);
+}
+
+void sc_avg_finish(sc_avg *avg) {
+    uint64_t filled, last = 0;
+    int c;
+
+    // the cube one camera is integrating, which the other may not have begun
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        filled = sc_atomic_load(&avg->filled[c]);
+        if (filled > last) last = filled;
+    }
+    sc_atomic_store(&avg->finish_at, last + 1);
+}
+
+int sc_avg_done(sc_avg *avg) {
+    int done;
+
+    sc_mutex_lock(&avg->stats_mutex);
+    done = avg->n_camera_threads > 0 && avg->n_exited == avg->n_camera_threads;
+    sc_mutex_unlock(&avg->stats_mutex);
+
+    return done;
+}
+
+int sc_avg_reserve(sc_pool *pool, const sc_avg_options *options) {
+    int clip = options->clip > 0.0;
+    int n_slots = options->n_slots < 2 ? 2 : options->n_slots;
+    int n_buffers = options->n_write_buffers * (clip ? 2 : 1);
+    size_t buffer_size = (SC_HEADER_SIZE + SC_CUBE_NVALUES * sizeof(int16_t) + SC_IO_ALIGNMENT - 1)
+        / SC_IO_ALIGNMENT * SC_IO_ALIGNMENT;
+    void **buffers;
+    int n, b = 0, i, s, status = 0;
+
+    // the buffers sc_avg_start and its writer take from the pool
+    if (pool == NULL) return 0;
+    if (n_buffers < 1) n_buffers = 1;
+    n = n_slots * (clip ? 2 : 1) + (clip ? 4 * SC_NCAMERAS : 0) + n_buffers;
+    if ((buffers = (void **) calloc(n, sizeof(void *))) == NULL) return -1;
+
+    for (s = 0; s < n_slots; s++) {
+        buffers[b++] = sc_pool_get(pool, SC_CUBE_BYTES, 1);
+        if (clip) buffers[b++] = sc_pool_get(pool, SC_CUBE_NVALUES * sizeof(uint16_t), 1);
+    }
+    for (i = 0; i < 4 * SC_NCAMERAS && clip; i++) {
+        buffers[b++] = sc_pool_get(pool, SC_CLIP_NVALUES * sizeof(float), 1);
+    }
+    for (i = 0; i < n_buffers; i++) buffers[b++] = sc_pool_get(pool, buffer_size, 1);
+
+    for (i = 0; i < b; i++) {
+        if (buffers[i] == NULL) status = -1;
+        sc_pool_put(pool, buffers[i], 1);
+    }
+    free(buffers);
+
+    return status;
+}
+
+void sc_avg_join(sc_avg *avg) {
+    int c;
+
+    if (avg->joined) return;
+
+    for (c = 0; c < avg->n_camera_threads; c++) sc_thread_join(avg->camera_threads[c]);
+
+    // the cameras are done, so the writer drains what they filled and exits
+    sc_atomic_store(&avg->quit, 1);
+    if (avg->writer_started) {
+        sc_sem_post(&avg->slot_filled);
+        sc_thread_join(avg->writer_thread);
+    }
+
+    // wait for the queued cubes to be written
+    sc_writer_free(avg->writer);
+    avg->writer = NULL;
+
+    avg->joined = 1;
+}
+
+void sc_avg_get_stats(sc_avg *avg, sc_avg_stats *stats) {
+    sc_mutex_lock(&avg->stats_mutex);
+    *stats = avg->stats;
+    sc_mutex_unlock(&avg->stats_mutex);
+}
+
+void sc_avg_free(sc_avg *avg) {
+    uint64_t filled = 0, index;
+    int s, c, clean;
+
+    if (avg == NULL) return;
+
+    // every drained slot has been zeroed, but the writer never saw a slot
+    // only one camera filled
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        if (avg->filled[c] > filled) filled = avg->filled[c];
+    }
+    if (avg->slots != NULL) {
+        for (s = 0; s < avg->n_slots; s++) {
+            clean = avg->joined;
+            for (index = avg->drained; index < filled && clean; index++) {
+                if (index % avg->n_slots == (uint64_t) s) clean = 0;
+            }
+            sc_pool_put(avg->options.pool, avg->slots[s].cube, clean);
+            sc_pool_put(avg->options.pool, avg->slots[s].n_kept, clean);
+        }
+        free(avg->slots);
+    }
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        sc_pool_put(avg->options.pool, avg->clip[c].ref_mean, 0);
+        sc_pool_put(avg->options.pool, avg->clip[c].ref_limit, 0);
+        sc_pool_put(avg->options.pool, avg->clip[c].mean, 0);
+        sc_pool_put(avg->options.pool, avg->clip[c].m2, 0);
+    }
+    sc_writer_free(avg->writer);
+
+    for (c = 0; c < SC_NCAMERAS; c++) sc_sem_destroy(&avg->slot_free[c]);
+    sc_sem_destroy(&avg->slot_filled);
+    sc_mutex_destroy(&avg->stats_mutex);
+    free(avg);
+}
@@ -0,0 +1,471 @@
+// sc_bench.c   runs the socketcam averaging program, or stream mode, against
+//              a synthetic or replayed camera and reports throughput and lag.
+//
+// It is also the replay harness for the averaging path: frames from .raw
+// files or a stream container go through the same co-adding, LUT and writer
+// code as on the observing PC, at the camera rate, faster or unpaced, and
+// the sustained frame rate, lag counts and latency percentiles of each stage
+// are reported, so acquisition changes can be compared before deployment.
+//
+// usage: socketcam_bench [options]
+//   --cubes N           average cubes to acquire (default 4)
+//   --integrations N    frames per modulator state per cube (default 16)
+//   --rate FPS          camera frame rate, 0 for as fast as possible
+//   --buffers N         simulated board buffers per camera (default 1032)
+//   --replay0 FILE      raw frames for camera 0, may be repeated
+//   --replay1 FILE      raw frames for camera 1, may be repeated
+//   --replay-stream FILE  frames of both cameras from a stream container
+//   --lut-config FILE   kcoConfig.ini listing the LUT files
+//   --no-lut            co-add raw counts instead of applying LUTs
+//   --kernel NAME       LUT kernel: auto, scalar or avx2 (default auto)
+//   --band-threads N    threads co-adding each camera's frames (default 1)
+//   --slots N           accumulation buffers in the ring (default 4)
+//   --no-direct         write cubes through the page cache
+//   --fits              write _kcor.fts files with a FITS header
+//   --gzip LEVEL        gzip the FITS files on the I/O thread
+//   --clip SIGMA        sigma-clip frames against the previous cube
+//   --output DIR        write average cubes or stream files below DIR
+//   --stream N          stream N frames per camera instead of averaging
+//   --raw               stream to .raw files instead of a container
+//   --file-frames N     frames per .raw stream file (default 1024)
+//   --switch N          switch between stream and averaging N times
+//   --dwell SECS        time each program runs between switches (default 1)
+//   --no-pool           reallocate the buffers on every switch
+//   --verbose           print the "img ... lagged" messages
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sc_core.h"
+#include "sc_thread.h"
+
+#define SC_BENCH_MAX_FILES 4096
+
+static void sc_bench_notify(const char *message, void *data) {
+    int *verbose = (int *) data;
+    if (*verbose) printf("%s\n", message);
+}
+
+static void sc_bench_usage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [--cubes N] [--integrations N] [--rate FPS] [--buffers N]\n"
+            "          [--replay0 FILE]... [--replay1 FILE]... [--replay-stream FILE]\n"
+            "          [--lut-config FILE] [--no-lut] [--kernel auto|scalar|avx2]\n"
+            "          [--band-threads N] [--slots N] [--no-direct] [--fits] [--gzip LEVEL]\n"
+            "          [--clip SIGMA] [--output DIR] [--verbose]\n"
+            "          [--stream N] [--raw] [--file-frames N]\n"
+            "          [--switch N] [--dwell SECS] [--no-pool]\n",
+            program);
+}
+
+static void sc_bench_latency(const char *stage, const sc_hist *hist) {
+    if (hist->count == 0) return;
+    printf("  %-13s %10llu %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+           stage, (unsigned long long) hist->count,
+           1.0e3 * hist->sum / (double) hist->count,
+           1.0e3 * sc_hist_percentile(hist, 50.0),
+           1.0e3 * sc_hist_percentile(hist, 90.0),
+           1.0e3 * sc_hist_percentile(hist, 99.0),
+           1.0e3 * hist->max);
+}
+
+// stream n_frames frames per camera; returns the exit status
+static int sc_bench_stream(sc_source *src, const sc_source_options *source_options,
+                           const char *output_root, int direct_io, int container,
+                           int file_frames, int *verbose) {
+    sc_stream_options stream_options;
+    sc_stream_stats stats;
+    sc_stream *stream;
+    double t0, elapsed;
+    int c;
+
+    sc_stream_options_init(&stream_options);
+    stream_options.container = container;
+    stream_options.file_frames = file_frames;
+    stream_options.direct_io = direct_io;
+    stream_options.output_root = output_root;
+    stream_options.notify = sc_bench_notify;
+    stream_options.notify_data = verbose;
+
+    t0 = sc_time();
+    if ((stream = sc_stream_start(src, &stream_options)) == NULL) return EXIT_FAILURE;
+    sc_stream_join(stream);
+    elapsed = sc_time() - t0;
+
+    sc_stream_get_stats(stream, &stats);
+    sc_stream_free(stream);
+
+    printf("mode            : stream to %s, %d x %d frame buffers per camera\n",
+           container ? "container" : ".raw files",
+           stream_options.n_buffers, stream_options.buffer_frames);
+    printf("camera rate     : ");
+    if (source_options->frame_rate > 0.0) {
+        printf("%0.1f frames/sec\n", source_options->frame_rate);
+    } else {
+        printf("unpaced\n");
+    }
+    printf("files           : %llu written, %llu write errors\n",
+           (unsigned long long) stats.n_files,
+           (unsigned long long) stats.n_write_errors);
+    printf("elapsed         : %0.3f secs\n", elapsed);
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        printf("camera %d        : %llu frames, %llu written, %0.1f frames/sec, lagged %llu, missed %llu, overruns %llu\n",
+               c,
+               (unsigned long long) stats.n_frames[c],
+               (unsigned long long) stats.n_written[c],
+               (double) stats.n_frames[c] / elapsed,
+               (unsigned long long) stats.n_lagged[c],
+               (unsigned long long) stats.n_missed[c],
+               (unsigned long long) stats.n_overruns[c]);
+    }
+    if (output_root != NULL) {
+        printf("write rate      : %0.1f MB/sec, %0.3f secs/write max (%s)\n",
+               (double) (stats.n_written[0] + stats.n_written[1])
+                   * SC_NPIXELS * sizeof(uint16_t) / 1.0e6 / elapsed,
+               stats.max_write_time,
+               direct_io ? "direct" : "buffered");
+    }
+
+    return stats.n_write_errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Without a pool, a switch stops the program, frees its buffers and allocates
+// the next program's, as closing and reopening the boards does.
+static int sc_bench_switch_alloc(sc_source *src, sc_avg **avg, sc_stream **stream,
+                                 const sc_avg_options *avg_options,
+                                 const sc_stream_options *stream_options) {
+    src->stop(src);
+    if (*avg != NULL) {
+        sc_avg_join(*avg);
+        sc_avg_free(*avg);
+        *avg = NULL;
+        src->start(src);
+        *stream = sc_stream_start(src, stream_options);
+        return *stream != NULL ? SC_OK : SC_ERROR;
+    }
+    if (*stream != NULL) {
+        sc_stream_join(*stream);
+        sc_stream_free(*stream);
+        *stream = NULL;
+    }
+    src->start(src);
+    *avg = sc_avg_start(src, avg_options);
+    return *avg != NULL ? SC_OK : SC_ERROR;
+}
+
+// alternate between averaging and stream mode n_switches times, a program
+// change every dwell secs; returns the exit status
+static int sc_bench_switch(sc_source *src, const sc_source_options *source_options,
+                           const sc_avg_options *avg_options, int n_switches,
+                           double dwell, int use_pool, int *verbose) {
+    sc_session_options options;
+    sc_session *session = NULL;
+    sc_avg *avg = NULL;
+    sc_stream *stream = NULL;
+    char command[64];
+    double t, switch_time, times[2] = { 0.0, 0.0 }, max_times[2] = { 0.0, 0.0 };
+    int counts[2] = { 0, 0 }, i, to_stream, status = SC_OK;
+
+    sc_session_options_init(&options);
+    options.avg = *avg_options;
+    options.stream.direct_io = avg_options->direct_io;
+    options.stream.output_root = avg_options->output_root;
+    options.stream.notify = sc_bench_notify;
+    options.stream.notify_data = verbose;
+    options.notify = sc_bench_notify;
+    options.notify_data = verbose;
+    options.preallocate = use_pool;
+
+    snprintf(command, sizeof(command), "avging start %d %d",
+             avg_options->n_integrations, avg_options->start_state);
+    if (use_pool) {
+        if ((session = sc_session_new(src, &options)) == NULL) return EXIT_FAILURE;
+        status = sc_session_command(session, command);
+    } else {
+        avg = sc_avg_start(src, avg_options);
+        if (avg == NULL) status = SC_ERROR;
+    }
+
+    for (i = 0; i < n_switches && status == SC_OK; i++) {
+        sc_sleep(dwell);
+
+        to_stream = i % 2 == 0;
+        t = sc_time();
+        if (use_pool) {
+            status = sc_session_command(session, to_stream ? "stream start" : command);
+        } else {
+            status = sc_bench_switch_alloc(src, &avg, &stream, avg_options, &options.stream);
+        }
+        switch_time = sc_time() - t;
+
+        times[to_stream] += switch_time;
+        if (switch_time > max_times[to_stream]) max_times[to_stream] = switch_time;
+        counts[to_stream]++;
+    }
+
+    if (use_pool) {
+        printf("pool            : %0.1f MB\n", (double) sc_pool_size(sc_session_pool(session)) / 1.0e6);
+        sc_session_free(session);
+    } else {
+        src->stop(src);
+        if (avg != NULL) {
+            sc_avg_join(avg);
+            sc_avg_free(avg);
+        }
+        if (stream != NULL) {
+            sc_stream_join(stream);
+            sc_stream_free(stream);
+        }
+    }
+
+    printf("mode            : %d switches, %0.2f secs per program, %s\n",
+           counts[0] + counts[1], dwell, use_pool ? "pooled buffers" : "buffers reallocated");
+    printf("camera rate     : ");
+    if (source_options->frame_rate > 0.0) {
+        printf("%0.1f frames/sec\n", source_options->frame_rate);
+    } else {
+        printf("unpaced\n");
+    }
+    for (i = 1; i >= 0; i--) {
+        if (counts[i] == 0) continue;
+        printf("%-16s: %0.3f msecs mean, %0.3f msecs max over %d switches\n",
+               i ? "to stream" : "to averaging",
+               1.0e3 * times[i] / counts[i], 1.0e3 * max_times[i], counts[i]);
+    }
+
+    return status == SC_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[]) {
+    sc_source_options source_options;
+    sc_avg_options avg_options;
+    sc_avg_stats stats;
+    sc_source *src;
+    sc_avg *avg;
+    sc_lut *lut = NULL;
+    static const char *replay_files[SC_NCAMERAS][SC_BENCH_MAX_FILES];
+    const char **filenames[SC_NCAMERAS] = { replay_files[0], replay_files[1] };
+    int n_files[SC_NCAMERAS] = { 0, 0 };
+    const char *lut_config = NULL, *output_root = NULL, *container_file = NULL;
+    int n_cubes = 4, n_integrations = 16, use_lut = 1, verbose = 0;
+    int kernel = SC_KERNEL_AUTO, n_band_threads = 1, n_slots = SC_DEFAULT_NSLOTS;
+    int direct_io = 1, container = 1, file_frames = 1024, status;
+    int fits = 0, gzip = 0;
+    int n_switches = 0, use_pool = 1;
+    long long n_stream_frames = 0;
+    double clip = 0.0, dwell = 1.0, t0, elapsed, frames_per_cube;
+    int i, c;
+
+    sc_source_options_init(&source_options);
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = 1;
+        } else if (strcmp(argv[i], "--no-lut") == 0) {
+            use_lut = 0;
+        } else if (strcmp(argv[i], "--no-direct") == 0) {
+            direct_io = 0;
+        } else if (strcmp(argv[i], "--fits") == 0) {
+            fits = 1;
+        } else if (i + 1 < argc && strcmp(argv[i], "--gzip") == 0) {
+            gzip = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "--clip") == 0) {
+            clip = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--no-pool") == 0) {
+            use_pool = 0;
+        } else if (i + 1 < argc && strcmp(argv[i], "--switch") == 0) {
+            n_switches = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "--dwell") == 0) {
+            dwell = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--raw") == 0) {
+            container = 0;
+        } else if (i + 1 < argc && strcmp(argv[i], "--cubes") == 0) {
+            n_cubes = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "--integrations") == 0) {
+            n_integrations = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "--rate") == 0) {
+            source_options.frame_rate = atof(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "--buffers") == 0) {
+            source_options.n_buffers = (uint32_t) atol(argv[++i]);
+        } else if (i + 1 < argc && (strcmp(argv[i], "--replay0") == 0
+                                    || strcmp(argv[i], "--replay1") == 0)) {
+            c = argv[i][8] - '0';
+            if (n_files[c] == SC_BENCH_MAX_FILES) {
+                fprintf(stderr, "too many replay files for camera %d\n", c);
+                return EXIT_FAILURE;
+            }
+            filenames[c][n_files[c]++] = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "--replay-stream") == 0) {
+            container_file = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "--kernel") == 0) {
+            i++;
+            if (strcmp(argv[i], "scalar") == 0) {
+                kernel = SC_KERNEL_SCALAR;
+            } else if (strcmp(argv[i], "avx2") == 0) {
+                kernel = SC_KERNEL_AVX2;
+            } else if (strcmp(argv[i], "auto") != 0) {
+                sc_bench_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (i + 1 < argc && strcmp(argv[i], "--band-threads") == 0) {
+            n_band_threads = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "--slots") == 0) {
+            n_slots = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "--lut-config") == 0) {
+            lut_config = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "--stream") == 0) {
+            n_stream_frames = atoll(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "--file-frames") == 0) {
+            file_frames = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "--output") == 0) {
+            output_root = argv[++i];
+        } else {
+            sc_bench_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (n_cubes < 1 || n_integrations < 1 || n_stream_frames < 0 || n_switches < 0
+            || dwell < 0.0) {
+        sc_bench_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (use_lut) {
+        lut = (sc_lut *) malloc(sizeof(sc_lut));
+        if (lut == NULL) return EXIT_FAILURE;
+        if (lut_config != NULL) {
+            if (sc_lut_read_config(lut, lut_config) != 0) return EXIT_FAILURE;
+        } else {
+            sc_lut_identity(lut);
+        }
+    }
+
+    // a finite source, so the run ends after the requested number of cubes
+    frames_per_cube = (double) n_integrations * SC_NSTATES;
+    source_options.n_frames = (uint64_t) n_cubes * n_integrations * SC_NSTATES;
+    if (n_stream_frames > 0) source_options.n_frames = (uint64_t) n_stream_frames;
+    if (n_switches > 0) source_options.n_frames = 0;
+
+    if (container_file != NULL) {
+        if (n_files[0] > 0 || n_files[1] > 0) {
+            fprintf(stderr, "replay either .raw files or a stream container\n");
+            return EXIT_FAILURE;
+        }
+        src = sc_container_source_new(container_file, &source_options);
+    } else if (n_files[0] > 0 || n_files[1] > 0) {
+        if (n_files[0] == 0 || n_files[1] == 0) {
+            fprintf(stderr, "replay files are needed for both cameras\n");
+            return EXIT_FAILURE;
+        }
+        src = sc_replay_source_new(filenames, n_files, &source_options);
+    } else {
+        src = sc_synthetic_source_new(&source_options);
+    }
+    if (src == NULL) return EXIT_FAILURE;
+
+    if (n_stream_frames > 0) {
+        status = sc_bench_stream(src, &source_options, output_root, direct_io,
+                                 container, file_frames, &verbose);
+        sc_source_free(src);
+        free(lut);
+        return status;
+    }
+
+    kernel = sc_set_kernel(kernel);
+
+    sc_avg_options_init(&avg_options);
+    avg_options.n_integrations = n_integrations;
+    avg_options.lut = lut;
+    avg_options.n_band_threads = n_band_threads;
+    avg_options.n_slots = n_slots;
+    avg_options.direct_io = direct_io;
+    avg_options.fits = fits || gzip > 0;
+    avg_options.gzip = gzip;
+    avg_options.clip = clip;
+    avg_options.output_root = output_root;
+    avg_options.notify = sc_bench_notify;
+    avg_options.notify_data = &verbose;
+
+    if (n_switches > 0) {
+        status = sc_bench_switch(src, &source_options, &avg_options, n_switches,
+                                 dwell, use_pool, &verbose);
+        sc_source_free(src);
+        free(lut);
+        return status;
+    }
+
+    t0 = sc_time();
+    if ((avg = sc_avg_start(src, &avg_options)) == NULL) {
+        sc_source_free(src);
+        return EXIT_FAILURE;
+    }
+    sc_avg_join(avg);
+    elapsed = sc_time() - t0;
+
+    sc_avg_get_stats(avg, &stats);
+    sc_avg_free(avg);
+    sc_source_free(src);
+    free(lut);
+
+    printf("source          : %s\n",
+           container_file != NULL ? "stream container" : n_files[0] > 0 ? "replay" : "synthetic");
+    printf("kernel          : %s, %d band thread%s per camera\n",
+           use_lut ? sc_kernel_name(kernel) : "no LUT",
+           n_band_threads, n_band_threads == 1 ? "" : "s");
+    printf("buffers         : %d slot ring\n", n_slots);
+    printf("camera rate     : ");
+    if (source_options.frame_rate > 0.0) {
+        printf("%0.1f frames/sec\n", source_options.frame_rate);
+    } else {
+        printf("unpaced\n");
+    }
+    printf("cubes           : %llu written, %llu discarded, %llu write errors\n",
+           (unsigned long long) stats.n_cubes,
+           (unsigned long long) stats.n_discarded,
+           (unsigned long long) stats.n_write_errors);
+    printf("elapsed         : %0.3f secs\n", elapsed);
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        printf("camera %d        : %llu frames, %0.1f frames/sec, lagged %llu (%u max), missed %llu, overruns %llu\n",
+               c,
+               (unsigned long long) stats.n_frames[c],
+               (double) stats.n_frames[c] / elapsed,
+               (unsigned long long) stats.n_lagged[c],
+               stats.max_behind[c],
+               (unsigned long long) stats.n_missed[c],
+               (unsigned long long) stats.n_overruns[c]);
+    }
+    printf("cube rate       : %0.3f cubes/sec (%0.0f frames/camera/cube)\n",
+           (double) stats.n_cubes / elapsed, frames_per_cube);
+    if (clip > 0.0) {
+        printf("clipping        : %0.2f sigma, %llu values rejected (%0.4f%% of those co-added)\n",
+               clip, (unsigned long long) stats.n_rejected,
+               stats.n_cubes > 0
+                   ? 100.0 * (double) stats.n_rejected
+                         / ((double) stats.n_cubes * frames_per_cube * SC_NCAMERAS * SC_NPIXELS)
+                   : 0.0);
+    }
+    if (stats.n_cubes + stats.n_write_errors > 0) {
+        printf("slot held       : %0.3f secs/cube mean, %0.3f secs max\n",
+               stats.drain_time / (double) (stats.n_cubes + stats.n_write_errors),
+               stats.max_drain_time);
+        if (output_root != NULL) {
+            printf("write time      : %0.3f secs/cube mean, %0.3f secs max (%s%s)\n",
+                   stats.write_time / (double) (stats.n_cubes + stats.n_write_errors),
+                   stats.max_write_time,
+                   avg_options.fits ? "FITS, " : "",
+                   gzip > 0 ? "gzip" : direct_io ? "direct" : "buffered");
+        }
+    }
+
+    printf("latency (msecs) %10s %10s %10s %10s %10s %10s\n",
+           "count", "mean", "p50", "p90", "p99", "max");
+    sc_bench_latency("frame lag", &stats.frame_latency);
+    sc_bench_latency("co-add", &stats.coadd_latency);
+    sc_bench_latency("cube queued", &stats.queue_latency);
+    sc_bench_latency("convert", &stats.drain_latency);
+    sc_bench_latency("write", &stats.write_latency);
+
+    return stats.n_discarded == 0 && stats.n_write_errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,642 @@
+// sc_core.h   platform-neutral core of socketcam: frame sources, LUT
+//             application and co-adding, accumulation buffer ring, the
+//             average cube writer and stream mode.
+//
+//             The acquisition logic here is what socketcam.c does through
+//             GetImgAndApplyLut[01].h, threadsforavging.h,
+//             threadsforwriting.h and writeAvg16.h, but with the BitFlow
+//             board calls replaced by the sc_source interface, so it can be
+//             run against a synthetic or replayed camera on any workstation.
+
+#ifndef SC_CORE_H
+#define SC_CORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Image geometry: 2 cameras x 4 modulator (quad) states of 1024x1024 pixels.
+#define SC_XSIZE       1024
+#define SC_YSIZE       1024
+#define SC_NPIXELS     ((size_t) SC_XSIZE * SC_YSIZE)
+#define SC_NCAMERAS    2
+#define SC_NSTATES     4
+#define SC_NIMAGES     (SC_NCAMERAS * SC_NSTATES)
+#define SC_CUBE_NVALUES (SC_NIMAGES * SC_NPIXELS)
+
+// Each camera reads out through 4 ADC taps, interleaved pixel by pixel, and
+// each tap has its own 12-bit LUT, i.e., lut[8][LUTSZ] in socketcam.c.
+#define SC_NADCS       4
+#define SC_LUT_SIZE    4096
+
+// Bytes reserved at the start of an average cube file for the FITS header.
+#define SC_HEADER_SIZE (2 * 2880)
+
+// Default number of accumulation buffers in the averaging ring; socketcam.c
+// uses 2, the X and Y buffers.
+#define SC_DEFAULT_NSLOTS 4
+
+// Status codes returned by the core; the sc_source ones mirror the
+// BiCirWaitDoneFrame return values handled in GetImgAndApplyLut[01].h.
+#define SC_OK          0
+#define SC_STOPPED     1   // BI_CIR_STOPPED, or a finite source is exhausted
+#define SC_ABORTED     2   // BI_CIR_ABORTED
+#define SC_TIMEOUT     3   // BI_ERROR_CIR_WAIT_TIMEOUT
+#define SC_ERROR       (-1)
+
+const char *sc_status_name(int status);
+
+
+// ---------------------------------------------------------------------------
+// logging
+
+// Messages go to stderr and, if set, to a log file, like the pairs of
+// fprintf(stderr, ...)/fprintf(logfid, ...) calls in socketcam.c.
+void sc_set_logfile(FILE *logfid);
+void sc_log(const char *format, ...);
+
+
+// ---------------------------------------------------------------------------
+// memory and files
+
+void *sc_aligned_malloc(size_t size, size_t alignment);
+void  sc_aligned_free(void *ptr);
+
+// create a directory if it does not exist; returns 0 on success
+int   sc_mkdir(const char *dirname);
+
+// create a directory or an empty file only if it does not exist yet, to
+// claim its name; returns 0 if created, 1 if it already exists, -1 on error
+int   sc_mkdir_exclusive(const char *dirname);
+int   sc_create_exclusive(const char *filename);
+
+// A pool keeps the large buffers of the averaging and stream programs
+// allocated between programs, so the next program, of either kind, reuses
+// them instead of allocating and faulting in hundreds of MB. Buffers are
+// matched by size and aligned to SC_IO_ALIGNMENT. A NULL pool allocates and
+// frees buffers directly.
+typedef struct sc_pool sc_pool;
+
+sc_pool *sc_pool_new(void);
+
+// get a buffer of `size` bytes, zeroed if `zero` is set; new buffers are
+// always zeroed, so their pages are in memory
+void    *sc_pool_get(sc_pool *pool, size_t size, int zero);
+
+// give a buffer back; set `clean` if it is all zero, so it need not be
+// zeroed again
+void     sc_pool_put(sc_pool *pool, void *buffer, int clean);
+
+// bytes held by the pool, in use or not
+size_t   sc_pool_size(sc_pool *pool);
+
+// free a pool whose buffers have all been given back
+void     sc_pool_free(sc_pool *pool);
+
+
+// ---------------------------------------------------------------------------
+// latency histograms
+
+// Durations are binned by their nanoseconds, 4 bins per power of 2, so a
+// percentile is within about 20% and adding a sample is a few integer
+// operations, cheap enough to time every frame.
+#define SC_HIST_NBINS 176
+
+typedef struct {
+    uint64_t count;
+    double   sum;                     // secs
+    double   max;                     // secs
+    uint64_t bins[SC_HIST_NBINS];
+} sc_hist;
+
+void   sc_hist_init(sc_hist *hist);
+void   sc_hist_add(sc_hist *hist, double secs);
+void   sc_hist_merge(sc_hist *hist, const sc_hist *other);
+
+// the upper edge of the bin holding the p-th percentile, at most the
+// largest duration added, in secs; 0 if the histogram is empty
+double sc_hist_percentile(const sc_hist *hist, double p);
+
+
+// ---------------------------------------------------------------------------
+// frame sources
+
+typedef struct {
+    const uint16_t *pixels;     // SC_NPIXELS pixel values
+    uint64_t        number;     // frame number for this camera
+    uint32_t        n_behind;   // frames waiting behind this one, i.e.,
+                                // BiBufferQueueSize
+    uint32_t        n_missed;   // frames overwritten before they were read
+    double          time;       // sc_time() when the frame was complete
+} sc_frame;
+
+typedef struct sc_source sc_source;
+
+// A frame source delivers frames for each camera to one thread per camera.
+// `next` blocks until the next frame for `camera` is complete and returns
+// SC_OK, or a status saying why there is no frame. Frames must be given back
+// with `release` (BiCirStatusSet(..., BIAVAILABLE)) before the next call to
+// `next` for that camera. `stop` may be called from any thread and makes
+// pending and future `next` calls return SC_STOPPED, i.e., brdstop.h.
+// `start` restarts acquisition once no thread is in `next`, i.e.,
+// brdstrt.h, with frames numbered on from where they stopped; it may be
+// NULL for a source that can not be restarted.
+struct sc_source {
+    const char *name;
+    int  (*next)(sc_source *src, int camera, sc_frame *frame);
+    void (*release)(sc_source *src, int camera, sc_frame *frame);
+    void (*stop)(sc_source *src);
+    void (*start)(sc_source *src);
+    void (*free)(sc_source *src);
+    void *state;
+};
+
+typedef struct {
+    double   frame_rate;  // frames/sec per camera, 0 to run as fast as the
+                          // consumer reads
+    uint32_t n_buffers;   // depth of the simulated board buffer ring
+    uint64_t n_frames;    // frames per camera before SC_STOPPED, 0 for no limit
+    uint32_t seed;        // seed for synthetic noise
+} sc_source_options;
+
+void sc_source_options_init(sc_source_options *options);
+
+// synthetic camera: a fixed, modulated disk pattern plus noise
+sc_source *sc_synthetic_source_new(const sc_source_options *options);
+
+// replays raw frames, e.g., the cam0_NNNN.raw/cam1_NNNN.raw files written in
+// stream mode; each file may hold one or more concatenated frames, and the
+// frames for a camera are delivered in order, cycling through them
+sc_source *sc_replay_source_new(const char **filenames[SC_NCAMERAS],
+                                const int n_files[SC_NCAMERAS],
+                                const sc_source_options *options);
+
+// replays the frames of a closed stream container, see sc_stream_header,
+// each camera's frames in the order they were written; all the frames are
+// read into memory, as the board buffers would hold them
+sc_source *sc_container_source_new(const char *filename,
+                                   const sc_source_options *options);
+
+void sc_source_free(sc_source *src);
+
+
+// ---------------------------------------------------------------------------
+// LUTs and accumulation
+
+typedef struct {
+    uint32_t table[SC_NCAMERAS][SC_NADCS][SC_LUT_SIZE];
+    char     id[SC_NCAMERAS][64];   // e.g., "08888-20131203", as in RCAMLUT
+} sc_lut;
+
+void sc_lut_identity(sc_lut *lut);
+
+// read the 8 LUT files, in the order cam0 adc0..adc3, cam1 adc0..adc3; the
+// id of each camera's LUT is taken from its adc0 filename, i.e.,
+// Photonfocus_MV-D1024E_<serial>_adc0_<date>.bin
+int  sc_lut_read(sc_lut *lut, const char *filenames[SC_NCAMERAS * SC_NADCS]);
+
+// read the LUT filenames listed after "LUT_Names" in a kcoConfig.ini file,
+// then read the LUTs, as readConfig.h does
+int  sc_lut_read_config(sc_lut *lut, const char *config_filename);
+
+// acc[i] += lut[i % SC_NADCS][frame[i]] for n_pixels pixels, with pixel
+// values masked to 12 bits; frame must start on ADC 0 and n_pixels must be a
+// multiple of SC_NADCS. sc_lut_accumulate uses the kernel selected with
+// sc_set_kernel.
+void sc_lut_accumulate(const uint32_t lut[SC_NADCS][SC_LUT_SIZE],
+                       const uint16_t *frame,
+                       uint32_t *acc,
+                       size_t n_pixels);
+void sc_lut_accumulate_scalar(const uint32_t lut[SC_NADCS][SC_LUT_SIZE],
+                              const uint16_t *frame,
+                              uint32_t *acc,
+                              size_t n_pixels);
+
+// acc[i] += frame[i], i.e., socketcam.c without DO_LUT[01]
+void sc_accumulate(const uint16_t *frame, uint32_t *acc, size_t n_pixels);
+
+// Sigma-clipped co-adding: as sc_lut_accumulate, adding every value v to the
+// plain sum acc, but also, if (v - ref_mean[i])^2 <= ref_limit[i], counting
+// it in n_kept and adding it to the Welford running mean and sum of squared
+// deviations, mean and m2, of the values kept. A ref_limit of INFINITY keeps
+// every value. lut may be NULL to clip raw counts. sc_clip_accumulate uses
+// the kernel selected with sc_set_kernel; both give identical results.
+void sc_clip_accumulate(const uint32_t lut[SC_NADCS][SC_LUT_SIZE],
+                        const uint16_t *frame,
+                        const float *ref_mean,
+                        const float *ref_limit,
+                        float *mean,
+                        float *m2,
+                        uint16_t *n_kept,
+                        uint32_t *acc,
+                        size_t n_pixels);
+void sc_clip_accumulate_scalar(const uint32_t lut[SC_NADCS][SC_LUT_SIZE],
+                               const uint16_t *frame,
+                               const float *ref_mean,
+                               const float *ref_limit,
+                               float *mean,
+                               float *m2,
+                               uint16_t *n_kept,
+                               uint32_t *acc,
+                               size_t n_pixels);
+
+// LUT kernels
+#define SC_KERNEL_AUTO   0   // fastest kernel the CPU supports
+#define SC_KERNEL_SCALAR 1
+#define SC_KERNEL_AVX2   2   // 8-wide AVX2 gathers
+
+// select the LUT kernel, returning the kernel actually used, i.e., the
+// scalar kernel if the CPU does not support the one asked for
+int sc_set_kernel(int kernel);
+int sc_get_kernel(void);
+const char *sc_kernel_name(int kernel);
+
+// A band pool splits each frame into horizontal bands of rows and co-adds
+// them on n_threads threads, the calling thread doing the first band. With
+// n_threads <= 1 no threads are created and frames are co-added inline.
+typedef struct sc_band_pool sc_band_pool;
+
+sc_band_pool *sc_band_pool_new(int n_threads);
+
+// co-add a whole frame; lut may be NULL to sum raw counts
+void sc_band_pool_accumulate(sc_band_pool *pool,
+                             const uint32_t lut[SC_NADCS][SC_LUT_SIZE],
+                             const uint16_t *frame,
+                             uint32_t *acc);
+
+// run fn on every band of a frame, i.e., on n_pixels pixels starting at
+// pixel offset, and wait for all the bands to finish
+typedef void (*sc_band_fn)(void *arg, size_t offset, size_t n_pixels);
+
+void sc_band_pool_run(sc_band_pool *pool, sc_band_fn fn, void *arg);
+
+void sc_band_pool_free(sc_band_pool *pool);
+
+
+// ---------------------------------------------------------------------------
+// average cube writer
+
+// Convert a cube of 32-bit sums to signed 16-bit, keeping the high 16 bits:
+// (short)((v >> 16) - 0x8000), as writeAvg16.h does.
+void sc_convert_cube(const uint32_t *cube, int16_t *cube16, size_t n_values);
+
+// sc_convert_cube and zero the 32-bit cube in the same pass, i.e.,
+// writeAvg16.h and the zeroing loop of threadsforwriting.h fused, using the
+// kernel selected with sc_set_kernel; with big_endian set, the 16-bit values
+// are byte swapped for FITS
+void sc_convert_cube_zero(uint32_t *cube, int16_t *cube16, size_t n_values,
+                          int big_endian);
+
+// Names only have a resolution of a second, so a name already used by an
+// earlier file gets a sequence number, e.g., YYYYMMDD_hhmmss_1_kcor.fts, up
+// to this many per second.
+#define SC_MAX_SEQUENCE 1000
+
+// Name of the average cube file for a cube started at `timestamp`:
+// root/YYYYMMDD/avg/YYYYMMDD_hhmmss_kcor<suffix>, e.g., ".bin", ".fts.gz"
+// or "_rejected.fts", where the directory uses local time and the basename
+// uses UT. The directories are created, and the file is created empty to
+// claim the name. If `*sequence` is negative, it is set to the first sequence
+// number whose name was free, 0 for none; otherwise that sequence number is
+// used, e.g., so the rejected map of a cube has the same name as the cube.
+// If `root` is NULL, only the basename is returned and nothing is created.
+int sc_cube_filename(char *filename, size_t size,
+                     const char *root, time_t timestamp,
+                     const char *suffix, int *sequence);
+
+// What socketcam knows about a cube for its FITS header; NULL strings are
+// left out of the header.
+typedef struct {
+    time_t      date_obs;      // when the first frame was co-added
+    time_t      date_end;      // when the cube was complete
+    int         numsum;        // frames summed per modulator state
+    int         start_state;   // StartingQuadState of "avging start"
+    const char *camera_id[SC_NCAMERAS];   // RCAMID, TCAMID
+    const char *lut_id[SC_NCAMERAS];      // RCAMLUT, TCAMLUT
+    double      clip;          // CLIPSIG, 0 if the cube was not clipped
+    int         rejected;      // the data are a rejected frame count map
+} sc_fits_info;
+
+// Fill the SC_HEADER_SIZE bytes before the cube with a FITS primary header
+// for the unsigned 16-bit 1024 x 1024 x 4 x 2 cube, so the file is a level 0
+// FITS file as it is written. As in the existing level 0 files, the data are
+// not padded to a multiple of 2880 bytes.
+void sc_fits_header(char header[SC_HEADER_SIZE], const sc_fits_info *info);
+
+// Name of the stream container for a stream started at `timestamp`:
+// root/YYYYMMDD/YYYYMMDD_hhmmss_kcor_stream.bin, in UT. The directories are
+// created, and the container is created empty, with a sequence number if an
+// earlier stream started in the same second.
+int sc_stream_filename(char *filename, size_t size,
+                       const char *root, time_t timestamp);
+
+// Start of the .raw stream file names for a stream started at `timestamp`:
+// root/YYYYMMDD/hhmmssraw/YYYYMMDD_hhmmss, all in UT as in writeoutstrm.h,
+// to which "cam0_NNNN.raw" etc. is appended. The directories are created; if
+// an earlier stream started in the same second, both the directory and the
+// basename get a sequence number, i.e., hhmmss_1raw/YYYYMMDD_hhmmss_1.
+int sc_stream_basename(char *basename, size_t size,
+                       const char *root, time_t timestamp);
+
+// write SC_HEADER_SIZE bytes of header space followed by the 16-bit cube
+int sc_write_cube(const char *filename, const int16_t *cube16, size_t n_values);
+
+// Asynchronous writer: a few aligned buffers and an I/O thread writing them
+// unbuffered, so the caller only waits for a write when every buffer is in
+// flight.
+#define SC_WRITE_DIRECT 1      // O_DIRECT or FILE_FLAG_NO_BUFFERING
+#define SC_WRITE_APPEND 2      // append each buffer to the file it names
+#define SC_WRITE_GZIP   4      // gzip each buffer, with zlib
+#define SC_WRITE_GZIP_LEVEL(level) ((level) << 8)   // default level 1
+#define SC_IO_ALIGNMENT 4096   // buffer alignment and unbuffered write size
+
+// called on the I/O thread when a write finishes; status is 0 on success
+typedef void (*sc_write_done_fn)(const char *filename, const char *tag,
+                                 int status, double write_time, void *data);
+
+typedef struct sc_writer sc_writer;
+
+// buffers hold buffer_size bytes, rounded up to SC_IO_ALIGNMENT, and are
+// taken from `pool`, which may be NULL; their contents are undefined
+sc_writer *sc_writer_new(int n_buffers, size_t buffer_size, int flags,
+                         sc_write_done_fn done, void *done_data,
+                         sc_pool *pool);
+
+// get a free buffer, waiting for a write to finish if none is free
+void *sc_writer_acquire(sc_writer *writer);
+
+// get a free buffer, or NULL if every buffer is in flight
+void *sc_writer_try_acquire(sc_writer *writer);
+
+// give back an acquired buffer without writing it
+void sc_writer_release(sc_writer *writer, void *buffer);
+
+// queue the first `size` bytes of an acquired buffer to be written to
+// filename; the buffer is reused once written, and `tag` is passed to done.
+// With SC_WRITE_APPEND, successive buffers for the same filename are
+// appended to it, and all but the last must be a multiple of
+// SC_IO_ALIGNMENT bytes.
+void sc_writer_submit(sc_writer *writer, void *buffer, size_t size,
+                      const char *filename, const char *tag);
+
+// write any queued buffers, close the file being appended to, then free the
+// writer
+void sc_writer_free(sc_writer *writer);
+
+
+// ---------------------------------------------------------------------------
+// averaging program
+
+// called with the "img <file> lagged<X|Y> <n0> <n1> overrun <o0> <o1>"
+// message for each cube, i.e., SendSignals in socketcam.c, where the overrun
+// counts are the number of times each camera has found the ring full
+typedef void (*sc_notify_fn)(const char *message, void *data);
+
+// With clip set, each pixel of a cube only co-adds the frames within clip
+// sigma of its mean in the previous cube of that camera and state, where
+// sigma is the standard deviation of the frames kept then (plus one count, so
+// a constant pixel is not clipped on noise), and the cube holds the mean of
+// the frames kept times n_integrations. A pixel keeping fewer than
+// clip_min_kept of its frames, e.g., where the sky changed, gets the plain
+// sum instead and is not clipped in the next cube; nor is anything in the
+// first cube. Each cube is followed by a map of the number of frames
+// rejected per pixel, in the same layout, as YYYYMMDD_hhmmss_kcor_rejected.*.
+// Clipping limits n_integrations to 65535.
+
+typedef struct {
+    int           n_integrations;  // frames to sum per modulator state
+    const sc_lut *lut;             // NULL to sum raw counts
+    int           n_band_threads;  // threads co-adding each camera's frames
+    int           n_slots;         // accumulation buffers in the ring, >= 2
+    int           n_write_buffers; // cubes that may be queued for writing
+    int           direct_io;       // write cubes bypassing the page cache
+    int           fits;            // write _kcor.fts files, not _kcor.bin
+    int           gzip;            // gzip level for FITS files, 0 for none
+    int           start_state;     // StartingQuadState, for the header
+    double        clip;            // rejection threshold in sigma, 0 for none
+    double        clip_min_kept;   // fraction of frames to keep to clip
+    const char   *camera_id[SC_NCAMERAS];  // for the header, may be NULL
+    const char   *output_root;     // e.g. "e:", NULL to not write files
+    sc_pool      *pool;            // buffers to use, NULL to allocate them
+    sc_notify_fn  notify;
+    void         *notify_data;
+} sc_avg_options;
+
+typedef struct {
+    uint64_t n_cubes;                   // cubes completed and written
+    uint64_t n_discarded;               // cubes dropped after a source error
+    uint64_t n_write_errors;
+    uint64_t n_frames[SC_NCAMERAS];     // frames accumulated
+    uint64_t n_lagged[SC_NCAMERAS];     // sum of queue depths, i.e., BuffQSz
+    uint64_t n_missed[SC_NCAMERAS];     // frames overwritten in the source
+    uint64_t n_overruns[SC_NCAMERAS];   // times the ring was full
+    uint32_t max_behind[SC_NCAMERAS];   // deepest queue seen
+    uint64_t n_rejected;                // pixel values rejected by clipping
+    double   drain_time;                // secs a slot is held converting
+    double   max_drain_time;
+    double   write_time;                // secs spent writing on the I/O thread
+    double   max_write_time;
+
+    // per stage latencies, for both cameras
+    sc_hist  frame_latency;   // frame complete to co-added, i.e., lag
+    sc_hist  coadd_latency;   // co-adding a frame
+    sc_hist  queue_latency;   // cube complete to the writer taking it
+    sc_hist  drain_latency;   // converting a cube, i.e., drain_time
+    sc_hist  write_latency;   // writing a file on the I/O thread
+} sc_avg_stats;
+
+typedef struct sc_avg sc_avg;
+
+void sc_avg_options_init(sc_avg_options *options);
+
+// start the two camera threads and the writer thread
+sc_avg *sc_avg_start(sc_source *src, const sc_avg_options *options);
+
+// ask the camera threads to stop by stopping the source
+void sc_avg_stop(sc_avg *avg);
+
+// ask the camera threads to stop once the cube they are co-adding is
+// complete, i.e., KeepRunningCam=FALSE; the source is not stopped
+void sc_avg_finish(sc_avg *avg);
+
+// whether both camera threads have exited, e.g., after a source error
+int  sc_avg_done(sc_avg *avg);
+
+// get and give back the buffers an averaging program with these options
+// uses, so they are in the pool before it starts
+int  sc_avg_reserve(sc_pool *pool, const sc_avg_options *options);
+
+// wait for the camera threads to finish, i.e., after sc_avg_stop or when a
+// finite source is exhausted, and for the writers to drain
+void sc_avg_join(sc_avg *avg);
+
+void sc_avg_get_stats(sc_avg *avg, sc_avg_stats *stats);
+
+// free an averaging program that has been joined
+void sc_avg_free(sc_avg *avg);
+
+
+// ---------------------------------------------------------------------------
+// stream mode
+
+// Stream mode writes every frame to disk while acquiring, instead of holding
+// them in the board buffers until "stream stop" as threadsforstream.h and
+// writeoutstrm.h do. Each camera copies its frames into a few large write
+// buffers, which are appended to its .raw files by its own I/O thread, so
+// memory is bounded by n_buffers * buffer_frames frames per camera and a
+// capture can be as long as the disk allows.
+//
+// By default a capture is one indexed container file for both cameras,
+// root/YYYYMMDD/YYYYMMDD_hhmmss_kcor_stream.bin, laid out as:
+//
+//   sc_stream_header, zero padded to SC_STREAM_HEADER_SIZE bytes
+//   n_frames frames of SC_NPIXELS uint16 pixels, in the order written
+//   n_frames sc_stream_index_entry, one per frame, in the same order
+//
+// All values are little-endian. The header is rewritten with n_frames and
+// index_offset when the capture is closed; index_offset is 0 in a capture
+// that was not closed. Frame i starts at data_offset + i * frame_size, so
+// readers can memory map the frames.
+
+#define SC_STREAM_MAGIC       "KCORSTRM"
+#define SC_STREAM_VERSION     1
+#define SC_STREAM_HEADER_SIZE 4096
+
+typedef struct {
+    char     magic[8];         // SC_STREAM_MAGIC, not NUL terminated
+    uint32_t version;
+    uint32_t header_size;      // SC_STREAM_HEADER_SIZE
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes_per_pixel;
+    uint32_t n_cameras;
+    uint32_t n_states;
+    uint32_t reserved;
+    int64_t  start_time;       // microsecs since 1970-01-01 00:00:00 UT
+    uint64_t n_frames;
+    uint64_t data_offset;      // offset of the first frame
+    uint64_t frame_size;       // bytes per frame
+    uint64_t index_offset;     // offset of the index, 0 if not closed
+} sc_stream_header;
+
+typedef struct {
+    int64_t  time;             // microsecs since start_time
+    uint64_t number;           // frame number for the camera
+    uint8_t  camera;
+    uint8_t  state;            // modulator state, i.e., number % SC_NSTATES
+    uint16_t flags;
+    uint32_t n_behind;         // sc_frame n_behind and n_missed
+    uint32_t n_missed;
+    uint32_t reserved;
+} sc_stream_index_entry;
+
+typedef struct {
+    int           buffer_frames;   // frames per write
+    int           n_buffers;       // write buffers per camera
+    int           container;       // write an indexed container, not .raw
+    int           file_frames;     // frames per .raw file, 0 for one file
+    int           direct_io;       // write bypassing the page cache
+    const char   *output_root;     // e.g. "e:", NULL to not write files
+    sc_pool      *pool;            // buffers to use, NULL to allocate them
+    sc_notify_fn  notify;          // gets "write stream done <n0> <n1>"
+    void         *notify_data;
+} sc_stream_options;
+
+typedef struct {
+    uint64_t n_files;
+    uint64_t n_write_errors;
+    uint64_t n_frames[SC_NCAMERAS];     // frames acquired
+    uint64_t n_written[SC_NCAMERAS];    // frames written to disk
+    uint64_t n_lagged[SC_NCAMERAS];     // sum of queue depths, i.e., BuffQSz
+    uint64_t n_missed[SC_NCAMERAS];     // frames overwritten in the source
+    uint64_t n_overruns[SC_NCAMERAS];   // times every write buffer was busy
+    double   write_time;                // secs spent writing on the I/O threads
+    double   max_write_time;
+} sc_stream_stats;
+
+typedef struct sc_stream sc_stream;
+
+void sc_stream_options_init(sc_stream_options *options);
+
+// start the two camera threads and their I/O threads; the stream files are
+// named after the start time
+sc_stream *sc_stream_start(sc_source *src, const sc_stream_options *options);
+
+// ask the camera threads to stop by stopping the source
+void sc_stream_stop(sc_stream *stream);
+
+// whether both camera threads have exited, e.g., after a source error
+int  sc_stream_done(sc_stream *stream);
+
+// get and give back the buffers a stream with these options uses, so they
+// are in the pool before it starts
+int  sc_stream_reserve(sc_pool *pool, const sc_stream_options *options);
+
+// wait for the camera threads to finish and the last buffers to be written,
+// then send the "write stream done" message
+void sc_stream_join(sc_stream *stream);
+
+void sc_stream_get_stats(sc_stream *stream, sc_stream_stats *stats);
+
+// free a stream that has been joined
+void sc_stream_free(sc_stream *stream);
+
+
+// ---------------------------------------------------------------------------
+// program switching
+
+// A session is the program logic of parselogic.h over a source that stays
+// open: the boards are opened once with enough buffers for either program
+// and are only stopped and restarted between programs, and the buffers of
+// both programs come from one pool, so a program change takes milliseconds
+// instead of closing and reopening the boards.
+
+#define SC_PROGRAM_NONE   0   // P_NONE
+#define SC_PROGRAM_STREAM 1   // P_STREAM
+#define SC_PROGRAM_AVGING 2   // P_AVGING
+
+#define SC_SESSION_START  0   // P_RUNNING
+#define SC_SESSION_STOP   1   // P_STOPPED
+#define SC_SESSION_GENTLE 2   // P_GENTLESTOP
+
+typedef struct {
+    sc_avg_options    avg;         // "avging start" sets n_integrations and
+                                   // start_state
+    sc_stream_options stream;
+    int               preallocate; // fill the pool for both programs up front
+    sc_notify_fn      notify;      // gets "cam ready <stream|avging>"
+    void             *notify_data;
+} sc_session_options;
+
+typedef struct sc_session sc_session;
+
+void sc_session_options_init(sc_session_options *options);
+
+// the session uses, but does not own, the source; the avg and stream pool
+// options are replaced by the session's pool
+sc_session *sc_session_new(sc_source *src, const sc_session_options *options);
+
+// run a command from the client, as parselogic.h does, e.g., "stream start",
+// "avging start 512 0", "avging stop", "avging gentle" or "quit"; returns
+// SC_OK or SC_ERROR
+int  sc_session_command(sc_session *session, const char *command);
+
+// load `program` and start, stop or gently stop it
+int  sc_session_switch(sc_session *session, int program, int action,
+                       int n_integrations, int start_state);
+
+// Reap a program whose threads have stopped on their own, e.g., after a
+// board error, leaving the boards open; socketcam.c closes them from
+// RestartThread. Returns 1 if a program was reaped.
+int  sc_session_poll(sc_session *session);
+
+// current program and whether it is running
+int  sc_session_program(sc_session *session, int *running);
+
+sc_pool *sc_session_pool(sc_session *session);
+
+// stop any program and free the session, but not the source
+void sc_session_free(sc_session *session);
+
+#endif
@@ -0,0 +1,120 @@
+// sc_fits.c   FITS primary header for average cubes.
+//
+// socketcam.c leaves the first 2 x 2880 bytes of each _kcor.bin file blank
+// and the header is filled in, and the data byte swapped, later. Here the
+// header is written in place, so the cube is a FITS file as it is written.
+// The header always takes the full SC_HEADER_SIZE bytes: blank cards pad it
+// before the END card, so the data start where they always have.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "sc_core.h"
+
+#define SC_FITS_CARD   80
+#define SC_FITS_NCARDS (SC_HEADER_SIZE / SC_FITS_CARD)
+
+typedef struct {
+    char *header;
+    int   n_cards;
+} sc_fits_cards;
+
+// add a card, padded with blanks to 80 characters
+static void sc_fits_card(sc_fits_cards *cards, const char *format, ...) {
+    char card[SC_FITS_CARD + 1];
+    va_list args;
+    size_t len;
+
+    if (cards->n_cards >= SC_FITS_NCARDS - 1) return;   // room for END
+
+    va_start(args, format);
+    vsnprintf(card, sizeof(card), format, args);
+    va_end(args);
+
+    len = strlen(card);
+    memset(card + len, ' ', SC_FITS_CARD - len);
+    memcpy(cards->header + (size_t) cards->n_cards * SC_FITS_CARD, card, SC_FITS_CARD);
+    cards->n_cards++;
+}
+
+static void sc_fits_int(sc_fits_cards *cards, const char *keyword,
+                        long value, const char *comment) {
+    sc_fits_card(cards, "%-8.8s= %20ld / %s", keyword, value, comment);
+}
+
+static void sc_fits_string(sc_fits_cards *cards, const char *keyword,
+                           const char *value, const char *comment) {
+    char quoted[69];
+
+    // string values are quoted and at least 8 characters long
+    snprintf(quoted, sizeof(quoted), "'%-8.60s'", value);
+    sc_fits_card(cards, "%-8.8s= %-20s / %s", keyword, quoted, comment);
+}
+
+static void sc_fits_date(sc_fits_cards *cards, const char *keyword,
+                         time_t t, const char *comment) {
+    struct tm TS = *gmtime(&t);
+    char value[64];
+
+    snprintf(value, sizeof(value), "%4d-%02d-%02dT%02d:%02d:%02d",
+             TS.tm_year + 1900, TS.tm_mon + 1, TS.tm_mday,
+             TS.tm_hour, TS.tm_min, TS.tm_sec);
+    sc_fits_string(cards, keyword, value, comment);
+}
+
+void sc_fits_header(char header[SC_HEADER_SIZE], const sc_fits_info *info) {
+    static const char *camera_keywords[SC_NCAMERAS] = { "RCAMID", "TCAMID" };
+    static const char *lut_keywords[SC_NCAMERAS] = { "RCAMLUT", "TCAMLUT" };
+    static const char *camera_comments[SC_NCAMERAS] = {
+        "camera 0 (reflected) ID", "camera 1 (transmitted) ID"
+    };
+    static const char *lut_comments[SC_NCAMERAS] = {
+        "camera 0 (reflected) LUT", "camera 1 (transmitted) LUT"
+    };
+    sc_fits_cards cards;
+    int c;
+
+    memset(header, ' ', SC_HEADER_SIZE);
+    cards.header = header;
+    cards.n_cards = 0;
+
+    sc_fits_card(&cards, "%-8s= %20s / %s", "SIMPLE", "T", "file does conform to FITS standard");
+    sc_fits_int(&cards, "BITPIX", 16, "number of bits per data pixel");
+    sc_fits_int(&cards, "NAXIS", 4, "number of data axes");
+    sc_fits_int(&cards, "NAXIS1", SC_XSIZE, "[pixels] width");
+    sc_fits_int(&cards, "NAXIS2", SC_YSIZE, "[pixels] height");
+    sc_fits_int(&cards, "NAXIS3", SC_NSTATES, "modulator states");
+    sc_fits_int(&cards, "NAXIS4", SC_NCAMERAS, "cameras");
+    sc_fits_int(&cards, "BZERO", 32768, "data are unsigned 16-bit integers");
+    sc_fits_int(&cards, "BSCALE", 1, "data scaling factor");
+
+    sc_fits_date(&cards, "DATE-OBS", info->date_obs, "[UT] date/time when obs started");
+    sc_fits_date(&cards, "DATE-END", info->date_end, "[UT] date/time when obs ended");
+    sc_fits_int(&cards, "NUMSUM", info->numsum, "number of frames summed per state");
+    sc_fits_int(&cards, "QUADSTRT", info->start_state, "starting modulator (quad) state");
+
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        if (info->camera_id[c] != NULL && info->camera_id[c][0] != '\0') {
+            sc_fits_string(&cards, camera_keywords[c], info->camera_id[c], camera_comments[c]);
+        }
+    }
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        if (info->lut_id[c] != NULL && info->lut_id[c][0] != '\0') {
+            sc_fits_string(&cards, lut_keywords[c], info->lut_id[c], lut_comments[c]);
+        }
+    }
+
+    if (info->clip > 0.0) {
+        sc_fits_card(&cards, "%-8.8s= %20.3f / %s", "CLIPSIG", info->clip,
+                     "[sigma] frames rejected beyond this from mean");
+    }
+    if (info->rejected) {
+        sc_fits_card(&cards, "%-8.8s= %20s / %s", "REJMAP", "T",
+                     "data are frames rejected per pixel, not sums");
+    }
+
+    // blank cards up to the END card, which ends the last header block
+    memcpy(header + SC_HEADER_SIZE - SC_FITS_CARD, "END", 3);
+}
@@ -0,0 +1,460 @@
+// sc_kernel.c   vectorized LUT-apply-and-accumulate, clipping and cube
+//               conversion kernels, and the band pool that runs them on
+//               several threads per camera.
+//
+// The LUT values are up to 23 bits wide, so they can not be narrowed to a
+// 16-bit table; the AVX2 kernel instead gathers 8 32-bit LUT values at a
+// time. The 4 ADC tables of a camera are contiguous, so one gather serves
+// all 4 interleaved ADCs by adding adc * SC_LUT_SIZE to each pixel value.
+
+#include <stdlib.h>
+
+#include "sc_core.h"
+#include "sc_thread.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SC_HAVE_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SC_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SC_TARGET_AVX2
+#endif
+
+typedef void (*sc_lut_kernel)(const uint32_t lut[SC_NADCS][SC_LUT_SIZE],
+                              const uint16_t *frame,
+                              uint32_t *acc,
+                              size_t n_pixels);
+
+typedef void (*sc_clip_kernel)(const uint32_t lut[SC_NADCS][SC_LUT_SIZE],
+                               const uint16_t *frame,
+                               const float *ref_mean,
+                               const float *ref_limit,
+                               float *mean,
+                               float *m2,
+                               uint16_t *n_kept,
+                               uint32_t *acc,
+                               size_t n_pixels);
+
+typedef void (*sc_convert_kernel)(uint32_t *cube, int16_t *cube16, size_t n_values,
+                                  int big_endian);
+
+
+// ---------------------------------------------------------------------------
+// scalar conversion kernel
+
+static void sc_convert_cube_zero_scalar(uint32_t *cube, int16_t *cube16, size_t n_values,
+                                        int big_endian) {
+    uint16_t v;
+    size_t i;
+
+    if (!big_endian) {
+        for (i = 0; i < n_values; i++) {
+            cube16[i] = (int16_t) ((cube[i] >> 16) - 0x8000);
+            cube[i] = 0;
+        }
+        return;
+    }
+
+    // FITS data are big-endian; the cores are little-endian
+    for (i = 0; i < n_values; i++) {
+        v = (uint16_t) ((cube[i] >> 16) - 0x8000);
+        cube16[i] = (int16_t) (uint16_t) ((v << 8) | (v >> 8));
+        cube[i] = 0;
+    }
+}
+
+
+// ---------------------------------------------------------------------------
+// AVX2 kernels
+
+#ifdef SC_HAVE_X86
+
+SC_TARGET_AVX2
+static void sc_lut_accumulate_avx2(const uint32_t lut[SC_NADCS][SC_LUT_SIZE],
+                                   const uint16_t *frame,
+                                   uint32_t *acc,
+                                   size_t n_pixels) {
+    const int *base = (const int *) lut[0];
+    const __m256i mask = _mm256_set1_epi32(SC_LUT_SIZE - 1);
+    const __m256i offsets = _mm256_setr_epi32(0, SC_LUT_SIZE, 2 * SC_LUT_SIZE, 3 * SC_LUT_SIZE,
+                                              0, SC_LUT_SIZE, 2 * SC_LUT_SIZE, 3 * SC_LUT_SIZE);
+    __m256i pixels, lo, hi, a0, a1;
+    size_t i;
+
+    for (i = 0; i + 16 <= n_pixels; i += 16) {
+        pixels = _mm256_loadu_si256((const __m256i *) (frame + i));
+
+        // widen 16 pixels to two vectors of 8 32-bit table indices
+        lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(pixels));
+        hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(pixels, 1));
+        lo = _mm256_add_epi32(_mm256_and_si256(lo, mask), offsets);
+        hi = _mm256_add_epi32(_mm256_and_si256(hi, mask), offsets);
+
+        a0 = _mm256_loadu_si256((const __m256i *) (acc + i));
+        a1 = _mm256_loadu_si256((const __m256i *) (acc + i + 8));
+        a0 = _mm256_add_epi32(a0, _mm256_i32gather_epi32(base, lo, 4));
+        a1 = _mm256_add_epi32(a1, _mm256_i32gather_epi32(base, hi, 4));
+        _mm256_storeu_si256((__m256i *) (acc + i), a0);
+        _mm256_storeu_si256((__m256i *) (acc + i + 8), a1);
+    }
+
+    // i is a multiple of 16, so the remainder still starts on ADC 0
+    if (i < n_pixels) sc_lut_accumulate_scalar(lut, frame + i, acc + i, n_pixels - i);
+}
+
+// Clip 8 pixels at a time. Every value gets the same float operations as in
+// the scalar kernel, with the Welford update computed for all 8 and blended
+// in only where the value is kept, so the results are identical.
+SC_TARGET_AVX2
+static void sc_clip_accumulate_avx2(const uint32_t lut[SC_NADCS][SC_LUT_SIZE],
+                                    const uint16_t *frame,
+                                    const float *ref_mean,
+                                    const float *ref_limit,
+                                    float *mean,
+                                    float *m2,
+                                    uint16_t *n_kept,
+                                    uint32_t *acc,
+                                    size_t n_pixels) {
+    const int *base = (const int *) lut[0];
+    const __m256i mask = _mm256_set1_epi32(SC_LUT_SIZE - 1);
+    const __m256i offsets = _mm256_setr_epi32(0, SC_LUT_SIZE, 2 * SC_LUT_SIZE, 3 * SC_LUT_SIZE,
+                                              0, SC_LUT_SIZE, 2 * SC_LUT_SIZE, 3 * SC_LUT_SIZE);
+    __m256i v, n, keep;
+    __m256 x, d, mu, delta, s2;
+    size_t i;
+
+    if (lut == NULL) {
+        sc_clip_accumulate_scalar(lut, frame, ref_mean, ref_limit, mean, m2, n_kept, acc,
+                                  n_pixels);
+        return;
+    }
+
+    for (i = 0; i + 8 <= n_pixels; i += 8) {
+        v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (frame + i)));
+        v = _mm256_add_epi32(_mm256_and_si256(v, mask), offsets);
+        v = _mm256_i32gather_epi32(base, v, 4);
+        _mm256_storeu_si256((__m256i *) (acc + i),
+                            _mm256_add_epi32(_mm256_loadu_si256((const __m256i *) (acc + i)), v));
+
+        x = _mm256_cvtepi32_ps(v);
+        d = _mm256_sub_ps(x, _mm256_loadu_ps(ref_mean + i));
+        keep = _mm256_castps_si256(_mm256_cmp_ps(_mm256_mul_ps(d, d),
+                                                 _mm256_loadu_ps(ref_limit + i),
+                                                 _CMP_LE_OQ));
+
+        // kept lanes are all ones, i.e., -1
+        n = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (n_kept + i)));
+        n = _mm256_sub_epi32(n, keep);
+        _mm_storeu_si128((__m128i *) (n_kept + i),
+                         _mm_packus_epi32(_mm256_castsi256_si128(n),
+                                          _mm256_extracti128_si256(n, 1)));
+
+        mu = _mm256_loadu_ps(mean + i);
+        delta = _mm256_sub_ps(x, mu);
+        mu = _mm256_blendv_ps(mu, _mm256_add_ps(mu, _mm256_div_ps(delta, _mm256_cvtepi32_ps(n))),
+                              _mm256_castsi256_ps(keep));
+        _mm256_storeu_ps(mean + i, mu);
+
+        s2 = _mm256_loadu_ps(m2 + i);
+        s2 = _mm256_blendv_ps(s2, _mm256_add_ps(s2, _mm256_mul_ps(delta, _mm256_sub_ps(x, mu))),
+                              _mm256_castsi256_ps(keep));
+        _mm256_storeu_ps(m2 + i, s2);
+    }
+
+    // i is a multiple of 8, so the remainder still starts on ADC 0
+    if (i < n_pixels) {
+        sc_clip_accumulate_scalar(lut, frame + i, ref_mean + i, ref_limit + i,
+                                  mean + i, m2 + i, n_kept + i, acc + i, n_pixels - i);
+    }
+}
+
+// Convert 16 values at a time: after the shift and subtracting 0x8000 the
+// values fit in 16 bits, so the saturating pack is exact. The zeroes are
+// written with non-temporal stores, since the cube is not read again until
+// the cameras start co-adding into it.
+SC_TARGET_AVX2
+static void sc_convert_cube_zero_avx2(uint32_t *cube, int16_t *cube16, size_t n_values,
+                                      int big_endian) {
+    const __m256i bias = _mm256_set1_epi32(0x8000);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i swap = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                          1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    __m256i a, b;
+    size_t i = 0, head = 0;
+
+    // scalar until the cube is 32-byte aligned for the streaming stores
+    while (head < n_values && ((uintptr_t) (cube + head) & 31) != 0) head++;
+    if (head > 0) sc_convert_cube_zero_scalar(cube, cube16, head, big_endian);
+    i = head;
+
+    for (; i + 16 <= n_values; i += 16) {
+        a = _mm256_load_si256((const __m256i *) (cube + i));
+        b = _mm256_load_si256((const __m256i *) (cube + i + 8));
+        a = _mm256_sub_epi32(_mm256_srli_epi32(a, 16), bias);
+        b = _mm256_sub_epi32(_mm256_srli_epi32(b, 16), bias);
+
+        // packs works within 128-bit lanes, so put the quadwords back in order
+        a = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        if (big_endian) a = _mm256_shuffle_epi8(a, swap);
+        _mm256_storeu_si256((__m256i *) (cube16 + i), a);
+
+        _mm256_stream_si256((__m256i *) (cube + i), zero);
+        _mm256_stream_si256((__m256i *) (cube + i + 8), zero);
+    }
+    _mm_sfence();
+
+    if (i < n_values) sc_convert_cube_zero_scalar(cube + i, cube16 + i, n_values - i, big_endian);
+}
+
+static int sc_cpu_has_avx2(void) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#elif defined(_MSC_VER)
+    int info[4];
+
+    __cpuid(info, 0);
+    if (info[0] < 7) return 0;
+
+    // the OS must save the AVX registers: OSXSAVE and AVX, then XCR0
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) return 0;
+    if ((_xgetbv(0) & 6) != 6) return 0;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return 0;
+#endif
+}
+
+#else
+
+static int sc_cpu_has_avx2(void) {
+    return 0;
+}
+
+#endif
+
+
+// ---------------------------------------------------------------------------
+// kernel selection
+
+static int sc_kernel = SC_KERNEL_AUTO;
+static sc_lut_kernel sc_kernel_fn = NULL;
+static sc_clip_kernel sc_clip_fn = NULL;
+static sc_convert_kernel sc_convert_fn = NULL;
+
+int sc_set_kernel(int kernel) {
+    if (kernel == SC_KERNEL_AUTO || kernel == SC_KERNEL_AVX2) {
+        kernel = sc_cpu_has_avx2() ? SC_KERNEL_AVX2 : SC_KERNEL_SCALAR;
+    }
+
+#ifdef SC_HAVE_X86
+    if (kernel == SC_KERNEL_AVX2) {
+        sc_kernel_fn = sc_lut_accumulate_avx2;
+        sc_clip_fn = sc_clip_accumulate_avx2;
+        sc_convert_fn = sc_convert_cube_zero_avx2;
+        sc_kernel = SC_KERNEL_AVX2;
+        return sc_kernel;
+    }
+#endif
+
+    sc_kernel_fn = sc_lut_accumulate_scalar;
+    sc_clip_fn = sc_clip_accumulate_scalar;
+    sc_convert_fn = sc_convert_cube_zero_scalar;
+    sc_kernel = SC_KERNEL_SCALAR;
+    return sc_kernel;
+}
+
+int sc_get_kernel(void) {
+    if (sc_kernel_fn == NULL) sc_set_kernel(SC_KERNEL_AUTO);
+    return sc_kernel;
+}
+
+const char *sc_kernel_name(int kernel) {
+    switch (kernel) {
+        case SC_KERNEL_AUTO:   return "auto";
+        case SC_KERNEL_SCALAR: return "scalar";
+        case SC_KERNEL_AVX2:   return "avx2";
+        default:               return "unknown";
+    }
+}
+
+void sc_lut_accumulate(const uint32_t lut[SC_NADCS][SC_LUT_SIZE],
+                       const uint16_t *frame,
+                       uint32_t *acc,
+                       size_t n_pixels) {
+    if (sc_kernel_fn == NULL) sc_set_kernel(SC_KERNEL_AUTO);
+    sc_kernel_fn(lut, frame, acc, n_pixels);
+}
+
+void sc_clip_accumulate(const uint32_t lut[SC_NADCS][SC_LUT_SIZE],
+                        const uint16_t *frame,
+                        const float *ref_mean,
+                        const float *ref_limit,
+                        float *mean,
+                        float *m2,
+                        uint16_t *n_kept,
+                        uint32_t *acc,
+                        size_t n_pixels) {
+    if (sc_clip_fn == NULL) sc_set_kernel(SC_KERNEL_AUTO);
+    sc_clip_fn(lut, frame, ref_mean, ref_limit, mean, m2, n_kept, acc, n_pixels);
+}
+
+void sc_convert_cube_zero(uint32_t *cube, int16_t *cube16, size_t n_values,
+                          int big_endian) {
+    if (sc_convert_fn == NULL) sc_set_kernel(SC_KERNEL_AUTO);
+    sc_convert_fn(cube, cube16, n_values, big_endian);
+}
+
+
+// ---------------------------------------------------------------------------
+// band pool
+
+typedef struct {
+    sc_band_pool *pool;
+    int           index;
+    sc_thread     thread;
+    sc_sem        start;
+} sc_band_worker;
+
+struct sc_band_pool {
+    int             n_threads;
+    int             n_workers;    // started worker threads, band 1 and up
+    sc_band_worker *workers;
+    sc_sem          done;
+    volatile int    quit;
+
+    // current job
+    sc_band_fn      fn;
+    void           *arg;
+};
+
+typedef struct {
+    const uint32_t (*lut)[SC_LUT_SIZE];
+    const uint16_t *frame;
+    uint32_t       *acc;
+} sc_band_accumulate_arg;
+
+static void sc_band_run(sc_band_pool *pool, int band) {
+    size_t y0 = (size_t) band * SC_YSIZE / pool->n_threads;
+    size_t y1 = (size_t) (band + 1) * SC_YSIZE / pool->n_threads;
+
+    pool->fn(pool->arg, y0 * SC_XSIZE, (y1 - y0) * SC_XSIZE);
+}
+
+static void sc_band_accumulate(void *arg, size_t offset, size_t n_pixels) {
+    sc_band_accumulate_arg *a = (sc_band_accumulate_arg *) arg;
+
+    if (a->lut != NULL) {
+        sc_lut_accumulate(a->lut, a->frame + offset, a->acc + offset, n_pixels);
+    } else {
+        sc_accumulate(a->frame + offset, a->acc + offset, n_pixels);
+    }
+}
+
+static SC_THREAD_RETURN sc_band_worker_thread(void *arg) {
+    sc_band_worker *worker = (sc_band_worker *) arg;
+    sc_band_pool *pool = worker->pool;
+
+    for (;;) {
+        sc_sem_wait(&worker->start);
+        if (pool->quit) break;
+        sc_band_run(pool, worker->index);
+        sc_sem_post(&pool->done);
+    }
+
+    return SC_THREAD_RESULT;
+}
+
+sc_band_pool *sc_band_pool_new(int n_threads) {
+    sc_band_pool *pool = (sc_band_pool *) calloc(1, sizeof(sc_band_pool));
+    sc_band_worker *worker;
+    int w;
+
+    if (pool == NULL) return NULL;
+
+    // make sure the kernel is chosen before any worker uses it
+    sc_get_kernel();
+
+    pool->n_threads = n_threads < 1 ? 1 : (n_threads > SC_YSIZE ? SC_YSIZE : n_threads);
+    if (pool->n_threads == 1) return pool;
+
+    pool->workers = (sc_band_worker *) calloc(pool->n_threads, sizeof(sc_band_worker));
+    if (pool->workers == NULL || sc_sem_init(&pool->done, 0) != 0) {
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+
+    for (w = 1; w < pool->n_threads; w++) {
+        worker = &pool->workers[w];
+        worker->pool = pool;
+        worker->index = w;
+        sc_sem_init(&worker->start, 0);
+        if (sc_thread_create(&worker->thread, sc_band_worker_thread, worker) != 0) {
+            sc_log("Could not create band thread, using %d threads\n", w);
+            sc_sem_destroy(&worker->start);
+            break;
+        }
+        pool->n_workers++;
+    }
+
+    // bands are only assigned to workers that started
+    pool->n_threads = pool->n_workers + 1;
+
+    return pool;
+}
+
+void sc_band_pool_accumulate(sc_band_pool *pool,
+                             const uint32_t lut[SC_NADCS][SC_LUT_SIZE],
+                             const uint16_t *frame,
+                             uint32_t *acc) {
+    sc_band_accumulate_arg arg;
+
+    arg.lut = lut;
+    arg.frame = frame;
+    arg.acc = acc;
+    sc_band_pool_run(pool, sc_band_accumulate, &arg);
+}
+
+void sc_band_pool_run(sc_band_pool *pool, sc_band_fn fn, void *arg) {
+    int w;
+
+    if (pool == NULL || pool->n_threads == 1) {
+        fn(arg, 0, SC_NPIXELS);
+        return;
+    }
+
+    pool->fn = fn;
+    pool->arg = arg;
+
+    for (w = 1; w <= pool->n_workers; w++) sc_sem_post(&pool->workers[w].start);
+    sc_band_run(pool, 0);
+    for (w = 1; w <= pool->n_workers; w++) sc_sem_wait(&pool->done);
+}
+
+void sc_band_pool_free(sc_band_pool *pool) {
+    int w;
+
+    if (pool == NULL) return;
+
+    if (pool->workers != NULL) {
+        pool->quit = 1;
+        for (w = 1; w <= pool->n_workers; w++) sc_sem_post(&pool->workers[w].start);
+        for (w = 1; w <= pool->n_workers; w++) {
+            sc_thread_join(pool->workers[w].thread);
+            sc_sem_destroy(&pool->workers[w].start);
+        }
+        sc_sem_destroy(&pool->done);
+        free(pool->workers);
+    }
+    free(pool);
+}
@@ -0,0 +1,359 @@
+// sc_kernelbench.c   microbenchmark of the LUT-apply-and-accumulate kernels.
+//
+// Both cameras co-add frames concurrently, as in the averaging program, for
+// each kernel and number of band threads per camera. The frame rate each
+// camera sustains is compared to the camera frame rate to give the headroom,
+// i.e., how many times faster than the cameras the co-adding runs. With
+// --clip the sigma-clipping kernel is timed instead.
+//
+// usage: socketcam_kernelbench [options]
+//   --frames N          frames co-added per camera (default 256)
+//   --rate FPS          camera frame rate to compare against (default 142,
+//                       i.e., the 1984 stream mode buffers in about 14 secs)
+//   --max-threads N     most band threads per camera to try (default 4)
+//   --lut-config FILE   kcoConfig.ini listing the LUT files
+//   --clip              time sigma-clipped co-adding
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sc_core.h"
+#include "sc_thread.h"
+
+typedef struct {
+    int             camera;
+    int             n_threads;
+    int             n_frames;
+    const sc_lut   *lut;
+    const uint16_t *frames;   // SC_NSTATES frames
+    uint32_t       *acc;      // SC_NSTATES images
+    float          *clip;     // SC_NSTATES images each of reference mean and
+                              // limit, mean and m2, or NULL to not clip
+    uint16_t       *n_kept;   // SC_NSTATES images
+    sc_sem         *ready;
+    sc_sem         *go;
+} sc_kernelbench_camera;
+
+typedef struct {
+    sc_kernelbench_camera *cam;
+    size_t                 q;
+} sc_kernelbench_clip_arg;
+
+static void sc_kernelbench_clip_band(void *arg, size_t offset, size_t n_pixels) {
+    sc_kernelbench_clip_arg *a = (sc_kernelbench_clip_arg *) arg;
+    sc_kernelbench_camera *cam = a->cam;
+    const size_t n = SC_NSTATES * SC_NPIXELS, i = a->q * SC_NPIXELS + offset;
+
+    sc_clip_accumulate(cam->lut->table[cam->camera], cam->frames + i,
+                       cam->clip + i, cam->clip + n + i,
+                       cam->clip + 2 * n + i, cam->clip + 3 * n + i,
+                       cam->n_kept + i, cam->acc + i, n_pixels);
+}
+
+static SC_THREAD_RETURN sc_kernelbench_camera_thread(void *arg) {
+    sc_kernelbench_camera *cam = (sc_kernelbench_camera *) arg;
+    sc_band_pool *pool = sc_band_pool_new(cam->n_threads);
+    sc_kernelbench_clip_arg clip_arg;
+    size_t q;
+    int f;
+
+    clip_arg.cam = cam;
+
+    sc_sem_post(cam->ready);
+    sc_sem_wait(cam->go);
+
+    for (f = 0; f < cam->n_frames; f++) {
+        q = (size_t) (f % SC_NSTATES);
+        if (cam->clip != NULL) {
+            clip_arg.q = q;
+            sc_band_pool_run(pool, sc_kernelbench_clip_band, &clip_arg);
+        } else {
+            sc_band_pool_accumulate(pool, cam->lut->table[cam->camera],
+                                    cam->frames + q * SC_NPIXELS,
+                                    cam->acc + q * SC_NPIXELS);
+        }
+    }
+
+    sc_band_pool_free(pool);
+    return SC_THREAD_RESULT;
+}
+
+// time both cameras co-adding n_frames frames each; returns secs
+static double sc_kernelbench_run(const sc_lut *lut, uint16_t *frames[SC_NCAMERAS],
+                                 uint32_t *acc[SC_NCAMERAS], float *clip[SC_NCAMERAS],
+                                 uint16_t *n_kept[SC_NCAMERAS],
+                                 int n_threads, int n_frames) {
+    sc_kernelbench_camera cams[SC_NCAMERAS];
+    sc_thread threads[SC_NCAMERAS];
+    sc_sem ready, go;
+    double t0, elapsed;
+    int c;
+
+    sc_sem_init(&ready, 0);
+    sc_sem_init(&go, 0);
+
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        cams[c].camera = c;
+        cams[c].n_threads = n_threads;
+        cams[c].n_frames = n_frames;
+        cams[c].lut = lut;
+        cams[c].frames = frames[c];
+        cams[c].acc = acc[c];
+        cams[c].clip = clip[c];
+        cams[c].n_kept = n_kept[c];
+        cams[c].ready = &ready;
+        cams[c].go = &go;
+        if (sc_thread_create(&threads[c], sc_kernelbench_camera_thread, &cams[c]) != 0) {
+            fprintf(stderr, "could not create camera thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // start timing once every camera has its band threads running
+    for (c = 0; c < SC_NCAMERAS; c++) sc_sem_wait(&ready);
+    t0 = sc_time();
+    for (c = 0; c < SC_NCAMERAS; c++) sc_sem_post(&go);
+    for (c = 0; c < SC_NCAMERAS; c++) sc_thread_join(threads[c]);
+    elapsed = sc_time() - t0;
+
+    sc_sem_destroy(&ready);
+    sc_sem_destroy(&go);
+
+    return elapsed;
+}
+
+// compare a kernel against the scalar kernel on one frame per camera
+static int sc_kernelbench_check(const sc_lut *lut, uint16_t *frames[SC_NCAMERAS],
+                                uint32_t *expected, uint32_t *result) {
+    int c;
+
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        memset(expected, 0, SC_NPIXELS * sizeof(uint32_t));
+        memset(result, 0, SC_NPIXELS * sizeof(uint32_t));
+        sc_lut_accumulate_scalar(lut->table[c], frames[c], expected, SC_NPIXELS);
+        sc_lut_accumulate(lut->table[c], frames[c], result, SC_NPIXELS);
+        if (memcmp(expected, result, SC_NPIXELS * sizeof(uint32_t)) != 0) return -1;
+    }
+
+    return 0;
+}
+
+// Compare the clipping kernel against the scalar kernel over a few frames,
+// with a reference that rejects some of the values and a limit of INFINITY,
+// keeping everything, in part of the image.
+static int sc_kernelbench_check_clip(const sc_lut *lut, uint16_t *frames[SC_NCAMERAS]) {
+    const size_t n = SC_NPIXELS;
+    float *f = (float *) sc_aligned_malloc(8 * n * sizeof(float), 64);
+    uint16_t *n_kept = (uint16_t *) sc_aligned_malloc(2 * n * sizeof(uint16_t), 64);
+    uint32_t *acc = (uint32_t *) sc_aligned_malloc(2 * n * sizeof(uint32_t), 64);
+    float *ref_mean = f, *ref_limit = f + n;
+    int c, k, q, status = 0;
+    size_t i;
+
+    if (f == NULL || n_kept == NULL || acc == NULL) exit(EXIT_FAILURE);
+
+    for (c = 0; c < SC_NCAMERAS && status == 0; c++) {
+        for (i = 0; i < n; i++) {
+            ref_mean[i] = (float) lut->table[c][i % SC_NADCS][frames[c][i]];
+            ref_limit[i] = i < n / 8 ? INFINITY : (float) (i % 5000) * (float) (i % 5000);
+        }
+        memset(f + 2 * n, 0, 6 * n * sizeof(float));
+        memset(n_kept, 0, 2 * n * sizeof(uint16_t));
+        memset(acc, 0, 2 * n * sizeof(uint32_t));
+
+        for (q = 0; q < SC_NSTATES; q++) {
+            for (k = 0; k < 2; k++) {
+                (k == 0 ? sc_clip_accumulate_scalar : sc_clip_accumulate)(
+                    lut->table[c], frames[c] + q * n, ref_mean, ref_limit,
+                    f + (2 + 3 * k) * n, f + (3 + 3 * k) * n,
+                    n_kept + k * n, acc + k * n, n);
+            }
+        }
+
+        if (memcmp(f + 2 * n, f + 5 * n, 2 * n * sizeof(float)) != 0
+                || memcmp(n_kept, n_kept + n, n * sizeof(uint16_t)) != 0
+                || memcmp(acc, acc + n, n * sizeof(uint32_t)) != 0) {
+            status = -1;
+        }
+    }
+
+    sc_aligned_free(f);
+    sc_aligned_free(n_kept);
+    sc_aligned_free(acc);
+
+    return status;
+}
+
+// compare the fused convert-and-zero against sc_convert_cube, in both byte
+// orders, from an odd offset so the unaligned head and tail are covered too
+static int sc_kernelbench_check_convert(uint32_t *cube, uint32_t *copy,
+                                        int16_t *expected, int16_t *result) {
+    const size_t offset = 3, n = SC_NPIXELS - 7;
+    size_t i;
+
+    int big_endian;
+
+    for (big_endian = 0; big_endian < 2; big_endian++) {
+        memcpy(copy, cube, SC_NPIXELS * sizeof(uint32_t));
+        sc_convert_cube(copy + offset, expected, n);
+        if (big_endian) {
+            for (i = 0; i < n; i++) {
+                expected[i] = (int16_t) (uint16_t) (((uint16_t) expected[i] << 8)
+                                                    | ((uint16_t) expected[i] >> 8));
+            }
+        }
+        sc_convert_cube_zero(copy + offset, result, n, big_endian);
+        if (memcmp(expected, result, n * sizeof(int16_t)) != 0) return -1;
+        for (i = 0; i < SC_NPIXELS; i++) {
+            if (copy[i] != ((i >= offset && i < offset + n) ? 0 : cube[i])) return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void sc_kernelbench_usage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [--frames N] [--rate FPS] [--max-threads N] [--lut-config FILE]\n"
+            "          [--clip]\n",
+            program);
+}
+
+int main(int argc, char *argv[]) {
+    const int kernels[] = { SC_KERNEL_SCALAR, SC_KERNEL_AVX2 };
+    int n_frames = 256, max_threads = 4, clip = 0;
+    double rate = 142.0, elapsed, fps;
+    const char *lut_config = NULL;
+    uint16_t *frames[SC_NCAMERAS];
+    uint32_t *acc[SC_NCAMERAS];
+    float *clip_stats[SC_NCAMERAS] = { NULL, NULL };
+    uint16_t *n_kept[SC_NCAMERAS] = { NULL, NULL };
+    uint32_t *cube;
+    int16_t *cube16;
+    uint32_t seed = 1;
+    sc_lut *lut;
+    size_t i;
+    int k, kernel, n_threads, c;
+
+    for (k = 1; k < argc; k++) {
+        if (k + 1 < argc && strcmp(argv[k], "--frames") == 0) {
+            n_frames = atoi(argv[++k]);
+        } else if (k + 1 < argc && strcmp(argv[k], "--rate") == 0) {
+            rate = atof(argv[++k]);
+        } else if (k + 1 < argc && strcmp(argv[k], "--max-threads") == 0) {
+            max_threads = atoi(argv[++k]);
+        } else if (k + 1 < argc && strcmp(argv[k], "--lut-config") == 0) {
+            lut_config = argv[++k];
+        } else if (strcmp(argv[k], "--clip") == 0) {
+            clip = 1;
+        } else {
+            sc_kernelbench_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (n_frames < 1 || max_threads < 1 || rate <= 0.0) {
+        sc_kernelbench_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    lut = (sc_lut *) malloc(sizeof(sc_lut));
+    if (lut == NULL) return EXIT_FAILURE;
+    if (lut_config != NULL) {
+        if (sc_lut_read_config(lut, lut_config) != 0) return EXIT_FAILURE;
+    } else {
+        sc_lut_identity(lut);
+    }
+
+    // random 12-bit frames, so the gathers hit the whole table
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        frames[c] = (uint16_t *) sc_aligned_malloc(SC_NSTATES * SC_NPIXELS * sizeof(uint16_t), 64);
+        acc[c] = (uint32_t *) sc_aligned_malloc(SC_NSTATES * SC_NPIXELS * sizeof(uint32_t), 64);
+        if (frames[c] == NULL || acc[c] == NULL) return EXIT_FAILURE;
+        for (i = 0; i < SC_NSTATES * SC_NPIXELS; i++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            frames[c][i] = (uint16_t) (seed & (SC_LUT_SIZE - 1));
+        }
+        memset(acc[c], 0, SC_NSTATES * SC_NPIXELS * sizeof(uint32_t));
+
+        // a reference of the frames themselves, clipping at 2 counts
+        if (clip) {
+            clip_stats[c] = (float *) sc_aligned_malloc(4 * SC_NSTATES * SC_NPIXELS * sizeof(float), 64);
+            n_kept[c] = (uint16_t *) sc_aligned_malloc(SC_NSTATES * SC_NPIXELS * sizeof(uint16_t), 64);
+            if (clip_stats[c] == NULL || n_kept[c] == NULL) return EXIT_FAILURE;
+            memset(clip_stats[c], 0, 4 * SC_NSTATES * SC_NPIXELS * sizeof(float));
+            memset(n_kept[c], 0, SC_NSTATES * SC_NPIXELS * sizeof(uint16_t));
+            for (i = 0; i < SC_NSTATES * SC_NPIXELS; i++) {
+                clip_stats[c][i] = (float) lut->table[c][i % SC_NADCS][frames[c][i]] + (float) (i % 3);
+                clip_stats[c][SC_NSTATES * SC_NPIXELS + i] = 4.0f;
+            }
+        }
+    }
+
+    // an image co-added from 34 frames to check the conversion with
+    cube = (uint32_t *) sc_aligned_malloc(2 * SC_NPIXELS * sizeof(uint32_t), 64);
+    cube16 = (int16_t *) sc_aligned_malloc(2 * SC_NPIXELS * sizeof(int16_t), 64);
+    if (cube == NULL || cube16 == NULL) return EXIT_FAILURE;
+    for (i = 0; i < SC_NPIXELS; i++) {
+        cube[i] = lut->table[0][i % SC_NADCS][frames[0][i]] * 34u + (uint32_t) i;
+    }
+
+    printf("%d frames per camera, %d cameras, camera rate %0.1f frames/sec%s\n",
+           n_frames, SC_NCAMERAS, rate, clip ? ", clipping" : "");
+    printf("%-8s %8s %10s %12s %10s\n",
+           "kernel", "threads", "ns/pixel", "frames/sec", "headroom");
+
+    for (k = 0; k < (int) (sizeof(kernels) / sizeof(kernels[0])); k++) {
+        kernel = sc_set_kernel(kernels[k]);
+        if (kernel != kernels[k]) {
+            printf("%-8s not supported by this CPU\n", sc_kernel_name(kernels[k]));
+            continue;
+        }
+
+        if (sc_kernelbench_check(lut, frames, acc[0], acc[1]) != 0) {
+            fprintf(stderr, "%s kernel does not match the scalar kernel\n",
+                    sc_kernel_name(kernel));
+            return EXIT_FAILURE;
+        }
+
+        if (sc_kernelbench_check_clip(lut, frames) != 0) {
+            fprintf(stderr, "%s clipping kernel does not match the scalar kernel\n",
+                    sc_kernel_name(kernel));
+            return EXIT_FAILURE;
+        }
+
+        if (sc_kernelbench_check_convert(cube, cube + SC_NPIXELS,
+                                         cube16, cube16 + SC_NPIXELS) != 0) {
+            fprintf(stderr, "%s conversion does not match sc_convert_cube\n",
+                    sc_kernel_name(kernel));
+            return EXIT_FAILURE;
+        }
+
+        for (n_threads = 1; n_threads <= max_threads; n_threads *= 2) {
+            elapsed = sc_kernelbench_run(lut, frames, acc, clip_stats, n_kept,
+                                         n_threads, n_frames);
+            fps = (double) n_frames / elapsed;
+            printf("%-8s %8d %10.3f %12.1f %9.2fx\n",
+                   sc_kernel_name(kernel),
+                   n_threads,
+                   1.0e9 * elapsed / ((double) n_frames * SC_NPIXELS),
+                   fps,
+                   fps / rate);
+        }
+    }
+
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        sc_aligned_free(frames[c]);
+        sc_aligned_free(acc[c]);
+        sc_aligned_free(clip_stats[c]);
+        sc_aligned_free(n_kept[c]);
+    }
+    sc_aligned_free(cube);
+    sc_aligned_free(cube16);
+    free(lut);
+
+    return EXIT_SUCCESS;
+}
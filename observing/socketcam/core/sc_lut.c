@@ -0,0 +1,168 @@
+// sc_lut.c   reads the per-ADC lookup tables and applies them while
+//            co-adding frames, i.e., readConfig.h and the inner loops of
+//            GetImgAndApplyLut[01].h.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sc_core.h"
+
+#define SC_LUT_MASK (SC_LUT_SIZE - 1)
+
+// "<serial>-<date>" from .../Photonfocus_MV-D1024E_<serial>_adc0_<date>.bin,
+// or an empty string if the filename does not have that form
+static void sc_lut_id(char *id, size_t size, const char *filename) {
+    const char *basename = filename, *adc, *serial, *date, *p;
+    size_t serial_len, date_len;
+
+    id[0] = '\0';
+
+    for (p = filename; *p != '\0'; p++) {
+        if (*p == '/' || *p == '\\') basename = p + 1;
+    }
+
+    if ((adc = strstr(basename, "_adc")) == NULL) return;
+    for (serial = adc; serial > basename && serial[-1] != '_'; serial--) ;
+    if (serial == basename) return;
+    serial_len = (size_t) (adc - serial);
+
+    if ((date = strchr(adc + 1, '_')) == NULL) return;
+    date++;
+    date_len = strcspn(date, ".");
+
+    snprintf(id, size, "%.*s-%.*s", (int) serial_len, serial, (int) date_len, date);
+}
+
+void sc_lut_identity(sc_lut *lut) {
+    int c, a;
+    uint32_t v;
+
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        lut->id[c][0] = '\0';
+        for (a = 0; a < SC_NADCS; a++) {
+            for (v = 0; v < SC_LUT_SIZE; v++) lut->table[c][a][v] = v;
+        }
+    }
+}
+
+int sc_lut_read(sc_lut *lut, const char *filenames[SC_NCAMERAS * SC_NADCS]) {
+    int i;
+    FILE *lutfid;
+    size_t lutbread;
+    uint32_t *table;
+
+    for (i = 0; i < SC_NCAMERAS * SC_NADCS; i++) {
+        table = lut->table[i / SC_NADCS][i % SC_NADCS];
+        if ((lutfid = fopen(filenames[i], "rb")) == NULL) {
+            sc_log("Error opening %s for reading.\n", filenames[i]);
+            return -1;
+        }
+        lutbread = fread(table, sizeof(uint32_t), SC_LUT_SIZE, lutfid);
+        fclose(lutfid);
+        if (lutbread != SC_LUT_SIZE) {
+            sc_log("LUT read error: only read %zu values from %s, expected %d\n",
+                   lutbread, filenames[i], SC_LUT_SIZE);
+            return -1;
+        }
+        if (i % SC_NADCS == 0) {
+            sc_lut_id(lut->id[i / SC_NADCS], sizeof(lut->id[0]), filenames[i]);
+        }
+    }
+
+    return 0;
+}
+
+int sc_lut_read_config(sc_lut *lut, const char *config_filename) {
+    FILE *infid;
+    char line[1024];
+    char names[SC_NCAMERAS * SC_NADCS][1024];
+    const char *filenames[SC_NCAMERAS * SC_NADCS];
+    int found = 0, n = 0;
+    size_t len;
+
+    if ((infid = fopen(config_filename, "r")) == NULL) {
+        sc_log("Could not find %s\n", config_filename);
+        return -1;
+    }
+
+    // the 8 LUT filenames are on the lines following "LUT_Names"
+    while (n < SC_NCAMERAS * SC_NADCS && fgets(line, sizeof(line), infid) != NULL) {
+        len = strcspn(line, "\r\n");
+        line[len] = '\0';
+        if (!found) {
+            found = strstr(line, "LUT_Names") != NULL;
+            continue;
+        }
+        if (len == 0) continue;
+        strcpy(names[n], line);
+        filenames[n] = names[n];
+        sc_log("readConfig %d found '%s'\n", n, names[n]);
+        n++;
+    }
+    fclose(infid);
+
+    if (!found) {
+        sc_log("Could not find LUT_Names in %s\n", config_filename);
+        return -1;
+    }
+    if (n != SC_NCAMERAS * SC_NADCS) {
+        sc_log("Found only %d of %d LUT names in %s\n",
+               n, SC_NCAMERAS * SC_NADCS, config_filename);
+        return -1;
+    }
+
+    return sc_lut_read(lut, filenames);
+}
+
+void sc_lut_accumulate_scalar(const uint32_t lut[SC_NADCS][SC_LUT_SIZE],
+                              const uint16_t *frame,
+                              uint32_t *acc,
+                              size_t n_pixels) {
+    const uint32_t *lut0 = lut[0], *lut1 = lut[1], *lut2 = lut[2], *lut3 = lut[3];
+    size_t i;
+
+    // Pixel values are masked to 12 bits so a bad frame can not index past
+    // the end of the tables.
+    for (i = 0; i < n_pixels; i += SC_NADCS) {
+        acc[i    ] += lut0[frame[i    ] & SC_LUT_MASK];
+        acc[i + 1] += lut1[frame[i + 1] & SC_LUT_MASK];
+        acc[i + 2] += lut2[frame[i + 2] & SC_LUT_MASK];
+        acc[i + 3] += lut3[frame[i + 3] & SC_LUT_MASK];
+    }
+}
+
+void sc_accumulate(const uint16_t *frame, uint32_t *acc, size_t n_pixels) {
+    size_t i;
+
+    for (i = 0; i < n_pixels; i++) acc[i] += frame[i];
+}
+
+void sc_clip_accumulate_scalar(const uint32_t lut[SC_NADCS][SC_LUT_SIZE],
+                               const uint16_t *frame,
+                               const float *ref_mean,
+                               const float *ref_limit,
+                               float *mean,
+                               float *m2,
+                               uint16_t *n_kept,
+                               uint32_t *acc,
+                               size_t n_pixels) {
+    uint32_t v;
+    float x, d, delta;
+    size_t i;
+
+    for (i = 0; i < n_pixels; i++) {
+        v = lut != NULL ? lut[i % SC_NADCS][frame[i] & SC_LUT_MASK] : frame[i];
+        acc[i] += v;
+
+        // LUT values are at most 23 bits, so exact as floats
+        x = (float) v;
+        d = x - ref_mean[i];
+        if (!(d * d <= ref_limit[i])) continue;
+
+        // Welford's update of the mean and squared deviations of those kept
+        n_kept[i]++;
+        delta = x - mean[i];
+        mean[i] += delta / (float) n_kept[i];
+        m2[i] += delta * (x - mean[i]);
+    }
+}
@@ -0,0 +1,148 @@
+// sc_pool.c   a pool of large buffers kept between programs.
+//
+// brdopen[01].h allocate the board buffers, and the averaging threads their
+// accumulation buffers, every time the program changes. A pool instead keeps
+// every buffer it has handed out, so switching between stream and averaging
+// reuses memory that is already mapped. The averaging slots and the stream
+// write buffers are both 32 MB, so the two programs mostly share buffers.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sc_core.h"
+#include "sc_thread.h"
+
+typedef struct {
+    void   *buffer;
+    size_t  size;
+    int     in_use;
+    int     clean;      // known to be all zero
+} sc_pool_buffer;
+
+struct sc_pool {
+    sc_mutex        mutex;
+    sc_pool_buffer *buffers;
+    int             n_buffers;
+    int             max_buffers;
+};
+
+sc_pool *sc_pool_new(void) {
+    sc_pool *pool = (sc_pool *) calloc(1, sizeof(sc_pool));
+
+    if (pool == NULL) return NULL;
+    sc_mutex_init(&pool->mutex);
+
+    return pool;
+}
+
+void *sc_pool_get(sc_pool *pool, size_t size, int zero) {
+    sc_pool_buffer *b, *buffers;
+    void *buffer;
+    int i, found = -1, clean;
+
+    if (pool == NULL) {
+        buffer = sc_aligned_malloc(size, SC_IO_ALIGNMENT);
+        if (buffer != NULL) memset(buffer, 0, size);
+        return buffer;
+    }
+
+    // a free buffer of the right size, a clean one if zeroes are wanted
+    sc_mutex_lock(&pool->mutex);
+    for (i = 0; i < pool->n_buffers; i++) {
+        b = &pool->buffers[i];
+        if (b->in_use || b->size != size) continue;
+        if (!zero || b->clean) {
+            found = i;
+            break;
+        }
+        if (found < 0) found = i;
+    }
+    if (found >= 0) {
+        b = &pool->buffers[found];
+        b->in_use = 1;
+        buffer = b->buffer;
+        clean = b->clean;
+        sc_mutex_unlock(&pool->mutex);
+
+        if (zero && !clean) memset(buffer, 0, size);
+        return buffer;
+    }
+    sc_mutex_unlock(&pool->mutex);
+
+    // zeroing a new buffer also maps its pages
+    buffer = sc_aligned_malloc(size, SC_IO_ALIGNMENT);
+    if (buffer == NULL) return NULL;
+    memset(buffer, 0, size);
+
+    sc_mutex_lock(&pool->mutex);
+    if (pool->n_buffers == pool->max_buffers) {
+        buffers = (sc_pool_buffer *) realloc(pool->buffers,
+                                             (size_t) (2 * pool->max_buffers + 16)
+                                                 * sizeof(sc_pool_buffer));
+        if (buffers == NULL) {
+            sc_mutex_unlock(&pool->mutex);
+            sc_aligned_free(buffer);
+            return NULL;
+        }
+        pool->buffers = buffers;
+        pool->max_buffers = 2 * pool->max_buffers + 16;
+    }
+    b = &pool->buffers[pool->n_buffers++];
+    b->buffer = buffer;
+    b->size = size;
+    b->in_use = 1;
+    b->clean = 0;
+    sc_mutex_unlock(&pool->mutex);
+
+    return buffer;
+}
+
+void sc_pool_put(sc_pool *pool, void *buffer, int clean) {
+    int i, found = 0;
+
+    if (buffer == NULL) return;
+
+    if (pool == NULL) {
+        sc_aligned_free(buffer);
+        return;
+    }
+
+    sc_mutex_lock(&pool->mutex);
+    for (i = 0; i < pool->n_buffers && !found; i++) {
+        if (pool->buffers[i].buffer == buffer) {
+            pool->buffers[i].in_use = 0;
+            pool->buffers[i].clean = clean;
+            found = 1;
+        }
+    }
+    sc_mutex_unlock(&pool->mutex);
+
+    if (!found) sc_log("Buffer %p is not from the pool\n", buffer);
+}
+
+size_t sc_pool_size(sc_pool *pool) {
+    size_t size = 0;
+    int i;
+
+    if (pool == NULL) return 0;
+
+    sc_mutex_lock(&pool->mutex);
+    for (i = 0; i < pool->n_buffers; i++) size += pool->buffers[i].size;
+    sc_mutex_unlock(&pool->mutex);
+
+    return size;
+}
+
+void sc_pool_free(sc_pool *pool) {
+    int i;
+
+    if (pool == NULL) return;
+
+    for (i = 0; i < pool->n_buffers; i++) {
+        if (pool->buffers[i].in_use) sc_log("Freeing pool buffer %d still in use\n", i);
+        sc_aligned_free(pool->buffers[i].buffer);
+    }
+    free(pool->buffers);
+    sc_mutex_destroy(&pool->mutex);
+    free(pool);
+}
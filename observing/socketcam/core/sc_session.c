@@ -0,0 +1,228 @@
+// sc_session.c   program switching: parselogic.h without closing the boards.
+//
+// parselogic.h stops and closes both boards on every change of program and
+// reopens them with a different number of buffers, 1984 for stream mode and
+// 1032 for averaging, so that switching costs a board open, a reallocation
+// of the board buffers, and the averaging buffers on top. Here the source is
+// opened once, sized for stream mode, and is only stopped (brdstop.h) and
+// restarted (brdstrt.h) between programs. The averaging slots and the write
+// buffers of both programs come from the session's pool, so after the first
+// time each program runs a switch allocates nothing.
+//
+// The session is driven from one thread, as socketcam.c drives parselogic.h
+// from its socket thread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sc_core.h"
+
+struct sc_session {
+    sc_source          *src;
+    sc_session_options  options;
+    sc_pool            *pool;
+
+    int                 program;     // CamProgram
+    int                 running;     // CamProgramStatus == P_RUNNING
+    int                 finishing;   // gently stopped, the last cube pending
+    int                 src_stopped; // brdstop.h without a brdstrt.h since
+    sc_avg             *avg;
+    sc_stream          *stream;
+};
+
+
+void sc_session_options_init(sc_session_options *options) {
+    sc_avg_options_init(&options->avg);
+    sc_stream_options_init(&options->stream);
+    options->preallocate = 1;
+    options->notify      = NULL;
+    options->notify_data = NULL;
+}
+
+sc_session *sc_session_new(sc_source *src, const sc_session_options *options) {
+    sc_session *session = (sc_session *) calloc(1, sizeof(sc_session));
+
+    if (session == NULL) return NULL;
+
+    session->src = src;
+    session->options = *options;
+    session->program = SC_PROGRAM_NONE;
+    if ((session->pool = sc_pool_new()) == NULL) {
+        free(session);
+        return NULL;
+    }
+    session->options.avg.pool = session->pool;
+    session->options.stream.pool = session->pool;
+
+    if (session->options.preallocate
+            && (sc_avg_reserve(session->pool, &session->options.avg) != 0
+                || sc_stream_reserve(session->pool, &session->options.stream) != 0)) {
+        sc_log("Could not preallocate the program buffers\n");
+        sc_session_free(session);
+        return NULL;
+    }
+
+    return session;
+}
+
+// brdstop.h
+static void sc_session_stop_source(sc_session *session) {
+    if (session->src_stopped) return;
+    session->src->stop(session->src);
+    session->src_stopped = 1;
+}
+
+// stop the current program, if it has been started, and wait for its last
+// files to be written
+static void sc_session_unload(sc_session *session) {
+    if (session->avg != NULL) {
+        // a gently stopped program ends with its cube, unless stopped again
+        if (!session->finishing) sc_session_stop_source(session);
+        sc_avg_join(session->avg);
+        sc_avg_free(session->avg);
+        session->avg = NULL;
+        sc_session_stop_source(session);
+    }
+    if (session->stream != NULL) {
+        sc_session_stop_source(session);
+        sc_stream_join(session->stream);
+        sc_stream_free(session->stream);
+        session->stream = NULL;
+    }
+    session->running = 0;
+    session->finishing = 0;
+}
+
+// brdstrt.h and the acquisition threads of the loaded program
+static int sc_session_start(sc_session *session, int n_integrations, int start_state) {
+    if (session->src_stopped) {
+        if (session->src->start == NULL) {
+            sc_log("The %s source can not be restarted\n", session->src->name);
+            return SC_ERROR;
+        }
+        session->src->start(session->src);
+        session->src_stopped = 0;
+    }
+
+    if (session->program == SC_PROGRAM_STREAM) {
+        session->stream = sc_stream_start(session->src, &session->options.stream);
+        if (session->stream == NULL) return SC_ERROR;
+    } else {
+        session->options.avg.n_integrations = n_integrations;
+        session->options.avg.start_state = start_state;
+        session->avg = sc_avg_start(session->src, &session->options.avg);
+        if (session->avg == NULL) return SC_ERROR;
+    }
+    session->running = 1;
+
+    return SC_OK;
+}
+
+int sc_session_switch(sc_session *session, int program, int action,
+                      int n_integrations, int start_state) {
+    // Check if there is a change in program.
+    if (program != session->program) {
+        sc_session_unload(session);
+        session->program = program;
+        if (program == SC_PROGRAM_NONE) return SC_OK;
+
+        if (session->options.notify != NULL) {
+            session->options.notify(program == SC_PROGRAM_STREAM
+                                        ? "cam ready stream" : "cam ready avging",
+                                    session->options.notify_data);
+        }
+
+        // take no action for a new program asking for "stop"
+        if (action != SC_SESSION_START) return SC_OK;
+        return sc_session_start(session, n_integrations, start_state);
+    }
+
+    // The correct program is loaded, just need to match status
+    if (program == SC_PROGRAM_NONE) return SC_OK;
+    switch (action) {
+        case SC_SESSION_START:
+            if (session->running && !session->finishing) return SC_OK;
+            sc_session_unload(session);
+            return sc_session_start(session, n_integrations, start_state);
+        case SC_SESSION_STOP:
+            sc_session_unload(session);
+            return SC_OK;
+        case SC_SESSION_GENTLE:
+            // averaging stops at the end of the current cube, which
+            // sc_session_poll waits for; stream mode stops immediately
+            if (session->avg != NULL && session->running) {
+                sc_avg_finish(session->avg);
+                session->finishing = 1;
+            } else {
+                sc_session_unload(session);
+            }
+            return SC_OK;
+        default:
+            return SC_ERROR;
+    }
+}
+
+int sc_session_command(sc_session *session, const char *command) {
+    int program = SC_PROGRAM_NONE, action = SC_SESSION_STOP;
+    int n_integrations = 512, start_state = 0, dump = 0, kk;
+    char status[64];
+
+    // Determine the desired program
+    if (strncmp("stream", command, 6) == 0) program = SC_PROGRAM_STREAM;
+    if (strncmp("avging", command, 6) == 0) program = SC_PROGRAM_AVGING;
+
+    // Determine the desired status
+    kk = sscanf(command, "%*s %63s %d %d %d", status, &n_integrations, &start_state, &dump);
+    if (kk >= 1) {
+        if (strncmp("start", status, 5) == 0) {
+            action = SC_SESSION_START;
+            // load some default values
+            if (kk < 3) {
+                n_integrations = 512;
+                start_state = 0;
+            }
+        } else if (strncmp("gent", status, 4) == 0) {
+            action = SC_SESSION_GENTLE;
+        }
+    }
+
+    if (program == SC_PROGRAM_NONE && strncmp("quit", command, 4) == 0) {
+        sc_log("Got a 'quit'. Client is going away.\n");
+    }
+    // writeoutavgs.h needs the board buffers of a BitFlow source
+    if (program == SC_PROGRAM_AVGING && action == SC_SESSION_START && kk == 4 && dump) {
+        sc_log("Ignoring DoAvgImageDump in '%s'\n", command);
+    }
+
+    return sc_session_switch(session, program, action, n_integrations, start_state);
+}
+
+int sc_session_poll(sc_session *session) {
+    if (session->avg != NULL && sc_avg_done(session->avg)) {
+        sc_session_unload(session);
+        return 1;
+    }
+    if (session->stream != NULL && sc_stream_done(session->stream)) {
+        sc_session_unload(session);
+        return 1;
+    }
+    return 0;
+}
+
+int sc_session_program(sc_session *session, int *running) {
+    if (running != NULL) *running = session->running && !session->finishing;
+    return session->program;
+}
+
+sc_pool *sc_session_pool(sc_session *session) {
+    return session->pool;
+}
+
+void sc_session_free(sc_session *session) {
+    if (session == NULL) return;
+
+    sc_session_unload(session);
+    sc_pool_free(session->pool);
+    free(session);
+}
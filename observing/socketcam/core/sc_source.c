@@ -0,0 +1,412 @@
+// sc_source.c   synthetic and replay frame sources.
+//
+// All the sources simulate the BitFlow circular buffers: with a frame rate set,
+// frame k of a camera is complete at t0 + (k + 1) / frame_rate, frames that
+// are complete but not yet read are reported in n_behind (the
+// BiBufferQueueSize of GetImgAndApplyLut[01].h), and once more than
+// n_buffers frames are waiting the oldest ones are overwritten and counted in
+// n_missed.
+
+#ifndef _WIN32
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sc_core.h"
+#include "sc_thread.h"
+
+// longest single sleep while waiting for a frame, so stop is noticed
+#define SC_PACE_SLICE 0.01
+
+// number of distinct synthetic frames per camera and modulator state
+#define SC_SYNTHETIC_NVARIANTS 2
+
+typedef struct {
+    double   t0;
+    int      started;
+    uint64_t next;
+} sc_pacer;
+
+typedef struct {
+    sc_source_options options;
+    volatile uint64_t stopped;
+    sc_pacer          pacer[SC_NCAMERAS];
+    uint16_t         *frames[SC_NCAMERAS];  // n_frames[c] frames for camera c
+    uint64_t          n_frames[SC_NCAMERAS];
+} sc_buffered_source;
+
+
+void sc_source_options_init(sc_source_options *options) {
+    options->frame_rate = 0.0;
+    options->n_buffers  = 1032;   // NumBuffers in averaging mode
+    options->n_frames   = 0;
+    options->seed       = 1;
+}
+
+
+// Wait for the next frame of a camera to be "acquired", filling in the frame
+// number and the lag counts. Returns SC_STOPPED if the source is stopped or
+// exhausted.
+static int sc_pacer_next(sc_buffered_source *s, int camera, sc_frame *frame) {
+    sc_pacer *p = &s->pacer[camera];
+    double rate = s->options.frame_rate, now, ready;
+    uint64_t produced, behind, missed = 0;
+    uint64_t n_buffers = s->options.n_buffers > 0 ? s->options.n_buffers : 1;
+
+    if (sc_atomic_load(&s->stopped)) return SC_STOPPED;
+    if (s->options.n_frames > 0 && p->next >= s->options.n_frames) return SC_STOPPED;
+
+    if (rate <= 0.0) {
+        frame->number   = p->next++;
+        frame->n_behind = 0;
+        frame->n_missed = 0;
+        frame->time     = sc_time();
+        return SC_OK;
+    }
+
+    // after a restart the frames are numbered on from where they stopped
+    now = sc_time();
+    if (!p->started) {
+        p->t0 = now - (double) p->next / rate;
+        p->started = 1;
+    }
+
+    produced = (uint64_t) ((now - p->t0) * rate);
+    if (p->next >= produced) {
+        // wait for the frame to complete
+        ready = p->t0 + (double) (p->next + 1) / rate;
+        while ((now = sc_time()) < ready) {
+            if (sc_atomic_load(&s->stopped)) return SC_STOPPED;
+            sc_sleep(ready - now < SC_PACE_SLICE ? ready - now : SC_PACE_SLICE);
+        }
+        produced = p->next + 1;
+    }
+
+    behind = produced - p->next - 1;
+    if (behind >= n_buffers) {
+        missed = behind - (n_buffers - 1);
+        p->next += missed;
+        behind = n_buffers - 1;
+    }
+    if (s->options.n_frames > 0 && p->next >= s->options.n_frames) return SC_STOPPED;
+
+    // frame n is complete at t0 + (n + 1) / rate, however late it is read
+    frame->number   = p->next++;
+    frame->n_behind = (uint32_t) behind;
+    frame->n_missed = (uint32_t) missed;
+    frame->time     = p->t0 + (double) frame->number / rate + 1.0 / rate;
+    return SC_OK;
+}
+
+static int sc_buffered_next(sc_source *src, int camera, sc_frame *frame) {
+    sc_buffered_source *s = (sc_buffered_source *) src->state;
+    int status = sc_pacer_next(s, camera, frame);
+
+    if (status != SC_OK) return status;
+    frame->pixels = s->frames[camera]
+        + (size_t) (frame->number % s->n_frames[camera]) * SC_NPIXELS;
+    return SC_OK;
+}
+
+static void sc_buffered_release(sc_source *src, int camera, sc_frame *frame) {
+    (void) src;
+    (void) camera;
+    frame->pixels = NULL;
+}
+
+static void sc_buffered_stop(sc_source *src) {
+    sc_buffered_source *s = (sc_buffered_source *) src->state;
+    sc_atomic_store(&s->stopped, 1);
+}
+
+// the board ring is kept, as with brdstrt.h: the cameras start again from now
+static void sc_buffered_start(sc_source *src) {
+    sc_buffered_source *s = (sc_buffered_source *) src->state;
+    int c;
+
+    for (c = 0; c < SC_NCAMERAS; c++) s->pacer[c].started = 0;
+    sc_atomic_store(&s->stopped, 0);
+}
+
+static void sc_buffered_free(sc_source *src) {
+    sc_buffered_source *s = (sc_buffered_source *) src->state;
+    int c;
+
+    for (c = 0; c < SC_NCAMERAS; c++) sc_aligned_free(s->frames[c]);
+    free(s);
+    free(src);
+}
+
+static sc_source *sc_buffered_source_new(const char *name,
+                                         const sc_source_options *options) {
+    sc_source *src = (sc_source *) calloc(1, sizeof(sc_source));
+    sc_buffered_source *s = (sc_buffered_source *) calloc(1, sizeof(sc_buffered_source));
+
+    if (src == NULL || s == NULL) {
+        free(src);
+        free(s);
+        return NULL;
+    }
+
+    if (options != NULL) {
+        s->options = *options;
+    } else {
+        sc_source_options_init(&s->options);
+    }
+
+    src->name    = name;
+    src->next    = sc_buffered_next;
+    src->release = sc_buffered_release;
+    src->stop    = sc_buffered_stop;
+    src->start   = sc_buffered_start;
+    src->free    = sc_buffered_free;
+    src->state   = s;
+
+    return src;
+}
+
+
+// ---------------------------------------------------------------------------
+// synthetic source
+
+static uint32_t sc_xorshift(uint32_t *x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+// An occulted disk with a radially falling corona, modulated differently in
+// each state and camera, plus uniform noise; values fit in 12 bits.
+static void sc_synthetic_frame(uint16_t *frame, int camera, int state, uint32_t *seed) {
+    const double xc = 0.5 * SC_XSIZE, yc = 0.5 * SC_YSIZE, r_occulter = 180.0;
+    const double modulation[SC_NSTATES] = { 1.0, 0.8, 0.6, 0.8 };
+    double x, y, r2, value, scale;
+    size_t i, j;
+
+    scale = modulation[(state + camera) % SC_NSTATES];
+    for (j = 0; j < SC_YSIZE; j++) {
+        y = (double) j - yc;
+        for (i = 0; i < SC_XSIZE; i++) {
+            x = (double) i - xc;
+            r2 = x * x + y * y;
+            value = 100.0;
+            if (r2 > r_occulter * r_occulter) {
+                value += scale * 3000.0 * r_occulter * r_occulter / r2;
+            }
+            value += (double) (sc_xorshift(seed) & 0x3f);
+            frame[j * SC_XSIZE + i] = (uint16_t) (value > 4095.0 ? 4095.0 : value);
+        }
+    }
+}
+
+sc_source *sc_synthetic_source_new(const sc_source_options *options) {
+    sc_source *src = sc_buffered_source_new("synthetic", options);
+    sc_buffered_source *s;
+    uint32_t seed;
+    uint64_t f;
+    int c;
+
+    if (src == NULL) return NULL;
+    s = (sc_buffered_source *) src->state;
+
+    seed = s->options.seed != 0 ? s->options.seed : 1;
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        s->n_frames[c] = SC_NSTATES * SC_SYNTHETIC_NVARIANTS;
+        s->frames[c] = (uint16_t *) sc_aligned_malloc(s->n_frames[c] * SC_NPIXELS * sizeof(uint16_t), 64);
+        if (s->frames[c] == NULL) {
+            sc_log("Could not allocate synthetic frames\n");
+            sc_buffered_free(src);
+            return NULL;
+        }
+        for (f = 0; f < s->n_frames[c]; f++) {
+            sc_synthetic_frame(s->frames[c] + f * SC_NPIXELS, c, (int) (f % SC_NSTATES), &seed);
+        }
+    }
+
+    return src;
+}
+
+
+// ---------------------------------------------------------------------------
+// replay source
+
+static int64_t sc_file_size(FILE *fid) {
+    long size;
+
+    if (fseek(fid, 0, SEEK_END) != 0) return -1;
+    size = ftell(fid);
+    if (fseek(fid, 0, SEEK_SET) != 0) return -1;
+    return size;
+}
+
+sc_source *sc_replay_source_new(const char **filenames[SC_NCAMERAS],
+                                const int n_files[SC_NCAMERAS],
+                                const sc_source_options *options) {
+    const size_t frame_size = SC_NPIXELS * sizeof(uint16_t);
+    sc_source *src = sc_buffered_source_new("replay", options);
+    sc_buffered_source *s;
+    int64_t size;
+    uint64_t n;
+    FILE *fid;
+    int c, f;
+
+    if (src == NULL) return NULL;
+    s = (sc_buffered_source *) src->state;
+
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        // count the frames in the files for this camera
+        for (f = 0; f < n_files[c]; f++) {
+            if ((fid = fopen(filenames[c][f], "rb")) == NULL) {
+                sc_log("Error opening %s for reading.\n", filenames[c][f]);
+                goto error;
+            }
+            size = sc_file_size(fid);
+            fclose(fid);
+            if (size <= 0 || size % frame_size != 0) {
+                sc_log("%s is not a whole number of %zu byte frames\n",
+                       filenames[c][f], frame_size);
+                goto error;
+            }
+            s->n_frames[c] += (uint64_t) size / frame_size;
+        }
+        if (s->n_frames[c] == 0) {
+            sc_log("No frames to replay for camera %d\n", c);
+            goto error;
+        }
+
+        s->frames[c] = (uint16_t *) sc_aligned_malloc(s->n_frames[c] * frame_size, 64);
+        if (s->frames[c] == NULL) {
+            sc_log("Could not allocate %llu replay frames for camera %d\n",
+                   (unsigned long long) s->n_frames[c], c);
+            goto error;
+        }
+
+        n = 0;
+        for (f = 0; f < n_files[c]; f++) {
+            if ((fid = fopen(filenames[c][f], "rb")) == NULL) goto error;
+            size = sc_file_size(fid);
+            if (fread(s->frames[c] + n * SC_NPIXELS, 1, (size_t) size, fid) != (size_t) size) {
+                sc_log("Error reading %s\n", filenames[c][f]);
+                fclose(fid);
+                goto error;
+            }
+            fclose(fid);
+            n += (uint64_t) size / frame_size;
+        }
+    }
+
+    return src;
+
+  error:
+    sc_buffered_free(src);
+    return NULL;
+}
+
+// seek to a byte offset that may be past 2 GB
+static int sc_seek(FILE *fid, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(fid, (__int64) offset, SEEK_SET);
+#else
+    return fseeko(fid, (off_t) offset, SEEK_SET);
+#endif
+}
+
+sc_source *sc_container_source_new(const char *filename,
+                                   const sc_source_options *options) {
+    const size_t frame_size = SC_NPIXELS * sizeof(uint16_t);
+    sc_source *src = sc_buffered_source_new("container", options);
+    sc_buffered_source *s;
+    sc_stream_header header;
+    sc_stream_index_entry *index = NULL;
+    uint64_t i, n[SC_NCAMERAS] = { 0, 0 };
+    FILE *fid = NULL;
+    int c;
+
+    if (src == NULL) return NULL;
+    s = (sc_buffered_source *) src->state;
+
+    if ((fid = fopen(filename, "rb")) == NULL) {
+        sc_log("Error opening %s for reading.\n", filename);
+        goto error;
+    }
+
+    // the container is little-endian, as are the hosts socketcam runs on
+    if (fread(&header, sizeof(header), 1, fid) != 1
+            || memcmp(header.magic, SC_STREAM_MAGIC, sizeof(header.magic)) != 0
+            || header.version != SC_STREAM_VERSION) {
+        sc_log("%s is not a stream container\n", filename);
+        goto error;
+    }
+    if (header.index_offset == 0) {
+        sc_log("%s has no index, the capture was not closed\n", filename);
+        goto error;
+    }
+    if (header.width != SC_XSIZE || header.height != SC_YSIZE
+            || header.bytes_per_pixel != sizeof(uint16_t) || header.frame_size != frame_size) {
+        sc_log("%s does not hold %dx%d 16-bit frames\n", filename, SC_XSIZE, SC_YSIZE);
+        goto error;
+    }
+
+    index = (sc_stream_index_entry *) malloc(header.n_frames * sizeof(sc_stream_index_entry) + 1);
+    if (index == NULL) {
+        sc_log("Could not allocate the index of %s\n", filename);
+        goto error;
+    }
+    if (sc_seek(fid, header.index_offset) != 0
+            || fread(index, sizeof(sc_stream_index_entry), (size_t) header.n_frames, fid)
+                   != header.n_frames) {
+        sc_log("Error reading the index of %s\n", filename);
+        goto error;
+    }
+
+    for (i = 0; i < header.n_frames; i++) {
+        if (index[i].camera >= SC_NCAMERAS) {
+            sc_log("Bad camera %d in the index of %s\n", index[i].camera, filename);
+            goto error;
+        }
+        s->n_frames[index[i].camera]++;
+    }
+
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        if (s->n_frames[c] == 0) {
+            sc_log("No frames to replay for camera %d in %s\n", c, filename);
+            goto error;
+        }
+        s->frames[c] = (uint16_t *) sc_aligned_malloc(s->n_frames[c] * frame_size, 64);
+        if (s->frames[c] == NULL) {
+            sc_log("Could not allocate %llu replay frames for camera %d\n",
+                   (unsigned long long) s->n_frames[c], c);
+            goto error;
+        }
+    }
+
+    // the frames are contiguous, so read them in order
+    if (sc_seek(fid, header.data_offset) != 0) goto read_error;
+    for (i = 0; i < header.n_frames; i++) {
+        c = index[i].camera;
+        if (fread(s->frames[c] + n[c] * SC_NPIXELS, 1, frame_size, fid) != frame_size) {
+            goto read_error;
+        }
+        n[c]++;
+    }
+
+    fclose(fid);
+    free(index);
+    return src;
+
+  read_error:
+    sc_log("Error reading %s\n", filename);
+  error:
+    if (fid != NULL) fclose(fid);
+    free(index);
+    sc_buffered_free(src);
+    return NULL;
+}
+
+void sc_source_free(sc_source *src) {
+    if (src != NULL) src->free(src);
+}
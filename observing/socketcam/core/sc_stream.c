@@ -0,0 +1,492 @@
+// sc_stream.c   stream mode: threadsforstream.h and writeoutstrm.h without
+//               the BitFlow and Windows calls.
+//
+// socketcam.c keeps stream frames in 1984 board buffers (about 14 secs of
+// frames) and only writes them, one .raw file per frame, after "stream
+// stop". Here each camera thread copies its frames into the buffers of its
+// own sc_writer as they arrive, buffer_frames frames at a time, and the
+// writer's I/O thread appends each full buffer to the camera's current .raw
+// file with one large sequential write. A camera that finds every buffer
+// still being written counts an overrun and waits for one, with the frames
+// piling up in the board buffers.
+//
+// By default both cameras share one writer appending to a single indexed
+// container (see sc_core.h): each full buffer is given its place in the
+// container, and its frames their index entries, as it is queued, so the
+// index follows the order in which the buffers are written. The index is
+// kept in memory, 32 bytes a frame, and written after the last frame.
+//
+// Otherwise, each camera has its own writer and the files are named
+// root/YYYYMMDD/hhmmssraw/YYYYMMDD_hhmmsscam0_NNNN.raw as in writestrm0.h,
+// except that NNNN numbers files of file_frames frames rather than single
+// frames. The replay source reads them back directly.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sc_core.h"
+#include "sc_thread.h"
+
+#define SC_FRAME_BYTES (SC_NPIXELS * sizeof(uint16_t))
+
+typedef struct {
+    sc_stream *stream;
+    int        index;
+} sc_stream_thread_arg;
+
+struct sc_stream {
+    sc_source            *src;
+    sc_stream_options     options;
+    int                   joined;
+
+    char                  basename[1024];   // or container filename
+    sc_writer            *writers[SC_NCAMERAS];
+    sc_writer            *container;        // writers[0], for both cameras
+
+    // the container index, in the order the frames are queued
+    double                t0;
+    int64_t               start_time;
+    sc_mutex              index_mutex;
+    sc_stream_index_entry *index;
+    uint64_t              n_index;
+    uint64_t              index_size;
+
+    int                   n_camera_threads;
+    sc_thread             camera_threads[SC_NCAMERAS];
+    sc_stream_thread_arg  camera_args[SC_NCAMERAS];
+
+    sc_mutex              stats_mutex;
+    sc_stream_stats       stats;
+    int                   n_exited;         // camera threads finished
+};
+
+
+void sc_stream_options_init(sc_stream_options *options) {
+    options->buffer_frames = 16;     // 32 MB writes
+    options->n_buffers     = 8;      // 256 MB per camera
+    options->container     = 1;
+    options->file_frames   = 1024;   // 2 GB .raw files
+    options->direct_io     = 1;
+    options->output_root   = NULL;
+    options->pool          = NULL;
+    options->notify        = NULL;
+    options->notify_data   = NULL;
+}
+
+// called on an I/O thread once a buffer of frames has been written; the tag
+// is "<camera> <number of frames>"
+static void sc_stream_written(const char *filename, const char *tag,
+                              int status, double write_time, void *data) {
+    sc_stream *stream = (sc_stream *) data;
+    unsigned int camera = 0;
+    unsigned long long n_frames = 0;
+
+    (void) filename;
+    if (sscanf(tag, "%u %llu", &camera, &n_frames) != 2 || camera >= SC_NCAMERAS) return;
+
+    sc_mutex_lock(&stream->stats_mutex);
+    if (status == 0) {
+        stream->stats.n_written[camera] += n_frames;
+    } else {
+        stream->stats.n_write_errors++;
+    }
+    stream->stats.write_time += write_time;
+    if (write_time > stream->stats.max_write_time) stream->stats.max_write_time = write_time;
+    sc_mutex_unlock(&stream->stats_mutex);
+}
+
+// queue the n_frames frames in buffer, the first of which is frame number
+// `first` of the stream, to be appended to the file holding that frame
+static void sc_stream_submit(sc_stream *stream, int camera, void *buffer,
+                             uint64_t first, int n_frames) {
+    int file_frames = stream->options.file_frames;
+    uint64_t file = file_frames > 0 ? first / (uint64_t) file_frames : 0;
+    char filenm[1100];
+    char tag[32];
+
+    snprintf(filenm, sizeof(filenm), "%scam%d_%04llu.raw",
+             stream->basename, camera, (unsigned long long) file);
+    snprintf(tag, sizeof(tag), "%d %d", camera, n_frames);
+
+    if (file_frames > 0 ? first % (uint64_t) file_frames == 0 : first == 0) {
+        sc_mutex_lock(&stream->stats_mutex);
+        stream->stats.n_files++;
+        sc_mutex_unlock(&stream->stats_mutex);
+    }
+
+    sc_writer_submit(stream->writers[camera], buffer,
+                     (size_t) n_frames * SC_FRAME_BYTES, filenm, tag);
+}
+
+// queue the n_frames frames in buffer, whose index entries are in entries,
+// to be appended to the container
+static int sc_stream_submit_container(sc_stream *stream, int camera, void *buffer,
+                                      const sc_stream_index_entry *entries, int n_frames) {
+    sc_stream_index_entry *index;
+    uint64_t size;
+    char tag[32];
+
+    snprintf(tag, sizeof(tag), "%d %d", camera, n_frames);
+
+    // the writer appends in the order buffers are queued, so queue the
+    // buffer while holding the index
+    sc_mutex_lock(&stream->index_mutex);
+    if (stream->n_index + n_frames > stream->index_size) {
+        size = stream->index_size == 0 ? 4096 : 2 * stream->index_size;
+        while (size < stream->n_index + n_frames) size *= 2;
+        index = (sc_stream_index_entry *) realloc(stream->index,
+                                                  size * sizeof(sc_stream_index_entry));
+        if (index == NULL) {
+            sc_mutex_unlock(&stream->index_mutex);
+            sc_log("Could not allocate a stream index of %llu frames\n",
+                   (unsigned long long) size);
+            return -1;
+        }
+        stream->index = index;
+        stream->index_size = size;
+    }
+    memcpy(stream->index + stream->n_index, entries,
+           (size_t) n_frames * sizeof(sc_stream_index_entry));
+    stream->n_index += n_frames;
+    sc_writer_submit(stream->container, buffer,
+                     (size_t) n_frames * SC_FRAME_BYTES, stream->basename, tag);
+    sc_mutex_unlock(&stream->index_mutex);
+
+    return 0;
+}
+
+static SC_THREAD_RETURN sc_stream_camera_thread(void *arg) {
+    sc_stream_thread_arg *a = (sc_stream_thread_arg *) arg;
+    sc_stream *stream = a->stream;
+    sc_source *src = stream->src;
+    int container = stream->container != NULL;
+    sc_writer *writer = container ? stream->container : stream->writers[a->index];
+    int camera = a->index, buffer_frames = stream->options.buffer_frames;
+    int file_frames = container ? 0 : stream->options.file_frames;
+    uint64_t n = 0, n_lagged = 0, n_missed = 0, n_overruns = 0;
+    sc_stream_index_entry *entries = NULL, *e;
+    char *buffer = NULL;
+    int n_buffered = 0, status;
+    sc_frame frame;
+
+    if (container) {
+        entries = (sc_stream_index_entry *) calloc(buffer_frames, sizeof(sc_stream_index_entry));
+        if (entries == NULL) {
+            sc_log("Camera %d: could not allocate the index\n", camera);
+            writer = NULL;
+        }
+    }
+
+    for (;;) {
+        status = src->next(src, camera, &frame);
+        if (status != SC_OK) {
+            if (status != SC_STOPPED) {
+                sc_log("Camera %d: %s\n", camera, sc_status_name(status));
+            }
+            break;
+        }
+
+        n_lagged += frame.n_behind;
+        n_missed += frame.n_missed;
+
+        if (writer != NULL) {
+            if (buffer == NULL) {
+                buffer = (char *) sc_writer_try_acquire(writer);
+                if (buffer == NULL) {
+                    n_overruns++;
+                    buffer = (char *) sc_writer_acquire(writer);
+                }
+            }
+            memcpy(buffer + (size_t) n_buffered * SC_FRAME_BYTES, frame.pixels, SC_FRAME_BYTES);
+
+            if (container) {
+                e = &entries[n_buffered];
+                e->time = (int64_t) ((frame.time - stream->t0) * 1.0e6);
+                e->number = frame.number;
+                e->camera = (uint8_t) camera;
+                e->state = (uint8_t) (frame.number % SC_NSTATES);
+                e->n_behind = frame.n_behind;
+                e->n_missed = frame.n_missed;
+            }
+        }
+
+        src->release(src, camera, &frame);
+        n++;
+        n_buffered++;
+
+        // a buffer never spans two files
+        if (n_buffered == buffer_frames
+                || (file_frames > 0 && n % (uint64_t) file_frames == 0)) {
+            if (buffer != NULL) {
+                if (container) {
+                    if (sc_stream_submit_container(stream, camera, buffer, entries, n_buffered) != 0) {
+                        sc_writer_release(writer, buffer);
+                    }
+                } else {
+                    sc_stream_submit(stream, camera, buffer, n - n_buffered, n_buffered);
+                }
+            }
+            buffer = NULL;
+            n_buffered = 0;
+        }
+
+        // update the stats every so often, so they can be watched
+        if (n % 64 == 0) {
+            sc_mutex_lock(&stream->stats_mutex);
+            stream->stats.n_frames[camera] = n;
+            stream->stats.n_lagged[camera] = n_lagged;
+            stream->stats.n_missed[camera] = n_missed;
+            stream->stats.n_overruns[camera] = n_overruns;
+            sc_mutex_unlock(&stream->stats_mutex);
+        }
+    }
+
+    // the last, partial buffer
+    if (buffer != NULL) {
+        if (n_buffered == 0) {
+            sc_writer_release(writer, buffer);
+        } else if (container) {
+            if (sc_stream_submit_container(stream, camera, buffer, entries, n_buffered) != 0) {
+                sc_writer_release(writer, buffer);
+            }
+        } else {
+            sc_stream_submit(stream, camera, buffer, n - n_buffered, n_buffered);
+        }
+    }
+    free(entries);
+
+    sc_mutex_lock(&stream->stats_mutex);
+    stream->stats.n_frames[camera] = n;
+    stream->stats.n_lagged[camera] = n_lagged;
+    stream->stats.n_missed[camera] = n_missed;
+    stream->stats.n_overruns[camera] = n_overruns;
+    stream->n_exited++;
+    sc_mutex_unlock(&stream->stats_mutex);
+
+    return SC_THREAD_RESULT;
+}
+
+static void sc_stream_header_init(sc_stream_header *header, int64_t start_time,
+                                  uint64_t n_frames, uint64_t index_offset) {
+    memcpy(header->magic, SC_STREAM_MAGIC, sizeof(header->magic));
+    header->version         = SC_STREAM_VERSION;
+    header->header_size     = SC_STREAM_HEADER_SIZE;
+    header->width           = SC_XSIZE;
+    header->height          = SC_YSIZE;
+    header->bytes_per_pixel = sizeof(uint16_t);
+    header->n_cameras       = SC_NCAMERAS;
+    header->n_states        = SC_NSTATES;
+    header->reserved        = 0;
+    header->start_time      = start_time;
+    header->n_frames        = n_frames;
+    header->data_offset     = SC_STREAM_HEADER_SIZE;
+    header->frame_size      = SC_FRAME_BYTES;
+    header->index_offset    = index_offset;
+}
+
+// Append the index to the closed container and rewrite the header. After a
+// write error the frames may not be where the index says, so the container
+// is left unclosed.
+static void sc_stream_close_container(sc_stream *stream) {
+    sc_stream_header header;
+    uint64_t n_written;
+    FILE *fid;
+    int ok;
+
+    sc_mutex_lock(&stream->stats_mutex);
+    n_written = stream->stats.n_written[0] + stream->stats.n_written[1];
+    ok = stream->stats.n_write_errors == 0;
+    sc_mutex_unlock(&stream->stats_mutex);
+
+    if (!ok || n_written != stream->n_index) {
+        sc_log("Stream write errors, %s has no index\n", stream->basename);
+        return;
+    }
+
+    if ((fid = fopen(stream->basename, "r+b")) == NULL) {
+        sc_log("Error opening %s to write the index.\n", stream->basename);
+        return;
+    }
+
+    sc_stream_header_init(&header, stream->start_time, stream->n_index,
+                          SC_STREAM_HEADER_SIZE + stream->n_index * SC_FRAME_BYTES);
+
+    ok = fseek(fid, 0, SEEK_END) == 0
+        && fwrite(stream->index, sizeof(sc_stream_index_entry), (size_t) stream->n_index, fid)
+           == (size_t) stream->n_index
+        && fseek(fid, 0, SEEK_SET) == 0
+        && fwrite(&header, sizeof(header), 1, fid) == 1;
+    if (fclose(fid) != 0) ok = 0;
+
+    if (!ok) sc_log("Error writing the index of %s\n", stream->basename);
+}
+
+sc_stream *sc_stream_start(sc_source *src, const sc_stream_options *options) {
+    sc_stream *stream = (sc_stream *) calloc(1, sizeof(sc_stream));
+    time_t start = time(NULL);
+    void *buffer;
+    int c, flags;
+
+    if (stream == NULL) return NULL;
+
+    stream->src = src;
+    stream->options = *options;
+    if (stream->options.buffer_frames < 1) stream->options.buffer_frames = 1;
+    if (stream->options.n_buffers < 2) stream->options.n_buffers = 2;
+    if (stream->options.file_frames < 0) stream->options.file_frames = 0;
+
+    sc_mutex_init(&stream->stats_mutex);
+    sc_mutex_init(&stream->index_mutex);
+    stream->t0 = sc_time();
+    stream->start_time = (int64_t) start * 1000000;
+
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        stream->camera_args[c].stream = stream;
+        stream->camera_args[c].index = c;
+    }
+
+    if (stream->options.output_root != NULL && stream->options.container) {
+        if (sc_stream_filename(stream->basename, sizeof(stream->basename),
+                               stream->options.output_root, start) != 0) {
+            sc_log("Could not create the stream directory below %s\n",
+                   stream->options.output_root);
+            goto error;
+        }
+
+        // both cameras share the buffers
+        flags = SC_WRITE_APPEND | (stream->options.direct_io ? SC_WRITE_DIRECT : 0);
+        stream->writers[0] = sc_writer_new(SC_NCAMERAS * stream->options.n_buffers,
+                                           (size_t) stream->options.buffer_frames * SC_FRAME_BYTES,
+                                           flags, sc_stream_written, stream,
+                                           stream->options.pool);
+        if (stream->writers[0] == NULL) goto error;
+        stream->container = stream->writers[0];
+
+        // the header, until it is rewritten when the capture is closed
+        buffer = sc_writer_acquire(stream->container);
+        memset(buffer, 0, SC_STREAM_HEADER_SIZE);
+        sc_stream_header_init((sc_stream_header *) buffer, stream->start_time, 0, 0);
+        sc_writer_submit(stream->container, buffer, SC_STREAM_HEADER_SIZE, stream->basename, "0 0");
+        stream->stats.n_files = 1;
+    } else if (stream->options.output_root != NULL) {
+        if (sc_stream_basename(stream->basename, sizeof(stream->basename),
+                               stream->options.output_root, start) != 0) {
+            sc_log("Could not create the stream directory below %s\n",
+                   stream->options.output_root);
+            goto error;
+        }
+
+        flags = SC_WRITE_APPEND | (stream->options.direct_io ? SC_WRITE_DIRECT : 0);
+        for (c = 0; c < SC_NCAMERAS; c++) {
+            stream->writers[c] = sc_writer_new(stream->options.n_buffers,
+                                               (size_t) stream->options.buffer_frames * SC_FRAME_BYTES,
+                                               flags, sc_stream_written, stream,
+                                               stream->options.pool);
+            if (stream->writers[c] == NULL) goto error;
+        }
+    }
+
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        if (sc_thread_create(&stream->camera_threads[c], sc_stream_camera_thread,
+                             &stream->camera_args[c]) != 0) {
+            sc_log("Could not create camera thread\n");
+            goto error;
+        }
+        stream->n_camera_threads++;
+    }
+
+    return stream;
+
+  error:
+    sc_stream_stop(stream);
+    sc_stream_join(stream);
+    sc_stream_free(stream);
+    return NULL;
+}
+
+void sc_stream_stop(sc_stream *stream) {
+    stream->src->stop(stream->src);
+}
+
+int sc_stream_done(sc_stream *stream) {
+    int done;
+
+    sc_mutex_lock(&stream->stats_mutex);
+    done = stream->n_camera_threads > 0 && stream->n_exited == stream->n_camera_threads;
+    sc_mutex_unlock(&stream->stats_mutex);
+
+    return done;
+}
+
+int sc_stream_reserve(sc_pool *pool, const sc_stream_options *options) {
+    int buffer_frames = options->buffer_frames < 1 ? 1 : options->buffer_frames;
+    int n_buffers = SC_NCAMERAS * (options->n_buffers < 2 ? 2 : options->n_buffers);
+    size_t size = ((size_t) buffer_frames * SC_FRAME_BYTES + SC_IO_ALIGNMENT - 1)
+        / SC_IO_ALIGNMENT * SC_IO_ALIGNMENT;
+    void **buffers;
+    int b, status = 0;
+
+    // the write buffers of sc_stream_start, container or not
+    if (pool == NULL || options->output_root == NULL) return 0;
+
+    if ((buffers = (void **) calloc(n_buffers, sizeof(void *))) == NULL) return -1;
+    for (b = 0; b < n_buffers; b++) {
+        if ((buffers[b] = sc_pool_get(pool, size, 1)) == NULL) status = -1;
+    }
+    for (b = 0; b < n_buffers; b++) sc_pool_put(pool, buffers[b], 1);
+    free(buffers);
+
+    return status;
+}
+
+void sc_stream_join(sc_stream *stream) {
+    char my_Res[256];
+    int c;
+
+    if (stream->joined) return;
+
+    for (c = 0; c < stream->n_camera_threads; c++) sc_thread_join(stream->camera_threads[c]);
+
+    // at most n_buffers buffers per camera are left to write
+    for (c = 0; c < SC_NCAMERAS; c++) {
+        sc_writer_free(stream->writers[c]);
+        stream->writers[c] = NULL;
+    }
+
+    if (stream->container != NULL) {
+        stream->container = NULL;
+        sc_stream_close_container(stream);
+    }
+
+    stream->joined = 1;
+
+    // Tell the client that the raw images have finished writing to disk.
+    if (stream->n_camera_threads == SC_NCAMERAS && stream->options.notify != NULL) {
+        sc_mutex_lock(&stream->stats_mutex);
+        snprintf(my_Res, sizeof(my_Res), "write stream done %llu %llu",
+                 (unsigned long long) stream->stats.n_written[0],
+                 (unsigned long long) stream->stats.n_written[1]);
+        sc_mutex_unlock(&stream->stats_mutex);
+        stream->options.notify(my_Res, stream->options.notify_data);
+    }
+}
+
+void sc_stream_get_stats(sc_stream *stream, sc_stream_stats *stats) {
+    sc_mutex_lock(&stream->stats_mutex);
+    *stats = stream->stats;
+    sc_mutex_unlock(&stream->stats_mutex);
+}
+
+void sc_stream_free(sc_stream *stream) {
+    int c;
+
+    if (stream == NULL) return;
+
+    for (c = 0; c < SC_NCAMERAS; c++) sc_writer_free(stream->writers[c]);
+    free(stream->index);
+    sc_mutex_destroy(&stream->index_mutex);
+    sc_mutex_destroy(&stream->stats_mutex);
+    free(stream);
+}
@@ -0,0 +1,176 @@
+// sc_thread.h   thin portability layer for the threads, semaphores and
+//               clocks used by the socketcam core, so the acquisition logic
+//               does not call CreateThread/WaitForSingleObject directly.
+//
+//               socketcam.c hands buffers between threads with auto-reset
+//               events (hBufferX0ReadyEvent, etc.). The core uses counting
+//               semaphores instead, so a post made before anyone is waiting
+//               is never lost and shutdown can post one extra wake-up per
+//               waiter without racing real hand-offs.
+
+#ifndef SC_THREAD_H
+#define SC_THREAD_H
+
+#ifdef _WIN32
+
+#include <stdint.h>
+#include <windows.h>
+#include <process.h>
+
+typedef HANDLE sc_thread;
+typedef CRITICAL_SECTION sc_mutex;
+typedef HANDLE sc_sem;
+
+typedef unsigned (__stdcall *sc_thread_start)(void *arg);
+#define SC_THREAD_RETURN unsigned __stdcall
+#define SC_THREAD_RESULT 0
+
+static __inline int sc_thread_create(sc_thread *thread, sc_thread_start start, void *arg) {
+    *thread = (HANDLE) _beginthreadex(NULL, 0, start, arg, 0, NULL);
+    return *thread == NULL ? -1 : 0;
+}
+
+static __inline void sc_thread_join(sc_thread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+static __inline void sc_mutex_init(sc_mutex *m)    { InitializeCriticalSection(m); }
+static __inline void sc_mutex_destroy(sc_mutex *m) { DeleteCriticalSection(m); }
+static __inline void sc_mutex_lock(sc_mutex *m)    { EnterCriticalSection(m); }
+static __inline void sc_mutex_unlock(sc_mutex *m)  { LeaveCriticalSection(m); }
+
+static __inline int sc_sem_init(sc_sem *s, unsigned int count) {
+    *s = CreateSemaphore(NULL, (LONG) count, 0x7fffffff, NULL);
+    return *s == NULL ? -1 : 0;
+}
+static __inline void sc_sem_destroy(sc_sem *s) { CloseHandle(*s); }
+static __inline void sc_sem_post(sc_sem *s)    { ReleaseSemaphore(*s, 1, NULL); }
+static __inline void sc_sem_wait(sc_sem *s)    { WaitForSingleObject(*s, INFINITE); }
+
+// decrement the semaphore if it is positive; returns 1 if it was decremented
+static __inline int sc_sem_trywait(sc_sem *s) {
+    return WaitForSingleObject(*s, 0) == WAIT_OBJECT_0;
+}
+
+// 64-bit counters shared lock-free between one writing and one reading
+// thread: a release store publishes everything written before it to a
+// thread that acquire loads the new value
+static __inline uint64_t sc_atomic_load(volatile uint64_t *p) {
+    return (uint64_t) InterlockedCompareExchange64((volatile LONG64 *) p, 0, 0);
+}
+static __inline void sc_atomic_store(volatile uint64_t *p, uint64_t value) {
+    InterlockedExchange64((volatile LONG64 *) p, (LONG64) value);
+}
+
+static __inline void sc_sleep(double secs) {
+    if (secs > 0.0) Sleep((DWORD) (secs * 1000.0 + 0.5));
+}
+
+// seconds since an arbitrary, fixed starting point
+static __inline double sc_time(void) {
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double) count.QuadPart / (double) freq.QuadPart;
+}
+
+#else
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef pthread_t sc_thread;
+typedef pthread_mutex_t sc_mutex;
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    unsigned int    count;
+} sc_sem;
+
+typedef void *(*sc_thread_start)(void *arg);
+#define SC_THREAD_RETURN void *
+#define SC_THREAD_RESULT NULL
+
+static inline int sc_thread_create(sc_thread *thread, sc_thread_start start, void *arg) {
+    return pthread_create(thread, NULL, start, arg) == 0 ? 0 : -1;
+}
+
+static inline void sc_thread_join(sc_thread thread) { pthread_join(thread, NULL); }
+
+static inline void sc_mutex_init(sc_mutex *m)    { pthread_mutex_init(m, NULL); }
+static inline void sc_mutex_destroy(sc_mutex *m) { pthread_mutex_destroy(m); }
+static inline void sc_mutex_lock(sc_mutex *m)    { pthread_mutex_lock(m); }
+static inline void sc_mutex_unlock(sc_mutex *m)  { pthread_mutex_unlock(m); }
+
+static inline int sc_sem_init(sc_sem *s, unsigned int count) {
+    s->count = count;
+    if (pthread_mutex_init(&s->mutex, NULL) != 0) return -1;
+    if (pthread_cond_init(&s->cond, NULL) != 0) {
+        pthread_mutex_destroy(&s->mutex);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void sc_sem_destroy(sc_sem *s) {
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->mutex);
+}
+
+static inline void sc_sem_post(sc_sem *s) {
+    pthread_mutex_lock(&s->mutex);
+    s->count++;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+}
+
+static inline void sc_sem_wait(sc_sem *s) {
+    pthread_mutex_lock(&s->mutex);
+    while (s->count == 0) pthread_cond_wait(&s->cond, &s->mutex);
+    s->count--;
+    pthread_mutex_unlock(&s->mutex);
+}
+
+// decrement the semaphore if it is positive; returns 1 if it was decremented
+static inline int sc_sem_trywait(sc_sem *s) {
+    int decremented = 0;
+    pthread_mutex_lock(&s->mutex);
+    if (s->count > 0) {
+        s->count--;
+        decremented = 1;
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return decremented;
+}
+
+// 64-bit counters shared lock-free between one writing and one reading
+// thread: a release store publishes everything written before it to a
+// thread that acquire loads the new value
+static inline uint64_t sc_atomic_load(volatile uint64_t *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static inline void sc_atomic_store(volatile uint64_t *p, uint64_t value) {
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+static inline void sc_sleep(double secs) {
+    struct timespec ts;
+    if (secs <= 0.0) return;
+    ts.tv_sec = (time_t) secs;
+    ts.tv_nsec = (long) ((secs - (double) ts.tv_sec) * 1.0e9);
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+// seconds since an arbitrary, fixed starting point
+static inline double sc_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + 1.0e-9 * (double) ts.tv_nsec;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,157 @@
+// sc_util.c   logging, status names, aligned memory, directories and
+//             latency histograms for the socketcam core.
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <malloc.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#include "sc_core.h"
+
+static FILE *sc_logfid = NULL;
+
+const char *sc_status_name(int status) {
+    switch (status) {
+        case SC_OK:      return "OK";
+        case SC_STOPPED: return "Acquisition has been stopped";
+        case SC_ABORTED: return "Acquisition has been aborted";
+        case SC_TIMEOUT: return "Wait for frame has timed out";
+        default:         return "Wait for frame failed";
+    }
+}
+
+void sc_set_logfile(FILE *logfid) {
+    sc_logfid = logfid;
+}
+
+void sc_log(const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+
+    if (sc_logfid != NULL) {
+        va_start(args, format);
+        vfprintf(sc_logfid, format, args);
+        va_end(args);
+        fflush(sc_logfid);
+    }
+}
+
+void *sc_aligned_malloc(size_t size, size_t alignment) {
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    void *ptr;
+    if (posix_memalign(&ptr, alignment, size) != 0) return NULL;
+    return ptr;
+#endif
+}
+
+void sc_aligned_free(void *ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+int sc_mkdir(const char *dirname) {
+#ifdef _WIN32
+    if (_mkdir(dirname) == 0 || errno == EEXIST) return 0;
+#else
+    if (mkdir(dirname, 0775) == 0 || errno == EEXIST) return 0;
+#endif
+    sc_log("Could not create directory %s\n", dirname);
+    return -1;
+}
+
+int sc_mkdir_exclusive(const char *dirname) {
+#ifdef _WIN32
+    if (_mkdir(dirname) == 0) return 0;
+#else
+    if (mkdir(dirname, 0775) == 0) return 0;
+#endif
+    if (errno == EEXIST) return 1;
+    sc_log("Could not create directory %s\n", dirname);
+    return -1;
+}
+
+int sc_create_exclusive(const char *filename) {
+    FILE *fid;
+
+    // "x" fails if the file exists, like O_CREAT | O_EXCL
+    if ((fid = fopen(filename, "wbx")) != NULL) {
+        fclose(fid);
+        return 0;
+    }
+    if (errno == EEXIST) return 1;
+    sc_log("Could not create %s\n", filename);
+    return -1;
+}
+
+// bins 0-3 are 0-3 ns, then 4 bins for each power of 2 from 4 ns up
+static int sc_hist_bin(uint64_t ns) {
+    int msb = 0, bin;
+
+    if (ns < 4) return (int) ns;
+    while ((ns >> msb) > 1) msb++;
+    bin = 4 * msb + (int) ((ns >> (msb - 2)) & 3);
+    return bin < SC_HIST_NBINS ? bin : SC_HIST_NBINS - 1;
+}
+
+static double sc_hist_upper(int bin) {
+    if (bin < 4) return (double) (bin + 1) * 1.0e-9;
+    return (double) ((uint64_t) (4 + bin % 4 + 1) << (bin / 4 - 2)) * 1.0e-9;
+}
+
+void sc_hist_init(sc_hist *hist) {
+    memset(hist, 0, sizeof(sc_hist));
+}
+
+void sc_hist_add(sc_hist *hist, double secs) {
+    if (secs < 0.0) secs = 0.0;
+    hist->bins[sc_hist_bin((uint64_t) (secs * 1.0e9))]++;
+    hist->count++;
+    hist->sum += secs;
+    if (secs > hist->max) hist->max = secs;
+}
+
+void sc_hist_merge(sc_hist *hist, const sc_hist *other) {
+    int b;
+
+    for (b = 0; b < SC_HIST_NBINS; b++) hist->bins[b] += other->bins[b];
+    hist->count += other->count;
+    hist->sum += other->sum;
+    if (other->max > hist->max) hist->max = other->max;
+}
+
+double sc_hist_percentile(const sc_hist *hist, double p) {
+    uint64_t rank, n = 0;
+    double upper;
+    int b;
+
+    if (hist->count == 0) return 0.0;
+
+    // the rank of the p-th percentile sample, counting from 1
+    rank = (uint64_t) (p / 100.0 * (double) hist->count + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > hist->count) rank = hist->count;
+
+    for (b = 0; b < SC_HIST_NBINS; b++) {
+        n += hist->bins[b];
+        if (n >= rank) break;
+    }
+    upper = sc_hist_upper(b < SC_HIST_NBINS ? b : SC_HIST_NBINS - 1);
+    return upper < hist->max ? upper : hist->max;
+}
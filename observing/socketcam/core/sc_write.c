@@ -0,0 +1,178 @@
+// sc_write.c   converts average cubes to 16 bits and writes them to disk,
+//              i.e., writeAvg16.h, and names the average and stream files.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sc_core.h"
+
+void sc_convert_cube(const uint32_t *cube, int16_t *cube16, size_t n_values) {
+    size_t i;
+
+    // Drop the lowest 16 bits, then subtract 32768 so the unsigned 16-bit
+    // value fits in a signed 16-bit value without losing any information.
+    for (i = 0; i < n_values; i++) {
+        cube16[i] = (int16_t) ((cube[i] >> 16) - 0x8000);
+    }
+}
+
+// "" for the first file of a second, "_N" for later ones
+static void sc_sequence_tag(char *tag, size_t size, int sequence) {
+    if (sequence == 0) {
+        tag[0] = '\0';
+    } else {
+        snprintf(tag, size, "_%d", sequence);
+    }
+}
+
+int sc_cube_filename(char *filename, size_t size,
+                     const char *root, time_t timestamp,
+                     const char *suffix, int *sequence) {
+    struct tm lTS, aTS;
+    char mydir[1024], tag[16];
+    int seq, first, last, status;
+
+    // localtime and gmtime share static storage, so copy the results
+    lTS = *localtime(&timestamp);
+    aTS = *gmtime(&timestamp);
+
+    if (root == NULL) {
+        snprintf(filename, size, "%4d%02d%02d_%02d%02d%02d_kcor%s",
+                 aTS.tm_year + 1900, aTS.tm_mon + 1, aTS.tm_mday,
+                 aTS.tm_hour, aTS.tm_min, aTS.tm_sec, suffix);
+        return 0;
+    }
+
+    if (sc_mkdir(root) != 0) return -1;
+
+    // directory is based on the local date, as on the observing PC
+    snprintf(mydir, sizeof(mydir), "%s/%4d%02d%02d",
+             root, lTS.tm_year + 1900, lTS.tm_mon + 1, lTS.tm_mday);
+    if (sc_mkdir(mydir) != 0) return -1;
+
+    strncat(mydir, "/avg", sizeof(mydir) - strlen(mydir) - 1);
+    if (sc_mkdir(mydir) != 0) return -1;
+
+    // a given sequence number is used even if its file exists already
+    first = *sequence < 0 ? 0 : *sequence;
+    last = *sequence < 0 ? SC_MAX_SEQUENCE - 1 : *sequence;
+    for (seq = first; seq <= last; seq++) {
+        sc_sequence_tag(tag, sizeof(tag), seq);
+        snprintf(filename, size, "%s/%4d%02d%02d_%02d%02d%02d%s_kcor%s",
+                 mydir,
+                 aTS.tm_year + 1900, aTS.tm_mon + 1, aTS.tm_mday,
+                 aTS.tm_hour, aTS.tm_min, aTS.tm_sec, tag, suffix);
+        status = sc_create_exclusive(filename);
+        if (status < 0) return -1;
+        if (status == 0 || *sequence >= 0) {
+            *sequence = seq;
+            return 0;
+        }
+    }
+
+    sc_log("Too many files named %s/%4d%02d%02d_%02d%02d%02d*_kcor%s\n",
+           mydir, aTS.tm_year + 1900, aTS.tm_mon + 1, aTS.tm_mday,
+           aTS.tm_hour, aTS.tm_min, aTS.tm_sec, suffix);
+    return -1;
+}
+
+int sc_stream_filename(char *filename, size_t size,
+                       const char *root, time_t timestamp) {
+    struct tm TS;
+    char mydir[1024], tag[16];
+    int seq, status;
+
+    TS = *gmtime(&timestamp);
+
+    if (sc_mkdir(root) != 0) return -1;
+
+    snprintf(mydir, sizeof(mydir), "%s/%4d%02d%02d",
+             root, TS.tm_year + 1900, TS.tm_mon + 1, TS.tm_mday);
+    if (sc_mkdir(mydir) != 0) return -1;
+
+    for (seq = 0; seq < SC_MAX_SEQUENCE; seq++) {
+        sc_sequence_tag(tag, sizeof(tag), seq);
+        snprintf(filename, size, "%s/%4d%02d%02d_%02d%02d%02d%s_kcor_stream.bin",
+                 mydir,
+                 TS.tm_year + 1900, TS.tm_mon + 1, TS.tm_mday,
+                 TS.tm_hour, TS.tm_min, TS.tm_sec, tag);
+        status = sc_create_exclusive(filename);
+        if (status <= 0) return status;
+    }
+
+    sc_log("Too many streams started at %02d:%02d:%02d in %s\n",
+           TS.tm_hour, TS.tm_min, TS.tm_sec, mydir);
+    return -1;
+}
+
+int sc_stream_basename(char *basename, size_t size,
+                       const char *root, time_t timestamp) {
+    struct tm TS;
+    char mydir[1024], tag[16];
+    size_t n;
+    int seq, status;
+
+    TS = *gmtime(&timestamp);
+
+    // writeoutstrm.h uses UT for the directories too
+    if (sc_mkdir(root) != 0) return -1;
+
+    snprintf(mydir, sizeof(mydir), "%s/%4d%02d%02d",
+             root, TS.tm_year + 1900, TS.tm_mon + 1, TS.tm_mday);
+    if (sc_mkdir(mydir) != 0) return -1;
+
+    // the .raw files of a stream are claimed by creating their directory
+    n = strlen(mydir);
+    for (seq = 0; seq < SC_MAX_SEQUENCE; seq++) {
+        sc_sequence_tag(tag, sizeof(tag), seq);
+        snprintf(mydir + n, sizeof(mydir) - n, "/%02d%02d%02d%sraw",
+                 TS.tm_hour, TS.tm_min, TS.tm_sec, tag);
+        status = sc_mkdir_exclusive(mydir);
+        if (status < 0) return -1;
+        if (status == 0) {
+            snprintf(basename, size, "%s/%4d%02d%02d_%02d%02d%02d%s",
+                     mydir,
+                     TS.tm_year + 1900, TS.tm_mon + 1, TS.tm_mday,
+                     TS.tm_hour, TS.tm_min, TS.tm_sec, tag);
+            return 0;
+        }
+    }
+
+    mydir[n] = '\0';
+    sc_log("Too many streams started at %02d:%02d:%02d in %s\n",
+           TS.tm_hour, TS.tm_min, TS.tm_sec, mydir);
+    return -1;
+}
+
+int sc_write_cube(const char *filename, const int16_t *cube16, size_t n_values) {
+    static const char header[SC_HEADER_SIZE] = { 0 };
+    size_t imwrote, cube_size = n_values * sizeof(int16_t);
+    FILE *afid;
+
+    if ((afid = fopen(filename, "wb")) == NULL) {
+        sc_log("Error opening %s for writing.\n", filename);
+        return -1;
+    }
+
+    // leave room at the beginning of the file for the FITS header
+    if ((imwrote = fwrite(header, 1, SC_HEADER_SIZE, afid)) != SC_HEADER_SIZE) {
+        sc_log("Image write error: only wrote %zu bytes to %s, expected %d\n",
+               imwrote, filename, SC_HEADER_SIZE);
+        fclose(afid);
+        return -1;
+    }
+
+    if ((imwrote = fwrite(cube16, 1, cube_size, afid)) != cube_size) {
+        sc_log("Image write error: only wrote %zu bytes to %s, expected %zu\n",
+               imwrote, filename, cube_size);
+        fclose(afid);
+        return -1;
+    }
+
+    if (fclose(afid) != 0) {
+        sc_log("Error closing %s\n", filename);
+        return -1;
+    }
+
+    return 0;
+}
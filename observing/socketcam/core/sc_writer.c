@@ -0,0 +1,487 @@
+// sc_writer.c   asynchronous writer for average cubes and stream files.
+//
+// The thread draining the accumulation ring converts each cube into one of a
+// few aligned write buffers and hands it to the writer's I/O thread, so a
+// slot is released as soon as it is converted instead of after the file is
+// on disk. Files are written unbuffered from the aligned buffers: O_DIRECT on
+// Linux, FILE_FLAG_NO_BUFFERING with overlapped I/O on Windows. Unbuffered
+// writes must be a multiple of SC_IO_ALIGNMENT bytes, so the padded buffer is
+// written and the file truncated to its real size.
+//
+// With SC_WRITE_GZIP, each buffer is compressed with zlib on the I/O thread
+// as it is written, instead of by a gzip process per file afterwards.
+//
+// In stream mode the writer is opened with SC_WRITE_APPEND and each buffer
+// of frames is appended to the file it names, which stays open until a
+// buffer names another file or the writer is freed.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#ifdef SC_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "sc_core.h"
+#include "sc_thread.h"
+
+// an open output file and the number of bytes written to it
+typedef struct {
+#ifdef _WIN32
+    HANDLE   h;
+#else
+    int      fd;
+#endif
+    int      direct;
+    uint64_t offset;
+    uint64_t size;        // real size, without the padding of the last write
+} sc_file;
+
+#define SC_FILE_CLOSED 0
+#define SC_FILE_OPEN   1
+#define SC_FILE_FAILED 2
+
+typedef struct {
+    void  *buffer;
+    size_t size;
+    char   filename[1024];
+    char   tag[256];
+} sc_write_job;
+
+struct sc_writer {
+    int               n_buffers;
+    size_t            buffer_size;
+    int               flags;
+    int               gzip_level;
+    sc_write_done_fn  done;
+    void             *done_data;
+
+    void            **buffers;
+    sc_pool          *pool;        // where the buffers came from
+    sc_mutex          mutex;
+
+    void            **free_list;   // n_free buffers ready to be acquired
+    int               n_free;
+    sc_sem            free_sem;
+
+    sc_write_job     *jobs;        // queue of n_jobs jobs starting at head
+    int               head;
+    int               n_jobs;
+    sc_sem            job_sem;
+
+    // the file being appended to, with SC_WRITE_APPEND
+    sc_file           file;
+    int               file_state;
+    char              open_filename[1024];
+
+    int               quit;
+    int               started;
+    sc_thread         thread;
+};
+
+
+static size_t sc_round_up(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+#ifdef _WIN32
+
+static int sc_file_open(sc_file *f, const char *filename, int flags) {
+    DWORD attributes = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED;
+
+    f->direct = (flags & SC_WRITE_DIRECT) != 0;
+    if (f->direct) attributes |= FILE_FLAG_NO_BUFFERING;
+    f->offset = f->size = 0;
+
+    f->h = CreateFileA(filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, attributes, NULL);
+    if (f->h == INVALID_HANDLE_VALUE) {
+        sc_log("Error opening %s for writing.\n", filename);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int sc_file_write(sc_file *f, const char *filename,
+                         const void *buffer, size_t size) {
+    const size_t max_chunk = (size_t) 64 * 1024 * 1024;
+    size_t write_size = f->direct ? sc_round_up(size, SC_IO_ALIGNMENT) : size;
+    size_t offset = 0, chunk;
+    uint64_t position;
+    OVERLAPPED ov;
+    DWORD written;
+    int status = 0;
+
+    memset(&ov, 0, sizeof(ov));
+    ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    while (offset < write_size) {
+        chunk = write_size - offset < max_chunk ? write_size - offset : max_chunk;
+        position = f->offset + offset;
+        ov.Offset = (DWORD) (position & 0xffffffff);
+        ov.OffsetHigh = (DWORD) (position >> 32);
+        ResetEvent(ov.hEvent);
+        if (!WriteFile(f->h, (const char *) buffer + offset, (DWORD) chunk, NULL, &ov)
+                && GetLastError() != ERROR_IO_PENDING) {
+            status = -1;
+            break;
+        }
+        if (!GetOverlappedResult(f->h, &ov, &written, TRUE) || written != chunk) {
+            status = -1;
+            break;
+        }
+        offset += chunk;
+    }
+
+    CloseHandle(ov.hEvent);
+
+    if (status != 0) {
+        sc_log("Image write error: could not write %zu bytes to %s\n", size, filename);
+        return -1;
+    }
+
+    f->size = f->offset + size;
+    f->offset += write_size;
+    return 0;
+}
+
+static int sc_file_close(sc_file *f, const char *filename) {
+    FILE_END_OF_FILE_INFO eof;
+    int status = 0;
+
+    if (f->size != f->offset) {
+        eof.EndOfFile.QuadPart = (LONGLONG) f->size;
+        if (!SetFileInformationByHandle(f->h, FileEndOfFileInfo, &eof, sizeof(eof))) status = -1;
+    }
+    if (!CloseHandle(f->h)) status = -1;
+
+    if (status != 0) sc_log("Error closing %s\n", filename);
+    return status;
+}
+
+#else
+
+static int sc_file_open(sc_file *f, const char *filename, int flags) {
+    int oflags = O_WRONLY | O_CREAT | O_TRUNC;
+
+    f->fd = -1;
+    f->direct = 0;
+    f->offset = f->size = 0;
+
+#ifdef O_DIRECT
+    // not every filesystem, e.g., tmpfs, supports O_DIRECT
+    if (flags & SC_WRITE_DIRECT) {
+        f->fd = open(filename, oflags | O_DIRECT, 0664);
+        f->direct = f->fd >= 0;
+    }
+#else
+    (void) flags;
+#endif
+    if (f->fd < 0) f->fd = open(filename, oflags, 0664);
+    if (f->fd < 0) {
+        sc_log("Error opening %s for writing: %s\n", filename, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static int sc_file_write(sc_file *f, const char *filename,
+                         const void *buffer, size_t size) {
+    size_t write_size = f->direct ? sc_round_up(size, SC_IO_ALIGNMENT) : size;
+    size_t offset = 0;
+    ssize_t n;
+
+    while (offset < write_size) {
+        n = pwrite(f->fd, (const char *) buffer + offset, write_size - offset,
+                   (off_t) (f->offset + offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            sc_log("Image write error: only wrote %zu bytes to %s, expected %zu: %s\n",
+                   offset, filename, write_size, strerror(errno));
+            return -1;
+        }
+        offset += (size_t) n;
+    }
+
+    f->size = f->offset + size;
+    f->offset += write_size;
+    return 0;
+}
+
+static int sc_file_close(sc_file *f, const char *filename) {
+    int status = 0;
+
+    if (f->size != f->offset && ftruncate(f->fd, (off_t) f->size) != 0) {
+        sc_log("Error truncating %s: %s\n", filename, strerror(errno));
+        status = -1;
+    }
+
+    if (close(f->fd) != 0) {
+        sc_log("Error closing %s: %s\n", filename, strerror(errno));
+        status = -1;
+    }
+
+    return status;
+}
+
+#endif
+
+#ifdef SC_HAVE_ZLIB
+
+// write a whole file gzip compressed; unbuffered I/O does not apply
+static int sc_gzip_file(const char *filename, const void *buffer, size_t size, int level) {
+    const size_t max_chunk = (size_t) 1 << 30;
+    size_t offset = 0, chunk;
+    char mode[8];
+    gzFile gz;
+    int status = 0;
+
+    snprintf(mode, sizeof(mode), "wb%d", level);
+    if ((gz = gzopen(filename, mode)) == NULL) {
+        sc_log("Error opening %s for writing.\n", filename);
+        return -1;
+    }
+    gzbuffer(gz, 1 << 20);
+
+    while (offset < size) {
+        chunk = size - offset < max_chunk ? size - offset : max_chunk;
+        if (gzwrite(gz, (const char *) buffer + offset, (unsigned int) chunk) != (int) chunk) {
+            status = -1;
+            break;
+        }
+        offset += chunk;
+    }
+
+    if (gzclose(gz) != Z_OK) status = -1;
+
+    if (status != 0) sc_log("Image write error: could not compress %zu bytes to %s\n", size, filename);
+    return status;
+}
+
+#endif
+
+// close the file left open by appending
+static void sc_writer_close(sc_writer *writer) {
+    if (writer->file_state == SC_FILE_OPEN) sc_file_close(&writer->file, writer->open_filename);
+    writer->file_state = SC_FILE_CLOSED;
+}
+
+// Write a job: a whole file, or with SC_WRITE_APPEND, the next piece of the
+// file left open by the previous job. Unbuffered writes must start on an
+// SC_IO_ALIGNMENT boundary, so only the last piece of a file may have a size
+// that is not a multiple of SC_IO_ALIGNMENT.
+static int sc_writer_write(sc_writer *writer, const sc_write_job *job) {
+    int status;
+
+#ifdef SC_HAVE_ZLIB
+    if (writer->flags & SC_WRITE_GZIP) {
+        return sc_gzip_file(job->filename, job->buffer, job->size, writer->gzip_level);
+    }
+#endif
+
+    if (!(writer->flags & SC_WRITE_APPEND)) {
+        if (sc_file_open(&writer->file, job->filename, writer->flags) != 0) return -1;
+        status = sc_file_write(&writer->file, job->filename, job->buffer, job->size);
+        if (sc_file_close(&writer->file, job->filename) != 0) status = -1;
+        return status;
+    }
+
+    if (writer->file_state == SC_FILE_CLOSED || strcmp(writer->open_filename, job->filename) != 0) {
+        sc_writer_close(writer);
+        snprintf(writer->open_filename, sizeof(writer->open_filename), "%s", job->filename);
+        writer->file_state = sc_file_open(&writer->file, job->filename, writer->flags) == 0
+            ? SC_FILE_OPEN : SC_FILE_FAILED;
+    }
+
+    // later pieces of a file that could not be opened are errors too
+    if (writer->file_state != SC_FILE_OPEN) return -1;
+
+    if (writer->file.direct && writer->file.offset != writer->file.size) {
+        sc_log("Unaligned append to %s\n", job->filename);
+        return -1;
+    }
+
+    return sc_file_write(&writer->file, job->filename, job->buffer, job->size);
+}
+
+static void sc_writer_recycle(sc_writer *writer, void *buffer) {
+    sc_mutex_lock(&writer->mutex);
+    writer->free_list[writer->n_free++] = buffer;
+    sc_mutex_unlock(&writer->mutex);
+    sc_sem_post(&writer->free_sem);
+}
+
+static SC_THREAD_RETURN sc_writer_thread(void *arg) {
+    sc_writer *writer = (sc_writer *) arg;
+    sc_write_job job;
+    double t;
+    int status;
+
+    for (;;) {
+        sc_sem_wait(&writer->job_sem);
+
+        sc_mutex_lock(&writer->mutex);
+        if (writer->n_jobs == 0) {
+            // queued jobs are written before quitting
+            int quit = writer->quit;
+            sc_mutex_unlock(&writer->mutex);
+            if (quit) break;
+            continue;
+        }
+        job = writer->jobs[writer->head];
+        writer->head = (writer->head + 1) % writer->n_buffers;
+        writer->n_jobs--;
+        sc_mutex_unlock(&writer->mutex);
+
+        t = sc_time();
+        status = sc_writer_write(writer, &job);
+        t = sc_time() - t;
+
+        sc_writer_recycle(writer, job.buffer);
+
+        if (writer->done != NULL) {
+            writer->done(job.filename, job.tag, status, t, writer->done_data);
+        }
+    }
+
+    sc_writer_close(writer);
+
+    return SC_THREAD_RESULT;
+}
+
+sc_writer *sc_writer_new(int n_buffers, size_t buffer_size, int flags,
+                         sc_write_done_fn done, void *done_data,
+                         sc_pool *pool) {
+    sc_writer *writer = (sc_writer *) calloc(1, sizeof(sc_writer));
+    int b;
+
+    if (writer == NULL) return NULL;
+
+#ifndef SC_HAVE_ZLIB
+    if (flags & SC_WRITE_GZIP) {
+        sc_log("Built without zlib, can not gzip\n");
+        free(writer);
+        return NULL;
+    }
+#endif
+
+    writer->n_buffers = n_buffers < 1 ? 1 : n_buffers;
+    writer->buffer_size = sc_round_up(buffer_size, SC_IO_ALIGNMENT);
+    writer->flags = flags;
+    writer->gzip_level = (flags >> 8) & 0xf;
+    if (writer->gzip_level < 1 || writer->gzip_level > 9) writer->gzip_level = 1;
+    writer->done = done;
+    writer->done_data = done_data;
+    writer->pool = pool;
+
+    sc_mutex_init(&writer->mutex);
+    sc_sem_init(&writer->free_sem, (unsigned int) writer->n_buffers);
+    sc_sem_init(&writer->job_sem, 0);
+
+    writer->buffers = (void **) calloc(writer->n_buffers, sizeof(void *));
+    writer->free_list = (void **) calloc(writer->n_buffers, sizeof(void *));
+    writer->jobs = (sc_write_job *) calloc(writer->n_buffers, sizeof(sc_write_job));
+    if (writer->buffers == NULL || writer->free_list == NULL || writer->jobs == NULL) {
+        goto error;
+    }
+
+    for (b = 0; b < writer->n_buffers; b++) {
+        writer->buffers[b] = sc_pool_get(pool, writer->buffer_size, 0);
+        if (writer->buffers[b] == NULL) goto error;
+        writer->free_list[writer->n_free++] = writer->buffers[b];
+    }
+
+    if (sc_thread_create(&writer->thread, sc_writer_thread, writer) != 0) {
+        sc_log("Could not create I/O thread\n");
+        goto error;
+    }
+    writer->started = 1;
+
+    return writer;
+
+  error:
+    sc_log("Could not allocate %d write buffers\n", writer->n_buffers);
+    sc_writer_free(writer);
+    return NULL;
+}
+
+void *sc_writer_try_acquire(sc_writer *writer) {
+    void *buffer;
+
+    if (!sc_sem_trywait(&writer->free_sem)) return NULL;
+    sc_mutex_lock(&writer->mutex);
+    buffer = writer->free_list[--writer->n_free];
+    sc_mutex_unlock(&writer->mutex);
+
+    return buffer;
+}
+
+void *sc_writer_acquire(sc_writer *writer) {
+    void *buffer;
+
+    sc_sem_wait(&writer->free_sem);
+    sc_mutex_lock(&writer->mutex);
+    buffer = writer->free_list[--writer->n_free];
+    sc_mutex_unlock(&writer->mutex);
+
+    return buffer;
+}
+
+void sc_writer_release(sc_writer *writer, void *buffer) {
+    sc_writer_recycle(writer, buffer);
+}
+
+void sc_writer_submit(sc_writer *writer, void *buffer, size_t size,
+                      const char *filename, const char *tag) {
+    sc_write_job *job;
+
+    sc_mutex_lock(&writer->mutex);
+    // there are only n_buffers buffers, so the queue can not overflow
+    job = &writer->jobs[(writer->head + writer->n_jobs) % writer->n_buffers];
+    job->buffer = buffer;
+    job->size = size;
+    snprintf(job->filename, sizeof(job->filename), "%s", filename);
+    snprintf(job->tag, sizeof(job->tag), "%s", tag != NULL ? tag : "");
+    writer->n_jobs++;
+    sc_mutex_unlock(&writer->mutex);
+
+    sc_sem_post(&writer->job_sem);
+}
+
+void sc_writer_free(sc_writer *writer) {
+    int b;
+
+    if (writer == NULL) return;
+
+    if (writer->started) {
+        sc_mutex_lock(&writer->mutex);
+        writer->quit = 1;
+        sc_mutex_unlock(&writer->mutex);
+        sc_sem_post(&writer->job_sem);
+        sc_thread_join(writer->thread);
+    }
+
+    if (writer->buffers != NULL) {
+        for (b = 0; b < writer->n_buffers; b++) sc_pool_put(writer->pool, writer->buffers[b], 0);
+    }
+    free(writer->buffers);
+    free(writer->free_list);
+    free(writer->jobs);
+
+    sc_sem_destroy(&writer->free_sem);
+    sc_sem_destroy(&writer->job_sem);
+    sc_mutex_destroy(&writer->mutex);
+    free(writer);
+}
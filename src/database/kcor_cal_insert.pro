@@ -81,6 +81,58 @@ pro kcor_cal_insert, date, fits_list, quality, $
   cd, current=start_dir
   cd, _catalog_dir
 
+  ; columns of kcor_cal, with the format of their values
+  cal_fields = [{name: 'file_name', type: '''%s'''}, $
+                {name: 'date_obs', type: '''%s'''}, $
+                {name: 'date_end', type: '''%s'''}, $
+                {name: 'obs_day', type: '%d'}, $
+                {name: 'level', type: '%d'}, $
+                {name: 'quality', type: '%d'}, $
+                {name: 'numsum', type: '%d'}, $
+                {name: 'exptime', type: '%f'}, $
+                {name: 'cover', type: '''%s'''}, $
+                {name: 'darkshut', type: '''%s'''}, $
+                {name: 'diffuser', type: '''%s'''}, $
+                {name: 'calpol', type: '''%s'''}, $
+                {name: 'calpang', type: '%f'}, $
+                {name: 'rcam_xcenter', type: '%s'}, $
+                {name: 'rcam_ycenter', type: '%s'}, $
+                {name: 'rcam_radius', type: '%s'}, $
+                {name: 'rcam_dc_xcenter', type: '%s'}, $
+                {name: 'rcam_dc_ycenter', type: '%s'}, $
+                {name: 'rcam_dc_radius', type: '%s'}, $
+                {name: 'tcam_xcenter', type: '%s'}, $
+                {name: 'tcam_ycenter', type: '%s'}, $
+                {name: 'tcam_radius', type: '%s'}, $
+                {name: 'tcam_dc_xcenter', type: '%s'}, $
+                {name: 'tcam_dc_ycenter', type: '%s'}, $
+                {name: 'tcam_dc_radius', type: '%s'}, $
+                {name: 'mean_int_img0', type: '%f'}, $
+                {name: 'mean_int_img1', type: '%f'}, $
+                {name: 'mean_int_img2', type: '%f'}, $
+                {name: 'mean_int_img3', type: '%f'}, $
+                {name: 'mean_int_img4', type: '%f'}, $
+                {name: 'mean_int_img5', type: '%f'}, $
+                {name: 'mean_int_img6', type: '%f'}, $
+                {name: 'mean_int_img7', type: '%f'}, $
+                {name: 'rcamid', type: '''%s'''}, $
+                {name: 'tcamid', type: '''%s'''}, $
+                {name: 'rcamlut', type: '''%s'''}, $
+                {name: 'tcamlut', type: '''%s'''}, $
+                {name: 'rcamfocs', type: '%f'}, $
+                {name: 'tcamfocs', type: '%f'}, $
+                {name: 'modltrid', type: '''%s'''}, $
+                {name: 'modltrt', type: '%f'}, $
+                {name: 'occltrid', type: '''%s'''}, $
+                {name: 'o1id', type: '''%s'''}, $
+                {name: 'o1focs', type: '%f'}, $
+                {name: 'calpolid', type: '''%s'''}, $
+                {name: 'diffsrid', type: '''%s'''}, $
+                {name: 'filterid', type: '''%s'''}, $
+                {name: 'kcor_sgsdimv', type: '%s'}, $
+                {name: 'kcor_sgsdims', type: '%s'}]
+  rows = list()
+
   ; step through list of fits files passed in parameter
   nfiles = n_elements(fits_list)
   if (nfiles eq 0) then begin
@@ -243,102 +295,62 @@ pro kcor_cal_insert, date, fits_list, quality, $
     fits_file = file_basename(fts_file, '.gz') ; remove '.gz' from file name
 	
     ; get IDs from relational tables
-    level_count = db->query('select count(level_id) from kcor_level where level=''%s''', $
-                            level, fields=fields, status=status)
+    level_count = db->cached_query('select count(level_id) from kcor_level where level=''%s''', $
+                                   level, fields=fields, status=status)
     if (status ne 0L) then goto, done
     if (level_count.count_level_id_ eq 0) then begin
       ; If given level is not in the kcor_level table, set it to 'unknown' and log error
       level = 'unk'
       mg_log, 'level: %s', level, name='kcor/eod', /error
     endif
-    level_results = db->query('select * from kcor_level where level=''%s''', $
-                              level, fields=fields, status=status)
+    level_results = db->cached_query('select * from kcor_level where level=''%s''', $
+                                     level, fields=fields, status=status)
     if (status ne 0L) then goto, done
     level_num = level_results.level_id	
 
-    fields = [{name: 'file_name', type: '''%s'''}, $
-              {name: 'date_obs', type: '''%s'''}, $
-              {name: 'date_end', type: '''%s'''}, $
-              {name: 'obs_day', type: '%d'}, $
-              {name: 'level', type: '%d'}, $
-              {name: 'quality', type: '%d'}, $
-              {name: 'numsum', type: '%d'}, $
-              {name: 'exptime', type: '%f'}, $
-              {name: 'cover', type: '''%s'''}, $
-              {name: 'darkshut', type: '''%s'''}, $
-              {name: 'diffuser', type: '''%s'''}, $
-              {name: 'calpol', type: '''%s'''}, $
-              {name: 'calpang', type: '%f'}, $
-              {name: 'rcam_xcenter', type: '%s'}, $
-              {name: 'rcam_ycenter', type: '%s'}, $
-              {name: 'rcam_radius', type: '%s'}, $
-              {name: 'rcam_dc_xcenter', type: '%s'}, $
-              {name: 'rcam_dc_ycenter', type: '%s'}, $
-              {name: 'rcam_dc_radius', type: '%s'}, $
-              {name: 'tcam_xcenter', type: '%s'}, $
-              {name: 'tcam_ycenter', type: '%s'}, $
-              {name: 'tcam_radius', type: '%s'}, $
-              {name: 'tcam_dc_xcenter', type: '%s'}, $
-              {name: 'tcam_dc_ycenter', type: '%s'}, $
-              {name: 'tcam_dc_radius', type: '%s'}, $
-              {name: 'mean_int_img0', type: '%f'}, $
-              {name: 'mean_int_img1', type: '%f'}, $
-              {name: 'mean_int_img2', type: '%f'}, $
-              {name: 'mean_int_img3', type: '%f'}, $
-              {name: 'mean_int_img4', type: '%f'}, $
-              {name: 'mean_int_img5', type: '%f'}, $
-              {name: 'mean_int_img6', type: '%f'}, $
-              {name: 'mean_int_img7', type: '%f'}, $
-              {name: 'rcamid', type: '''%s'''}, $
-              {name: 'tcamid', type: '''%s'''}, $
-              {name: 'rcamlut', type: '''%s'''}, $
-              {name: 'tcamlut', type: '''%s'''}, $
-              {name: 'rcamfocs', type: '%f'}, $
-              {name: 'tcamfocs', type: '%f'}, $
-              {name: 'modltrid', type: '''%s'''}, $
-              {name: 'modltrt', type: '%f'}, $
-              {name: 'occltrid', type: '''%s'''}, $
-              {name: 'o1id', type: '''%s'''}, $
-              {name: 'o1focs', type: '%f'}, $
-              {name: 'calpolid', type: '''%s'''}, $
-              {name: 'diffsrid', type: '''%s'''}, $
-              {name: 'filterid', type: '''%s'''}, $
-              {name: 'kcor_sgsdimv', type: '%s'}, $
-              {name: 'kcor_sgsdims', type: '%s'}]
-    sql_cmd = string(strjoin(fields.name, ', '), $
-                     strjoin(fields.type, ', '), $
-                     format='(%"insert into kcor_cal (%s) values (%s)")')
-    db->execute, sql_cmd, $
-                 fits_file, date_obs, date_end, obsday_index, level_num, quality[i], $
-                 numsum, exptime, cover, darkshut, diffuser, calpol, calpang, $
-                 kcor_fitsfloat2db(raw_rcam_centering_info[0]), $
-                 kcor_fitsfloat2db(raw_rcam_centering_info[1]), $
-                 kcor_fitsfloat2db(raw_rcam_centering_info[2]), $
-                 kcor_fitsfloat2db(dc_rcam_centering_info[0]), $
-                 kcor_fitsfloat2db(dc_rcam_centering_info[1]), $
-                 kcor_fitsfloat2db(dc_rcam_centering_info[2]), $
-                 kcor_fitsfloat2db(raw_tcam_centering_info[0]), $
-                 kcor_fitsfloat2db(raw_tcam_centering_info[1]), $
-                 kcor_fitsfloat2db(raw_tcam_centering_info[2]), $
-                 kcor_fitsfloat2db(dc_tcam_centering_info[0]), $
-                 kcor_fitsfloat2db(dc_tcam_centering_info[1]), $
-                 kcor_fitsfloat2db(dc_tcam_centering_info[2]), $
-                 mean_int_img0, mean_int_img1, mean_int_img2, mean_int_img3, $
-                 mean_int_img4, mean_int_img5, mean_int_img6, mean_int_img7, $
-                 rcamid, tcamid, rcamlut, tcamlut, rcamfocs, tcamfocs, $
-                 modltrid, modltrt, occltrid, o1id, o1focs, calpolid, $
-                 diffsrid, filterid, sgsdimv_str, sgsdims_str, $
-                 status=status, $
-                 error_message=error_message, $
-                 sql_statement=sql_cmd
-    if (status ne 0L) then begin
-      mg_log, 'problem inserting cal file', name='kcor/eod', /error
-      mg_log, 'error message: %s', error_message, name='kcor/eod', /error
-      mg_log, 'SQL command: %s', sql_cmd, name='kcor/eod', /error
-    endif
+    rows->add, list(fits_file, date_obs, date_end, obsday_index, level_num, quality[i], $
+                    numsum, exptime, cover, darkshut, diffuser, calpol, calpang, $
+                    kcor_fitsfloat2db(raw_rcam_centering_info[0]), $
+                    kcor_fitsfloat2db(raw_rcam_centering_info[1]), $
+                    kcor_fitsfloat2db(raw_rcam_centering_info[2]), $
+                    kcor_fitsfloat2db(dc_rcam_centering_info[0]), $
+                    kcor_fitsfloat2db(dc_rcam_centering_info[1]), $
+                    kcor_fitsfloat2db(dc_rcam_centering_info[2]), $
+                    kcor_fitsfloat2db(raw_tcam_centering_info[0]), $
+                    kcor_fitsfloat2db(raw_tcam_centering_info[1]), $
+                    kcor_fitsfloat2db(raw_tcam_centering_info[2]), $
+                    kcor_fitsfloat2db(dc_tcam_centering_info[0]), $
+                    kcor_fitsfloat2db(dc_tcam_centering_info[1]), $
+                    kcor_fitsfloat2db(dc_tcam_centering_info[2]), $
+                    mean_int_img0, mean_int_img1, mean_int_img2, mean_int_img3, $
+                    mean_int_img4, mean_int_img5, mean_int_img6, mean_int_img7, $
+                    rcamid, tcamid, rcamlut, tcamlut, rcamfocs, tcamfocs, $
+                    modltrid, modltrt, occltrid, o1id, o1focs, calpolid, $
+                    diffsrid, filterid, sgsdimv_str, sgsdims_str)
   endwhile
 
   done:
+  if (n_elements(rows) gt 0L) then begin
+    db->bulk_insert, 'kcor_cal', cal_fields, rows, $
+                     n_loaded=n_loaded, $
+                     status=status, $
+                     error_message=error_message
+    if (status ne 0L) then begin
+      mg_log, 'bulk insert into kcor_cal failed: %s', error_message, $
+              name='kcor/eod', /error
+      mg_log, 'inserting remaining %d rows one at a time', $
+              n_elements(rows) - n_loaded, name='kcor/eod', /warn
+      remaining_rows = rows[n_loaded:*]
+      db->bulk_insert, 'kcor_cal', cal_fields, remaining_rows, /row_by_row, $
+                       n_failed=n_failed
+      if (n_failed gt 0L) then begin
+        mg_log, '%d rows failed to insert into kcor_cal', n_failed, $
+                name='kcor/eod', /error
+      endif
+      obj_destroy, remaining_rows
+    endif
+  endif
+  obj_destroy, rows
   cd, start_dir
 
   mg_log, 'done', name='kcor/eod', /info
@@ -0,0 +1,48 @@
+; docformat = 'rst'
+
+;+
+; Log the statement timing statistics collected by the MySQL DLM, i.e., when
+; `MG_MYSQL_STATS_ENABLE, 1` has been called, and reset them.
+;
+; :Keywords:
+;   log_name : in, required, type=string
+;     log name to use for logging, i.e., "kcor/rt", "kcor/eod", etc.
+;   n_statements : in, optional, type=long, default=10
+;     number of statement fingerprints, in order of total time, to log
+;-
+pro kcor_db_log_stats, log_name=log_name, n_statements=n_statements
+  compile_opt strictarr
+
+  stats = mg_mysql_stats()
+  if (size(stats, /type) ne 8) then return
+
+  _n_statements = n_elements(n_statements) eq 0L ? 10L : n_statements
+
+  mg_log, 'database: %d statements in %0.2f secs (%0.2f secs storing results)', $
+          total(stats.count, /preserve_type), $
+          total(stats.total_time), $
+          total(stats.store_time), $
+          name=log_name, /info
+
+  ; histogram bin b counts statements taking [2^b, 2^(b+1)) usecs
+  bin_edges = 2.0D^dindgen(n_elements(stats[0].histogram) + 1L) * 1.0e-6
+
+  order = reverse(sort(stats.total_time))
+  for s = 0L, (_n_statements < n_elements(stats)) - 1L do begin
+    st = stats[order[s]]
+    cumulative = total(st.histogram, /cumulative, /preserve_type)
+    p95_bin = (where(cumulative ge 0.95 * st.count))[0]
+    mg_log, '%0.3f secs: %d x [mean %0.1f ms, p95 < %0.1f ms, max %0.1f ms], %d rows, %d errors', $
+            st.total_time + st.store_time, $
+            st.count, $
+            1000.0 * st.total_time / st.count, $
+            1000.0 * bin_edges[p95_bin + 1L], $
+            1000.0 * st.max_time, $
+            st.n_rows, $
+            st.n_errors, $
+            name=log_name, /debug
+    mg_log, '  %s', st.fingerprint, name=log_name, /debug
+  endfor
+
+  mg_mysql_stats_reset
+end
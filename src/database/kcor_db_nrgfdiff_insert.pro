@@ -32,9 +32,9 @@ pro kcor_db_nrgfdiff_insert, nrgfdiff_gif_basenames, $
 
   ; find product type ID for NRGF+diff images
 
-  producttype_results = db->query('select * from mlso_producttype where producttype=''%s''', $
-                                  'nrgf+diff', $
-                                  status=status)
+  producttype_results = db->cached_query('select * from mlso_producttype where producttype=''%s''', $
+                                         'nrgf+diff', $
+                                         status=status)
   if (status ne 0L) then begin
     mg_log, 'NRGF+diff product type not found', name=run.logger_name, /error
     goto, done
@@ -43,18 +43,18 @@ pro kcor_db_nrgfdiff_insert, nrgfdiff_gif_basenames, $
 
   ; find file types for GIF and mp4 files
 
-  gif_filetype_results = db->query('select * from mlso_filetype where filetype=''%s''', $
-                                   'gif', $
-                                   status=status)
+  gif_filetype_results = db->cached_query('select * from mlso_filetype where filetype=''%s''', $
+                                          'gif', $
+                                          status=status)
   if (status ne 0L) then begin
     mg_log, 'GIF file type not found', name=run.logger_name, /error
     goto, done
   endif
   gif_filetype_id = gif_filetype_results.filetype_id
 
-  mp4_filetype_results = db->query('select * from mlso_filetype where filetype=''%s''', $
-                                   'mp4', $
-                                   status=status)
+  mp4_filetype_results = db->cached_query('select * from mlso_filetype where filetype=''%s''', $
+                                          'mp4', $
+                                          status=status)
   if (status ne 0L) then begin
     mg_log, 'mp4 file type not found', name=run.logger_name, /error
     goto, done
@@ -66,6 +66,54 @@ pro kcor_eng_insert, date, fits_list, $
   cd, current=start_dir 
   cd, l2_dir
 
+  ; columns of kcor_eng, with the format of their values
+  eng_fields = [{name: 'file_name', type: '''%s'''}, $
+                {name: 'date_obs', type: '''%s'''}, $
+                {name: 'obs_day', type: '%d'}, $
+                {name: 'hour_angle', type: '%f'}, $
+                {name: 'sec_z', type: '%f'}, $
+                {name: 'sidereal_time', type: '%f'}, $
+                {name: 'sol_dec', type: '%f'}, $
+                {name: 'sol_ra', type: '%f'}, $
+                {name: 'dist_au', type: '%f'}, $
+                {name: 'rcamfocs', type: '%s'}, $
+                {name: 'tcamfocs', type: '%s'}, $
+                {name: 'modltrt', type: '%s'}, $
+                {name: 'o1focs', type: '%s'}, $
+                {name: 'kcor_sgsdimv', type: '%s'}, $
+                {name: 'kcor_sgsdims', type: '%s'}, $
+                {name: 'level', type: '%d'}, $
+                {name: 'bunit', type: '''%s'''}, $
+                {name: 'bzero', type: '%d'}, $
+                {name: 'bscale', type: '%s'}, $
+                {name: 'rcamxcen', type: '%s'}, $
+                {name: 'rcamycen', type: '%s'}, $
+                {name: 'tcamxcen', type: '%s'}, $
+                {name: 'tcamycen', type: '%s'}, $
+                {name: 'rcam_rad', type: '%s'}, $
+                {name: 'tcam_rad', type: '%s'}, $
+                {name: 'rcam_dcx', type: '%s'}, $
+                {name: 'rcam_dcy', type: '%s'}, $
+                {name: 'rcam_dcr', type: '%s'}, $
+                {name: 'tcam_dcx', type: '%s'}, $
+                {name: 'tcam_dcy', type: '%s'}, $
+                {name: 'tcam_dcr', type: '%s'}, $
+                {name: 'scale_factor', type: '%s'}, $
+                {name: 'image_scale', type: '%f'}, $
+                {name: 'rcam_image_scale', type: '%f'}, $
+                {name: 'tcam_image_scale', type: '%f'}, $
+                {name: 'mean_phase1', type: '%s'}, $
+                {name: 'cover', type: '''%s'''}, $
+                {name: 'darkshut', type: '''%s'''}, $
+                {name: 'diffuser', type: '''%s'''}, $
+                {name: 'calpol', type: '''%s'''}, $
+                {name: 'distort', type: '''%s'''}, $
+                {name: 'labviewid', type: '''%s'''}, $
+                {name: 'socketcamid', type: '''%s'''}, $
+                {name: 'kcor_sw_id', type: '%d'}, $
+                {name: 'kcor_hw_id', type: '%d'}]
+  rows = list()
+
   ; step through list of fits files passed in parameter
   nfiles = n_elements(fits_list)
   if (nfiles eq 0) then begin
@@ -173,8 +221,8 @@ pro kcor_eng_insert, date, fits_list, $
 
     ; get IDs from relational tables
 
-    level_count = db->query('select count(level_id) from kcor_level where level=''%s''', $
-                            level, fields=fields, status=status)
+    level_count = db->cached_query('select count(level_id) from kcor_level where level=''%s''', $
+                                   level, fields=fields, status=status)
     if (status ne 0L) then goto, done
     if (level_count.count_level_id_ eq 0) then begin
       ; if given level is not in the kcor_level table, set it to 'unknown' and
@@ -182,108 +230,75 @@ pro kcor_eng_insert, date, fits_list, $
       level = 'unk'
       mg_log, 'level: %s', level, name='kcor/rt', /error
     endif
-    level_results = db->query('select * from kcor_level where level=''%s''', $
-                              level, fields=fields, status=status)
+    level_results = db->cached_query('select * from kcor_level where level=''%s''', $
+                                     level, fields=fields, status=status)
     if (status ne 0L) then goto, done
     level_num = level_results.level_id	
 
-    ; DB insert command
-    fields = [{name: 'file_name', type: '''%s'''}, $
-              {name: 'date_obs', type: '''%s'''}, $
-              {name: 'obs_day', type: '%d'}, $
-              {name: 'hour_angle', type: '%f'}, $
-              {name: 'sec_z', type: '%f'}, $
-              {name: 'sidereal_time', type: '%f'}, $
-              {name: 'sol_dec', type: '%f'}, $
-              {name: 'sol_ra', type: '%f'}, $
-              {name: 'dist_au', type: '%f'}, $
-              {name: 'rcamfocs', type: '%s'}, $
-              {name: 'tcamfocs', type: '%s'}, $
-              {name: 'modltrt', type: '%s'}, $
-              {name: 'o1focs', type: '%s'}, $
-              {name: 'kcor_sgsdimv', type: '%s'}, $
-              {name: 'kcor_sgsdims', type: '%s'}, $
-              {name: 'level', type: '%d'}, $
-              {name: 'bunit', type: '''%s'''}, $
-              {name: 'bzero', type: '%d'}, $
-              {name: 'bscale', type: '%s'}, $
-              {name: 'rcamxcen', type: '%s'}, $
-              {name: 'rcamycen', type: '%s'}, $
-              {name: 'tcamxcen', type: '%s'}, $
-              {name: 'tcamycen', type: '%s'}, $
-              {name: 'rcam_rad', type: '%s'}, $
-              {name: 'tcam_rad', type: '%s'}, $
-              {name: 'rcam_dcx', type: '%s'}, $
-              {name: 'rcam_dcy', type: '%s'}, $
-              {name: 'rcam_dcr', type: '%s'}, $
-              {name: 'tcam_dcx', type: '%s'}, $
-              {name: 'tcam_dcy', type: '%s'}, $
-              {name: 'tcam_dcr', type: '%s'}, $
-              {name: 'scale_factor', type: '%s'}, $
-              {name: 'image_scale', type: '%f'}, $
-              {name: 'rcam_image_scale', type: '%f'}, $
-              {name: 'tcam_image_scale', type: '%f'}, $
-              {name: 'mean_phase1', type: '%s'}, $
-              {name: 'cover', type: '''%s'''}, $
-              {name: 'darkshut', type: '''%s'''}, $
-              {name: 'diffuser', type: '''%s'''}, $
-              {name: 'calpol', type: '''%s'''}, $
-              {name: 'distort', type: '''%s'''}, $
-              {name: 'labviewid', type: '''%s'''}, $
-              {name: 'socketcamid', type: '''%s'''}, $
-              {name: 'kcor_sw_id', type: '%d'}, $
-              {name: 'kcor_hw_id', type: '%d'}]
-
-    sql_cmd = string(strjoin(fields.name, ', '), $
-                     strjoin(fields.type, ', '), $
-                     format='(%"insert into kcor_eng (%s) values (%s)")')
-
-    db->execute, sql_cmd, $
-                 fits_file, $
-                 date_obs, $
-                 obsday_index, $
-                 hour_angle, sec_z, sidereal_time, sol_dec, sol_ra, dist_au, $
-                 kcor_fitsfloat2db(rcamfocs), $
-                 kcor_fitsfloat2db(tcamfocs), $
-                 kcor_fitsfloat2db(modltrt), $
-                 kcor_fitsfloat2db(o1focs), $
-                 sgsdimv_str, $
-                 sgsdims_str, $
-                 level_num, $
-                 bunit, $
-                 bzero, $
-                 kcor_fitsfloat2db(bscale), $
-                 kcor_fitsfloat2db(rcamxcen), $
-                 kcor_fitsfloat2db(rcamycen), $
-                 kcor_fitsfloat2db(tcamxcen), $
-                 kcor_fitsfloat2db(tcamycen), $
-                 kcor_fitsfloat2db(rcam_rad), $
-                 kcor_fitsfloat2db(tcam_rad), $
-                 kcor_fitsfloat2db(rcam_dcx), $
-                 kcor_fitsfloat2db(rcam_dcy), $
-                 kcor_fitsfloat2db(tcam_dcx), $
-                 kcor_fitsfloat2db(tcam_dcy), $
-                 kcor_fitsfloat2db(rcam_dcr), $
-                 kcor_fitsfloat2db(tcam_dcr), $
-                 kcor_fitsfloat2db(scale_factor), $
-                 image_scale, $
-                 rcam_image_scale, $
-                 tcam_image_scale, $
-                 kcor_fitsfloat2db(mean_phase1[i - n_nrgf]), $
-                 cover, $
-                 darkshut, $
-                 diffuser, $
-                 calpol, $
-                 distort, $
-                 labviewid, $
-                 socketcamid, $
-                 sw_index, $
-                 hw_ids[i], $
-                 status=status, error_message=error_message, sql_statement=sql_cmd
-    if (status ne 0L) then continue
+    rows->add, list(fits_file, $
+                    date_obs, $
+                    obsday_index, $
+                    hour_angle, sec_z, sidereal_time, sol_dec, sol_ra, dist_au, $
+                    kcor_fitsfloat2db(rcamfocs), $
+                    kcor_fitsfloat2db(tcamfocs), $
+                    kcor_fitsfloat2db(modltrt), $
+                    kcor_fitsfloat2db(o1focs), $
+                    sgsdimv_str, $
+                    sgsdims_str, $
+                    level_num, $
+                    bunit, $
+                    bzero, $
+                    kcor_fitsfloat2db(bscale), $
+                    kcor_fitsfloat2db(rcamxcen), $
+                    kcor_fitsfloat2db(rcamycen), $
+                    kcor_fitsfloat2db(tcamxcen), $
+                    kcor_fitsfloat2db(tcamycen), $
+                    kcor_fitsfloat2db(rcam_rad), $
+                    kcor_fitsfloat2db(tcam_rad), $
+                    kcor_fitsfloat2db(rcam_dcx), $
+                    kcor_fitsfloat2db(rcam_dcy), $
+                    kcor_fitsfloat2db(tcam_dcx), $
+                    kcor_fitsfloat2db(tcam_dcy), $
+                    kcor_fitsfloat2db(rcam_dcr), $
+                    kcor_fitsfloat2db(tcam_dcr), $
+                    kcor_fitsfloat2db(scale_factor), $
+                    image_scale, $
+                    rcam_image_scale, $
+                    tcam_image_scale, $
+                    kcor_fitsfloat2db(mean_phase1[i - n_nrgf]), $
+                    cover, $
+                    darkshut, $
+                    diffuser, $
+                    calpol, $
+                    distort, $
+                    labviewid, $
+                    socketcamid, $
+                    sw_index, $
+                    hw_ids[i])
   endwhile
 
   done:
+  if (n_elements(rows) gt 0L) then begin
+    db->bulk_insert, 'kcor_eng', eng_fields, rows, $
+                     n_loaded=n_loaded, $
+                     status=status, $
+                     error_message=error_message
+    if (status ne 0L) then begin
+      mg_log, 'bulk insert into kcor_eng failed: %s', error_message, $
+              name='kcor/rt', /error
+      mg_log, 'inserting remaining %d rows one at a time', $
+              n_elements(rows) - n_loaded, name='kcor/rt', /warn
+      remaining_rows = rows[n_loaded:*]
+      db->bulk_insert, 'kcor_eng', eng_fields, remaining_rows, /row_by_row, $
+                       n_failed=n_failed
+      if (n_failed gt 0L) then begin
+        mg_log, '%d rows failed to insert into kcor_eng', n_failed, $
+                name='kcor/rt', /error
+      endif
+      obj_destroy, remaining_rows
+    endif
+  endif
+  obj_destroy, rows
   cd, start_dir
 
   mg_log, 'done', name='kcor/rt', /info
@@ -21,13 +21,13 @@ function kcor_get_level_id, level_name, database=db, count=count
   compile_opt strictarr
 
   q = 'select count(level_id) from kcor_level where level=''%s'''
-  count_result = db->query(q, level_name, status=status)
+  count_result = db->cached_query(q, level_name, status=status)
   if (status ne 0L) then return, -1
   count = count_result.count_level_id_
 
   _level_name = count eq 0 ? 'unk' : level_name
-  level_results = db->query('select * from kcor_level where level=''%s''', $
-                            _level_name, status=status)
+  level_results = db->cached_query('select * from kcor_level where level=''%s''', $
+                                   _level_name, status=status)
   if (status ne 0L) then return, -1
   return, level_results.level_id
 end
@@ -88,14 +88,19 @@ pro kcor_img_insert, date, fits_list, $
   n_nrgf_avg_added = 0L
   n_nrgf_extavg_added = 0L
 
+  ; inserts to count in mlso_numfiles, counted only once they have succeeded
+  ; since queued inserts may still fail
+  added_tickets = list()
+  added_counters = list()
+
   ; The decision is to not include non-FITS in the database because raster
   ; files (GIFs) will be created for every image in database. However, since
   ; we may add them later, or other file types, we'll keep the field in the
   ; kcor_img database table.
   filetype   = 'fits'
-  filetype_count = db->query('select count(filetype_id) from mlso_filetype where filetype=''%s''', $
-                             filetype, fields=fields, $
-                             status=status)
+  filetype_count = db->cached_query('select count(filetype_id) from mlso_filetype where filetype=''%s''', $
+                                    filetype, fields=fields, $
+                                    status=status)
   if (status ne 0L) then goto, done
   if (filetype_count.count_filetype_id_ eq 0) then begin
     ; if given filetype is not in the mlso_filetype table, set it to 'unknown'
@@ -103,9 +108,9 @@ pro kcor_img_insert, date, fits_list, $
     filetype = 'unknown'
     mg_log, 'filetype: %s', filetype, name=log_name, /error
   endif
-  filetype_results = db->query('select * from mlso_filetype where filetype=''%s''', $
-                               filetype, $
-                               status=status)
+  filetype_results = db->cached_query('select * from mlso_filetype where filetype=''%s''', $
+                                      filetype, $
+                                      status=status)
   if (status ne 0L) then goto, done
   filetype_num = filetype_results.filetype_id	
 
@@ -184,9 +189,9 @@ pro kcor_img_insert, date, fits_list, $
     fits_file = file_basename(fts_file, '.gz') ; remove '.gz' from file name.
 
     ; get IDs from relational tables
-    producttype_count = db->query('select count(producttype_id) from mlso_producttype where producttype=''%s''', $
-                                  producttype, $
-                                  status=status)
+    producttype_count = db->cached_query('select count(producttype_id) from mlso_producttype where producttype=''%s''', $
+                                         producttype, $
+                                         status=status)
     if (status ne 0L) then continue
     if (producttype_count.count_producttype_id_ eq 0) then begin
       ; if given producttype is not in the mlso_producttype table, set it to
@@ -194,9 +199,9 @@ pro kcor_img_insert, date, fits_list, $
       producttype = 'unknown'
       mg_log, 'producttype: %s', producttype, name=log_name, /error
     endif
-    producttype_results = db->query('select * from mlso_producttype where producttype=''%s''', $
-                                    producttype, $
-                                    status=status)
+    producttype_results = db->cached_query('select * from mlso_producttype where producttype=''%s''', $
+                                           producttype, $
+                                           status=status)
     if (status ne 0L) then continue
     producttype_num = producttype_results.producttype_id
 
@@ -209,29 +214,33 @@ pro kcor_img_insert, date, fits_list, $
                  date_obs, date_end, obsday_index, carrington_rotation, $
                  level_num, quality, producttype_num, $
                  filetype_num, numsum, exptime, $
-                 status=status
+                 status=status, /async, ticket=ticket
     if (status eq 0L) then begin
       ; only add non-enhanced images to counters used in mlso_numfiles counts
       if (~is_enhanced && ~is_difference) then begin
-        if (is_nrgf) then begin
-          case 1 of
-            is_extavg: n_nrgf_extavg_added += 1
-            is_avg: n_nrgf_avg_added += 1
-            else: n_nrgf_added += 1
-          endcase
-        endif else begin
-          case 1 of
-            is_extavg: n_pb_extavg_added += 1
-            is_avg: n_pb_avg_added += 1
-            else: n_pb_added += 1
-          endcase
-        endelse
+        added_tickets->add, ticket
+        added_counters->add, (is_nrgf ? 'nrgf' : 'pb') $
+                               + (is_extavg ? '_extavg' : (is_avg ? '_avg' : ''))
       endif
     endif else begin
       continue
     endelse
   endwhile
 
+  ; wait for queued inserts, counting only the ones that succeeded
+  foreach ticket, added_tickets, t do begin
+    if (db->wait(ticket) ne 0UL) then continue
+    case added_counters[t] of
+      'nrgf_extavg': n_nrgf_extavg_added += 1
+      'nrgf_avg': n_nrgf_avg_added += 1
+      'nrgf': n_nrgf_added += 1
+      'pb_extavg': n_pb_extavg_added += 1
+      'pb_avg': n_pb_avg_added += 1
+      'pb': n_pb_added += 1
+    endcase
+  endforeach
+  obj_destroy, [added_tickets, added_counters]
+
   ; update number of files in mlso_numfiles
   num_files_results = db->query('select * from mlso_numfiles where day_id=''%d''', obsday_index)
   n_pb_files = num_files_results.num_kcor_pb_fits + n_pb_added
@@ -67,6 +67,31 @@ pro kcor_raw_insert, date, fits_list, quality, $
   cd, current=start_dir 
   cd, date_dir
 
+  ; columns of kcor_raw, with the format of their values
+  raw_fields = [{name: 'file_name', type: '''%s'''}, $
+                {name: 'date_obs', type: '''%s'''}, $
+                {name: 'date_end', type: '''%s'''}, $
+                {name: 'obs_day', type: '%d'}, $
+                {name: 'level', type: '%d'}, $
+                {name: 'quality_id', type: '%d'}, $
+                {name: 'mean_int_img0', type: '%f'}, $
+                {name: 'mean_int_img1', type: '%f'}, $
+                {name: 'mean_int_img2', type: '%f'}, $
+                {name: 'mean_int_img3', type: '%f'}, $
+                {name: 'mean_int_img4', type: '%f'}, $
+                {name: 'mean_int_img5', type: '%f'}, $
+                {name: 'mean_int_img6', type: '%f'}, $
+                {name: 'mean_int_img7', type: '%f'}, $
+                {name: 'median_int_img0', type: '%f'}, $
+                {name: 'median_int_img1', type: '%f'}, $
+                {name: 'median_int_img2', type: '%f'}, $
+                {name: 'median_int_img3', type: '%f'}, $
+                {name: 'median_int_img4', type: '%f'}, $
+                {name: 'median_int_img5', type: '%f'}, $
+                {name: 'median_int_img6', type: '%f'}, $
+                {name: 'median_int_img7', type: '%f'}]
+  rows = list()
+
   ; step through list of fits files passed in parameter
   n_files = n_elements(fits_list)
   if (n_files eq 0) then begin
@@ -78,8 +103,8 @@ pro kcor_raw_insert, date, fits_list, quality, $
 
   ; get IDs from relational tables
   level = 'L0'
-  level_count = db->query('select count(level_id) from kcor_level where level=''%s''', $
-                          level, status=status)
+  level_count = db->cached_query('select count(level_id) from kcor_level where level=''%s''', $
+                                 level, status=status)
   if (status ne 0L) then goto, done
   if (level_count.count_level_id_ eq 0) then begin
     ; if given level is not in the kcor_level table, set it to 'unknown' and
@@ -87,21 +112,21 @@ pro kcor_raw_insert, date, fits_list, quality, $
     level = 'unk'
     mg_log, 'level: %s', level, name=log_name, /error
   endif
-  level_results = db->query('select * from kcor_level where level=''%s''', $
-                            level, status=status)
+  level_results = db->cached_query('select * from kcor_level where level=''%s''', $
+                                   level, status=status)
   if (status ne 0L) then goto, done
   level_num = level_results.level_id	
 
-  quality_count = db->query('select count(quality_id) from kcor_quality where quality=''%s''', $
-                            quality, status=status)
+  quality_count = db->cached_query('select count(quality_id) from kcor_quality where quality=''%s''', $
+                                   quality, status=status)
   if (status ne 0L) then goto, done
   if (quality_count.count_quality_id_ eq 0) then begin
     ; if given quality is not in the kcor_quality table, exit
     mg_log, 'unknown quality: %s', quality, name=log_name, /error
     goto, done
   endif
-  quality_results = db->query('select * from kcor_quality where quality=''%s''', $
-                              quality, status=status)
+  quality_results = db->cached_query('select * from kcor_quality where quality=''%s''', $
+                                     quality, status=status)
   if (status ne 0L) then goto, done
   quality_id = quality_results.quality_id
 
@@ -169,18 +194,35 @@ pro kcor_raw_insert, date, fits_list, quality, $
 
     fits_file = file_basename(fts_file, '.gz') ; remove '.gz' from file name.
 
-    ; DB insert command
-    db->execute, 'insert into kcor_raw (file_name, date_obs, date_end, obs_day, level, quality_id, mean_int_img0, mean_int_img1, mean_int_img2, mean_int_img3, mean_int_img4, mean_int_img5, mean_int_img6, mean_int_img7, median_int_img0, median_int_img1, median_int_img2, median_int_img3, median_int_img4, median_int_img5, median_int_img6, median_int_img7) values (''%s'', ''%s'', ''%s'', %d, %d, %d, %f, %f, %f, %f, %f, %f, %f, %f, %f, %f, %f, %f, %f, %f, %f, %f)', $
-                 fits_file, date_obs, date_end, obsday_index, level_num, quality_id, $
-                 mean_int_img0, mean_int_img1, mean_int_img2, mean_int_img3, $
-                 mean_int_img4, mean_int_img5, mean_int_img6, mean_int_img7, $
-                 median_int_img0, median_int_img1, median_int_img2, median_int_img3, $
-                 median_int_img4, median_int_img5, median_int_img6, median_int_img7, $
-                 status=status
-    if (status ne 0L) then continue
+    rows->add, list(fits_file, date_obs, date_end, obsday_index, level_num, quality_id, $
+                    mean_int_img0, mean_int_img1, mean_int_img2, mean_int_img3, $
+                    mean_int_img4, mean_int_img5, mean_int_img6, mean_int_img7, $
+                    median_int_img0, median_int_img1, median_int_img2, median_int_img3, $
+                    median_int_img4, median_int_img5, median_int_img6, median_int_img7)
   endfor
 
   done:
+  if (n_elements(rows) gt 0L) then begin
+    db->bulk_insert, 'kcor_raw', raw_fields, rows, $
+                     n_loaded=n_loaded, $
+                     status=status, $
+                     error_message=error_message
+    if (status ne 0L) then begin
+      mg_log, 'bulk insert into kcor_raw failed: %s', error_message, $
+              name=log_name, /error
+      mg_log, 'inserting remaining %d rows one at a time', $
+              n_elements(rows) - n_loaded, name=log_name, /warn
+      remaining_rows = rows[n_loaded:*]
+      db->bulk_insert, 'kcor_raw', raw_fields, remaining_rows, /row_by_row, $
+                       n_failed=n_failed
+      if (n_failed gt 0L) then begin
+        mg_log, '%d rows failed to insert into kcor_raw', n_failed, $
+                name=log_name, /error
+      endif
+      obj_destroy, remaining_rows
+    endif
+  endif
+  obj_destroy, rows
   cd, start_dir
 
   mg_log, 'done', name=log_name, /info
@@ -56,7 +56,7 @@ pro kcor_sw_insert, date, run=run, $
 
   ; check to see if passed observation day date is already in the kcor_sw table
   q = 'select count(sw_id) from kcor_sw where sw_version=''%s'' and sw_revision=''%s'''
-  sw_id_results = db->query(q, sw_version, sw_revision, status=status)
+  sw_id_results = db->cached_query(q, sw_version, sw_revision, status=status)
   if (status ne 0L) then goto, done
   sw_id_count = sw_id_results.count_sw_id_
 
@@ -81,8 +81,8 @@ pro kcor_sw_insert, date, run=run, $
   endif else begin
     ; if it is in the database, get the corresponding sw_id
     q = 'select sw_id from kcor_sw where sw_version=''%s'' and sw_revision=''%s'''
-    sw_results = db->query(q, sw_version, sw_revision, $
-                           status=status)
+    sw_results = db->cached_query(q, sw_version, sw_revision, $
+                                  status=status)
     if (status ne 0L) then begin
       mg_log, 'error finding ID of existing kcor_sw row...', name=log_name, /error
       goto, done
@@ -39,6 +39,345 @@ pro kcordbmysql::report_statement, mysql_statement
   compile_opt strictarr
 
   if (self.lun ge 0L) then printf, self.lun, mysql_statement
+
+  ; any statement of ours that modifies a table invalidates cached lookups
+  ; on that table
+  verb = strlowcase((strsplit(mysql_statement, /extract))[0])
+  if (verb eq 'insert' || verb eq 'update' || verb eq 'delete' $
+        || verb eq 'replace' || verb eq 'load') then begin
+    self->invalidate_cache, self->_statement_tables(mysql_statement)
+  endif
+end
+
+
+;+
+; Find the names of the tables referenced by a SQL statement.
+;
+; :Returns:
+;   `strarr` of lowercase table names or `!null` if none found
+;
+; :Params:
+;   sql_statement : in, required, type=string
+;     SQL statement
+;-
+function kcordbmysql::_statement_tables, sql_statement
+  compile_opt strictarr
+
+  words = strsplit(strlowcase(sql_statement), '[[:space:](),;`]+', $
+                   /regex, /extract)
+  ; "load data ... into table name"
+  words = words[where(words ne 'table', n_words, /null)]
+  ind = where(words eq 'from' or words eq 'join' $
+                or words eq 'into' or words eq 'update', n_tables)
+  if (n_tables eq 0L) then return, !null
+
+  ind = ind[where(ind lt n_words - 1L, n_tables, /null)]
+  if (n_tables eq 0L) then return, !null
+
+  tables = words[ind + 1L]
+  return, tables[uniq(tables, sort(tables))]
+end
+
+
+;+
+; Query a small, rarely changing table, such as `kcor_level`, `kcor_sw`,
+; `kcor_hw`, `mlso_filetype`, or `mlso_producttype`, returning a cached result
+; if the same query with the same arguments has already been made and no
+; statement since has modified any of the tables it references.
+;
+; Takes the same arguments and keywords as `::query` (but only up to 5
+; format arguments). Queries that fail or return no rows are not cached.
+;
+; :Returns:
+;   array of structures, see `::query`
+;
+; :Params:
+;   sql_query : in, required, type=string
+;     query string, may contain C format codes for the arguments
+;   arg1, arg2, arg3, arg4, arg5 : in, optional, type=any
+;     arguments for the format codes in `sql_query`
+;
+; :Keywords:
+;   fields : out, optional, type=array of structures
+;     information about the columns returned by the query
+;   status : out, optional, type=long
+;     status code of the query, 0 for success (or a cache hit)
+;   error_message : out, optional, type=string
+;     MySQL error message; "Success" if no error
+;   count : out, optional, type=long
+;     number of rows returned
+;   _extra : in, optional, type=keywords
+;     keywords to `::query`
+;-
+function kcordbmysql::cached_query, sql_query, arg1, arg2, arg3, arg4, arg5, $
+                                    fields=fields, $
+                                    status=status, $
+                                    error_message=error_message, $
+                                    count=count, $
+                                    _extra=e
+  compile_opt strictarr
+  on_ioerror, bad_fmt
+
+  fmt = '(%"' + sql_query + '")'
+  case n_params() of
+    1: key = sql_query
+    2: key = string(arg1, format=fmt)
+    3: key = string(arg1, arg2, format=fmt)
+    4: key = string(arg1, arg2, arg3, format=fmt)
+    5: key = string(arg1, arg2, arg3, arg4, format=fmt)
+    6: key = string(arg1, arg2, arg3, arg4, arg5, format=fmt)
+  endcase
+
+  if (self.cache->hasKey(key)) then begin
+    self.cache_hits += 1L
+    entry = self.cache[key]
+    fields = entry.fields
+    count = entry.count
+    status = 0L
+    error_message = 'Success'
+    return, entry.result
+  endif
+
+  self.cache_misses += 1L
+
+  ; key is already formatted, so pass it as a plain query
+  result = self->query(key, fields=fields, status=status, $
+                       error_message=error_message, count=count, _extra=e)
+  if (status ne 0L || count eq 0L) then return, result
+
+  self.cache[key] = {result: result, fields: fields, count: count}
+  tables = self->_statement_tables(key)
+  foreach t, tables do begin
+    if (~self.cache_tables->hasKey(t)) then self.cache_tables[t] = list()
+    (self.cache_tables[t])->add, key
+  endforeach
+
+  return, result
+
+  bad_fmt:
+  status = 1L
+  error_message = !error_state.msg
+  count = 0L
+  return, !null
+end
+
+
+;+
+; Remove cached lookups on the given tables, or all cached lookups if no
+; tables are given.
+;
+; :Params:
+;   tables : in, optional, type=strarr
+;     names of tables that have been modified
+;-
+pro kcordbmysql::invalidate_cache, tables
+  compile_opt strictarr
+
+  if (n_params() eq 0L) then begin
+    self.cache->remove, /all
+    self.cache_tables->remove, /all
+    return
+  endif
+
+  foreach t, tables do begin
+    if (~self.cache_tables->hasKey(t)) then continue
+    foreach key, self.cache_tables[t] do begin
+      if (self.cache->hasKey(key)) then self.cache->remove, key
+    endforeach
+    obj_destroy, self.cache_tables->remove(t)
+  endforeach
+end
+
+
+;+
+; Escape a value for a tab-separated file read by `LOAD DATA`.
+;
+; :Private:
+;
+; :Returns:
+;   string
+;
+; :Params:
+;   value : in, required, type=string
+;     value to escape
+;-
+function kcordbmysql::_tsv_escape, value
+  compile_opt strictarr
+
+  if (~stregex(value, '[\\' + string(9B) + string(10B) + ']', /boolean)) then begin
+    return, value
+  endif
+
+  result = strjoin(strsplit(value, '\', /extract, /preserve_null), '\\')
+  result = strjoin(strsplit(result, string(9B), /extract, /preserve_null), '\t')
+  result = strjoin(strsplit(result, string(10B), /extract, /preserve_null), '\n')
+  return, result
+end
+
+
+;+
+; Insert many rows into a table at once. Rows are written to a temporary
+; tab-separated file and loaded with `LOAD DATA LOCAL INFILE`; if the server
+; does not allow that, the rows are inserted with multi-row `INSERT`
+; statements instead.
+;
+; :Params:
+;   table : in, required, type=string
+;     name of table to insert into
+;   fields : in, required, type=array of structures
+;     array of `{name: '', type: ''}` structures giving the column names and
+;     the C format codes for their values, in the same form as used when
+;     building an `INSERT` statement for `::execute`, i.e., quoted for string
+;     columns and unquoted for numeric columns or values that can be "NULL"
+;   rows : in, required, type=list
+;     list of rows, each a list of values in the same order as `fields`
+;
+; :Keywords:
+;   batch_size : in, optional, type=long, default=500
+;     number of rows per `INSERT` statement if `LOAD DATA` is not available
+;   row_by_row : in, optional, type=boolean
+;     set to insert the rows with one `INSERT` statement each, continuing past
+;     rows that fail, e.g., to retry the rows of a failed bulk insert
+;   n_loaded : out, optional, type=ulong64
+;     set to a named variable to retrieve the number of rows inserted
+;   n_failed : out, optional, type=long
+;     set to a named variable to retrieve the number of rows that failed to
+;     insert with `ROW_BY_ROW`
+;   n_warnings : out, optional, type=ulong
+;     set to a named variable to retrieve the number of warnings generated
+;   status : out, optional, type=long
+;     set to a named variable to retrieve the status, 0 for success
+;   error_message : out, optional, type=string
+;     MySQL error message; "Success" if no error
+;-
+pro kcordbmysql::bulk_insert, table, fields, rows, $
+                              batch_size=batch_size, $
+                              row_by_row=row_by_row, $
+                              n_loaded=n_loaded, $
+                              n_failed=n_failed, $
+                              n_warnings=n_warnings, $
+                              status=status, $
+                              error_message=error_message
+  compile_opt strictarr
+
+  n_loaded = 0ULL
+  n_failed = 0L
+  n_warnings = 0UL
+  status = 0L
+  error_message = 'Success'
+
+  n_rows = n_elements(rows)
+  if (n_rows eq 0L) then return
+
+  n_fields = n_elements(fields)
+  _batch_size = n_elements(batch_size) eq 0L ? 500L : batch_size
+
+  ; string columns have a quoted format code, e.g., '%s', in fields.type
+  quoted = strmid(fields.type, 0, 1) eq ''''
+  formats = '(%"' + fields.type + '")'
+  q = where(quoted, n_quoted)
+  if (n_quoted gt 0L) then begin
+    formats[q] = '(%"' + strmid(fields[q].type, 1, strlen(fields[q].type) - 2L) + '")'
+  endif
+
+  ; format all values once, the same way for either method of loading
+  values = strarr(n_fields, n_rows)
+  for r = 0L, n_rows - 1L do begin
+    row = rows[r]
+    for f = 0L, n_fields - 1L do values[f, r] = string(row[f], format=formats[f])
+  endfor
+
+  ; non-finite numeric values are stored as NULL
+  v = strlowcase(strtrim(values, 2))
+  null_ind = where(rebin(~quoted, n_fields, n_rows) $
+                     and (v eq 'nan' or v eq '-nan' or v eq 'inf' or v eq '-inf' $
+                          or v eq 'infinity' or v eq '-infinity'), $
+                   n_null)
+  if (n_null gt 0L) then values[null_ind] = 'NULL'
+
+  if (keyword_set(row_by_row)) then begin
+    _batch_size = 1L
+    goto, insert
+  endif
+
+  ; try LOAD DATA LOCAL INFILE first, on its own connection so that the main
+  ; connection does not allow it
+  tsv_filename = filepath(string(table, ulong64(systime(/seconds) * 1.0D6), $
+                                 format='(%"%s-%d.tsv")'), $
+                          /tmp)
+  openw, lun, tsv_filename, /get_lun
+  tab = string(9B)
+  line = strarr(n_fields)
+  for r = 0L, n_rows - 1L do begin
+    for f = 0L, n_fields - 1L do begin
+      if (quoted[f]) then begin
+        line[f] = self->_tsv_escape(values[f, r])
+      endif else begin
+        line[f] = values[f, r] eq 'NULL' ? '\N' : values[f, r]
+      endelse
+    endfor
+    printf, lun, strjoin(line, tab)
+  endfor
+  free_lun, lun
+
+  self->execute, string(tsv_filename, table, strjoin(fields.name, ', '), $
+                        format='(%"load data local infile ''%s'' into table %s (%s)")'), $
+                 status=status, $
+                 error_message=error_message, $
+                 n_affected_rows=n_loaded, $
+                 n_warnings=n_warnings, $
+                 /local_infile, $
+                 errno=errno
+  file_delete, tsv_filename, /allow_nonexistent
+
+  if (status eq 0L) then goto, done
+
+  ; fall back to inserts only if LOAD DATA LOCAL is not allowed: 1148 is
+  ; command not allowed, 2068 is rejected by the client, and 3948 is disabled
+  ; by the server; or if its connection could not be opened
+  if (errno ne 1148 && errno ne 2068 && errno ne 3948 $
+        && self.local_infile_connection ne 0ULL) then goto, done
+
+  mg_log, 'LOAD DATA LOCAL INFILE not available, inserting %d rows in batches', $
+          n_rows, name=self.logger_name, /debug
+
+  insert:
+  n_loaded = 0ULL
+  n_warnings = 0UL
+  for r = 0L, n_rows - 1L do begin
+    for i = 0L, n_quoted - 1L do begin
+      values[q[i], r] = '''' + self->escape_string(values[q[i], r]) + ''''
+    endfor
+  endfor
+  row_values = '(' + reform(strjoin(values, ', ')) + ')'
+
+  for b = 0L, n_rows - 1L, _batch_size do begin
+    last = (b + _batch_size - 1L) < (n_rows - 1L)
+    self->execute, string(table, strjoin(fields.name, ', '), $
+                          strjoin(row_values[b:last], ', '), $
+                          format='(%"insert into %s (%s) values %s")'), $
+                   status=status, $
+                   error_message=error_message, $
+                   n_affected_rows=n_batch_loaded, $
+                   n_warnings=n_batch_warnings
+    if (status ne 0L) then begin
+      if (~keyword_set(row_by_row)) then goto, done
+      n_failed += 1L
+      continue
+    endif
+    n_loaded += n_batch_loaded
+    n_warnings += n_batch_warnings
+  endfor
+
+  if (n_failed gt 0L) then begin
+    status = 1L
+    error_message = string(n_failed, format='(%"%d rows failed to insert")')
+  endif
+
+  done:
+  mg_log, '%d/%d rows loaded into %s, %d warnings', $
+          n_loaded, n_rows, table, n_warnings, $
+          name=self.logger_name, /info
 end
 
 
@@ -49,9 +388,14 @@ pro kcordbmysql::setProperty, _extra=e
 end
 
 
-pro kcordbmysql::getProperty, _ref_extra=e
+pro kcordbmysql::getProperty, cache_hits=cache_hits, $
+                               cache_misses=cache_misses, $
+                               _ref_extra=e
   compile_opt strictarr
 
+  if (arg_present(cache_hits)) then cache_hits = self.cache_hits
+  if (arg_present(cache_misses)) then cache_misses = self.cache_misses
+
   if (n_elements(e) gt 0) then self->mgdbmysql::getProperty, _strict_extra=e
 end
 
@@ -59,6 +403,17 @@ end
 pro kcordbmysql::cleanup
   compile_opt strictarr
 
+  if (self.cache_hits + self.cache_misses gt 0L) then begin
+    mg_log, 'lookup cache: %d hits, %d misses', $
+            self.cache_hits, self.cache_misses, $
+            name=self.logger_name, /debug
+  endif
+
+  if (obj_valid(self.cache_tables)) then begin
+    foreach keys, self.cache_tables do obj_destroy, keys
+  endif
+  obj_destroy, [self.cache, self.cache_tables]
+
   if (self.lun ge 0L) then free_lun, self.lun
   self->mgdbmysql::cleanup
 end
@@ -74,6 +429,9 @@ function kcordbmysql::init, logger_name=logger_name, $
 
   if (n_elements(logger_name) gt 0L) then self.logger_name = logger_name
 
+  self.cache = hash()
+  self.cache_tables = hash()
+
   if (n_elements(log_filename) gt 0L) then begin
     openu, lun, log_filename, /get_lun, /append
     self.lun = lun
@@ -88,7 +446,11 @@ pro kcordbmysql__define
 
   !null = { KCordbMySQL, inherits MGdbMySQL, $
             lun: 0L, $
-            logger_name: '' }
+            logger_name: '', $
+            cache: obj_new(), $
+            cache_tables: obj_new(), $
+            cache_hits: 0L, $
+            cache_misses: 0L }
 end
 
 
@@ -44,9 +44,12 @@ function mlso_obsday_insert, date, $
     status = 0B
   endif else begin
     created_db = 1B
-    db = kcordbmysql(logger_name=log_name)
+    db = kcordbmysql(logger_name=log_name, $
+                     mysql_opt_compress=run->config('database/compress'))
     db->connect, config_filename=run->config('database/config_filename'), $
                  config_section=run->config('database/config_section'), $
+                 async=run->config('database/async_writes'), $
+                 pool=run->config('database/pool'), $
                  status=status, error_message=error_message
     if (status ne 0L) then begin
       mg_log, 'failed to connect to database', name=log_name, /error
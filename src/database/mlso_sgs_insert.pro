@@ -126,7 +126,7 @@ pro mlso_sgs_insert, date, fits_list, $
                  date_obs, obsday_index, sgs_source, sgsdimv_str, sgsdims_str, $
                  sgssumv_str, sgsrav_str, sgsras_str, sgsrazr_str, sgsdecv_str, $
                  sgsdecs_str, sgsdeczr_str, sgsscint_str, sgssums_str, sgsloop_str, $
-                 status=status
+                 status=status, /async
     if (status ne 0L) then continue
   endwhile
 
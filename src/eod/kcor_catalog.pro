@@ -52,6 +52,24 @@ pro kcor_catalog, date, list=list, run=run, catalog_dir=catalog_dir
   endelse
 
   mg_log, 'cataloging %d L0 files', n_files, name='kcor/eod', /info
+  if (n_files eq 0L) then goto, done
+
+  ; read the keywords needed from all the headers at once, with the repair
+  ; routine of each file's epoch
+  repair_routines = strarr(n_files)
+  for f = 0L, n_files - 1L do begin
+    run.time = strmid(file_basename(list[f]), 9, 6)
+    repair_routine = run->epoch('repair_routine')
+    if (n_elements(repair_routine) gt 0L) then repair_routines[f] = repair_routine
+  endfor
+
+  keywords = ['DATATYPE', 'DIFFUSER', 'CALPOL', 'CALPANG', 'DARKSHUT', $
+              'EXPTIME', 'EXPOSURE']
+  headers = kcor_read_headers(list, keywords, $
+                              repair_routine=repair_routines, $
+                              found=found, messages=messages)
+  no_exptime = where(~found[where(keywords eq 'EXPTIME'), *], n_no_exptime)
+  if (n_no_exptime gt 0L) then headers[no_exptime].exptime = headers[no_exptime].exposure
 
   n_digits = long(alog10(n_files)) + 1L
   for f = 0L, n_files - 1L do begin
@@ -66,7 +84,12 @@ pro kcor_catalog, date, list=list, run=run, catalog_dir=catalog_dir
     mg_log, mg_format('%*d/%d: %s', n_digits, /simple), $
             f + 1, n_files, file_basename(fits_file), $
             name='kcor/eod', /info
-    kcor_catalog_file, fits_file, run=run
+    ; files whose headers could not be read are read again the usual way
+    if (messages[f] eq '') then begin
+      kcor_catalog_file, fits_file, run=run, header_keywords=headers[f]
+    endif else begin
+      kcor_catalog_file, fits_file, run=run
+    endelse
   endfor
 
   done:
@@ -10,31 +10,44 @@
 ; :Keywords:
 ;   run : in, required, type=object
 ;     `kcor_run` object
+;   header_keywords : in, optional, type=structure
+;     element of the result of `kcor_read_headers` for the file, with
+;     DATATYPE, DIFFUSER, CALPOL, CALPANG, DARKSHUT and EXPTIME fields; the
+;     header is read from the file if not present
 ;
 ; :Author:
 ;   Sitongia
 ;-
-pro kcor_catalog_file, filename, run=run
+pro kcor_catalog_file, filename, run=run, header_keywords=header_keywords
   compile_opt strictarr
 
   process_dir = filepath(run.date, root=run->config('processing/process_basedir'))
 
-  ; read FITS header and read selected keyword parameters
-  kcor_read_rawdata, filename, header=header, $
-                     repair_routine=run->epoch('repair_routine'), $
-                     xshift=run->epoch('xshift_camera'), $
-                     start_state=run->epoch('start_state'), $
-                     raw_data_prefix=run->epoch('raw_data_prefix'), $
-                     datatype=run->epoch('raw_datatype')
+  if (n_elements(header_keywords) gt 0L) then begin
+    datatype = header_keywords.datatype
+    diffuser = strtrim(header_keywords.diffuser)
+    calpol   = strtrim(header_keywords.calpol)
+    calpang  = header_keywords.calpang
+    darkshut = strtrim(header_keywords.darkshut)
+    exposure = header_keywords.exptime
+  endif else begin
+    ; read FITS header and read selected keyword parameters
+    kcor_read_rawdata, filename, header=header, $
+                       repair_routine=run->epoch('repair_routine'), $
+                       xshift=run->epoch('xshift_camera'), $
+                       start_state=run->epoch('start_state'), $
+                       raw_data_prefix=run->epoch('raw_data_prefix'), $
+                       datatype=run->epoch('raw_datatype')
 
-  datatype = sxpar(header, 'DATATYPE')
-  diffuser = strtrim(sxpar(header, 'DIFFUSER'))
-  calpol   = strtrim(sxpar(header, 'CALPOL'))
-  calpang  = sxpar(header, 'CALPANG')
-  darkshut = strtrim(sxpar(header, 'DARKSHUT'))
+    datatype = sxpar(header, 'DATATYPE')
+    diffuser = strtrim(sxpar(header, 'DIFFUSER'))
+    calpol   = strtrim(sxpar(header, 'CALPOL'))
+    calpang  = sxpar(header, 'CALPANG')
+    darkshut = strtrim(sxpar(header, 'DARKSHUT'))
 
-  exposure = sxpar(header, 'EXPTIME', count=nrecords)
-  if (nrecords eq 0) then exposure = sxpar(header, 'EXPOSURE')
+    exposure = sxpar(header, 'EXPTIME', count=nrecords)
+    if (nrecords eq 0) then exposure = sxpar(header, 'EXPOSURE')
+  endelse
   if (~run->epoch('use_exptime')) then exposure = run->epoch('exptime')
 
   ; datatype = science
@@ -445,14 +445,7 @@ pro kcor_create_averages, date, l2_files, run=run, enhanced=enhanced
   if (n_avg_files gt 0L) then begin
     mg_log, 'zipping %d average FITS files...', n_avg_files, $
             name='kcor/eod', /info
-    gzip_cmd = string(run->config('externals/gzip'), unzipped_avg_glob, $
-                      format='(%"%s %s")')
-    spawn, gzip_cmd, result, error_result, exit_status=status
-    if (status ne 0L) then begin
-      mg_log, 'problem zipping average files with command: %s', gzip_cmd, $
-              name='kcor/eod', /error
-      mg_log, '%s', strjoin(error_result, ' '), name='kcor/eod', /error
-    endif
+    kcor_zip_files, unzipped_avg_files, run=run, log_name='kcor/eod'
   endif
  
   if (run->config('realtime/distribute') && n_avg_files gt 0L) then begin
@@ -701,14 +694,7 @@ pro kcor_create_averages, date, l2_files, run=run, enhanced=enhanced
     file_delete,  daily_fits_average_filename + '.gz', /allow_nonexistent
 
     mg_log, 'zipping daily FITS average file...', name='kcor/eod', /info
-    gzip_cmd = string(run->config('externals/gzip'), daily_fits_average_filename, $
-                      format='(%"%s %s")')
-    spawn, gzip_cmd, result, error_result, exit_status=status
-    if (status ne 0L) then begin
-      mg_log, 'problem zipping daily average file with command: %s', gzip_cmd, $
-              name='kcor/eod', /error
-      mg_log, '%s', strjoin(error_result, ' '), name='kcor/eod', /error
-    endif
+    kcor_zip_files, daily_fits_average_filename, run=run, log_name='kcor/eod'
 
     if (run->config('realtime/distribute')) then begin
       mg_log, 'copying daily average file to archive', name='kcor/eod', /info
@@ -81,6 +81,9 @@ pro kcor_plotparams, date, list=list, run=run
   pday    = strmid(date, 6, 2)
   pdate   = string(pyear, pmonth, pday, format='(%"%s-%s-%s")')
 
+  ; headers of the L0 files, read only for files not already in the index
+  header_index = kcor_header_index(l0_dir)
+
   ; image file loop
   for i = 0L, n_elements(list) - 1L do begin
     l0_file = list[i]
@@ -92,6 +95,7 @@ pro kcor_plotparams, date, list=list, run=run
     endif
 
     kcor_read_rawdata, l0_file, header=hdu, $
+                       header_index=header_index, $
                        repair_routine=run->epoch('repair_routine'), $
                        xshift=run->epoch('xshift_camera'), $
                        start_state=run->epoch('start_state'), $
@@ -405,6 +409,7 @@ pro kcor_plotparams, date, list=list, run=run
   cd, start_dir
   !p.multi = 0
   set_plot, original_device
+  if (obj_valid(header_index)) then obj_destroy, header_index
 
   mg_log, 'done', name='kcor/eod', /info
 end
@@ -145,14 +145,7 @@ pro kcor_redo_nrgf, date, run=run
   if (n_nrgf_files gt 0L) then begin
     mg_log, 'zipping %d NRGF FITS files...', n_nrgf_files, $
             name='kcor/eod', /info
-    gzip_cmd = string(run->config('externals/gzip'), unzipped_nrgf_glob, $
-                      format='(%"%s %s")')
-    spawn, gzip_cmd, result, error_result, exit_status=status
-    if (status ne 0L) then begin
-      mg_log, 'problem zipping NRGF FITS files with command: %s', gzip_cmd, $
-              name='kcor/eod', /error
-      mg_log, '%s', strjoin(error_result, ' '), name='kcor/eod', /error
-    endif
+    kcor_zip_files, unzipped_nrgf_files, run=run, log_name='kcor/eod'
   endif
 
   zipped_nrgf_files = unzipped_nrgf_files + '.gz'
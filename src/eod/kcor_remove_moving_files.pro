@@ -54,9 +54,11 @@ pro kcor_remove_moving_files, run=run
   l0_status = l0_status[sort_indices]
 
   if (run->config('database/update')) then begin
-    db = kcordbmysql(logger_name=log_name)
+    db = kcordbmysql(logger_name=log_name, $
+                     mysql_opt_compress=run->config('database/compress'))
     db->connect, config_filename=run->config('database/config_filename'), $
                  config_section=run->config('database/config_section'), $
+                 pool=run->config('database/pool'), $
                  status=status, error_message=error_message
     if (status eq 0L) then begin
       obsday_index = mlso_obsday_insert(run.date, $
@@ -0,0 +1,79 @@
+; docformat = 'rst'
+
+;+
+; Bring the header index of a directory of FITS files up to date and return
+; the primary headers of its files.
+;
+; The index is a file named `.kcor_header_index` in the directory holding the
+; size, modification time, CRC-32 checksum, and primary header of each
+; `.fts` and `.fts.gz` file. It is updated by `KCOR_UPDATE_INDEX` in the kcor
+; DLM, which reads only files that are new or whose size or modification time
+; changed, so calling this routine repeatedly, e.g., each realtime run, is
+; cheap. It can also be read from Python with `bin/kcor_index.py`.
+;
+; :Returns:
+;   `orderedhash` of basename to header, as returned by `headfits`, or `!null`
+;   if the index could not be read or `UPDATE_ONLY` is set
+;
+; :Params:
+;   dir : in, required, type=string
+;     directory of FITS files to index
+;
+; :Keywords:
+;   count : out, optional, type=long
+;     set to a named variable to retrieve the number of files in the index
+;   filenames : out, optional, type=strarr
+;     set to a named variable to retrieve the basenames of the files
+;   sizes : out, optional, type=lon64arr
+;     set to a named variable to retrieve the sizes of the files in bytes
+;   mtimes : out, optional, type=lon64arr
+;     set to a named variable to retrieve the modification times of the files
+;     in seconds since the epoch
+;   checksums : out, optional, type=ulonarr
+;     set to a named variable to retrieve the CRC-32 of the uncompressed data
+;     of the files
+;   n_threads : in, optional, type=long, default=number of CPUs
+;     number of threads to read new headers with
+;   update_only : in, optional, type=boolean
+;     set to only update the index, without returning the headers or the
+;     `FILENAMES`, `SIZES`, `MTIMES`, and `CHECKSUMS` of the files
+;   errmsg : out, optional, type=string
+;     set to a named variable to retrieve an error message, '' if none
+;-
+function kcor_header_index, dir, $
+                            count=count, $
+                            filenames=filenames, $
+                            sizes=sizes, $
+                            mtimes=mtimes, $
+                            checksums=checksums, $
+                            n_threads=n_threads, $
+                            update_only=update_only, $
+                            errmsg=errmsg
+  compile_opt strictarr
+
+  count = 0L
+  errmsg = ''
+
+  catch, error_status
+  if (error_status ne 0L) then begin
+    catch, /cancel
+    errmsg = !error_state.msg
+    return, !null
+  endif
+
+  if (keyword_set(update_only)) then begin
+    count = kcor_update_index(dir)
+    return, !null
+  endif
+
+  count = kcor_update_index(dir, filenames, sizes, mtimes, checksums, $
+                            cards, card_offsets, $
+                            n_elements(n_threads) eq 0L ? 0L : n_threads)
+
+  headers = orderedhash()
+  for f = 0L, count - 1L do begin
+    headers[filenames[f]] = cards[card_offsets[f]:card_offsets[f + 1] - 1L]
+  endfor
+
+  return, headers
+end
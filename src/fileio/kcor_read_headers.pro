@@ -0,0 +1,128 @@
+; docformat = 'rst'
+
+;+
+; Apply a repair routine to the string values of the keywords of a file, the
+; only values the repair routines change.
+;
+; :Params:
+;   keywords : in, required, type=strarr
+;     FITS keywords
+;   values : in, out, required, type=strarr
+;     values of `keywords` for the file
+;   kinds : in, out, required, type=bytarr
+;     kinds of `values`, as returned by `KCOR_SCAN_HEADERS`
+;   repair_routine : in, required, type=string
+;     name of the repair routine
+;-
+pro kcor_read_headers_repair, keywords, values, kinds, repair_routine
+  compile_opt strictarr
+
+  header = ['END' + string(bytarr(77) + 32B)]
+  for k = 0L, n_elements(keywords) - 1L do begin
+    if (kinds[k] eq 1B) then fxaddpar, header, keywords[k], values[k]
+  endfor
+
+  call_procedure, repair_routine, header=header
+
+  for k = 0L, n_elements(keywords) - 1L do begin
+    value = sxpar(header, keywords[k], count=count)
+    if (count gt 0L && size(value, /type) eq 7) then begin
+      values[k] = value
+      kinds[k] = 1B
+    endif
+  endfor
+end
+
+
+;+
+; Read selected keywords from the primary headers of many L0 files at once.
+;
+; The headers are read in parallel by `KCOR_SCAN_HEADERS` in the kcor DLM,
+; which decompresses only the header of each file, so this is much faster than
+; calling `kcor_read_rawdata` with `header=` for each file.
+;
+; :Returns:
+;   array of structures, one per file, with a `filename` field and a field for
+;   each keyword, named as `IDL_VALIDNAME` converts it. A field is a string if
+;   any file has a string value for it, otherwise a double, long or byte for
+;   real, integer or logical values. Missing values are 0 or ''.
+;
+; :Params:
+;   filenames : in, required, type=strarr
+;     L0 filenames, gzipped or not
+;   keywords : in, required, type=strarr
+;     FITS keywords to read
+;
+; :Keywords:
+;   repair_routine : in, optional, type=string/strarr
+;     repair routine to apply to the header values, either one for all the
+;     files or one per file; see `kcor_read_rawdata`
+;   n_threads : in, optional, type=long, default=number of CPUs
+;     number of threads to read headers with
+;   found : out, optional, type="bytarr(n_keywords, n_files)"
+;     set to a named variable to retrieve whether each keyword was present in
+;     each file
+;   messages : out, optional, type=strarr
+;     set to a named variable to retrieve an error message for each file, ''
+;     for files whose headers were read
+;-
+function kcor_read_headers, filenames, keywords, $
+                            repair_routine=repair_routine, $
+                            n_threads=n_threads, $
+                            found=found, $
+                            messages=messages
+  compile_opt strictarr
+
+  n_files = n_elements(filenames)
+  n_keywords = n_elements(keywords)
+  _keywords = strupcase(keywords)
+
+  values = kcor_scan_headers(filenames, _keywords, kinds, messages, $
+                             n_elements(n_threads) eq 0L ? 0L : n_threads)
+  values = reform(values, n_keywords, n_files)
+  kinds = reform(kinds, n_keywords, n_files)
+
+  n_repair_routines = n_elements(repair_routine)
+  if (n_repair_routines gt 0L) then begin
+    for f = 0L, n_files - 1L do begin
+      file_repair_routine = repair_routine[f < (n_repair_routines - 1L)]
+      if (file_repair_routine eq '' || messages[f] ne '') then continue
+
+      file_values = values[*, f]
+      file_kinds = kinds[*, f]
+      kcor_read_headers_repair, _keywords, file_values, file_kinds, $
+                                file_repair_routine
+      values[*, f] = file_values
+      kinds[*, f] = file_kinds
+    endfor
+  endif
+
+  found = kinds ne 0B
+
+  headers = {filename: ''}
+  for k = 0L, n_keywords - 1L do begin
+    keyword_kinds = kinds[k, *]
+    case 1 of
+      max(keyword_kinds eq 1B): default = ''
+      max(keyword_kinds eq 4B): default = 0.0D
+      max(keyword_kinds eq 3B): default = 0L
+      max(keyword_kinds eq 2B): default = 0B
+      else: default = ''
+    endcase
+    headers = create_struct(headers, idl_validname(_keywords[k], /convert_all), default)
+  endfor
+  headers = replicate(headers, n_files)
+
+  headers.filename = filenames
+  for k = 0L, n_keywords - 1L do begin
+    keyword_values = reform(values[k, *])
+    case size(headers[0].(k + 1), /type) of
+      7: headers.(k + 1) = keyword_values
+      5: headers.(k + 1) = double(keyword_values)
+      3: headers.(k + 1) = long(keyword_values)
+      1: headers.(k + 1) = byte(keyword_values eq 'T')
+    endcase
+  endfor
+
+  return, headers
+end
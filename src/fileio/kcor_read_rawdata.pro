@@ -1,5 +1,49 @@
 ; docformat = 'rst'
 
+;+
+; Read an L0 file with `KCOR_READ_L0` from the kcor DLM, which decompresses,
+; unsigns and shifts the data in a single pass.
+;
+; :Returns:
+;   image, or `!null` if the file could not be read natively
+;
+; :Params:
+;   filename : in, required, type=string
+;     raw FITS filename
+;
+; :Keywords:
+;   header : out, optional, type=strarr
+;     header, as returned by `readfits`
+;   xshift : in, optional, type=lonarr(2)
+;     shift in x by camera
+;   start_state : in, optional, type=lonarr(2)
+;     start state by camera
+;-
+function kcor_read_rawdata_native, filename, header=header, $
+                                   xshift=xshift, start_state=start_state
+  compile_opt strictarr
+
+  catch, error_status
+  if (error_status ne 0L) then begin
+    catch, /cancel
+    return, !null
+  endif
+
+  im = kcor_read_l0(filename, header, $
+                    n_elements(xshift) eq 0L ? lonarr(2) : long(xshift), $
+                    n_elements(start_state) eq 0L ? lonarr(2) : long(start_state))
+
+  ; readfits resets BZERO for unsigned data
+  bzero = sxpar(header, 'BZERO', count=n_bzero)
+  if (n_bzero gt 0L && bzero ne 0) then begin
+    sxaddpar, header, 'BZERO', 0
+    sxaddpar, header, 'O_BZERO', bzero, ' Original BZERO Value'
+  endif
+
+  return, im
+end
+
+
 ;+
 ; Routine to read raw KCor data and, optionally, repair it.
 ;
@@ -14,6 +58,9 @@
 ;     repaired header
 ;   start_state : in, optional, type=integer, default=lonarr(2)
 ;     start state by camera
+;   header_index : in, optional, type=orderedhash
+;     headers by basename, as returned by `kcor_header_index`; when only the
+;     header is requested, it is taken from here instead of the file if present
 ;   repair_routine : in, optional, type=string
 ;     if present, repair routine will be called; interface is::
 ;
@@ -29,31 +76,49 @@ pro kcor_read_rawdata, filename, $
                        start_state=start_state, $
                        datatype=datatype, $
                        raw_data_prefix=raw_data_prefix, $
+                       header_index=header_index, $
                        double=double
   compile_opt strictarr
 
   errmsg = ''
 
-  case 1 of
-    arg_present(im) && arg_present(header): begin
-        if (keyword_set(raw_data_prefix)) then begin
-          im = kcor_old_readfits(filename, header, errmsg=errmsg, datatype=datatype)
-        endif else begin
-          im = readfits(filename, header, /silent, errmsg=errmsg)
-        endelse
-      end
-    arg_present(im): begin
-        if (keyword_set(raw_data_prefix)) then begin
-          im = kcor_old_readfits(filename, header, errmsg=errsg, datatype=datatype)
-        endif else begin
-          im = readfits(filename, /silent, errmsg=errmsg)
-        endelse
-      end
-    arg_present(header): header = headfits(filename, errmsg=errmsg, /silent)
-    else: return
-  endcase
-
-  if (arg_present(im) && n_elements(xshift) gt 0L) then begin
+  ; read current L0 files natively, already shifted, falling back to readfits
+  ; for anything else
+  if (arg_present(im) && ~keyword_set(raw_data_prefix)) then begin
+    im = kcor_read_rawdata_native(filename, header=header, $
+                                  xshift=xshift, start_state=start_state)
+    shifted = n_elements(im) gt 0L
+  endif else shifted = 0B
+
+  if (~shifted) then begin
+    case 1 of
+      arg_present(im) && arg_present(header): begin
+          if (keyword_set(raw_data_prefix)) then begin
+            im = kcor_old_readfits(filename, header, errmsg=errmsg, datatype=datatype)
+          endif else begin
+            im = readfits(filename, header, /silent, errmsg=errmsg)
+          endelse
+        end
+      arg_present(im): begin
+          if (keyword_set(raw_data_prefix)) then begin
+            im = kcor_old_readfits(filename, header, errmsg=errsg, datatype=datatype)
+          endif else begin
+            im = readfits(filename, /silent, errmsg=errmsg)
+          endelse
+        end
+      arg_present(header): begin
+          basename = file_basename(filename)
+          if (obj_valid(header_index) && header_index->hasKey(basename)) then begin
+            header = header_index[basename]
+          endif else begin
+            header = headfits(filename, errmsg=errmsg, /silent)
+          endelse
+        end
+      else: return
+    endcase
+  endif
+
+  if (arg_present(im) && ~shifted && n_elements(xshift) gt 0L) then begin
     for c = 0, 1 do begin
       if (xshift[c] ne 0L) then begin
         im[*, *, *, c] = shift(im[*, *, *, c], xshift[c], 0, 0)
@@ -61,7 +126,8 @@ pro kcor_read_rawdata, filename, $
     endfor
   endif
 
-  if (arg_present(im) && (n_elements(start_state) gt 0L) && ~array_equal(start_state, lonarr(2))) then begin
+  if (arg_present(im) && ~shifted $
+        && (n_elements(start_state) gt 0L) && ~array_equal(start_state, lonarr(2))) then begin
     for c = 0L, 1L do begin
       im[*, *, *, c] = shift(im[*, *, *, c], 0, 0, start_state[c])
     endfor
@@ -0,0 +1,138 @@
+; docformat = 'rst'
+
+;+
+; Read frames from a stream container written by socketcam, i.e., a
+; `YYYYMMDD_hhmmss_kcor_stream.bin` file. The container has a header, the
+; frames of both cameras in the order they were written, and an index giving
+; the time, camera, frame number, and modulator state of each frame, so any
+; frame can be read without reading the others. See
+; `observing/socketcam/core/sc_core.h` for the layout.
+;
+; :Returns:
+;   `uintarr(1024, 1024, n)` of the selected frames, or `!null` if no frames
+;   are selected or there is an error
+;
+; :Params:
+;   filename : in, required, type=string
+;     stream container filename
+;
+; :Keywords:
+;   header : out, optional, type=structure
+;     container header; `start_time` is in microseconds since
+;     1970-01-01 00:00:00 UT
+;   index : out, optional, type=array of structures
+;     index entry for every frame in the container; `time` is in microseconds
+;     since `header.start_time`
+;   frames : in, optional, type=lonarr
+;     indices of the frames to read, in the order written; default is all the
+;     frames selected by `camera` and `state`
+;   camera : in, optional, type=integer
+;     only read frames from this camera
+;   state : in, optional, type=integer
+;     only read frames in this modulator state
+;   selected : out, optional, type=lonarr
+;     set to a named variable to retrieve the indices of the frames returned
+;   no_data : in, optional, type=boolean
+;     set to only read the header and index
+;   error : out, optional, type=long
+;     set to a named variable to retrieve the error status, 0 for success
+;-
+function kcor_read_stream, filename, $
+                           header=header, $
+                           index=index, $
+                           frames=frames, $
+                           camera=camera, $
+                           state=state, $
+                           selected=selected, $
+                           no_data=no_data, $
+                           error=error
+  compile_opt strictarr
+  on_ioerror, io_error
+
+  error = 0L
+  selected = !null
+
+  openr, lun, filename, /get_lun, /swap_if_big_endian
+
+  header = {magic: bytarr(8), $
+            version: 0UL, $
+            header_size: 0UL, $
+            width: 0UL, $
+            height: 0UL, $
+            bytes_per_pixel: 0UL, $
+            n_cameras: 0UL, $
+            n_states: 0UL, $
+            reserved: 0UL, $
+            start_time: 0LL, $
+            n_frames: 0ULL, $
+            data_offset: 0ULL, $
+            frame_size: 0ULL, $
+            index_offset: 0ULL}
+  readu, lun, header
+
+  if (string(header.magic) ne 'KCORSTRM' || header.version ne 1UL) then begin
+    message, string(filename, format='(%"%s is not a stream container")'), /informational
+    error = 1L
+    goto, done
+  endif
+
+  ; a capture that was not closed has no index
+  if (header.index_offset eq 0ULL) then begin
+    message, string(filename, format='(%"%s has no index")'), /informational
+    error = 2L
+    goto, done
+  endif
+
+  if (header.n_frames eq 0ULL) then goto, done
+
+  index = replicate({time: 0LL, $
+                     number: 0ULL, $
+                     camera: 0B, $
+                     state: 0B, $
+                     flags: 0US, $
+                     n_behind: 0UL, $
+                     n_missed: 0UL, $
+                     reserved: 0UL}, header.n_frames)
+  point_lun, lun, header.index_offset
+  readu, lun, index
+
+  if (n_elements(frames) gt 0L) then begin
+    selected = long(frames)
+  endif else begin
+    mask = bytarr(header.n_frames) + 1B
+    if (n_elements(camera) gt 0L) then mask and= index.camera eq camera
+    if (n_elements(state) gt 0L) then mask and= index.state eq state
+    selected = where(mask, n_selected, /null)
+  endelse
+
+  if (keyword_set(no_data) || n_elements(selected) eq 0L) then goto, done
+
+  ; random access to the frames without reading the rest of the file
+  data = assoc(lun, uintarr(header.width, header.height), header.data_offset)
+  im = uintarr(header.width, header.height, n_elements(selected), /nozero)
+  for f = 0L, n_elements(selected) - 1L do im[*, *, f] = data[selected[f]]
+
+  free_lun, lun
+  return, im
+
+  io_error:
+  message, !error_state.msg, /informational
+  error = 3L
+
+  done:
+  if (n_elements(lun) gt 0L) then free_lun, lun
+  return, !null
+end
+
+
+; main-level example program
+
+filename = '20261018_170647_kcor_stream.bin'
+
+; the state 0 frames of camera 1
+im = kcor_read_stream(filename, header=header, index=index, $
+                      camera=1, state=0, selected=selected)
+help, header, index, im
+print, index[selected[0:3]].number
+
+end
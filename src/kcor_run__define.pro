@@ -462,6 +462,73 @@ function kcor_run::getVariable, name, found=found
 end
 
 
+;= run-scoped cache
+
+;+
+; Retrieve a value cached for the run, e.g., the calibration quantities of the
+; current cal file.
+;
+; :Returns:
+;   pointer to the cached value, a null pointer if `name` has nothing cached
+;   under `key`; the run owns the pointer
+;
+; :Params:
+;   name : in, required, type=string
+;     name of the cache, e.g., 'calibration'
+;   key : in, required, type=string
+;     key identifying the inputs the value was computed from
+;
+; :Keywords:
+;   found : out, optional, type=boolean
+;     set to a named variable to retrieve whether `key` was found
+;-
+function kcor_run::cache_get, name, key, found=found
+  compile_opt strictarr
+
+  found = 0B
+  if (self.cache->hasKey(name)) then begin
+    entry = self.cache[name]
+    found = entry.key eq key
+  endif
+
+  if (found) then begin
+    self.cache_hits += 1L
+    return, entry.value
+  endif
+
+  self.cache_misses += 1L
+  return, ptr_new()
+end
+
+
+;+
+; Cache a value for the run. Each cache holds a single value, so caching a
+; value under a new key, e.g., when the cal epoch changes during the day,
+; frees the value cached before it.
+;
+; :Returns:
+;   pointer to the cached value; the run owns the pointer
+;
+; :Params:
+;   name : in, required, type=string
+;     name of the cache, e.g., 'calibration'
+;   key : in, required, type=string
+;     key identifying the inputs the value was computed from
+;   value : in, required, type=any
+;     value to cache, undefined after the call
+;-
+function kcor_run::cache_put, name, key, value
+  compile_opt strictarr
+
+  if (self.cache->hasKey(name)) then ptr_free, (self.cache->remove(name)).value
+
+  entry = {key: key, value: ptr_new(value, /no_copy)}
+  self.cache[name] = entry
+
+  return, entry.value
+end
+
+
 ;= property access
 
 ;+
@@ -531,6 +598,16 @@ end
 pro kcor_run::cleanup
   compile_opt strictarr
 
+  if (self.cache_hits + self.cache_misses gt 0L) then begin
+    mg_log, 'run cache: %d hits, %d misses', $
+            self.cache_hits, self.cache_misses, $
+            name=self.logger_name, /debug
+  endif
+  if (obj_valid(self.cache)) then begin
+    foreach entry, self.cache do ptr_free, entry.value
+  endif
+  obj_destroy, self.cache
+
   mg_log, /quit
   obj_destroy, self.options
 end
@@ -545,15 +622,27 @@ end
 ; :Params:
 ;   date : in, required, type=string
 ;     date in the form 'YYYYMMDD'
+;
+; :Keywords:
+;   config_filename : in, required, type=string
+;     filename of the config file
+;   mode : in, optional, type=string
+;     "realtime", "eod", etc.
+;   rotate_logs : in, optional, type=boolean
+;     set to 0 to not rotate the logs even when reprocessing, e.g., for a
+;     worker process logging to the same logs; default is the value of the
+;     `realtime/reprocess` option
 ;-
 function kcor_run::init, date, $
                          config_filename=config_filename, $
-                         mode=mode
+                         mode=mode, $
+                         rotate_logs=rotate_logs
   compile_opt strictarr
   on_error, 2
 
   self.date = date
   self.pipe_dir = file_expand_path(filepath('..', root=mg_src_root()))
+  self.cache = hash()
 
   if (~file_test(config_filename)) then message, config_filename + ' not found'
   self.config_filename = config_filename
@@ -589,7 +678,9 @@ function kcor_run::init, date, $
   ; rotate the logs if this is a reprocessing
   self->setProperty, mode=mode
   reprocess = self->config('realtime/reprocess')
-  self->setup_loggers, rotate_logs=reprocess
+  self->setup_loggers, rotate_logs=n_elements(rotate_logs) eq 0L $
+                                     ? reprocess $
+                                     : rotate_logs
 
   return, 1
 end
@@ -608,7 +699,10 @@ pro kcor_run__define
            logger_name:     '', $
            pipe_dir:        '', $
            options:         obj_new(), $
-           epochs:          obj_new()}
+           epochs:          obj_new(), $
+           cache:           obj_new(), $
+           cache_hits:      0L, $
+           cache_misses:    0L}
 end
 
 
@@ -3,6 +3,11 @@
 #include <math.h>
 #include <string.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #ifdef strlcpy
 #undef strlcpy
 #endif
@@ -12,6 +17,16 @@
 #endif
 
 #include "idl_export.h"
+#include "kcor_fits.h"
+#include "kcor_gzip.h"
+#include "kcor_index.h"
+#include "kcor_watch.h"
+
+/*
+ * IDL_Message does not substitute arguments into IDL_M_NAMED_GENERIC
+ * messages, so they are formatted into a buffer of this size first.
+ */
+#define KCOR_MESSAGE_SIZE 1024
 
 #define IDL_KCOR_MATRIX_VECTOR_MULTIPLY(TYPE)                                \
 void IDL_kcor_matrix_vector_multiply_ ## TYPE(TYPE *a_data, TYPE *b_data, TYPE *result_data, int n, int m) { \
@@ -105,6 +120,806 @@ static IDL_VPTR IDL_kcor_batched_matrix_vector_multiply(int argc, IDL_VPTR *argv
 }
 
 
+/*
+ * Camera correction cache
+ *
+ * The fit parameters and bad pixel lists of a camera correction file are
+ * cached in a flat binary file: a header, then the fit parameters as raw
+ * float planes, the bad column and bad value indices as 32-bit integers, and
+ * the bad pixel mask as bytes. Each section starts on a 64 KB boundary so it
+ * can be mapped on its own; the arrays returned by the reader are backed by
+ * the mapping and are paged in from the page cache, which is shared by every
+ * process reading the same cache file.
+ *
+ * The file is in native byte order; a cache written on a machine of the other
+ * byte order, or in another version of the format, is rejected.
+ */
+
+#define KCOR_CAMCOR_MAGIC     "KCORCAM"
+#define KCOR_CAMCOR_VERSION   1
+#define KCOR_CAMCOR_ALIGNMENT 65536
+
+typedef struct {
+  char       magic[8];
+  IDL_LONG   version;
+  IDL_LONG   header_size;
+  IDL_LONG64 dims[3];             /* nx, ny, number of fit parameters */
+  IDL_LONG64 n_bad_columns;
+  IDL_LONG64 n_bad_values;
+  IDL_LONG64 fit_params_offset;
+  IDL_LONG64 bad_columns_offset;
+  IDL_LONG64 bad_values_offset;
+  IDL_LONG64 mask_offset;
+  IDL_LONG64 file_size;
+} kcor_camcor_header;
+
+/* mappings backing arrays returned to IDL, so they can be unmapped when freed */
+typedef struct kcor_mapping {
+  UCHAR *data;
+  size_t length;
+  struct kcor_mapping *next;
+} kcor_mapping;
+
+static kcor_mapping *kcor_mappings = NULL;
+
+static IDL_LONG64 kcor_align(IDL_LONG64 offset) {
+  return (offset + KCOR_CAMCOR_ALIGNMENT - 1) / KCOR_CAMCOR_ALIGNMENT * KCOR_CAMCOR_ALIGNMENT;
+}
+
+static void kcor_unmap(UCHAR *data) {
+  kcor_mapping **m, *mapping;
+
+  for (m = &kcor_mappings; *m != NULL; m = &(*m)->next) {
+    if ((*m)->data == data) {
+      mapping = *m;
+      *m = mapping->next;
+      munmap(mapping->data, mapping->length);
+      free(mapping);
+      return;
+    }
+  }
+}
+
+/*
+ * Map a section of the cache privately, so that IDL can modify the array
+ * without changing the file; pages are only copied when written to.
+ */
+static UCHAR *kcor_map(int fd, IDL_LONG64 offset, size_t length) {
+  kcor_mapping *mapping;
+  void *data;
+
+  data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t) offset);
+  if (data == MAP_FAILED) return NULL;
+
+  mapping = (kcor_mapping *) malloc(sizeof(kcor_mapping));
+  if (mapping == NULL) {
+    munmap(data, length);
+    return NULL;
+  }
+  mapping->data = (UCHAR *) data;
+  mapping->length = length;
+  mapping->next = kcor_mappings;
+  kcor_mappings = mapping;
+
+  return mapping->data;
+}
+
+static IDL_VPTR kcor_import(int fd, IDL_LONG64 offset, int n_dims, IDL_MEMINT *dims,
+                            int type, size_t elt_size) {
+  IDL_MEMINT n = 1;
+  UCHAR *data;
+  int d;
+
+  for (d = 0; d < n_dims; d++) n *= dims[d];
+  data = kcor_map(fd, offset, n * elt_size);
+  if (data == NULL) return NULL;
+
+  return IDL_ImportArray(n_dims, dims, type, data, kcor_unmap, NULL);
+}
+
+/* map n indices, if any, setting result to NULL for none; returns -1 on error */
+static int kcor_import_indices(int fd, IDL_LONG64 offset, IDL_LONG64 n,
+                               IDL_VPTR *result) {
+  IDL_MEMINT dims[1];
+
+  *result = NULL;
+  if (n == 0) return 0;
+
+  dims[0] = n;
+  *result = kcor_import(fd, offset, 1, dims, IDL_TYP_LONG, sizeof(IDL_LONG));
+  return *result == NULL ? -1 : 0;
+}
+
+static void kcor_store_indices(IDL_VPTR result, IDL_LONG64 n,
+                               IDL_VPTR indices, IDL_VPTR n_indices) {
+  IDL_StoreScalarZero(n_indices, IDL_TYP_LONG);
+  n_indices->value.l = (IDL_LONG) n;
+
+  /* no indices are stored as -1L, like WHERE */
+  if (result == NULL) {
+    IDL_StoreScalarZero(indices, IDL_TYP_LONG);
+    indices->value.l = -1L;
+    return;
+  }
+
+  IDL_VarCopy(result, indices);
+}
+
+static int kcor_check_section(const kcor_camcor_header *header,
+                              IDL_LONG64 offset, IDL_LONG64 length) {
+  return offset % KCOR_CAMCOR_ALIGNMENT == 0
+           && offset >= header->header_size
+           && length >= 0
+           && offset + length <= header->file_size;
+}
+
+/*
+ * fit_params = kcor_read_camera_correction_cache(filename, $
+ *                bad_columns, n_bad_columns, bad_values, n_bad_values, mask)
+ */
+static IDL_VPTR IDL_kcor_read_camera_correction_cache(int argc, IDL_VPTR *argv) {
+  char *filename;
+  kcor_camcor_header header;
+  struct stat st;
+  IDL_MEMINT dims[3];
+  IDL_LONG64 n_pixels;
+  IDL_VPTR fit_params, bad_columns = NULL, bad_values = NULL, mask = NULL;
+  int fd, i;
+
+  IDL_ENSURE_STRING(argv[0]);
+  IDL_ENSURE_SCALAR(argv[0]);
+  for (i = 1; i < argc; i++) IDL_EXCLUDE_EXPR(argv[i]);
+
+  filename = IDL_VarGetString(argv[0]);
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP,
+                "unable to open camera correction cache");
+  }
+
+  if (fstat(fd, &st) != 0
+        || read(fd, &header, sizeof(header)) != (ssize_t) sizeof(header)
+        || strncmp(header.magic, KCOR_CAMCOR_MAGIC, sizeof(header.magic)) != 0
+        || header.version != KCOR_CAMCOR_VERSION
+        || header.header_size != (IDL_LONG) sizeof(header)
+        || header.file_size > (IDL_LONG64) st.st_size) {
+    close(fd);
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP,
+                "invalid camera correction cache");
+  }
+
+  n_pixels = header.dims[0] * header.dims[1];
+  if (header.dims[0] <= 0 || header.dims[1] <= 0 || header.dims[2] <= 0
+        || header.n_bad_columns < 0 || header.n_bad_values < 0
+        || !kcor_check_section(&header, header.fit_params_offset,
+                               n_pixels * header.dims[2] * (IDL_LONG64) sizeof(float))
+        || !kcor_check_section(&header, header.bad_columns_offset,
+                               header.n_bad_columns * (IDL_LONG64) sizeof(IDL_LONG))
+        || !kcor_check_section(&header, header.bad_values_offset,
+                               header.n_bad_values * (IDL_LONG64) sizeof(IDL_LONG))
+        || !kcor_check_section(&header, header.mask_offset, n_pixels)) {
+    close(fd);
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP,
+                "invalid camera correction cache");
+  }
+
+  dims[0] = header.dims[0];
+  dims[1] = header.dims[1];
+  dims[2] = header.dims[2];
+  fit_params = kcor_import(fd, header.fit_params_offset, 3, dims,
+                           IDL_TYP_FLOAT, sizeof(float));
+  if (fit_params == NULL) {
+    close(fd);
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP,
+                "unable to map camera correction cache");
+  }
+
+  /* map every section before storing any output, so a failure leaves none */
+  if ((argc > 2 && kcor_import_indices(fd, header.bad_columns_offset,
+                                       header.n_bad_columns, &bad_columns) != 0)
+        || (argc > 4 && kcor_import_indices(fd, header.bad_values_offset,
+                                            header.n_bad_values, &bad_values) != 0)
+        || (argc > 5 && (mask = kcor_import(fd, header.mask_offset, 2, dims,
+                                            IDL_TYP_BYTE, 1)) == NULL)) {
+    close(fd);
+    /* freeing the temporaries unmaps their sections */
+    IDL_Deltmp(fit_params);
+    if (bad_columns != NULL) IDL_Deltmp(bad_columns);
+    if (bad_values != NULL) IDL_Deltmp(bad_values);
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP,
+                "unable to map camera correction cache");
+  }
+
+  /* the mappings stay valid after the file is closed */
+  close(fd);
+
+  if (argc > 2) {
+    kcor_store_indices(bad_columns, header.n_bad_columns, argv[1], argv[2]);
+  }
+  if (argc > 4) {
+    kcor_store_indices(bad_values, header.n_bad_values, argv[3], argv[4]);
+  }
+  if (argc > 5) IDL_VarCopy(mask, argv[5]);
+
+  return fit_params;
+}
+
+static int kcor_write_section(FILE *f, IDL_LONG64 offset, void *data, size_t length) {
+  if (length == 0) return 0;
+  if (fseeko(f, (off_t) offset, SEEK_SET) != 0) return -1;
+  return fwrite(data, 1, length, f) == length ? 0 : -1;
+}
+
+static IDL_LONG64 kcor_n_indices(IDL_VPTR indices, IDL_VPTR n_indices) {
+  IDL_LONG64 n = IDL_LongScalar(n_indices);
+
+  if (n == 0) return 0;
+  if (indices->type != IDL_TYP_LONG || !(indices->flags & IDL_V_ARR)
+        || indices->value.arr->n_elts < n) {
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP,
+                "bad column and bad value indices must be LONG arrays");
+  }
+  return n;
+}
+
+/*
+ * kcor_write_camera_correction_cache, filename, fit_params, $
+ *   bad_columns, n_bad_columns, bad_values, n_bad_values, mask
+ *
+ * The cache is written to a temporary file and renamed into place, so
+ * processes reading the cache concurrently see either no cache or a complete
+ * one.
+ */
+static void IDL_kcor_write_camera_correction_cache(int argc, IDL_VPTR *argv) {
+  char *filename, *tmp_filename;
+  kcor_camcor_header header;
+  IDL_VPTR fit_params = argv[1], mask = argv[6];
+  IDL_LONG64 n_pixels;
+  FILE *f;
+  int status;
+
+  IDL_ENSURE_STRING(argv[0]);
+  IDL_ENSURE_SCALAR(argv[0]);
+  IDL_ENSURE_ARRAY(fit_params);
+  IDL_ENSURE_ARRAY(mask);
+
+  if (fit_params->type != IDL_TYP_FLOAT || fit_params->value.arr->n_dim != 3) {
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP,
+                "fit parameters must be a 3-dimensional FLOAT array");
+  }
+
+  memset(&header, 0, sizeof(header));
+  strncpy(header.magic, KCOR_CAMCOR_MAGIC, sizeof(header.magic));
+  header.version = KCOR_CAMCOR_VERSION;
+  header.header_size = sizeof(header);
+  header.dims[0] = fit_params->value.arr->dim[0];
+  header.dims[1] = fit_params->value.arr->dim[1];
+  header.dims[2] = fit_params->value.arr->dim[2];
+  n_pixels = header.dims[0] * header.dims[1];
+
+  if (mask->type != IDL_TYP_BYTE || mask->value.arr->n_elts != n_pixels) {
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP,
+                "mask must be a BYTE array the size of a fit parameter");
+  }
+
+  header.n_bad_columns = kcor_n_indices(argv[2], argv[3]);
+  header.n_bad_values = kcor_n_indices(argv[4], argv[5]);
+
+  header.fit_params_offset = kcor_align(sizeof(header));
+  header.bad_columns_offset = kcor_align(header.fit_params_offset
+                                           + n_pixels * header.dims[2] * sizeof(float));
+  header.bad_values_offset = kcor_align(header.bad_columns_offset
+                                          + header.n_bad_columns * sizeof(IDL_LONG));
+  header.mask_offset = kcor_align(header.bad_values_offset
+                                    + header.n_bad_values * sizeof(IDL_LONG));
+  header.file_size = header.mask_offset + n_pixels;
+
+  filename = IDL_VarGetString(argv[0]);
+  tmp_filename = (char *) malloc(strlen(filename) + 32);
+  if (tmp_filename == NULL) {
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP, "out of memory");
+  }
+  sprintf(tmp_filename, "%s.%ld.tmp", filename, (long) getpid());
+
+  f = fopen(tmp_filename, "wb");
+  if (f == NULL) {
+    free(tmp_filename);
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP,
+                "unable to write camera correction cache");
+  }
+
+  status = kcor_write_section(f, 0, &header, sizeof(header));
+  if (status == 0) {
+    status = kcor_write_section(f, header.fit_params_offset,
+                                fit_params->value.arr->data,
+                                n_pixels * header.dims[2] * sizeof(float));
+  }
+  if (status == 0 && header.n_bad_columns > 0) {
+    status = kcor_write_section(f, header.bad_columns_offset,
+                                argv[2]->value.arr->data,
+                                header.n_bad_columns * sizeof(IDL_LONG));
+  }
+  if (status == 0 && header.n_bad_values > 0) {
+    status = kcor_write_section(f, header.bad_values_offset,
+                                argv[4]->value.arr->data,
+                                header.n_bad_values * sizeof(IDL_LONG));
+  }
+  if (status == 0) {
+    status = kcor_write_section(f, header.mask_offset,
+                                mask->value.arr->data, n_pixels);
+  }
+  if (fclose(f) != 0) status = -1;
+
+  if (status == 0 && rename(tmp_filename, filename) != 0) status = -1;
+  if (status != 0) {
+    unlink(tmp_filename);
+    free(tmp_filename);
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP,
+                "unable to write camera correction cache");
+  }
+
+  free(tmp_filename);
+}
+
+
+/*
+ * Compress files with gzip, in place of spawning the gzip executable. Each
+ * file is written to file.gz and removed only after its .gz file has been
+ * verified.
+ *
+ * sizes = KCOR_GZIP_FILES(filenames[, n_threads[, messages]])
+ *
+ * Returns the compressed size of each file, -1 for files that could not be
+ * compressed. N_THREADS defaults to the number of online processors. MESSAGES
+ * is set to the error message for each file, '' for files that succeeded.
+ */
+static IDL_VPTR IDL_kcor_gzip_files(int argc, IDL_VPTR *argv) {
+  IDL_VPTR filenames = argv[0], sizes, messages = NULL;
+  IDL_STRING *filenames_data, *messages_data = NULL;
+  IDL_LONG64 *sizes_data;
+  IDL_MEMINT f, n_files;
+  kcor_gzip_status status;
+  off_t compressed_size;
+  int n_threads = argc > 1 ? IDL_LongScalar(argv[1]) : 0;
+
+  IDL_ENSURE_STRING(filenames);
+  if (argc > 2) {
+    IDL_EXCLUDE_EXPR(argv[2]);
+  }
+
+  if (filenames->flags & IDL_V_ARR) {
+    filenames_data = (IDL_STRING *) filenames->value.arr->data;
+    n_files = filenames->value.arr->n_elts;
+  } else {
+    filenames_data = &filenames->value.str;
+    n_files = 1;
+  }
+
+  sizes_data = (IDL_LONG64 *) IDL_MakeTempVector(IDL_TYP_LONG64, n_files,
+                                                 IDL_ARR_INI_ZERO, &sizes);
+  if (argc > 2) {
+    messages_data = (IDL_STRING *) IDL_MakeTempVector(IDL_TYP_STRING, n_files,
+                                                      IDL_ARR_INI_ZERO,
+                                                      &messages);
+  }
+
+  for (f = 0; f < n_files; f++) {
+    status = kcor_gzip_file(IDL_STRING_STR(&filenames_data[f]),
+                            KCOR_GZIP_DEFAULT_LEVEL, n_threads,
+                            &compressed_size);
+    sizes_data[f] = status == KCOR_GZIP_OK ? (IDL_LONG64) compressed_size : -1;
+    if (messages_data != NULL && status != KCOR_GZIP_OK) {
+      IDL_StrStore(&messages_data[f], kcor_gzip_strerror(status));
+    }
+  }
+
+  if (messages != NULL) IDL_VarCopy(messages, argv[2]);
+
+  return sizes;
+}
+
+
+static void kcor_get_camera_longs(IDL_VPTR var, const char *name, long values[2]) {
+  char message[KCOR_MESSAGE_SIZE];
+  IDL_LONG *data;
+
+  IDL_ENSURE_ARRAY(var);
+  if (var->type != IDL_TYP_LONG || var->value.arr->n_elts != 2) {
+    snprintf(message, sizeof(message), "%s must be a 2-element LONG array", name);
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP, message);
+  }
+  data = (IDL_LONG *) var->value.arr->data;
+  values[0] = data[0];
+  values[1] = data[1];
+}
+
+
+/*
+ * Read an L0 file, gzipped or not, in place of readfits followed by shifting
+ * by xshift and start_state.
+ *
+ * image = KCOR_READ_L0(filename, header, xshift, start_state)
+ *
+ * Returns the image as UINT/ULONG (for BZERO of 2^15/2^31) or INT/LONG, like
+ * readfits, with each camera shifted by XSHIFT columns and START_STATE
+ * states. HEADER is set to the primary header, unmodified. Files not in the
+ * L0 layout give an error, so the caller can fall back to readfits.
+ */
+static IDL_VPTR IDL_kcor_read_l0(int argc, IDL_VPTR *argv) {
+  kcor_fits_file file;
+  kcor_fits_status status;
+  long xshift[2] = { 0, 0 }, start_state[2] = { 0, 0 };
+  IDL_MEMINT dims[KCOR_FITS_MAX_AXES];
+  IDL_VPTR image, header;
+  IDL_STRING *header_data;
+  char card[KCOR_FITS_CARD_SIZE + 1];
+  char message[KCOR_MESSAGE_SIZE];
+  char *image_data;
+  int c, type;
+
+  IDL_ENSURE_STRING(argv[0]);
+  IDL_ENSURE_SCALAR(argv[0]);
+  IDL_EXCLUDE_EXPR(argv[1]);
+  if (argc > 2) kcor_get_camera_longs(argv[2], "xshift", xshift);
+  if (argc > 3) kcor_get_camera_longs(argv[3], "start_state", start_state);
+
+  status = kcor_fits_open(IDL_VarGetString(argv[0]), &file);
+  if (status == KCOR_FITS_OK) status = kcor_fits_check_l0(&file);
+  if (status != KCOR_FITS_OK) {
+    kcor_fits_close(&file);
+    snprintf(message, sizeof(message), "%s", kcor_fits_strerror(status));
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP, message);
+  }
+
+  if (file.bitpix == 16) {
+    type = file.is_unsigned ? IDL_TYP_UINT : IDL_TYP_INT;
+  } else {
+    type = file.is_unsigned ? IDL_TYP_ULONG : IDL_TYP_LONG;
+  }
+  for (c = 0; c < KCOR_FITS_MAX_AXES; c++) dims[c] = file.naxes[c];
+
+  image_data = IDL_MakeTempArray(type, KCOR_FITS_MAX_AXES, dims,
+                                 IDL_ARR_INI_NOP, &image);
+  status = kcor_fits_read_l0(&file, image_data, xshift, start_state);
+  if (status != KCOR_FITS_OK) {
+    kcor_fits_close(&file);
+    IDL_Deltmp(image);
+    snprintf(message, sizeof(message), "%s", kcor_fits_strerror(status));
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP, message);
+  }
+
+  header_data = (IDL_STRING *) IDL_MakeTempVector(IDL_TYP_STRING, file.n_cards,
+                                                  IDL_ARR_INI_ZERO, &header);
+  card[KCOR_FITS_CARD_SIZE] = '\0';
+  for (c = 0; c < file.n_cards; c++) {
+    memcpy(card, file.cards + c * KCOR_FITS_CARD_SIZE, KCOR_FITS_CARD_SIZE);
+    IDL_StrStore(&header_data[c], card);
+  }
+  IDL_VarCopy(header, argv[1]);
+
+  kcor_fits_close(&file);
+
+  return image;
+}
+
+
+/*
+ * Read keywords from the primary headers of many files, gzipped or not,
+ * decompressing only the headers, in parallel.
+ *
+ * values = KCOR_SCAN_HEADERS(filenames, keywords[, kinds[, messages[, n_threads]]])
+ *
+ * Returns a [n_keywords, n_files] STRING array of the keyword values as text,
+ * with strings unquoted. KINDS is set to a BYTE array of the same size giving
+ * the kind of each value: 0 for missing, 1 for string, 2 for logical, 3 for
+ * integer and 4 for real. MESSAGES is set to the error message for each file,
+ * '' for files that were read. N_THREADS defaults to the number of online
+ * processors.
+ */
+static IDL_VPTR IDL_kcor_scan_headers(int argc, IDL_VPTR *argv) {
+  IDL_VPTR filenames = argv[0], keywords = argv[1];
+  IDL_VPTR values, kinds = NULL, messages = NULL;
+  IDL_STRING *filenames_data, *keywords_data, *values_data, *messages_data;
+  IDL_MEMINT dims[2];
+  const char **filename_strs, **keyword_strs;
+  char *value_strs;
+  kcor_fits_kind *kind_data;
+  kcor_fits_status *statuses;
+  UCHAR *kinds_data;
+  int n_threads = argc > 4 ? IDL_LongScalar(argv[4]) : 0;
+  IDL_MEMINT f, k, n_files, n_keywords, i;
+
+  IDL_ENSURE_STRING(filenames);
+  IDL_ENSURE_STRING(keywords);
+  for (i = 2; i < argc && i < 4; i++) {
+    IDL_EXCLUDE_EXPR(argv[i]);
+  }
+
+  if (filenames->flags & IDL_V_ARR) {
+    filenames_data = (IDL_STRING *) filenames->value.arr->data;
+    n_files = filenames->value.arr->n_elts;
+  } else {
+    filenames_data = &filenames->value.str;
+    n_files = 1;
+  }
+  if (keywords->flags & IDL_V_ARR) {
+    keywords_data = (IDL_STRING *) keywords->value.arr->data;
+    n_keywords = keywords->value.arr->n_elts;
+  } else {
+    keywords_data = &keywords->value.str;
+    n_keywords = 1;
+  }
+
+  filename_strs = malloc(n_files * sizeof(char *));
+  keyword_strs = malloc(n_keywords * sizeof(char *));
+  value_strs = malloc(n_files * n_keywords * KCOR_FITS_CARD_SIZE);
+  kind_data = malloc(n_files * n_keywords * sizeof(kcor_fits_kind));
+  statuses = malloc(n_files * sizeof(kcor_fits_status));
+  if (filename_strs == NULL || keyword_strs == NULL || value_strs == NULL
+        || kind_data == NULL || statuses == NULL) {
+    free(filename_strs);
+    free(keyword_strs);
+    free(value_strs);
+    free(kind_data);
+    free(statuses);
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP,
+                "unable to allocate memory for scanning headers");
+  }
+
+  for (f = 0; f < n_files; f++) filename_strs[f] = IDL_STRING_STR(&filenames_data[f]);
+  for (k = 0; k < n_keywords; k++) keyword_strs[k] = IDL_STRING_STR(&keywords_data[k]);
+
+  kcor_fits_scan_headers(n_files, filename_strs, n_keywords, keyword_strs,
+                         value_strs, kind_data, statuses, n_threads);
+
+  dims[0] = n_keywords;
+  dims[1] = n_files;
+  values_data = (IDL_STRING *) IDL_MakeTempArray(IDL_TYP_STRING, 2, dims,
+                                                 IDL_ARR_INI_ZERO, &values);
+  for (i = 0; i < n_files * n_keywords; i++) {
+    IDL_StrStore(&values_data[i], value_strs + i * KCOR_FITS_CARD_SIZE);
+  }
+
+  if (argc > 2) {
+    kinds_data = (UCHAR *) IDL_MakeTempArray(IDL_TYP_BYTE, 2, dims,
+                                             IDL_ARR_INI_NOP, &kinds);
+    for (i = 0; i < n_files * n_keywords; i++) kinds_data[i] = kind_data[i];
+    IDL_VarCopy(kinds, argv[2]);
+  }
+
+  if (argc > 3) {
+    messages_data = (IDL_STRING *) IDL_MakeTempVector(IDL_TYP_STRING, n_files,
+                                                      IDL_ARR_INI_ZERO,
+                                                      &messages);
+    for (f = 0; f < n_files; f++) {
+      if (statuses[f] != KCOR_FITS_OK) {
+        IDL_StrStore(&messages_data[f], kcor_fits_strerror(statuses[f]));
+      }
+    }
+    IDL_VarCopy(messages, argv[3]);
+  }
+
+  free(filename_strs);
+  free(keyword_strs);
+  free(value_strs);
+  free(kind_data);
+  free(statuses);
+
+  return values;
+}
+
+
+/*
+ * Bring the header index of a directory up to date and return its contents.
+ *
+ * n_files = KCOR_UPDATE_INDEX(dir[, filenames, sizes, mtimes, checksums, $
+ *                             cards, card_offsets[, n_threads]])
+ *
+ * Returns the number of .fts and .fts.gz files in DIR. FILENAMES, SIZES,
+ * MTIMES and CHECKSUMS are set to the basename, size, modification time and
+ * CRC-32 of the uncompressed data of each file. CARDS is set to the cards of
+ * the primary headers of all the files, padded to 80 characters, with the
+ * header of file i in CARDS[CARD_OFFSETS[i]:CARD_OFFSETS[i + 1] - 1]. Only
+ * new or changed files are read. Called with DIR only, the index is updated
+ * without returning its contents.
+ */
+static IDL_VPTR IDL_kcor_update_index(int argc, IDL_VPTR *argv) {
+  kcor_index index;
+  kcor_index_status status;
+  IDL_VPTR filenames, sizes, mtimes, checksums, cards, card_offsets;
+  IDL_STRING *filenames_data, *cards_data;
+  IDL_LONG64 *sizes_data, *mtimes_data, *card_offsets_data;
+  IDL_ULONG *checksums_data;
+  IDL_MEMINT n_cards = 0, n;
+  char card[KCOR_FITS_CARD_SIZE + 1];
+  char message[KCOR_MESSAGE_SIZE];
+  int n_threads = argc > 7 ? IDL_LongScalar(argv[7]) : 0;
+  int i, e, c;
+
+  IDL_ENSURE_STRING(argv[0]);
+  IDL_ENSURE_SCALAR(argv[0]);
+  if (argc > 1 && argc < 7) {
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP,
+                "pass either only the directory or all of the outputs");
+  }
+  for (i = 1; i < argc && i < 7; i++) {
+    IDL_EXCLUDE_EXPR(argv[i]);
+  }
+
+  status = kcor_index_update(IDL_VarGetString(argv[0]), n_threads, &index);
+  if (status != KCOR_INDEX_OK) {
+    snprintf(message, sizeof(message), "%s: %s",
+             kcor_index_strerror(status), IDL_VarGetString(argv[0]));
+    IDL_Message(IDL_M_NAMED_GENERIC,
+                status == KCOR_INDEX_WRITE ? IDL_MSG_INFO : IDL_MSG_LONGJMP,
+                message);
+  }
+
+  if (argc == 1 || index.n_entries == 0) {
+    n = index.n_entries;
+    kcor_index_free(&index);
+    return IDL_GettmpLong(n);
+  }
+
+  for (e = 0; e < index.n_entries; e++) n_cards += index.entries[e].n_cards;
+
+  n = index.n_entries;
+  filenames_data = (IDL_STRING *) IDL_MakeTempVector(IDL_TYP_STRING, n,
+                                                     IDL_ARR_INI_ZERO, &filenames);
+  sizes_data = (IDL_LONG64 *) IDL_MakeTempVector(IDL_TYP_LONG64, n,
+                                                 IDL_ARR_INI_NOP, &sizes);
+  mtimes_data = (IDL_LONG64 *) IDL_MakeTempVector(IDL_TYP_LONG64, n,
+                                                  IDL_ARR_INI_NOP, &mtimes);
+  checksums_data = (IDL_ULONG *) IDL_MakeTempVector(IDL_TYP_ULONG, n,
+                                                    IDL_ARR_INI_NOP, &checksums);
+  card_offsets_data = (IDL_LONG64 *) IDL_MakeTempVector(IDL_TYP_LONG64, n + 1,
+                                                        IDL_ARR_INI_NOP,
+                                                        &card_offsets);
+  cards_data = (IDL_STRING *) IDL_MakeTempVector(IDL_TYP_STRING,
+                                                 n_cards > 0 ? n_cards : 1,
+                                                 IDL_ARR_INI_ZERO, &cards);
+
+  n_cards = 0;
+  for (e = 0; e < index.n_entries; e++) {
+    kcor_index_entry *entry = &index.entries[e];
+
+    IDL_StrStore(&filenames_data[e], entry->name);
+    sizes_data[e] = entry->size;
+    mtimes_data[e] = entry->mtime;
+    checksums_data[e] = entry->checksum;
+    card_offsets_data[e] = n_cards;
+
+    for (c = 0; c < entry->n_cards; c++) {
+      snprintf(card, sizeof(card), "%-*s", KCOR_FITS_CARD_SIZE, entry->cards[c]);
+      IDL_StrStore(&cards_data[n_cards++], card);
+    }
+  }
+  card_offsets_data[n] = n_cards;
+
+  kcor_index_free(&index);
+
+  IDL_VarCopy(filenames, argv[1]);
+  IDL_VarCopy(sizes, argv[2]);
+  IDL_VarCopy(mtimes, argv[3]);
+  IDL_VarCopy(checksums, argv[4]);
+  IDL_VarCopy(cards, argv[5]);
+  IDL_VarCopy(card_offsets, argv[6]);
+
+  return IDL_GettmpLong(n);
+}
+
+
+/* watch kept between calls, so that files closed between calls are seen */
+static kcor_watch watch;
+static int watch_is_open = 0;
+
+
+static int watch_is_same(const char *dir, int n_suffixes,
+                              const char **suffixes) {
+  int s;
+
+  if (!watch_is_open || strcmp(watch.dir, dir) != 0
+        || watch.n_suffixes != n_suffixes) {
+    return 0;
+  }
+  for (s = 0; s < n_suffixes; s++) {
+    if (strcmp(watch.suffixes[s], suffixes[s]) != 0) return 0;
+  }
+  return 1;
+}
+
+
+/*
+ * Wait for complete files to arrive in a directory.
+ *
+ * files = KCOR_WAIT_FOR_FILES(dir, suffixes, timeout, count[, expected_size[, $
+ *                             settle[, polling]]])
+ *
+ * Returns the sorted paths of all complete files in DIR with names ending in
+ * one of SUFFIXES as soon as there are any, or '' with COUNT 0 if there are
+ * none after TIMEOUT seconds. A file is complete when it was closed after
+ * writing, or moved into DIR, since the directory was first watched, when its
+ * size is EXPECTED_SIZE (if positive), or when it has not been modified for
+ * SETTLE seconds (default 10). POLLING is set to 1 if the directory is polled
+ * because inotify cannot watch it, e.g., on NFS.
+ */
+static IDL_VPTR IDL_kcor_wait_for_files(int argc, IDL_VPTR *argv) {
+  IDL_VPTR suffixes = argv[1], files;
+  IDL_STRING *suffixes_data, *files_data;
+  const char **suffix_strs;
+  char *dir, **filenames;
+  char message[KCOR_MESSAGE_SIZE];
+  double timeout = IDL_DoubleScalar(argv[2]);
+  off_t expected_size = argc > 4 ? (off_t) IDL_Long64Scalar(argv[4]) : 0;
+  double settle = argc > 5 ? IDL_DoubleScalar(argv[5]) : 10.0;
+  kcor_watch_status status;
+  IDL_ALLTYPES value;
+  int n_suffixes, n_files, s, f;
+
+  IDL_ENSURE_STRING(argv[0]);
+  IDL_ENSURE_SCALAR(argv[0]);
+  IDL_ENSURE_STRING(suffixes);
+  IDL_EXCLUDE_EXPR(argv[3]);
+  if (argc > 6) {
+    IDL_EXCLUDE_EXPR(argv[6]);
+  }
+
+  dir = IDL_VarGetString(argv[0]);
+  if (suffixes->flags & IDL_V_ARR) {
+    suffixes_data = (IDL_STRING *) suffixes->value.arr->data;
+    n_suffixes = suffixes->value.arr->n_elts;
+  } else {
+    suffixes_data = &suffixes->value.str;
+    n_suffixes = 1;
+  }
+
+  suffix_strs = malloc(n_suffixes * sizeof(char *));
+  if (suffix_strs == NULL) {
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP,
+                "unable to allocate memory for suffixes");
+  }
+  for (s = 0; s < n_suffixes; s++) suffix_strs[s] = IDL_STRING_STR(&suffixes_data[s]);
+
+  if (!watch_is_same(dir, n_suffixes, suffix_strs)) {
+    if (watch_is_open) kcor_watch_close(&watch);
+    watch_is_open = 0;
+    status = kcor_watch_open(dir, n_suffixes, suffix_strs, &watch);
+    if (status != KCOR_WATCH_OK) {
+      free(suffix_strs);
+      snprintf(message, sizeof(message), "%s: %s",
+               kcor_watch_strerror(status), dir);
+      IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP, message);
+    }
+    watch_is_open = 1;
+  }
+  free(suffix_strs);
+
+  status = kcor_watch_wait(&watch, timeout, expected_size, settle,
+                           &n_files, &filenames);
+  if (status != KCOR_WATCH_OK) {
+    snprintf(message, sizeof(message), "%s: %s",
+             kcor_watch_strerror(status), dir);
+    IDL_Message(IDL_M_NAMED_GENERIC, IDL_MSG_LONGJMP, message);
+  }
+
+  value.l = n_files;
+  IDL_StoreScalar(argv[3], IDL_TYP_LONG, &value);
+  if (argc > 6) {
+    value.l = kcor_watch_is_polling(&watch);
+    IDL_StoreScalar(argv[6], IDL_TYP_LONG, &value);
+  }
+
+  if (n_files == 0) return IDL_StrToSTRING("");
+
+  files_data = (IDL_STRING *) IDL_MakeTempVector(IDL_TYP_STRING, n_files,
+                                                 IDL_ARR_INI_ZERO, &files);
+  for (f = 0; f < n_files; f++) IDL_StrStore(&files_data[f], filenames[f]);
+  kcor_watch_free_filenames(n_files, filenames);
+
+  return files;
+}
+
+
 int IDL_Load(void) {
   /*
    * These tables contain information on the functions and procedures
@@ -113,12 +928,21 @@ int IDL_Load(void) {
    */
   static IDL_SYSFUN_DEF2 function_addr[] = {
     { IDL_kcor_batched_matrix_vector_multiply, "KCOR_BATCHED_MATRIX_VECTOR_MULTIPLY", 5, 5, 0, 0 },
-
+    { IDL_kcor_read_camera_correction_cache, "KCOR_READ_CAMERA_CORRECTION_CACHE", 1, 6, 0, 0 },
+    { IDL_kcor_gzip_files, "KCOR_GZIP_FILES", 1, 3, 0, 0 },
+    { IDL_kcor_read_l0, "KCOR_READ_L0", 2, 4, 0, 0 },
+    { IDL_kcor_scan_headers, "KCOR_SCAN_HEADERS", 2, 5, 0, 0 },
+    { IDL_kcor_update_index, "KCOR_UPDATE_INDEX", 1, 8, 0, 0 },
+    { IDL_kcor_wait_for_files, "KCOR_WAIT_FOR_FILES", 4, 7, 0, 0 },
+  };
+  static IDL_SYSFUN_DEF2 procedure_addr[] = {
+    { (IDL_SYSRTN_GENERIC) IDL_kcor_write_camera_correction_cache, "KCOR_WRITE_CAMERA_CORRECTION_CACHE", 7, 7, 0, 0 },
   };
 
   /*
    * Register our routines. The routines must be specified exactly the same
    * as in kcor.
    */
-  return IDL_SysRtnAdd(function_addr, TRUE, IDL_CARRAY_ELTS(function_addr));
+  return IDL_SysRtnAdd(function_addr, TRUE, IDL_CARRAY_ELTS(function_addr))
+    && IDL_SysRtnAdd(procedure_addr, FALSE, IDL_CARRAY_ELTS(procedure_addr));
 }
@@ -51,8 +51,9 @@ pro kcor_correct_camera, im, header, $
   n_polstates = dims[2]
   n_cameras = dims[3]
 
-  ; read the fit paramaters
-  fp = fltarr(1024, 1024, 5, n_cameras)
+  ; read the fit paramaters; they are mapped from the camera correction cache,
+  ; so they are kept in pointers rather than copied into a single array
+  fp = ptrarr(n_cameras)
 
   exposure = sxpar(header, 'EXPTIME')
   if (~run->epoch('use_exptime')) then exposure = run->epoch('exptime')
@@ -108,18 +109,19 @@ pro kcor_correct_camera, im, header, $
     endelse
 
     rcam_cor_cache_filename = filepath(string(prefix, rcamid, exposure, $
-                                              rcam_lut, 'sav', $
+                                              rcam_lut, 'bin', $
                                               format=fmt), $
                                        subdir='.cache', $
                                        root=run->config('calibration/camera_correction_dir'))
 
-    fp[*, *, *, 0] = kcor_read_camera_correction(rcam_cor_filename, $
-                                                 rcam_cor_cache_filename, $
-                                                 bad_columns=rbad_columns, $
-                                                 n_bad_columns=n_rbad_columns, $
-                                                 bad_values=rbad_values, $
-                                                 n_bad_values=n_rbad_values, $
-                                                 interpolate=interpolate)
+    rcam_fp = kcor_read_camera_correction(rcam_cor_filename, $
+                                          rcam_cor_cache_filename, $
+                                          bad_columns=rbad_columns, $
+                                          n_bad_columns=n_rbad_columns, $
+                                          bad_values=rbad_values, $
+                                          n_bad_values=n_rbad_values, $
+                                          interpolate=interpolate)
+    fp[0] = ptr_new(rcam_fp, /no_copy)
     mg_log, 'RCAM fit: %d bad cols, %d bad values', n_rbad_columns, n_rbad_values, $
             name=logger_name, /debug
   endif
@@ -136,28 +138,34 @@ pro kcor_correct_camera, im, header, $
     endif else begin
       mg_log, '%s not found', tcam_cor_filename, name=logger_name, /error
       tcam_cor_filename = ''
+      ptr_free, fp
       return
     endelse
 
     tcam_cor_cache_filename = filepath(string(prefix, tcamid, exposure, $
-                                              tcam_lut, 'sav', $
+                                              tcam_lut, 'bin', $
                                               format=fmt), $
                                        subdir='.cache', $
                                        root=run->config('calibration/camera_correction_dir'))
 
-    fp[*, *, *, 1] = kcor_read_camera_correction(tcam_cor_filename, $
-                                                 tcam_cor_cache_filename, $
-                                                 bad_columns=tbad_columns, $
-                                                 n_bad_columns=n_tbad_columns, $
-                                                 bad_values=tbad_values, $
-                                                 n_bad_values=n_tbad_values, $
-                                                 interpolate=interpolate)
+    tcam_fp = kcor_read_camera_correction(tcam_cor_filename, $
+                                          tcam_cor_cache_filename, $
+                                          bad_columns=tbad_columns, $
+                                          n_bad_columns=n_tbad_columns, $
+                                          bad_values=tbad_values, $
+                                          n_bad_values=n_tbad_values, $
+                                          interpolate=interpolate)
+    fp[1] = ptr_new(tcam_fp, /no_copy)
     mg_log, 'TCAM fit: %d bad cols, %d bad values', n_tbad_columns, n_tbad_values, $
             name=logger_name, /debug
   endif
 
 
-  if (n_elements(xoffset) gt 0L) then fp = shift(fp, xoffset, 0, 0, 0)
+  if (n_elements(xoffset) gt 0L) then begin
+    for c = 0L, n_cameras - 1L do begin
+      if (ptr_valid(fp[c])) then *fp[c] = shift(*fp[c], xoffset, 0, 0)
+    endfor
+  endif
 
   ; scale the data to 0..1
   bitpix = sxpar(header, 'BITPIX')
@@ -170,19 +178,22 @@ pro kcor_correct_camera, im, header, $
   for p = 0L, n_polstates - 1L do begin
     for c = 0L, n_cameras_to_correct - 1L do begin
       camera = camera_indices[c]
+      camera_fp = fp[camera]
       x = shift(im[*, *, p, camera], xshift[camera], 0)
       ;x = im[*, *, p, camera]
-      im[*, *, p, camera] = fp[*, *, 0, camera] $
-                              + fp[*, *, 1, camera] * x $
-                              + fp[*, *, 2, camera] * x^2 $
-                              + fp[*, *, 3, camera] * x^3 $
-                              + fp[*, *, 4, camera] * x^4
+      im[*, *, p, camera] = (*camera_fp)[*, *, 0] $
+                              + (*camera_fp)[*, *, 1] * x $
+                              + (*camera_fp)[*, *, 2] * x^2 $
+                              + (*camera_fp)[*, *, 3] * x^3 $
+                              + (*camera_fp)[*, *, 4] * x^4
       im[*, *, p, camera] = shift(im[*, *, p, camera], - xshift[camera], 0)
     endfor
   endfor
 
   ; return to original scale
   im *= scale
+
+  ptr_free, fp
 end
 
 
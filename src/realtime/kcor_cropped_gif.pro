@@ -23,11 +23,16 @@
 ;     `AVERAGE` to indicate the `extavg` image
 ;   output : out, optional, type=string
 ;     set to a named variable to retrieve the filename of the GIF written
+;   scaled_image : in, optional, type="bytarr(1024, 1024)"
+;     `im` as already scaled for the full-size pB GIF by `KCOR_CREATE_GIF`;
+;     it is cropped instead of scaling `im` again if the cropped display
+;     parameters are the same as the full-size ones
 ;-
 pro kcor_cropped_gif, im, date, date_obs, $
                       nomask=nomask, $
                       daily=daily, average=average, $
                       output_filename=cgif_filename, $
+                      scaled_image=scaled_image, $
                       run=run, log_name=log_name, $
                       level=level, $
                       enhanced=enhanced
@@ -37,7 +42,18 @@ pro kcor_cropped_gif, im, date, date_obs, $
   end_index   = 1024L - start_index - 1L
   width       = end_index - start_index + 1L
   height      = end_index - start_index + 1L
-  crop_image  = im[start_index:end_index, start_index:end_index]
+
+  min = run->epoch('cropped_display_min')
+  max = run->epoch('cropped_display_max')
+  exp = run->epoch('cropped_display_exp')
+
+  use_scaled_image = n_elements(scaled_image) gt 0L $
+                       && min eq run->epoch('display_min') $
+                       && max eq run->epoch('display_max') $
+                       && exp eq run->epoch('display_exp')
+  if (~use_scaled_image) then begin
+    crop_image = im[start_index:end_index, start_index:end_index]
+  endif
 
   original_device = !d.name
   set_plot, 'Z'
@@ -56,15 +72,15 @@ pro kcor_cropped_gif, im, date, date_obs, $
   loadct, 0, /silent
   gamma_ct, 1.0, /current   ; reset gamma to linear ramp
 
-  min = run->epoch('cropped_display_min')
-  max = run->epoch('cropped_display_max')
-  exp = run->epoch('cropped_display_exp')
-
   ; display image
-  display_factor = 1.0e6
-  tv, bytscl((display_factor * crop_image)^exp, $
-             min=display_factor * min, $
-             max=display_factor * max)
+  if (use_scaled_image) then begin
+    tv, scaled_image[start_index:end_index, start_index:end_index]
+  endif else begin
+    display_factor = 1.0e6
+    tv, bytscl((display_factor * crop_image)^exp, $
+               min=display_factor * min, $
+               max=display_factor * max)
+  endelse
 
   ; print annotations
 
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "kcor_fits.h"
+
+/*
+ * Reading of our L0 FITS files without going through readfits. The files are
+ * read through zlib's gz interface, which decompresses gzipped files as they
+ * are read and reads plain files as is, so the data is decompressed, byte
+ * swapped, unsigned and shifted into its destination in a single pass.
+ */
+#define KCOR_FITS_BUFFER_SIZE (256 * 1024)
+/* small enough that reading a header does not inflate much of the data */
+#define KCOR_FITS_HEADER_BUFFER_SIZE (8 * 1024)
+#define KCOR_FITS_MAX_HEADER_BLOCKS 1000
+#define KCOR_FITS_CARDS_PER_BLOCK (KCOR_FITS_BLOCK_SIZE / KCOR_FITS_CARD_SIZE)
+
+
+static int kcor_fits_is_keyword(const char *card, const char *keyword) {
+  size_t length = strlen(keyword);
+  size_t i;
+
+  if (length > 8 || strncmp(card, keyword, length) != 0) return 0;
+  for (i = length; i < 8; i++) {
+    if (card[i] != ' ') return 0;
+  }
+  return 1;
+}
+
+
+/* copy the value part of a card into a NUL-terminated buffer */
+static int kcor_fits_value(const char *card, char *value) {
+  if (card == NULL || card[8] != '=' || card[9] != ' ') return 0;
+  memcpy(value, card + 10, KCOR_FITS_CARD_SIZE - 10);
+  value[KCOR_FITS_CARD_SIZE - 10] = '\0';
+  return 1;
+}
+
+
+const char *kcor_fits_find(const kcor_fits_file *file, const char *keyword) {
+  int c;
+
+  for (c = 0; c < file->n_cards; c++) {
+    const char *card = file->cards + c * KCOR_FITS_CARD_SIZE;
+    if (kcor_fits_is_keyword(card, keyword)) return card;
+  }
+  return NULL;
+}
+
+
+int kcor_fits_get_long(const kcor_fits_file *file, const char *keyword, long *value) {
+  char buffer[KCOR_FITS_CARD_SIZE];
+  char *end;
+
+  if (!kcor_fits_value(kcor_fits_find(file, keyword), buffer)) return 0;
+  *value = strtol(buffer, &end, 10);
+  return end != buffer;
+}
+
+
+int kcor_fits_get_double(const kcor_fits_file *file, const char *keyword, double *value) {
+  char buffer[KCOR_FITS_CARD_SIZE];
+  char *end;
+
+  if (!kcor_fits_value(kcor_fits_find(file, keyword), buffer)) return 0;
+  *value = strtod(buffer, &end);
+  return end != buffer;
+}
+
+
+static kcor_fits_status kcor_fits_open_buffered(const char *filename,
+                                                kcor_fits_file *file,
+                                                unsigned buffer_size) {
+  gzFile gz;
+  char *cards;
+  int b, c, done = 0;
+  long value;
+
+  memset(file, 0, sizeof(kcor_fits_file));
+
+  gz = gzopen(filename, "rb");
+  if (gz == NULL) return KCOR_FITS_OPEN;
+  gzbuffer(gz, buffer_size);
+  file->gz = gz;
+
+  for (b = 0; b < KCOR_FITS_MAX_HEADER_BLOCKS && !done; b++) {
+    cards = realloc(file->cards, (b + 1) * KCOR_FITS_BLOCK_SIZE);
+    if (cards == NULL) {
+      kcor_fits_close(file);
+      return KCOR_FITS_MEMORY;
+    }
+    file->cards = cards;
+
+    cards += b * KCOR_FITS_BLOCK_SIZE;
+    if (gzread(gz, cards, KCOR_FITS_BLOCK_SIZE) != KCOR_FITS_BLOCK_SIZE) break;
+
+    for (c = 0; c < KCOR_FITS_CARDS_PER_BLOCK; c++) {
+      file->n_cards++;
+      if (kcor_fits_is_keyword(cards + c * KCOR_FITS_CARD_SIZE, "END")) {
+        done = 1;
+        break;
+      }
+    }
+  }
+
+  if (!done
+        || !kcor_fits_is_keyword(file->cards, "SIMPLE")
+        || file->cards[29] != 'T'
+        || !kcor_fits_get_long(file, "BITPIX", &value)) {
+    kcor_fits_close(file);
+    return KCOR_FITS_HEADER;
+  }
+  file->bitpix = value;
+
+  if (!kcor_fits_get_long(file, "NAXIS", &value) || value < 0) {
+    kcor_fits_close(file);
+    return KCOR_FITS_HEADER;
+  }
+  file->naxis = value;
+
+  for (c = 0; c < file->naxis && c < KCOR_FITS_MAX_AXES; c++) {
+    char keyword[9];
+    sprintf(keyword, "NAXIS%d", c + 1);
+    if (!kcor_fits_get_long(file, keyword, &file->naxes[c])) {
+      kcor_fits_close(file);
+      return KCOR_FITS_HEADER;
+    }
+  }
+
+  return KCOR_FITS_OK;
+}
+
+
+kcor_fits_status kcor_fits_open(const char *filename, kcor_fits_file *file) {
+  return kcor_fits_open_buffered(filename, file, KCOR_FITS_BUFFER_SIZE);
+}
+
+
+kcor_fits_status kcor_fits_read_header(const char *filename, kcor_fits_file *file) {
+  kcor_fits_status status;
+
+  status = kcor_fits_open_buffered(filename, file, KCOR_FITS_HEADER_BUFFER_SIZE);
+  if (status == KCOR_FITS_OK) {
+    gzclose((gzFile) file->gz);
+    file->gz = NULL;
+  }
+  return status;
+}
+
+
+void kcor_fits_close(kcor_fits_file *file) {
+  if (file->gz != NULL) gzclose((gzFile) file->gz);
+  free(file->cards);
+  memset(file, 0, sizeof(kcor_fits_file));
+}
+
+
+static void kcor_fits_trim(char *s) {
+  size_t start = strspn(s, " ");
+  size_t length = strlen(s + start);
+
+  memmove(s, s + start, length + 1);
+  while (length > 0 && s[length - 1] == ' ') s[--length] = '\0';
+}
+
+
+kcor_fits_kind kcor_fits_get_value(const kcor_fits_file *file,
+                                   const char *keyword, char *value) {
+  const char *card = kcor_fits_find(file, keyword);
+  char buffer[KCOR_FITS_CARD_SIZE];
+  char *slash;
+  size_t i, n = 0;
+
+  value[0] = '\0';
+  if (card == NULL || card[8] != '=') return KCOR_FITS_MISSING;
+
+  memcpy(buffer, card + 9, KCOR_FITS_CARD_SIZE - 9);
+  buffer[KCOR_FITS_CARD_SIZE - 9] = '\0';
+  kcor_fits_trim(buffer);
+
+  /* strings keep their trailing blanks, like sxpar returns them */
+  if (buffer[0] == '\'') {
+    for (i = 1; buffer[i] != '\0'; i++) {
+      if (buffer[i] == '\'') {
+        if (buffer[i + 1] != '\'') break;
+        i++;
+      }
+      value[n++] = buffer[i];
+    }
+    value[n] = '\0';
+    return KCOR_FITS_STRING;
+  }
+
+  slash = strchr(buffer, '/');
+  if (slash != NULL) *slash = '\0';
+  kcor_fits_trim(buffer);
+  buffer[strcspn(buffer, " ")] = '\0';
+  strcpy(value, buffer);
+
+  if (strcmp(value, "T") == 0 || strcmp(value, "F") == 0) return KCOR_FITS_LOGICAL;
+  if (strchr(value, '.') != NULL || strchr(value, 'D') != NULL
+        || (value[0] != '\0' && strchr(value + 1, 'E') != NULL)) {
+    return KCOR_FITS_REAL;
+  }
+  if (value[0] == '\0') strcpy(value, "0");
+  return KCOR_FITS_INTEGER;
+}
+
+
+typedef struct {
+  int n_files;
+  const char **filenames;
+  int n_keywords;
+  const char **keywords;
+  char *values;
+  kcor_fits_kind *kinds;
+  kcor_fits_status *statuses;
+  int n_threads;
+  int thread;
+} kcor_fits_scan;
+
+
+static void *kcor_fits_scan_work(void *arg) {
+  kcor_fits_scan *scan = (kcor_fits_scan *) arg;
+  kcor_fits_file file;
+  int f, k;
+
+  for (f = scan->thread; f < scan->n_files; f += scan->n_threads) {
+    scan->statuses[f] = kcor_fits_read_header(scan->filenames[f], &file);
+    for (k = 0; k < scan->n_keywords; k++) {
+      size_t i = (size_t) f * scan->n_keywords + k;
+      if (scan->statuses[f] == KCOR_FITS_OK) {
+        scan->kinds[i] = kcor_fits_get_value(&file, scan->keywords[k],
+                                             scan->values + i * KCOR_FITS_CARD_SIZE);
+      } else {
+        scan->kinds[i] = KCOR_FITS_MISSING;
+        scan->values[i * KCOR_FITS_CARD_SIZE] = '\0';
+      }
+    }
+    kcor_fits_close(&file);
+  }
+
+  return NULL;
+}
+
+
+void kcor_fits_scan_headers(int n_files, const char **filenames,
+                            int n_keywords, const char **keywords,
+                            char *values, kcor_fits_kind *kinds,
+                            kcor_fits_status *statuses, int n_threads) {
+  kcor_fits_scan *scans;
+  pthread_t *threads;
+  int t, n_started;
+
+  if (n_threads <= 0) n_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (n_threads > n_files) n_threads = n_files;
+  if (n_threads <= 0) n_threads = 1;
+
+  scans = malloc(n_threads * sizeof(kcor_fits_scan));
+  threads = malloc(n_threads * sizeof(pthread_t));
+  if (scans == NULL || threads == NULL) {
+    /* scan in this thread only */
+    kcor_fits_scan scan = { n_files, filenames, n_keywords, keywords,
+                            values, kinds, statuses, 1, 0 };
+    free(scans);
+    free(threads);
+    kcor_fits_scan_work(&scan);
+    return;
+  }
+
+  for (t = 0; t < n_threads; t++) {
+    kcor_fits_scan scan = { n_files, filenames, n_keywords, keywords,
+                            values, kinds, statuses, n_threads, t };
+    scans[t] = scan;
+  }
+
+  /* the calling thread scans too, and for any thread that fails to start */
+  for (n_started = 1; n_started < n_threads; n_started++) {
+    if (pthread_create(&threads[n_started], NULL, kcor_fits_scan_work,
+                       &scans[n_started]) != 0) break;
+  }
+  kcor_fits_scan_work(&scans[0]);
+  for (t = n_started; t < n_threads; t++) kcor_fits_scan_work(&scans[t]);
+  for (t = 1; t < n_started; t++) pthread_join(threads[t], NULL);
+
+  free(scans);
+  free(threads);
+}
+
+
+kcor_fits_status kcor_fits_check_l0(kcor_fits_file *file) {
+  double bscale, bzero;
+
+  if (file->naxis != 4 || file->naxes[3] != 2) return KCOR_FITS_UNSUPPORTED;
+  if (file->bitpix != 16 && file->bitpix != 32) return KCOR_FITS_UNSUPPORTED;
+
+  if (kcor_fits_get_double(file, "BSCALE", &bscale) && bscale != 1.0) {
+    return KCOR_FITS_UNSUPPORTED;
+  }
+
+  file->is_unsigned = 0;
+  if (kcor_fits_get_double(file, "BZERO", &bzero) && bzero != 0.0) {
+    if (bzero != (file->bitpix == 16 ? 32768.0 : 2147483648.0)) {
+      return KCOR_FITS_UNSUPPORTED;
+    }
+    /* readfits would rewrite BLANK for unsigned data */
+    if (kcor_fits_find(file, "BLANK") != NULL) return KCOR_FITS_UNSUPPORTED;
+    file->is_unsigned = 1;
+  }
+
+  return KCOR_FITS_OK;
+}
+
+
+static long kcor_fits_mod(long a, long n) {
+  return ((a % n) + n) % n;
+}
+
+
+/*
+ * Copy a row of big-endian values, flipping the sign bit for unsigned data,
+ * to dest shifted right by shift columns, wrapping around like SHIFT.
+ */
+static void kcor_fits_copy_row16(const unsigned char *src, uint16_t *dest,
+                                 long n, long shift, uint16_t flip) {
+  long x;
+
+  for (x = 0; x < n - shift; x++, src += 2) {
+    dest[x + shift] = (uint16_t) ((src[0] << 8) | src[1]) ^ flip;
+  }
+  for (; x < n; x++, src += 2) {
+    dest[x + shift - n] = (uint16_t) ((src[0] << 8) | src[1]) ^ flip;
+  }
+}
+
+
+static void kcor_fits_copy_row32(const unsigned char *src, uint32_t *dest,
+                                 long n, long shift, uint32_t flip) {
+  long x;
+
+  for (x = 0; x < n - shift; x++, src += 4) {
+    dest[x + shift] = ((uint32_t) src[0] << 24 | (uint32_t) src[1] << 16
+                         | (uint32_t) src[2] << 8 | src[3]) ^ flip;
+  }
+  for (; x < n; x++, src += 4) {
+    dest[x + shift - n] = ((uint32_t) src[0] << 24 | (uint32_t) src[1] << 16
+                             | (uint32_t) src[2] << 8 | src[3]) ^ flip;
+  }
+}
+
+
+kcor_fits_status kcor_fits_read_l0(kcor_fits_file *file, void *data,
+                                   const long xshift[2],
+                                   const long start_state[2]) {
+  long n1 = file->naxes[0], n2 = file->naxes[1], n3 = file->naxes[2];
+  size_t element_size = file->bitpix / 8;
+  size_t frame_size = n1 * n2 * element_size;
+  unsigned char *frame;
+  long c, k, y, shift;
+  kcor_fits_status status = KCOR_FITS_OK;
+
+  frame = malloc(frame_size);
+  if (frame == NULL) return KCOR_FITS_MEMORY;
+
+  /* data is in FITS order, so each frame is a [*, *, state, camera] image */
+  for (c = 0; c < 2 && status == KCOR_FITS_OK; c++) {
+    shift = kcor_fits_mod(xshift[c], n1);
+    for (k = 0; k < n3; k++) {
+      long dest_k = kcor_fits_mod(k + start_state[c], n3);
+      unsigned char *dest = (unsigned char *) data
+                              + (dest_k + n3 * c) * frame_size;
+
+      if (gzread((gzFile) file->gz, frame, frame_size) != (int) frame_size) {
+        status = KCOR_FITS_TRUNCATED;
+        break;
+      }
+
+      for (y = 0; y < n2; y++) {
+        if (element_size == 2) {
+          kcor_fits_copy_row16(frame + y * n1 * 2,
+                               (uint16_t *) dest + y * n1,
+                               n1, shift, file->is_unsigned ? 0x8000 : 0);
+        } else {
+          kcor_fits_copy_row32(frame + y * n1 * 4,
+                               (uint32_t *) dest + y * n1,
+                               n1, shift, file->is_unsigned ? 0x80000000 : 0);
+        }
+      }
+    }
+  }
+
+  free(frame);
+  return status;
+}
+
+
+const char *kcor_fits_strerror(kcor_fits_status status) {
+  switch (status) {
+    case KCOR_FITS_OK: return "success";
+    case KCOR_FITS_OPEN: return "unable to open file";
+    case KCOR_FITS_MEMORY: return "out of memory";
+    case KCOR_FITS_HEADER: return "invalid FITS header";
+    case KCOR_FITS_UNSUPPORTED: return "not a supported L0 file";
+    case KCOR_FITS_TRUNCATED: return "truncated FITS data";
+  }
+  return "unknown error";
+}
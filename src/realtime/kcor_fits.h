@@ -0,0 +1,92 @@
+#ifndef KCOR_FITS_H
+#define KCOR_FITS_H
+
+#define KCOR_FITS_BLOCK_SIZE 2880
+#define KCOR_FITS_CARD_SIZE 80
+#define KCOR_FITS_MAX_AXES 4
+
+/*
+ * Error codes returned by the FITS routines.
+ */
+typedef enum {
+  KCOR_FITS_OK = 0,
+  KCOR_FITS_OPEN,         /* could not open the file */
+  KCOR_FITS_MEMORY,       /* out of memory */
+  KCOR_FITS_HEADER,       /* invalid or truncated primary header */
+  KCOR_FITS_UNSUPPORTED,  /* not in the L0 layout read natively */
+  KCOR_FITS_TRUNCATED     /* data shorter than given by the header */
+} kcor_fits_status;
+
+/*
+ * A FITS file, plain or gzipped, positioned after its primary header.
+ */
+typedef struct {
+  void *gz;
+  char *cards;            /* n_cards cards of 80 characters, through END */
+  int n_cards;
+  int bitpix;
+  int naxis;
+  long naxes[KCOR_FITS_MAX_AXES];
+  int is_unsigned;        /* BZERO makes the data unsigned */
+} kcor_fits_file;
+
+kcor_fits_status kcor_fits_open(const char *filename, kcor_fits_file *file);
+void kcor_fits_close(kcor_fits_file *file);
+
+/*
+ * Read only the primary header of a file, decompressing as little of it as
+ * possible; the file is closed afterward, but the cards can still be queried.
+ */
+kcor_fits_status kcor_fits_read_header(const char *filename, kcor_fits_file *file);
+
+/* card with the given keyword, or NULL if not present */
+const char *kcor_fits_find(const kcor_fits_file *file, const char *keyword);
+int kcor_fits_get_long(const kcor_fits_file *file, const char *keyword, long *value);
+int kcor_fits_get_double(const kcor_fits_file *file, const char *keyword, double *value);
+
+/*
+ * Kinds of keyword values, as sxpar would return them.
+ */
+typedef enum {
+  KCOR_FITS_MISSING = 0,
+  KCOR_FITS_STRING,
+  KCOR_FITS_LOGICAL,
+  KCOR_FITS_INTEGER,
+  KCOR_FITS_REAL
+} kcor_fits_kind;
+
+/*
+ * Copy the value of keyword as text into value, which must hold at least
+ * KCOR_FITS_CARD_SIZE characters: string values are unquoted like sxpar
+ * does, other values have their comment and blanks removed.
+ */
+kcor_fits_kind kcor_fits_get_value(const kcor_fits_file *file,
+                                   const char *keyword, char *value);
+
+/*
+ * Read the given keywords from the headers of n_files files, using n_threads
+ * threads. values holds KCOR_FITS_CARD_SIZE characters for each keyword of
+ * each file, keyword varying fastest, like kinds; statuses is by file.
+ */
+void kcor_fits_scan_headers(int n_files, const char **filenames,
+                            int n_keywords, const char **keywords,
+                            char *values, kcor_fits_kind *kinds,
+                            kcor_fits_status *statuses, int n_threads);
+
+/*
+ * Check that the file is an L0 file: 4-dimensional, 2 cameras, 16 or 32 bit
+ * integers with no scaling other than a BZERO giving unsigned data.
+ */
+kcor_fits_status kcor_fits_check_l0(kcor_fits_file *file);
+
+/*
+ * Read the data of an L0 file into data, in the byte order of the machine and
+ * already shifted by xshift columns and start_state states for each camera.
+ */
+kcor_fits_status kcor_fits_read_l0(kcor_fits_file *file, void *data,
+                                   const long xshift[2],
+                                   const long start_state[2]);
+
+const char *kcor_fits_strerror(kcor_fits_status status);
+
+#endif
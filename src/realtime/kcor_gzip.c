@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "kcor_gzip.h"
+#include "kcor_stat.h"
+
+/*
+ * Files are compressed in independent blocks, like pigz does. Each block is
+ * deflated on its own with the last 32 KB of the previous block as its
+ * dictionary, so the compression ratio is close to gzip's, and ends on a byte
+ * boundary with a sync flush, so the blocks concatenated form a single valid
+ * deflate stream. The CRC of the file is combined from the CRCs of the blocks.
+ */
+#define KCOR_GZIP_BLOCK_SIZE (128 * 1024)
+#define KCOR_GZIP_DICT_SIZE (32 * 1024)
+#define KCOR_GZIP_BUFFER_SIZE (256 * 1024)
+
+typedef struct {
+  unsigned char *out;
+  size_t out_length;
+  uLong crc;
+  int status;
+} kcor_gzip_block;
+
+typedef struct {
+  const unsigned char *data;
+  size_t size;
+  size_t n_blocks;
+  int level;
+  int n_threads;
+  kcor_gzip_block *blocks;
+} kcor_gzip_job;
+
+typedef struct {
+  kcor_gzip_job *job;
+  int thread;
+} kcor_gzip_worker;
+
+
+static int kcor_gzip_deflate_block(kcor_gzip_job *job, size_t b) {
+  kcor_gzip_block *block = &job->blocks[b];
+  size_t offset = b * KCOR_GZIP_BLOCK_SIZE;
+  size_t length = job->size - offset;
+  int last = b == job->n_blocks - 1;
+  z_stream strm;
+  size_t bound;
+  int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+  int ret;
+
+  if (length > KCOR_GZIP_BLOCK_SIZE) length = KCOR_GZIP_BLOCK_SIZE;
+
+  block->crc = crc32(0L, Z_NULL, 0);
+  if (length > 0) block->crc = crc32(block->crc, job->data + offset, length);
+
+  memset(&strm, 0, sizeof(strm));
+  if (deflateInit2(&strm, job->level, Z_DEFLATED, -15, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return KCOR_GZIP_DEFLATE;
+  }
+
+  if (b > 0) {
+    size_t dict_length = offset < KCOR_GZIP_DICT_SIZE ? offset : KCOR_GZIP_DICT_SIZE;
+    if (deflateSetDictionary(&strm, job->data + offset - dict_length,
+                             dict_length) != Z_OK) {
+      deflateEnd(&strm);
+      return KCOR_GZIP_DEFLATE;
+    }
+  }
+
+  /* room for the empty stored block of the sync flush too */
+  bound = deflateBound(&strm, length) + 16;
+  block->out = malloc(bound);
+  if (block->out == NULL) {
+    deflateEnd(&strm);
+    return KCOR_GZIP_MEMORY;
+  }
+
+  strm.next_in = (Bytef *) (job->data + offset);
+  strm.avail_in = length;
+  strm.next_out = block->out;
+  strm.avail_out = bound;
+
+  ret = deflate(&strm, flush);
+  block->out_length = bound - strm.avail_out;
+  deflateEnd(&strm);
+
+  if (last ? ret != Z_STREAM_END
+           : (ret != Z_OK || strm.avail_in != 0 || strm.avail_out == 0)) {
+    return KCOR_GZIP_DEFLATE;
+  }
+
+  return KCOR_GZIP_OK;
+}
+
+
+static void *kcor_gzip_work(void *arg) {
+  kcor_gzip_worker *worker = (kcor_gzip_worker *) arg;
+  kcor_gzip_job *job = worker->job;
+  size_t b;
+
+  for (b = worker->thread; b < job->n_blocks; b += job->n_threads) {
+    job->blocks[b].status = kcor_gzip_deflate_block(job, b);
+  }
+
+  return NULL;
+}
+
+
+static int kcor_gzip_deflate_blocks(kcor_gzip_job *job) {
+  pthread_t *threads;
+  kcor_gzip_worker *workers;
+  int t, n_started;
+  size_t b;
+
+  if (job->n_threads == 1) {
+    kcor_gzip_worker worker = { job, 0 };
+    kcor_gzip_work(&worker);
+  } else {
+    threads = malloc(job->n_threads * sizeof(pthread_t));
+    workers = malloc(job->n_threads * sizeof(kcor_gzip_worker));
+    if (threads == NULL || workers == NULL) {
+      free(threads);
+      free(workers);
+      return KCOR_GZIP_MEMORY;
+    }
+
+    /* the main thread is worker 0, any workers that fail to start are too */
+    for (t = 0; t < job->n_threads; t++) {
+      workers[t].job = job;
+      workers[t].thread = t;
+    }
+    for (n_started = 1; n_started < job->n_threads; n_started++) {
+      if (pthread_create(&threads[n_started], NULL, kcor_gzip_work,
+                         &workers[n_started]) != 0) break;
+    }
+    kcor_gzip_work(&workers[0]);
+    for (t = n_started; t < job->n_threads; t++) kcor_gzip_work(&workers[t]);
+    for (t = 1; t < n_started; t++) pthread_join(threads[t], NULL);
+
+    free(threads);
+    free(workers);
+  }
+
+  for (b = 0; b < job->n_blocks; b++) {
+    if (job->blocks[b].status != KCOR_GZIP_OK) return job->blocks[b].status;
+  }
+
+  return KCOR_GZIP_OK;
+}
+
+
+static void kcor_gzip_put_uint32(FILE *f, uLong value) {
+  fputc(value & 0xff, f);
+  fputc((value >> 8) & 0xff, f);
+  fputc((value >> 16) & 0xff, f);
+  fputc((value >> 24) & 0xff, f);
+}
+
+
+/*
+ * Write a gzip member with the original name and modification time in its
+ * header, as gzip does by default.
+ */
+static int kcor_gzip_write(const char *filename, const char *name,
+                           time_t mtime, kcor_gzip_job *job, uLong crc,
+                           off_t *compressed_size) {
+  FILE *f = fopen(filename, "wb");
+  size_t b;
+  int xfl = job->level == 9 ? 2 : (job->level == 1 ? 4 : 0);
+  int status = KCOR_GZIP_OK;
+
+  if (f == NULL) return KCOR_GZIP_WRITE;
+
+  fputc(0x1f, f);
+  fputc(0x8b, f);
+  fputc(8, f);        /* deflate */
+  fputc(0x08, f);     /* FNAME */
+  kcor_gzip_put_uint32(f, (uLong) mtime);
+  fputc(xfl, f);
+  fputc(3, f);        /* Unix */
+  fwrite(name, 1, strlen(name) + 1, f);
+
+  for (b = 0; b < job->n_blocks; b++) {
+    if (fwrite(job->blocks[b].out, 1, job->blocks[b].out_length, f)
+          != job->blocks[b].out_length) {
+      status = KCOR_GZIP_WRITE;
+      break;
+    }
+  }
+
+  kcor_gzip_put_uint32(f, crc);
+  kcor_gzip_put_uint32(f, (uLong) (job->size & 0xffffffff));
+
+  if (status == KCOR_GZIP_OK) *compressed_size = ftello(f);
+  if (ferror(f)) status = KCOR_GZIP_WRITE;
+  if (fclose(f) != 0) status = KCOR_GZIP_WRITE;
+
+  return status;
+}
+
+
+/*
+ * Decompress the written file and check it against the CRC and size of the
+ * original; zlib checks the trailer of the file itself.
+ */
+static int kcor_gzip_verify(const char *filename, uLong crc, size_t size) {
+  gzFile gz = gzopen(filename, "rb");
+  unsigned char *buffer;
+  uLong verify_crc = crc32(0L, Z_NULL, 0);
+  size_t total = 0;
+  int n, status = KCOR_GZIP_OK;
+
+  if (gz == NULL) return KCOR_GZIP_VERIFY;
+
+  buffer = malloc(KCOR_GZIP_BUFFER_SIZE);
+  if (buffer == NULL) {
+    gzclose(gz);
+    return KCOR_GZIP_MEMORY;
+  }
+
+  gzbuffer(gz, KCOR_GZIP_BUFFER_SIZE);
+  while ((n = gzread(gz, buffer, KCOR_GZIP_BUFFER_SIZE)) > 0) {
+    verify_crc = crc32(verify_crc, buffer, n);
+    total += n;
+  }
+  if (n < 0) status = KCOR_GZIP_VERIFY;
+
+  free(buffer);
+  if (gzclose(gz) != Z_OK) status = KCOR_GZIP_VERIFY;
+
+  if (verify_crc != crc || total != size) status = KCOR_GZIP_VERIFY;
+
+  return status;
+}
+
+
+kcor_gzip_status kcor_gzip_file(const char *filename, int level, int n_threads,
+                                off_t *compressed_size) {
+  kcor_gzip_job job;
+  struct stat st;
+  struct timespec times[2];
+  const char *name;
+  char *gz_filename = NULL, *tmp_filename = NULL;
+  void *data = MAP_FAILED;
+  uLong crc;
+  size_t b;
+  int fd, status = KCOR_GZIP_OK;
+
+  *compressed_size = -1;
+  memset(&job, 0, sizeof(job));
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) return KCOR_GZIP_OPEN;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return KCOR_GZIP_OPEN;
+  }
+
+  gz_filename = malloc(strlen(filename) + 4);
+  tmp_filename = malloc(strlen(filename) + 32);
+  if (gz_filename == NULL || tmp_filename == NULL) {
+    status = KCOR_GZIP_MEMORY;
+    goto done;
+  }
+  sprintf(gz_filename, "%s.gz", filename);
+  sprintf(tmp_filename, "%s.gz.%d.tmp", filename, (int) getpid());
+
+  if (access(gz_filename, F_OK) == 0) {
+    status = KCOR_GZIP_EXISTS;
+    goto done;
+  }
+
+  job.size = st.st_size;
+  if (job.size > 0) {
+    data = mmap(NULL, job.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      status = KCOR_GZIP_READ;
+      goto done;
+    }
+    madvise(data, job.size, MADV_SEQUENTIAL);
+    job.data = (const unsigned char *) data;
+  }
+
+  /* an empty file is still a single, empty, final block */
+  job.n_blocks = job.size == 0 ? 1
+                   : (job.size + KCOR_GZIP_BLOCK_SIZE - 1) / KCOR_GZIP_BLOCK_SIZE;
+  job.level = level;
+
+  if (n_threads <= 0) n_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (n_threads <= 0) n_threads = 1;
+  if ((size_t) n_threads > job.n_blocks) n_threads = (int) job.n_blocks;
+  job.n_threads = n_threads;
+
+  job.blocks = calloc(job.n_blocks, sizeof(kcor_gzip_block));
+  if (job.blocks == NULL) {
+    status = KCOR_GZIP_MEMORY;
+    goto done;
+  }
+
+  status = kcor_gzip_deflate_blocks(&job);
+  if (status != KCOR_GZIP_OK) goto done;
+
+  crc = job.blocks[0].crc;
+  for (b = 1; b < job.n_blocks; b++) {
+    size_t length = b == job.n_blocks - 1
+                      ? job.size - b * KCOR_GZIP_BLOCK_SIZE
+                      : KCOR_GZIP_BLOCK_SIZE;
+    crc = crc32_combine(crc, job.blocks[b].crc, length);
+  }
+
+  name = strrchr(filename, '/');
+  name = name == NULL ? filename : name + 1;
+
+  status = kcor_gzip_write(tmp_filename, name, st.st_mtime, &job, crc,
+                           compressed_size);
+  if (status == KCOR_GZIP_OK) {
+    status = kcor_gzip_verify(tmp_filename, crc, job.size);
+  }
+  if (status != KCOR_GZIP_OK) {
+    unlink(tmp_filename);
+    *compressed_size = -1;
+    goto done;
+  }
+
+  /* keep the mode and times of the original, like gzip */
+  chmod(tmp_filename, st.st_mode & 07777);
+  times[0] = KCOR_STAT_ATIME(&st);
+  times[1] = KCOR_STAT_MTIME(&st);
+  utimensat(AT_FDCWD, tmp_filename, times, 0);
+
+  if (rename(tmp_filename, gz_filename) != 0) {
+    unlink(tmp_filename);
+    *compressed_size = -1;
+    status = KCOR_GZIP_WRITE;
+    goto done;
+  }
+
+  unlink(filename);
+
+ done:
+  if (job.blocks != NULL) {
+    for (b = 0; b < job.n_blocks; b++) free(job.blocks[b].out);
+    free(job.blocks);
+  }
+  if (data != MAP_FAILED) munmap(data, job.size);
+  close(fd);
+  free(gz_filename);
+  free(tmp_filename);
+
+  return status;
+}
+
+
+const char *kcor_gzip_strerror(kcor_gzip_status status) {
+  switch (status) {
+    case KCOR_GZIP_OK: return "success";
+    case KCOR_GZIP_OPEN: return "unable to open file";
+    case KCOR_GZIP_EXISTS: return "zipped file already exists";
+    case KCOR_GZIP_READ: return "unable to read file";
+    case KCOR_GZIP_MEMORY: return "out of memory";
+    case KCOR_GZIP_DEFLATE: return "error compressing file";
+    case KCOR_GZIP_WRITE: return "unable to write zipped file";
+    case KCOR_GZIP_VERIFY: return "zipped file failed CRC check";
+  }
+  return "unknown error";
+}
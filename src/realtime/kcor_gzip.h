@@ -0,0 +1,33 @@
+#ifndef KCOR_GZIP_H
+#define KCOR_GZIP_H
+
+#include <sys/types.h>
+
+/* same as the gzip executable */
+#define KCOR_GZIP_DEFAULT_LEVEL 6
+
+/*
+ * Error codes returned by kcor_gzip_file.
+ */
+typedef enum {
+  KCOR_GZIP_OK = 0,
+  KCOR_GZIP_OPEN,      /* could not open or stat the file */
+  KCOR_GZIP_EXISTS,    /* the .gz file already exists */
+  KCOR_GZIP_READ,      /* could not read the file */
+  KCOR_GZIP_MEMORY,    /* out of memory */
+  KCOR_GZIP_DEFLATE,   /* zlib failed to compress a block */
+  KCOR_GZIP_WRITE,     /* could not write the .gz file */
+  KCOR_GZIP_VERIFY     /* the .gz file did not decompress to the original */
+} kcor_gzip_status;
+
+/*
+ * Compress filename to filename.gz, like gzip does, using n_threads threads to
+ * compress blocks of the file in parallel. The original file is removed
+ * only after the .gz file has been written and its CRC verified.
+ */
+kcor_gzip_status kcor_gzip_file(const char *filename, int level, int n_threads,
+                                off_t *compressed_size);
+
+const char *kcor_gzip_strerror(kcor_gzip_status status);
+
+#endif
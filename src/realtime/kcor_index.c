@@ -0,0 +1,547 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "kcor_fits.h"
+#include "kcor_index.h"
+
+/*
+ * The index of a directory is a text file in the directory, so that it can be
+ * read by anything, e.g., the Python reader in bin/kcor_index.py:
+ *
+ *   # kcor header index 1
+ *   <name>\t<size>\t<mtime>\t<checksum>\t<n_cards>
+ *   <card>
+ *   ...
+ *
+ * with each entry followed by its n_cards cards, trailing blanks removed. New
+ * files are appended to the index; a later entry for a file replaces an
+ * earlier one. The index is rewritten when files have changed or been
+ * removed. Updates are serialized with flock on the index file.
+ */
+#define KCOR_INDEX_MAGIC "# kcor header index 1"
+#define KCOR_INDEX_BUFFER_SIZE (256 * 1024)
+
+typedef struct {
+  int n;
+  int capacity;
+  kcor_index_entry *entries;
+} kcor_index_list;
+
+
+static int kcor_index_add(kcor_index_list *list, kcor_index_entry *entry) {
+  if (list->n == list->capacity) {
+    int capacity = list->capacity == 0 ? 256 : 2 * list->capacity;
+    kcor_index_entry *entries = realloc(list->entries,
+                                        capacity * sizeof(kcor_index_entry));
+    if (entries == NULL) return 0;
+    list->entries = entries;
+    list->capacity = capacity;
+  }
+  list->entries[list->n++] = *entry;
+  return 1;
+}
+
+
+static void kcor_index_free_entry(kcor_index_entry *entry) {
+  int c;
+
+  if (entry->cards != NULL) {
+    for (c = 0; c < entry->n_cards; c++) free(entry->cards[c]);
+    free(entry->cards);
+  }
+  free(entry->name);
+  memset(entry, 0, sizeof(kcor_index_entry));
+}
+
+
+static void kcor_index_free_list(kcor_index_list *list) {
+  int e;
+
+  for (e = 0; e < list->n; e++) kcor_index_free_entry(&list->entries[e]);
+  free(list->entries);
+  memset(list, 0, sizeof(kcor_index_list));
+}
+
+
+static int kcor_index_compare(const void *a, const void *b) {
+  return strcmp(((const kcor_index_entry *) a)->name,
+                ((const kcor_index_entry *) b)->name);
+}
+
+
+static int kcor_index_is_fits(const char *name) {
+  size_t length = strlen(name);
+
+  if (name[0] == '.') return 0;
+  return (length > 4 && strcmp(name + length - 4, ".fts") == 0)
+           || (length > 7 && strcmp(name + length - 7, ".fts.gz") == 0);
+}
+
+
+/* next line of the buffer, NUL-terminated in place, or NULL at the end */
+static char *kcor_index_next_line(char **pos, char *end) {
+  char *line = *pos, *newline;
+
+  if (line >= end) return NULL;
+  newline = memchr(line, '\n', end - line);
+  if (newline == NULL) return NULL;   /* incomplete last line */
+  *newline = '\0';
+  *pos = newline + 1;
+  return line;
+}
+
+
+/*
+ * Parse the contents of an index file into list; returns 0 if the contents
+ * are not a complete index, so it must be rewritten.
+ */
+static int kcor_index_parse(char *contents, size_t length, kcor_index_list *list) {
+  char *pos = contents, *end = contents + length, *line;
+  int c;
+
+  line = kcor_index_next_line(&pos, end);
+  if (line == NULL || strcmp(line, KCOR_INDEX_MAGIC) != 0) return 0;
+
+  while ((line = kcor_index_next_line(&pos, end)) != NULL) {
+    kcor_index_entry entry;
+    char *tab = strchr(line, '\t');
+    long long size, mtime;
+
+    memset(&entry, 0, sizeof(entry));
+    if (tab == NULL
+          || sscanf(tab + 1, "%lld\t%lld\t%lx\t%d", &size, &mtime,
+                    &entry.checksum, &entry.n_cards) != 4
+          || entry.n_cards < 0) {
+      return 0;
+    }
+    *tab = '\0';
+    entry.size = size;
+    entry.mtime = mtime;
+    entry.name = strdup(line);
+    entry.cards = calloc(entry.n_cards > 0 ? entry.n_cards : 1, sizeof(char *));
+    if (entry.name == NULL || entry.cards == NULL) {
+      kcor_index_free_entry(&entry);
+      return 0;
+    }
+
+    for (c = 0; c < entry.n_cards; c++) {
+      line = kcor_index_next_line(&pos, end);
+      if (line == NULL || (entry.cards[c] = strdup(line)) == NULL) {
+        kcor_index_free_entry(&entry);
+        return 0;
+      }
+    }
+
+    if (!kcor_index_add(list, &entry)) {
+      kcor_index_free_entry(&entry);
+      return 0;
+    }
+  }
+
+  return pos == end;
+}
+
+
+/*
+ * Sort the entries by name, keeping only the last entry for each name;
+ * returns the number of entries removed.
+ */
+static int kcor_index_dedupe(kcor_index_list *list) {
+  int e, n = 0, n_removed;
+
+  /* a stable sort, so the last entry for a name stays last */
+  for (e = 1; e < list->n; e++) {
+    kcor_index_entry entry = list->entries[e];
+    int i = e - 1;
+    while (i >= 0 && strcmp(list->entries[i].name, entry.name) > 0) {
+      list->entries[i + 1] = list->entries[i];
+      i--;
+    }
+    list->entries[i + 1] = entry;
+  }
+
+  for (e = 0; e < list->n; e++) {
+    if (e + 1 < list->n && strcmp(list->entries[e].name, list->entries[e + 1].name) == 0) {
+      kcor_index_free_entry(&list->entries[e]);
+    } else {
+      list->entries[n++] = list->entries[e];
+    }
+  }
+  n_removed = list->n - n;
+  list->n = n;
+
+  return n_removed;
+}
+
+
+/* CRC-32 of the uncompressed file: the gzip trailer has it for .gz files */
+static unsigned long kcor_index_checksum(const char *path, off_t size) {
+  unsigned char *buffer;
+  unsigned long crc = crc32(0L, Z_NULL, 0);
+  size_t length = strlen(path);
+  ssize_t n;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0) return crc;
+
+  if (length > 3 && strcmp(path + length - 3, ".gz") == 0) {
+    unsigned char trailer[4];
+    if (size >= 18 && pread(fd, trailer, 4, size - 8) == 4) {
+      crc = (unsigned long) trailer[0] | (unsigned long) trailer[1] << 8
+              | (unsigned long) trailer[2] << 16 | (unsigned long) trailer[3] << 24;
+    }
+  } else {
+    buffer = malloc(KCOR_INDEX_BUFFER_SIZE);
+    if (buffer != NULL) {
+      while ((n = read(fd, buffer, KCOR_INDEX_BUFFER_SIZE)) > 0) {
+        crc = crc32(crc, buffer, n);
+      }
+      free(buffer);
+    }
+  }
+
+  close(fd);
+  return crc;
+}
+
+
+typedef struct {
+  const char *dir;
+  kcor_index_entry *entries;
+  int *ok;
+  int n_entries;
+  int n_threads;
+  int thread;
+} kcor_index_scan;
+
+
+static void *kcor_index_scan_work(void *arg) {
+  kcor_index_scan *scan = (kcor_index_scan *) arg;
+  kcor_fits_file file;
+  char *path, *card;
+  int e, c, length;
+
+  for (e = scan->thread; e < scan->n_entries; e += scan->n_threads) {
+    kcor_index_entry *entry = &scan->entries[e];
+
+    scan->ok[e] = 0;
+    path = malloc(strlen(scan->dir) + strlen(entry->name) + 2);
+    if (path == NULL) continue;
+    sprintf(path, "%s/%s", scan->dir, entry->name);
+
+    /* files that are not readable yet, e.g., still arriving, are skipped */
+    if (kcor_fits_read_header(path, &file) == KCOR_FITS_OK) {
+      entry->cards = calloc(file.n_cards, sizeof(char *));
+      if (entry->cards != NULL) {
+        entry->n_cards = file.n_cards;
+        scan->ok[e] = 1;
+        for (c = 0; c < file.n_cards; c++) {
+          card = file.cards + c * KCOR_FITS_CARD_SIZE;
+          for (length = KCOR_FITS_CARD_SIZE; length > 0 && card[length - 1] == ' '; length--);
+          entry->cards[c] = strndup(card, length);
+          if (entry->cards[c] == NULL) scan->ok[e] = 0;
+        }
+        entry->checksum = kcor_index_checksum(path, entry->size);
+      }
+    }
+
+    kcor_fits_close(&file);
+    free(path);
+  }
+
+  return NULL;
+}
+
+
+static void kcor_index_scan_files(const char *dir, kcor_index_list *list,
+                                  int *ok, int n_threads) {
+  kcor_index_scan *scans;
+  pthread_t *threads;
+  int t, n_started;
+
+  if (n_threads <= 0) n_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (n_threads > list->n) n_threads = list->n;
+  if (n_threads <= 0) n_threads = 1;
+
+  scans = malloc(n_threads * sizeof(kcor_index_scan));
+  threads = malloc(n_threads * sizeof(pthread_t));
+  if (scans == NULL || threads == NULL) {
+    kcor_index_scan scan = { dir, list->entries, ok, list->n, 1, 0 };
+    free(scans);
+    free(threads);
+    kcor_index_scan_work(&scan);
+    return;
+  }
+
+  for (t = 0; t < n_threads; t++) {
+    kcor_index_scan scan = { dir, list->entries, ok, list->n, n_threads, t };
+    scans[t] = scan;
+  }
+
+  for (n_started = 1; n_started < n_threads; n_started++) {
+    if (pthread_create(&threads[n_started], NULL, kcor_index_scan_work,
+                       &scans[n_started]) != 0) break;
+  }
+  kcor_index_scan_work(&scans[0]);
+  for (t = n_started; t < n_threads; t++) kcor_index_scan_work(&scans[t]);
+  for (t = 1; t < n_started; t++) pthread_join(threads[t], NULL);
+
+  free(scans);
+  free(threads);
+}
+
+
+static int kcor_index_write_entries(FILE *f, kcor_index_entry *entries, int n) {
+  int e, c;
+
+  for (e = 0; e < n; e++) {
+    fprintf(f, "%s\t%lld\t%lld\t%08lx\t%d\n",
+            entries[e].name, (long long) entries[e].size,
+            (long long) entries[e].mtime, entries[e].checksum,
+            entries[e].n_cards);
+    for (c = 0; c < entries[e].n_cards; c++) {
+      fputs(entries[e].cards[c], f);
+      fputc('\n', f);
+    }
+  }
+  return !ferror(f);
+}
+
+
+static int kcor_index_rewrite(const char *path, kcor_index_list *list) {
+  char *tmp_path = malloc(strlen(path) + 32);
+  FILE *f;
+  int ok;
+
+  if (tmp_path == NULL) return 0;
+  sprintf(tmp_path, "%s.%d.tmp", path, (int) getpid());
+
+  f = fopen(tmp_path, "w");
+  if (f == NULL) {
+    free(tmp_path);
+    return 0;
+  }
+  fprintf(f, "%s\n", KCOR_INDEX_MAGIC);
+  ok = kcor_index_write_entries(f, list->entries, list->n);
+  if (fclose(f) != 0) ok = 0;
+
+  if (ok) ok = rename(tmp_path, path) == 0;
+  if (!ok) unlink(tmp_path);
+
+  free(tmp_path);
+  return ok;
+}
+
+
+/* append entries in a single write, so readers never see a partial entry */
+static int kcor_index_append(int fd, kcor_index_entry *entries, int n) {
+  char *buffer = NULL;
+  size_t length = 0;
+  FILE *f = open_memstream(&buffer, &length);
+  int ok;
+
+  if (f == NULL) return 0;
+  ok = kcor_index_write_entries(f, entries, n);
+  if (fclose(f) != 0) ok = 0;
+
+  if (ok) {
+    ok = lseek(fd, 0, SEEK_END) >= 0
+           && write(fd, buffer, length) == (ssize_t) length;
+  }
+  free(buffer);
+  return ok;
+}
+
+
+/* open and lock the index file, making sure it was not replaced meanwhile */
+static int kcor_index_lock(const char *path, int *writable) {
+  struct stat fd_st, path_st;
+  int fd;
+
+  for (;;) {
+    fd = open(path, O_RDWR | O_CREAT, 0664);
+    if (fd < 0) {
+      *writable = 0;
+      return open(path, O_RDONLY);
+    }
+    *writable = 1;
+
+    if (flock(fd, LOCK_EX) != 0) return fd;
+    if (fstat(fd, &fd_st) == 0 && stat(path, &path_st) == 0
+          && fd_st.st_dev == path_st.st_dev && fd_st.st_ino == path_st.st_ino) {
+      return fd;
+    }
+    close(fd);
+  }
+}
+
+
+kcor_index_status kcor_index_update(const char *dir, int n_threads,
+                                    kcor_index *index) {
+  kcor_index_list loaded, result, scanned;
+  kcor_index_entry entry, *found;
+  kcor_index_status status = KCOR_INDEX_OK;
+  struct stat st, index_st;
+  struct dirent *dirent;
+  char *path = NULL, *contents = NULL;
+  int *ok = NULL, *used = NULL;
+  int fd, writable, valid, rewrite, n_duplicates, n_read, e;
+  DIR *d;
+
+  memset(index, 0, sizeof(kcor_index));
+  memset(&loaded, 0, sizeof(loaded));
+  memset(&result, 0, sizeof(result));
+  memset(&scanned, 0, sizeof(scanned));
+
+  path = malloc(strlen(dir) + strlen(KCOR_INDEX_FILENAME) + 2);
+  if (path == NULL) return KCOR_INDEX_MEMORY;
+  sprintf(path, "%s/%s", dir, KCOR_INDEX_FILENAME);
+
+  d = opendir(dir);
+  if (d == NULL) {
+    free(path);
+    return KCOR_INDEX_DIR;
+  }
+
+  fd = kcor_index_lock(path, &writable);
+
+  /* read the current index, if any */
+  valid = 0;
+  if (fd >= 0 && fstat(fd, &index_st) == 0 && index_st.st_size > 0) {
+    contents = malloc(index_st.st_size);
+    if (contents != NULL
+          && pread(fd, contents, index_st.st_size, 0) == index_st.st_size) {
+      valid = kcor_index_parse(contents, index_st.st_size, &loaded);
+    }
+    free(contents);
+  }
+  n_duplicates = kcor_index_dedupe(&loaded);
+  used = calloc(loaded.n > 0 ? loaded.n : 1, sizeof(int));
+  if (used == NULL) {
+    status = KCOR_INDEX_MEMORY;
+    goto done;
+  }
+
+  /* keep the entries of unchanged files, collect the others to read */
+  while ((dirent = readdir(d)) != NULL) {
+    if (!kcor_index_is_fits(dirent->d_name)) continue;
+    if (fstatat(dirfd(d), dirent->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) continue;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.name = dirent->d_name;
+    found = loaded.n == 0 ? NULL
+              : bsearch(&entry, loaded.entries, loaded.n,
+                        sizeof(kcor_index_entry), kcor_index_compare);
+    if (found != NULL && found->size == st.st_size && found->mtime == st.st_mtime) {
+      used[found - loaded.entries] = 1;
+      continue;
+    }
+
+    entry.name = strdup(dirent->d_name);
+    entry.size = st.st_size;
+    entry.mtime = st.st_mtime;
+    if (entry.name == NULL || !kcor_index_add(&scanned, &entry)) {
+      free(entry.name);
+      status = KCOR_INDEX_MEMORY;
+      goto done;
+    }
+  }
+
+  ok = calloc(scanned.n > 0 ? scanned.n : 1, sizeof(int));
+  if (ok == NULL) {
+    status = KCOR_INDEX_MEMORY;
+    goto done;
+  }
+  if (scanned.n > 0) kcor_index_scan_files(dir, &scanned, ok, n_threads);
+
+  /* drop files that could not be read, so they are tried again next time */
+  for (e = 0; e < scanned.n; e++) {
+    if (!ok[e]) kcor_index_free_entry(&scanned.entries[e]);
+  }
+  for (e = 0, n_read = 0; e < scanned.n; e++) {
+    if (ok[e]) scanned.entries[n_read++] = scanned.entries[e];
+  }
+  scanned.n = n_read;
+
+  /*
+   * New files are appended; an index that is new, incomplete, or has entries
+   * for files that changed or were removed is rewritten
+   */
+  rewrite = !valid || n_duplicates > 0;
+  for (e = 0; e < loaded.n; e++) rewrite = rewrite || !used[e];
+  if (writable && !rewrite && scanned.n > 0) {
+    if (!kcor_index_append(fd, scanned.entries, scanned.n)) status = KCOR_INDEX_WRITE;
+  }
+
+  /* the index is the unchanged loaded entries and the newly read ones */
+  for (e = 0; e < loaded.n && status != KCOR_INDEX_MEMORY; e++) {
+    if (!used[e]) continue;
+    if (!kcor_index_add(&result, &loaded.entries[e])) {
+      status = KCOR_INDEX_MEMORY;
+      break;
+    }
+    memset(&loaded.entries[e], 0, sizeof(kcor_index_entry));
+  }
+  for (e = 0; e < scanned.n && status != KCOR_INDEX_MEMORY; e++) {
+    if (!kcor_index_add(&result, &scanned.entries[e])) {
+      status = KCOR_INDEX_MEMORY;
+      break;
+    }
+    memset(&scanned.entries[e], 0, sizeof(kcor_index_entry));
+  }
+  if (status == KCOR_INDEX_MEMORY) goto done;
+
+  if (result.n > 0) {
+    qsort(result.entries, result.n, sizeof(kcor_index_entry), kcor_index_compare);
+  }
+
+  if (writable && rewrite) {
+    if (!kcor_index_rewrite(path, &result)) status = KCOR_INDEX_WRITE;
+  }
+
+  index->n_entries = result.n;
+  index->entries = result.entries;
+  memset(&result, 0, sizeof(result));
+
+ done:
+  if (fd >= 0) close(fd);
+  closedir(d);
+  kcor_index_free_list(&loaded);
+  kcor_index_free_list(&scanned);
+  kcor_index_free_list(&result);
+  free(used);
+  free(ok);
+  free(path);
+
+  return status;
+}
+
+
+void kcor_index_free(kcor_index *index) {
+  int e;
+
+  for (e = 0; e < index->n_entries; e++) kcor_index_free_entry(&index->entries[e]);
+  free(index->entries);
+  memset(index, 0, sizeof(kcor_index));
+}
+
+
+const char *kcor_index_strerror(kcor_index_status status) {
+  switch (status) {
+    case KCOR_INDEX_OK: return "success";
+    case KCOR_INDEX_DIR: return "unable to read directory";
+    case KCOR_INDEX_MEMORY: return "out of memory";
+    case KCOR_INDEX_WRITE: return "unable to write index";
+  }
+  return "unknown error";
+}
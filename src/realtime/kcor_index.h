@@ -0,0 +1,50 @@
+#ifndef KCOR_INDEX_H
+#define KCOR_INDEX_H
+
+#include <sys/types.h>
+#include <time.h>
+
+/* name of the index file in each indexed directory */
+#define KCOR_INDEX_FILENAME ".kcor_header_index"
+
+/*
+ * Error codes returned by kcor_index_update.
+ */
+typedef enum {
+  KCOR_INDEX_OK = 0,
+  KCOR_INDEX_DIR,      /* could not read the directory */
+  KCOR_INDEX_MEMORY,   /* out of memory */
+  KCOR_INDEX_WRITE     /* could not write the index file */
+} kcor_index_status;
+
+/*
+ * A FITS file of the directory, with the cards of its primary header, trailing
+ * blanks removed, through END.
+ */
+typedef struct {
+  char *name;
+  off_t size;
+  time_t mtime;
+  unsigned long checksum;   /* CRC-32 of the uncompressed file */
+  int n_cards;
+  char **cards;
+} kcor_index_entry;
+
+typedef struct {
+  int n_entries;
+  kcor_index_entry *entries;   /* sorted by name */
+} kcor_index;
+
+/*
+ * Bring the index of the .fts and .fts.gz files of dir up to date, reading
+ * only files that are new or whose size or modification time changed, and
+ * return its entries. If the index file cannot be written, the index is
+ * still returned, but only in memory.
+ */
+kcor_index_status kcor_index_update(const char *dir, int n_threads,
+                                    kcor_index *index);
+void kcor_index_free(kcor_index *index);
+
+const char *kcor_index_strerror(kcor_index_status status);
+
+#endif
@@ -122,100 +122,27 @@ pro kcor_l1, ok_filename, $
     goto, done
   endelse
 
-  unit = ncdf_open(calpath)
-  if (unit lt 0L) then begin
-    mg_log, 'unable to open cal file %s', file_basename(calpath), $
-            name=log_name, /error
+  ; cal file quantities are cached for the run, so only the first file of a
+  ; cal epoch reads the cal file
+  calibration = kcor_l1_calibration(calpath, run=run, log_name=log_name, $
+                                    error=cal_read_error)
+  if (cal_read_error ne 0L) then begin
     error = 1L
     goto, done
   endif
 
-  ncdf_varget, unit, 'Dark', dark_alfred
-  ncdf_varget, unit, 'Gain', gain_alfred  ; gain_alfred is a dark corrected gain
-  gain_alfred /= 1.0e-6   ; this makes gain_alfred in units of B/Bsun
-
-  gain_id = ncdf_varid(unit, 'Gain')
-  ncdf_attget, unit, gain_id, 'RCAM x-center', frcam_x
-  ncdf_attget, unit, gain_id, 'RCAM y-center', frcam_y
-  ncdf_attget, unit, gain_id, 'RCAM radius', frcam_r
-  ncdf_attget, unit, gain_id, 'TCAM x-center', ftcam_x
-  ncdf_attget, unit, gain_id, 'TCAM y-center', ftcam_y
-  ncdf_attget, unit, gain_id, 'TCAM radius', ftcam_r
-
-  ; multiply by ad hoc non-linearity correction factor
-  gain_alfred /= run->epoch('nonlinearity-correction-factor')
-
-  ncdf_varget, unit, 'Modulation Matrix', mmat
-  ncdf_varget, unit, 'Demodulation Matrix', dmat
-  ncdf_varget, unit, 'DIM Reference Voltage', flat_vdimref
-
-  cal_epoch_version = kcor_nc_getattribute(unit, 'epoch_version', default='-1')
-
-  if (kcor_nc_varid(unit, 'lyotstop') eq -1L) then begin
-    cal_lyotstop = !null
-  endif else begin
-    ncdf_varget, unit, 'lyotstop', cal_lyotstop
-    if (cal_lyotstop eq '') then cal_lyotstop = !null
-  endelse
-
-  if (kcor_nc_varid(unit, 'numsum') eq -1L) then begin
-    ; default for old cal files without a numsum variable is 512
-    cal_numsum = 512L
-  endif else begin
-    ncdf_varget, unit, 'numsum', cal_numsum
-  endelse
-
-  if (kcor_nc_varid(unit, 'exptime') eq -1L) then begin
-    tokens = strsplit(file_basename(cal_file, '.ncdf'), '_', /extract)
-    cal_exptime = float(strmid(tokens[-1], 0, strlen(tokens[-1]) - 2))
-  endif else begin
-    ncdf_varget, unit, 'exptime', cal_exptime
-  endelse
-
-  ncdf_close, unit
-
-  ; modify gain images
-  ;   - set zero and negative values in gain to value stored in 'gain_negative'
-
-  ; GdT: changed gain correction and moved it up (not inside the loop)
-  ; this will change when we read the daily gain instead of a fixed one
-  gain_negative = -10
-  gain_alfred[where(gain_alfred le 0, /null)] = gain_negative
-
-  ; replace zero and negative values with mean of 5x5 neighbour pixels
-  for b = 0, 1 do begin
-    gain_temp = double(reform(gain_alfred[*, *, b]))
-    filter = mean_filter(gain_temp, 5, 5, invalid=gain_negative, missing=1)
-    bad = where(gain_temp eq gain_negative, nbad)
-
-    if (nbad gt 0) then begin
-      gain_temp[bad] = filter[bad]
-      gain_alfred[*, *, b] = gain_temp
-    endif
-  endfor
-  gain_temp = 0
-
-  ; TODO: use centering from netCDF cal file
-  info_gain0 = [frcam_x, frcam_y, frcam_r]
-  info_gain1 = [ftcam_x, ftcam_y, ftcam_r]
-
-  ; find center and radius for gain images
-  ; info_gain0 = kcor_find_image(gain_alfred[*, *, 0], radius_guess, log_name=log_name)
-  ; mg_log, /check_math, name=log_name, /debug
-  ; info_gain1 = kcor_find_image(gain_alfred[*, *, 1], radius_guess, log_name=log_name)
-  ; mg_log, /check_math, name=log_name, /debug
-
-  ; define coordinate arrays for gain images
-  gxx0 = findgen(xsize, ysize) mod xsize - info_gain0[0]
-  gyy0 = transpose(findgen(ysize, xsize) mod ysize) - info_gain0[1]
-
-  gxx0 = double(gxx0)
-  gyy0 = double(gyy0)
-  grr0 = sqrt(gxx0 ^ 2.0 + gyy0 ^ 2.0)
-
-  gxx1 = dindgen(xsize, ysize) mod xsize - info_gain1[0]
-  gyy1 = transpose(dindgen(ysize, xsize) mod ysize) - info_gain1[1]
-  grr1 = sqrt(gxx1 ^ 2.0 + gyy1 ^ 2.0)
+  dark_alfred       = (*calibration).dark_alfred
+  gain_alfred       = (*calibration).gain_alfred
+  info_gain0        = (*calibration).info_gain0
+  info_gain1        = (*calibration).info_gain1
+  grr0              = (*calibration).grr0
+  grr1              = (*calibration).grr1
+  flat_vdimref      = (*calibration).flat_vdimref
+  cal_epoch_version = (*calibration).epoch_version
+  cal_numsum        = (*calibration).numsum
+  cal_exptime       = (*calibration).exptime
+  cal_lyotstop      = (*calibration).lyotstop
+  if (cal_lyotstop eq '') then cal_lyotstop = !null
 
   mg_log, 'gain 0 center: %0.1f, %0.1f and radius: %0.1f', $
           info_gain0, name=log_name, /debug
@@ -553,10 +480,11 @@ pro kcor_l1, ok_filename, $
   ; new method using M. Galloy C-language code (04 Mar 2015)
   dclock = tic('demod_matrix')
 
-  a = transpose(dmat, [3, 4, 0, 1, 2])
+  ; the cached demodulation matrix is already transposed to [3, 4, 0, 1, 2]
   b = transpose(img_cor, [2, 0, 1, 3])
 
-  result = kcor_batched_matrix_vector_multiply(a, b, 4, 3, xsize * ysize * 2)
+  result = kcor_batched_matrix_vector_multiply((*calibration).dmat, b, $
+                                               4, 3, xsize * ysize * 2)
   cal_data = reform(transpose(result), xsize, ysize, 2, 3)
 
   demod_time = toc(dclock)
@@ -579,7 +507,11 @@ pro kcor_l1, ok_filename, $
   ; epoch values like distortion correction filename can change during the day
   dc_path = filepath(run->epoch('distortion_correction_filename'), $
                      root=run.resources_dir)
-  restore, dc_path   ; distortion correction file
+  distortion = kcor_l1_distortion(dc_path, run=run)
+  dx1_c = (*distortion).dx1_c
+  dy1_c = (*distortion).dy1_c
+  dx2_c = (*distortion).dx2_c
+  dy2_c = (*distortion).dy2_c
 
   dat1 = img0
   dat2 = img1
@@ -637,8 +569,6 @@ pro kcor_l1, ok_filename, $
   endfor
 
   ; apply distortion correction to calibrated data
-  restore, dc_path   ; distortion correction file
-
   for s = 0, 2 do begin
     dat1 = cal_data[*, *, 0, s]
     dat2 = cal_data[*, *, 1, s]
@@ -844,13 +774,22 @@ pro kcor_l1, ok_filename, $
   ; do some radius finding of various distortion corrected images to compare
   ; against each other
 
-  ; distortion corrected flats
-  rcam_gain = reform(gain_alfred[*, *, 0])
-  rcam_gain  = reverse(rcam_gain, 2)
-  tcam_gain = reform(gain_alfred[*, *, 1])
-  kcor_apply_dist, rcam_gain, tcam_gain, dx1_c, dy1_c, dx2_c, dy2_c
-  info_dc_gain0 = kcor_find_image(rcam_gain, radius_guess, log_name=log_name)
-  info_dc_gain1 = kcor_find_image(tcam_gain, radius_guess, log_name=log_name)
+  ; distortion corrected flats, which only depend on the cal file, distortion
+  ; file and occulter
+  flat_key = string(calpath, (file_info(calpath)).mtime, dc_path, radius_guess, $
+                    format='(%"%s:%d:%s:%0.8g")')
+  flat_centers = run->cache_get('flat_centers', flat_key, found=found)
+  if (~found) then begin
+    rcam_gain = reform(gain_alfred[*, *, 0])
+    rcam_gain  = reverse(rcam_gain, 2)
+    tcam_gain = reform(gain_alfred[*, *, 1])
+    kcor_apply_dist, rcam_gain, tcam_gain, dx1_c, dy1_c, dx2_c, dy2_c
+    flat_centers = run->cache_put('flat_centers', flat_key, $
+        {info_dc_gain0: kcor_find_image(rcam_gain, radius_guess, log_name=log_name), $
+         info_dc_gain1: kcor_find_image(tcam_gain, radius_guess, log_name=log_name)})
+  endif
+  info_dc_gain0 = (*flat_centers).info_dc_gain0
+  info_dc_gain1 = (*flat_centers).info_dc_gain1
 
   ; unflat-corrected, but distortion corrected intensity
   kcor_apply_dist, rcam_ungain_i, tcam_ungain_i, dx1_c, dy1_c, dx2_c, dy2_c
@@ -1234,22 +1173,22 @@ pro kcor_l1, ok_filename, $
             format='(f0.2)'
 
   ; flat centering info
-  fxaddpar, l1_header, 'FRCAM_X', frcam_x + 1, $
+  fxaddpar, l1_header, 'FRCAM_X', info_gain0[0] + 1, $
             ' [pixel] cam 0 dark cor flat occulter X center', $
             format='(f0.2)', after='TCAM_DCR'
-  fxaddpar, l1_header, 'FRCAM_Y', frcam_y + 1, $
+  fxaddpar, l1_header, 'FRCAM_Y', info_gain0[1] + 1, $
             ' [pixel] cam 0 dark cor flat occulter Y center', $
             format='(f0.2)', after='FRCAM_X'
-  fxaddpar, l1_header, 'FRCAM_R', frcam_r, $
+  fxaddpar, l1_header, 'FRCAM_R', info_gain0[2], $
             ' [pixel] cam 0 dark cor flat occulter radius', $
             format='(f0.2)', after='FRCAM_Y'
-  fxaddpar, l1_header, 'FTCAM_X', ftcam_x + 1, $
+  fxaddpar, l1_header, 'FTCAM_X', info_gain1[0] + 1, $
             ' [pixel] cam 1 dark cor flat occulter X center', $
             format='(f0.2)', after='FRCAM_R'
-  fxaddpar, l1_header, 'FTCAM_Y', ftcam_y + 1, $
+  fxaddpar, l1_header, 'FTCAM_Y', info_gain1[1] + 1, $
             ' [pixel] cam 1 dark cor flat occulter Y center', $
             format='(f0.2)', after='FTCAM_X'
-  fxaddpar, l1_header, 'FTCAM_R', ftcam_r, $
+  fxaddpar, l1_header, 'FTCAM_R', info_gain1[2], $
             ' [pixel] cam 1 dark cor flat occulter radius', $
             format='(f0.2)', after='FTCAM_Y'
 
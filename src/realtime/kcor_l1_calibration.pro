@@ -0,0 +1,176 @@
+; docformat = 'rst'
+
+;+
+; Read the quantities `kcor_l1` needs from a calibration file: the dark, the
+; gain with bad values filled in, the gain centers, the demodulation matrix
+; and the values checked against each file.
+;
+; These depend only on the cal file, so they are read once for the run and
+; cached on the `kcor_run` object until the cal file changes, e.g., at a new
+; cal epoch during the day.
+;
+; :Returns:
+;   pointer to a structure, owned by `run`; a null pointer if the cal file
+;   could not be read
+;
+; :Params:
+;   calpath : in, required, type=string
+;     filename of the netCDF calibration file
+;
+; :Keywords:
+;   run : in, required, type=object
+;     `kcor_run` object
+;   log_name : in, optional, type=string
+;     name of the log to send messages to
+;   error : out, optional, type=long
+;     set to a named variable to retrieve the error status of the call
+;-
+function kcor_l1_calibration, calpath, run=run, log_name=log_name, error=error
+  compile_opt strictarr
+
+  error = 0L
+
+  xsize = run->epoch('xsize')
+  ysize = run->epoch('ysize')
+  nonlinearity_factor = run->epoch('nonlinearity-correction-factor')
+
+  ; a cal file rewritten during the run is read again
+  key = string(calpath, (file_info(calpath)).mtime, nonlinearity_factor, $
+                xsize, ysize, $
+                format='(%"%s:%d:%0.8g:%dx%d")')
+  calibration = run->cache_get('calibration', key, found=found)
+  if (found) then return, calibration
+
+  unit = ncdf_open(calpath)
+  if (unit lt 0L) then begin
+    mg_log, 'unable to open cal file %s', file_basename(calpath), $
+            name=log_name, /error
+    error = 1L
+    return, ptr_new()
+  endif
+
+  ncdf_varget, unit, 'Dark', dark_alfred
+  ncdf_varget, unit, 'Gain', gain_alfred  ; gain_alfred is a dark corrected gain
+  gain_alfred /= 1.0e-6   ; this makes gain_alfred in units of B/Bsun
+
+  gain_id = ncdf_varid(unit, 'Gain')
+  ncdf_attget, unit, gain_id, 'RCAM x-center', frcam_x
+  ncdf_attget, unit, gain_id, 'RCAM y-center', frcam_y
+  ncdf_attget, unit, gain_id, 'RCAM radius', frcam_r
+  ncdf_attget, unit, gain_id, 'TCAM x-center', ftcam_x
+  ncdf_attget, unit, gain_id, 'TCAM y-center', ftcam_y
+  ncdf_attget, unit, gain_id, 'TCAM radius', ftcam_r
+
+  ; multiply by ad hoc non-linearity correction factor
+  gain_alfred /= nonlinearity_factor
+
+  ncdf_varget, unit, 'Demodulation Matrix', dmat
+  ncdf_varget, unit, 'DIM Reference Voltage', flat_vdimref
+
+  cal_epoch_version = kcor_nc_getattribute(unit, 'epoch_version', default='-1')
+
+  if (kcor_nc_varid(unit, 'lyotstop') eq -1L) then begin
+    cal_lyotstop = ''
+  endif else begin
+    ncdf_varget, unit, 'lyotstop', cal_lyotstop
+  endelse
+
+  if (kcor_nc_varid(unit, 'numsum') eq -1L) then begin
+    ; default for old cal files without a numsum variable is 512
+    cal_numsum = 512L
+  endif else begin
+    ncdf_varget, unit, 'numsum', cal_numsum
+  endelse
+
+  if (kcor_nc_varid(unit, 'exptime') eq -1L) then begin
+    tokens = strsplit(file_basename(calpath, '.ncdf'), '_', /extract)
+    cal_exptime = float(strmid(tokens[-1], 0, strlen(tokens[-1]) - 2))
+  endif else begin
+    ncdf_varget, unit, 'exptime', cal_exptime
+  endelse
+
+  ncdf_close, unit
+
+  ; modify gain images
+  ;   - set zero and negative values in gain to value stored in 'gain_negative'
+
+  ; GdT: changed gain correction and moved it up (not inside the loop)
+  ; this will change when we read the daily gain instead of a fixed one
+  gain_negative = -10
+  gain_alfred[where(gain_alfred le 0, /null)] = gain_negative
+
+  ; replace zero and negative values with mean of 5x5 neighbour pixels
+  for b = 0, 1 do begin
+    gain_temp = double(reform(gain_alfred[*, *, b]))
+    filter = mean_filter(gain_temp, 5, 5, invalid=gain_negative, missing=1)
+    bad = where(gain_temp eq gain_negative, nbad)
+
+    if (nbad gt 0) then begin
+      gain_temp[bad] = filter[bad]
+      gain_alfred[*, *, b] = gain_temp
+    endif
+  endfor
+  gain_temp = 0
+
+  ; TODO: use centering from netCDF cal file
+  info_gain0 = [frcam_x, frcam_y, frcam_r]
+  info_gain1 = [ftcam_x, ftcam_y, ftcam_r]
+
+  ; define coordinate arrays for gain images
+  gxx0 = findgen(xsize, ysize) mod xsize - info_gain0[0]
+  gyy0 = transpose(findgen(ysize, xsize) mod ysize) - info_gain0[1]
+
+  gxx0 = double(gxx0)
+  gyy0 = double(gyy0)
+  grr0 = sqrt(gxx0 ^ 2.0 + gyy0 ^ 2.0)
+
+  gxx1 = dindgen(xsize, ysize) mod xsize - info_gain1[0]
+  gyy1 = transpose(dindgen(ysize, xsize) mod ysize) - info_gain1[1]
+  grr1 = sqrt(gxx1 ^ 2.0 + gyy1 ^ 2.0)
+
+  ; the demodulation matrix is only used in the order the C code wants it
+  dmat = transpose(temporary(dmat), [3, 4, 0, 1, 2])
+
+  mg_log, 'read cal file %s', file_basename(calpath), name=log_name, /debug
+
+  calibration = {dark_alfred: temporary(dark_alfred), $
+                 gain_alfred: temporary(gain_alfred), $
+                 info_gain0: info_gain0, $
+                 info_gain1: info_gain1, $
+                 grr0: temporary(grr0), $
+                 grr1: temporary(grr1), $
+                 dmat: temporary(dmat), $
+                 flat_vdimref: flat_vdimref, $
+                 epoch_version: cal_epoch_version, $
+                 lyotstop: cal_lyotstop, $
+                 numsum: cal_numsum, $
+                 exptime: cal_exptime}
+
+  return, run->cache_put('calibration', key, calibration)
+end
+
+
+; main-level example program
+
+date = '20190924'
+config_filename = filepath('kcor.parker.cfg', $
+                           subdir=['..', '..', 'config'], $
+                           root=mg_src_root())
+run = kcor_run(date, config_filename=config_filename)
+run.time = '2019-09-24T17:51:32'
+
+calpath = filepath(run->epoch('cal_file'), root=run->config('calibration/out_dir'))
+
+clock = tic('first')
+calibration = kcor_l1_calibration(calpath, run=run, log_name='kcor/rt')
+print, toc(clock), format='(%"first read: %0.2f sec")'
+
+clock = tic('cached')
+calibration = kcor_l1_calibration(calpath, run=run, log_name='kcor/rt')
+print, toc(clock), format='(%"cached: %0.2f sec")'
+
+help, *calibration
+
+obj_destroy, run
+
+end
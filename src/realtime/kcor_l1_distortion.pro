@@ -0,0 +1,49 @@
+; docformat = 'rst'
+
+;+
+; Restore the distortion correction coefficients, once for the run for each
+; distortion correction file.
+;
+; :Returns:
+;   pointer to a structure with fields `dx1_c`, `dy1_c`, `dx2_c` and `dy2_c`,
+;   owned by `run`
+;
+; :Params:
+;   dc_path : in, required, type=string
+;     filename of the distortion correction `.sav` file
+;
+; :Keywords:
+;   run : in, required, type=object
+;     `kcor_run` object
+;-
+function kcor_l1_distortion, dc_path, run=run
+  compile_opt strictarr
+
+  key = string(dc_path, (file_info(dc_path)).mtime, format='(%"%s:%d")')
+  distortion = run->cache_get('distortion', key, found=found)
+  if (found) then return, distortion
+
+  restore, dc_path   ; distortion correction file
+
+  distortion = {dx1_c: dx1_c, dy1_c: dy1_c, dx2_c: dx2_c, dy2_c: dy2_c}
+  return, run->cache_put('distortion', key, distortion)
+end
+
+
+; main-level example program
+
+date = '20190924'
+config_filename = filepath('kcor.parker.cfg', $
+                           subdir=['..', '..', 'config'], $
+                           root=mg_src_root())
+run = kcor_run(date, config_filename=config_filename)
+run.time = '2019-09-24T17:51:32'
+
+dc_path = filepath(run->epoch('distortion_correction_filename'), $
+                   root=run.resources_dir)
+distortion = kcor_l1_distortion(dc_path, run=run)
+help, *distortion
+
+obj_destroy, run
+
+end
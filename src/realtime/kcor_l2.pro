@@ -206,7 +206,10 @@ pro kcor_l2, l1_filename, $
   l2_filename = string(strmid(file_basename(l1_filename), 0, 20), $
                        keyword_set(nomask) ? '_nomask' : '', $
                        format='(%"%s_l2_pb%s.fts")')
-  writefits, filepath(l2_filename, root=l2_dir), float(corona), l2_header
+  ; the NRGFs below are made from this image and header rather than from the
+  ; file, so writefits must be called first to update l2_header to match it
+  l2_image = float(corona)
+  writefits, filepath(l2_filename, root=l2_dir), l2_image, l2_header
 
   ; write Helioviewer JPEG2000 image to a web accessible directory
   if (run->config('results/hv_basedir') ne '' && ~keyword_set(nomask)) then begin
@@ -217,6 +220,7 @@ pro kcor_l2, l1_filename, $
 
   ; now make cropped GIF file
   kcor_cropped_gif, corona, run.date, date_struct, $
+                    scaled_image=keyword_set(nomask) ? !null : scaled_image, $
                     run=run, nomask=nomask, log_name=log_name, $
                     level=2
 
@@ -224,9 +228,11 @@ pro kcor_l2, l1_filename, $
   cd, l2_dir
   if (date_struct.second lt 15 and date_struct.minute mod 2 eq 0 $
         and ~keyword_set(nomask)) then begin
-    kcor_nrgf, l2_filename, run=run, log_name=log_name
+    kcor_nrgf, l2_filename, image=l2_image, header=l2_header, $
+               run=run, log_name=log_name
     mg_log, /check_math, name=log_name, /debug
-    kcor_nrgf, l2_filename, /cropped, run=run, log_name=log_name
+    kcor_nrgf, l2_filename, image=l2_image, header=l2_header, /cropped, $
+               run=run, log_name=log_name
     mg_log, /check_math, name=log_name, /debug
   endif
   cd, l0_dir
@@ -101,9 +101,14 @@ end
 ;
 ; :Params:
 ;   fits_file : in, required, type=string
-;     KCor L1 FITS file
+;     KCor L2 FITS file; the output filenames are based on it, but it is only
+;     read if `IMAGE` and `HEADER` are not given
 ;
 ; :Keywords:
+;   image : in, optional, type="fltarr(1024, 1024)"
+;     L2 image of `fits_file`, if already in memory
+;   header : in, optional, type=strarr
+;     FITS header of `fits_file`, if already in memory
 ;   cropped : in, optional, type=boolean
 ;     set to create a cropped NRGF
 ;   run : in, required, type=object
@@ -121,6 +126,8 @@ end
 ;   04 Mar 2016 Generate a 16 bit fits nrgf image in addition to a gif.
 ;-
 pro kcor_nrgf, fits_file, $
+               image=image, $
+               header=header, $
                mean_r=mean_r, $
                sdev_r=sdev_r, $
                cropped=cropped, $
@@ -141,8 +148,13 @@ pro kcor_nrgf, fits_file, $
   enhanced_radius = run->epoch('enhanced_radius')
   enhanced_amount = run->epoch('enhanced_amount')
 
-  ; read L1 FITS image
-  img = readfits(fits_file, hdu, /noscale, /silent)
+  ; read L2 FITS image, unless the caller already has it
+  if (n_elements(image) gt 0L && n_elements(header) gt 0L) then begin
+    img = image
+    hdu = header
+  endif else begin
+    img = readfits(fits_file, hdu, /noscale, /silent)
+  endelse
 
   if (keyword_set(enhanced)) then begin
     img = kcor_enhanced(img, radius=enhanced_radius, amount=enhanced_amount)
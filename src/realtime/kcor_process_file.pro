@@ -0,0 +1,83 @@
+; docformat = 'rst'
+
+;+
+; Do L1 and L2 processing for a single file.
+;
+; This is the body of the file loop of `kcor_process_files`, run either in the
+; main process or in one of its `IDL_IDLBridge` workers, so it must not depend
+; on any state other than `run`.
+;
+; :Params:
+;   l0_filename : in, required, type=string
+;     full path of the L0 file
+;
+; :Keywords:
+;   nomask : in, optional, type=boolean
+;     set to not apply a mask to the FITS or GIF files, adding a "nomask" to the
+;     filenames
+;   run : in, required, type=object
+;     `kcor_run` object
+;   mean_phase1 : out, optional, type=float
+;     mean_phase1 of the file, 0.0 if L1 processing failed
+;   l1_filename : out, optional, type=string
+;     basename of the L1 file, '' if L1 processing failed
+;   log_name : in, optional, type=string
+;     name of the log to send messages to
+;   error : out, optional, type=long
+;     set to a named variable to retrieve the error status of the L1 and L2
+;     processing; crashes are logged, but are not reflected in `error`
+;-
+pro kcor_process_file, l0_filename, $
+                       nomask=nomask, $
+                       run=run, $
+                       mean_phase1=mean_phase1, $
+                       l1_filename=l1_filename, $
+                       log_name=log_name, $
+                       error=error
+  compile_opt strictarr
+
+  error = 0L
+  mean_phase1 = 0.0
+  l1_filename = ''
+
+  catch, error_status
+  if (error_status ne 0L) then begin
+    catch, /cancel
+    mg_log, 'error processing %s, skipping', file_basename(l0_filename), $
+            name=log_name, /error
+    mg_log, /last_error, name=log_name, /error
+    return
+  endif
+
+  kcor_l1, l0_filename, $
+           run=run, $
+           nomask=nomask, $
+           mean_phase1=file_mean_phase1, $
+           l1_filename=file_l1_filename, $
+           l1_header=l1_header, $
+           intensity=intensity, $
+           q=q, $
+           u=u, $
+           flat_vdimref=flat_vdimref, scale_factor=scale_factor, $
+           log_name=log_name, $
+           error=error
+
+  if (error ne 0L) then begin
+    mg_log, 'error in L1 processing, skipping L2 processing', $
+            name=log_name, /warn
+    return
+  endif
+
+  mean_phase1 = file_mean_phase1
+  l1_filename = file_l1_filename
+
+  kcor_l2, l1_filename, $
+           l1_header, $
+           intensity, q, u, flat_vdimref, $
+           scale_factor=scale_factor, $
+           run=run, $
+           nomask=nomask, $
+           log_name=log_name, $
+           error=l2_error
+  error or= l2_error
+end
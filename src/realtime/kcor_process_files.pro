@@ -1,8 +1,127 @@
 ; docformat = 'rst'
 
+;+
+; Start worker processes for `kcor_process_files`. Each worker has its own
+; `kcor_run` object for the same date, config file, and mode as `run`, so it
+; keeps its own calibration state from file to file.
+;
+; :Returns:
+;   `objarr` of `IDL_IDLBridge` objects, `!null` if the workers could not be
+;   started
+;
+; :Params:
+;   n_workers : in, required, type=integer
+;     number of workers to start
+;
+; :Keywords:
+;   run : in, required, type=object
+;     `kcor_run` object
+;   log_name : in, optional, type=string
+;     name of the log to send messages to
+;-
+function kcor_process_files_start_workers, n_workers, $
+                                           run=run, $
+                                           log_name=log_name
+  compile_opt strictarr
+
+  workers = objarr(n_workers)
+
+  catch, error
+  if (error ne 0L) then begin
+    catch, /cancel
+    mg_log, 'unable to start workers, processing in main process', $
+            name=log_name, /warn
+    mg_log, /last_error, name=log_name, /warn
+    obj_destroy, workers
+    return, !null
+  endif
+
+  for w = 0L, n_workers - 1L do begin
+    workers[w] = obj_new('IDL_IDLBridge')
+    workers[w]->setVar, 'path', !path
+    workers[w]->setVar, 'date', run.date
+    workers[w]->setVar, 'config_filename', run.config_filename
+    workers[w]->setVar, 'mode', run.mode
+    workers[w]->execute, '!path = path'
+
+    ; the main process has already rotated the logs, if needed
+    workers[w]->execute, 'run = kcor_run(date, config_filename=config_filename, mode=mode, rotate_logs=0B)'
+    status = workers[w]->status(error=error_msg)
+    if (status eq 3) then message, error_msg
+  endfor
+
+  mg_log, 'started %d workers', n_workers, name=log_name, /debug
+
+  return, workers
+end
+
+
+;+
+; Stop worker processes started by `kcor_process_files_start_workers`.
+;
+; :Params:
+;   workers : in, required, type=objarr
+;     `IDL_IDLBridge` objects
+;-
+pro kcor_process_files_stop_workers, workers
+  compile_opt strictarr
+
+  for w = 0L, n_elements(workers) - 1L do begin
+    if (~obj_valid(workers[w])) then continue
+    if (workers[w]->status() eq 1) then workers[w]->abort
+    workers[w]->execute, 'obj_destroy, run'
+  endfor
+  obj_destroy, workers
+end
+
+
+;+
+; Call the `done_routine` of `kcor_process_files` for a finished file. Errors
+; in it are logged, but do not stop the processing of the other files.
+;
+; :Params:
+;   done_routine : in, required, type=string
+;     name of the procedure to call
+;   l0_filename : in, required, type=string
+;     full path of the L0 file
+;   l1_filename : in, required, type=string
+;     basename of the L1 file, '' if L1 processing failed
+;   error : in, required, type=long
+;     error status of the L1 and L2 processing of the file
+;
+; :Keywords:
+;   run : in, required, type=object
+;     `kcor_run` object
+;   log_name : in, optional, type=string
+;     name of the log to send messages to
+;   done_state : in, optional, type=any
+;     passed to `done_routine`
+;-
+pro kcor_process_files_done, done_routine, l0_filename, l1_filename, error, $
+                             run=run, log_name=log_name, done_state=done_state
+  compile_opt strictarr
+
+  catch, error_status
+  if (error_status ne 0L) then begin
+    catch, /cancel
+    mg_log, 'error in %s for %s', done_routine, file_basename(l0_filename), $
+            name=log_name, /error
+    mg_log, /last_error, name=log_name, /error
+    return
+  endif
+
+  call_procedure, done_routine, l0_filename, l1_filename, error, $
+                  run=run, log_name=log_name, state=done_state
+end
+
+
 ;+
 ; Do L1 and L2 processing for a list of files.
 ;
+; If the `processing/n_workers` option is more than 1, the files are processed
+; in that many `IDL_IDLBridge` worker processes, handed out in order as
+; workers become free. Results are returned in the order of `ok_files`.
+;
 ; :Author:
 ;   Joan Burkepile [JB]
 ;
@@ -301,6 +420,17 @@
 ;     set to a named variable to retrieve the error status of the call; `!null`
 ;     if `ok_files` was empty or empty after skipping the first good science
 ;     image of the day
+;   done_routine : in, optional, type=string
+;     procedure to call in the main process as each file is finished, in the
+;     order they finish, so that later stages can start on a file while the
+;     workers process the following files; interface is::
+;
+;       pro done_routine, l0_filename, l1_filename, error, $
+;                         run=run, log_name=log_name, state=state
+;
+;     where `l1_filename` is '' if L1 processing failed
+;   done_state : in, optional, type=any
+;     passed as `STATE` to `done_routine`, e.g., a hash to collect results
 ;-
 pro kcor_process_files, ok_files, $
                         nomask=nomask, $
@@ -309,7 +439,9 @@ pro kcor_process_files, ok_files, $
                         mean_phase1=mean_phase1, $
                         log_name=log_name, $
                         l1_filenames=l1_filenames, $
-                        error=error
+                        error=error, $
+                        done_routine=done_routine, $
+                        done_state=done_state
   compile_opt strictarr
 
   tic
@@ -348,65 +480,135 @@ pro kcor_process_files, ok_files, $
   fnum = 0L
   first_skipped = 0B
   l1_filenames = strarr(n_ok_files)
+  l0_file_dir = keyword_set(eod) ? l0_dir : date_dir
+  call_done = n_elements(done_routine) gt 0L && done_routine ne ''
+
+  n_workers = run->config('processing/n_workers') < n_ok_files
+  if (n_workers gt 1L) then begin
+    workers = kcor_process_files_start_workers(n_workers, $
+                                               run=run, $
+                                               log_name=log_name)
+  endif
 
-  foreach l0_file, ok_files do begin
-    catch, error_status
-    if (error_status ne 0L) then begin
-      mg_log, 'error processing %s, skipping', file_basename(l0_file), $
-              name=log_name, /error
-      mg_log, /last_error, name=log_name, /error
-      continue
-    endif
-
-    fnum += 1L
-
-    mg_log, '%d/%d: %s', $
-            fnum, n_ok_files, file_basename(l0_file), $
-            name=log_name, /info
-
-    ; skip first good image of the day
-    if (~kcor_state(/first_image, run=run)) then begin
-      mg_log, 'skipping first good science image', $
+  if (n_elements(workers) gt 0L) then begin
+    ; index of the file each worker is processing, -1 if idle
+    worker_file = lonarr(n_workers) - 1L
+    n_running = 0L
+
+    while (fnum lt n_ok_files || n_running gt 0L) do begin
+      n_changed = 0L
+      for w = 0L, n_workers - 1L do begin
+        ; collect the results of a finished file
+        f = worker_file[w]
+        if (f ge 0L) then begin
+          status = workers[w]->status(error=error_msg)
+          if (status eq 1) then continue
+
+          if (status eq 2) then begin
+            error[f] or= workers[w]->getVar('file_error')
+            mean_phase1[f] = workers[w]->getVar('file_mean_phase1')
+            l1_filenames[f] = workers[w]->getVar('file_l1_filename')
+          endif else begin
+            ; 3 is an error and 4 is aborted
+            error[f] = 1L
+            mg_log, 'error processing %s, skipping', file_basename(ok_files[f]), $
+                    name=log_name, /error
+            mg_log, '%s', error_msg, name=log_name, /error
+          endelse
+
+          if (call_done) then begin
+            kcor_process_files_done, done_routine, $
+                                     filepath(file_basename(ok_files[f]), root=l0_file_dir), $
+                                     l1_filenames[f], error[f], $
+                                     run=run, log_name=log_name, $
+                                     done_state=done_state
+          endif
+
+          worker_file[w] = -1L
+          n_running -= 1L
+          n_changed += 1L
+        endif
+
+        ; hand the next file to an idle worker, in order, so that the first
+        ; good science image is still the one skipped
+        while (fnum lt n_ok_files) do begin
+          l0_file = ok_files[fnum]
+          fnum += 1L
+
+          mg_log, '%d/%d: %s', $
+                  fnum, n_ok_files, file_basename(l0_file), $
+                  name=log_name, /info
+
+          ; skip first good image of the day
+          if (~kcor_state(/first_image, run=run)) then begin
+            mg_log, 'skipping first good science image', $
+                    name=log_name, /info
+            first_skipped = 1B
+            continue
+          endif
+
+          workers[w]->setVar, 'l0_filename', $
+                              filepath(file_basename(l0_file), root=l0_file_dir)
+          workers[w]->setVar, 'nomask', keyword_set(nomask)
+          if (n_elements(log_name) gt 0L) then workers[w]->setVar, 'log_name', log_name
+          workers[w]->execute, 'kcor_process_file, l0_filename, nomask=nomask, run=run, mean_phase1=file_mean_phase1, l1_filename=file_l1_filename, log_name=log_name, error=file_error', $
+                               /nowait
+          worker_file[w] = fnum - 1L
+          n_running += 1L
+          n_changed += 1L
+          break
+        endwhile
+      endfor
+
+      if (n_changed eq 0L) then wait, 0.1
+    endwhile
+
+    kcor_process_files_stop_workers, workers
+  endif else begin
+    foreach l0_file, ok_files do begin
+      catch, error_status
+      if (error_status ne 0L) then begin
+        mg_log, 'error processing %s, skipping', file_basename(l0_file), $
+                name=log_name, /error
+        mg_log, /last_error, name=log_name, /error
+        continue
+      endif
+
+      fnum += 1L
+
+      mg_log, '%d/%d: %s', $
+              fnum, n_ok_files, file_basename(l0_file), $
               name=log_name, /info
-      first_skipped = 1B
-      continue
-    endif
-
-    kcor_l1, filepath(file_basename(l0_file), $
-                      root=keyword_set(eod) ? l0_dir : date_dir), $
-             run=run, $
-             nomask=nomask, $
-             mean_phase1=file_mean_phase1, $
-             l1_filename=l1_filename, $
-             l1_header=l1_header, $
-             intensity=intensity, $
-             q=q, $
-             u=u, $
-             flat_vdimref=flat_vdimref, scale_factor=scale_factor, $
-             log_name=log_name, $
-             error=l1_error
-
-    error[fnum - 1L] or= l1_error
-    if (l1_error ne 0L) then begin
-      mg_log, 'error in L1 processing, skipping L2 processing', $
-              name=log_name, /warn
-      continue
-    endif
-
-    mean_phase1[fnum - 1L] = file_mean_phase1
-    l1_filenames[fnum - 1L] = l1_filename
-
-    kcor_l2, l1_filename, $
-             l1_header, $
-             intensity, q, u, flat_vdimref, $
-             scale_factor=scale_factor, $
-             run=run, $
-             nomask=nomask, $
-             log_name=log_name, $
-             error=l2_error
-    error[fnum - 1L] or= l2_error
-  endforeach
 
+      ; skip first good image of the day
+      if (~kcor_state(/first_image, run=run)) then begin
+        mg_log, 'skipping first good science image', $
+                name=log_name, /info
+        first_skipped = 1B
+        continue
+      endif
+
+      kcor_process_file, filepath(file_basename(l0_file), root=l0_file_dir), $
+                         run=run, $
+                         nomask=nomask, $
+                         mean_phase1=file_mean_phase1, $
+                         l1_filename=file_l1_filename, $
+                         log_name=log_name, $
+                         error=file_error
+
+      error[fnum - 1L] or= file_error
+      mean_phase1[fnum - 1L] = file_mean_phase1
+      l1_filenames[fnum - 1L] = file_l1_filename
+
+      if (call_done) then begin
+        kcor_process_files_done, done_routine, $
+                                 filepath(file_basename(l0_file), root=l0_file_dir), $
+                                 file_l1_filename, error[fnum - 1L], $
+                                 run=run, log_name=log_name, $
+                                 done_state=done_state
+      endif
+    endforeach
+  endelse
 
   ; drop the first file from OK files if skipped
   if (first_skipped) then begin
@@ -3,6 +3,12 @@
 ;+
 ; Read the fit parameters from a camera correction file.
 ;
+; The fit parameters and bad pixel lists are cached in a binary file written
+; by `KCOR_WRITE_CAMERA_CORRECTION_CACHE`. Reading the cache maps it into
+; memory instead of copying it, so only the pages of the arrays actually used
+; are read, and processes correcting files at the same time share them. A
+; cache in an older format is rebuilt from the netCDF file.
+;
 ; :Returns:
 ;   fltarr(1024, 1024, 5)
 ;
@@ -10,7 +16,7 @@
 ;   filename : in, required, type=string
 ;     camera correction filename for netCDF file
 ;   cache_filename : in, required, type=string
-;     cache of mask info `.sav` file corresponding to the `filename`
+;     binary cache file corresponding to the `filename`, '' to not cache
 ;
 ; :Keywords:
 ;   bad_columns : out, optional, type=lonarr
@@ -35,72 +41,77 @@ function kcor_read_camera_correction, filename, $
                                       interpolate=interpolate
   compile_opt strictarr
 
-  if (file_test(cache_filename, /regular)) then begin
-    restore, filename=cache_filename
-  endif else begin
-    id = ncdf_open(filename)
+  if (cache_filename ne '' && file_test(cache_filename, /regular)) then begin
+    ; a cache in an older format, or truncated, is rebuilt below
+    catch, error
+    if (error eq 0L) then begin
+      fit_params = kcor_read_camera_correction_cache(cache_filename, $
+                                                     bad_columns, $
+                                                     n_bad_columns, $
+                                                     bad_values, $
+                                                     n_bad_values, $
+                                                     bad_pixel_mask)
+      catch, /cancel
+      return, fit_params
+    endif
+    catch, /cancel
+  endif
 
-    fit_params_varid = ncdf_varid(id, 'Fit Parameters')
-    ncdf_varget, id, fit_params_varid, fit_params
+  id = ncdf_open(filename)
 
-    bad_pixel_mask_varid = ncdf_varid(id, 'Bad Pixel Mask')
-    ncdf_varget, id, bad_pixel_mask_varid, bad_pixel_mask
+  fit_params_varid = ncdf_varid(id, 'Fit Parameters')
+  ncdf_varget, id, fit_params_varid, fit_params
 
-    ncdf_close, id
+  bad_pixel_mask_varid = ncdf_varid(id, 'Bad Pixel Mask')
+  ncdf_varget, id, bad_pixel_mask_varid, bad_pixel_mask
 
-    compute_bad_columns = arg_present(bad_columns) || arg_present(n_bad_columns)
-    compute_bad_values = arg_present(bad_values) $
-                           || arg_present(n_bad_values) $
-                           || keyword_set(interpolate)
+  ncdf_close, id
 
-    if (compute_bad_columns || compute_bad_values) then begin
-      dims = size(bad_pixel_mask, /dimensions)
+  ; the bad columns and values are always found, since they are cached for
+  ; later calls which may ask for them
+  dims = size(bad_pixel_mask, /dimensions)
 
-      bad_pixel_mask or= (fit_params[*, *, 4] gt 1.0) or (fit_params[*, *, 4] lt -1.0)
+  bad_pixel_mask or= (fit_params[*, *, 4] gt 1.0) or (fit_params[*, *, 4] lt -1.0)
 
-      ; number of bad pixels in a column to call it a bad column (all of them)
-      bad_column_max = dims[1]
+  ; number of bad pixels in a column to call it a bad column (all of them)
+  bad_column_max = dims[1]
 
-      bad_pixels_by_column = total(bad_pixel_mask, 2, /integer)
-      bad_columns = where(bad_pixels_by_column ge bad_column_max, $
-                          n_bad_columns)
+  bad_pixels_by_column = total(bad_pixel_mask, 2, /integer)
+  bad_columns = where(bad_pixels_by_column ge bad_column_max, $
+                      n_bad_columns)
 
-      ; find individual bad values if needed
-      if (compute_bad_values) then begin
-        fixable_column_mask = bytarr(dims[0]) + 1B
-        fixable_column_mask[bad_columns] = 0B
-        fixable_column_mask = rebin(reform(fixable_column_mask, dims[0], 1), $
-                                    dims[0], dims[1])
+  ; find individual bad values
+  fixable_column_mask = bytarr(dims[0]) + 1B
+  fixable_column_mask[bad_columns] = 0B
+  fixable_column_mask = rebin(reform(fixable_column_mask, dims[0], 1), $
+                              dims[0], dims[1])
 
-        bad_pixel_mask and= fixable_column_mask
-        bad_values = where(bad_pixel_mask, n_bad_values)
-      endif
-    endif
+  bad_pixel_mask and= fixable_column_mask
+  bad_values = where(bad_pixel_mask, n_bad_values)
 
-    if (keyword_set(interpolate) && n_bad_values gt 0L) then begin
-      fit_dims = size(fit_params, /dimensions)
+  if (keyword_set(interpolate) && n_bad_values gt 0L) then begin
+    fit_dims = size(fit_params, /dimensions)
 
-      width = 11
-      for f = 0L, fit_dims[2] - 1L do begin
-        fit_params[*, *, f] = kcor_fix_badpixels(fit_params[*, *, f], $
-                                                 bad_values, $
-                                                 width=width)
-      endfor
-    endif
+    width = 11
+    for f = 0L, fit_dims[2] - 1L do begin
+      fit_params[*, *, f] = kcor_fix_badpixels(fit_params[*, *, f], $
+                                               bad_values, $
+                                               width=width)
+    endfor
+  endif
 
-    if (cache_filename ne '') then begin
-      cache_dirname = file_dirname(cache_filename)
-      if (~file_test(cache_dirname, /directory)) then file_mkdir, cache_dirname
-
-      save, fit_params, $
-            bad_columns, $
-            n_bad_columns, $
-            bad_values, $
-            n_bad_values, $
-            bad_pixel_mask, $
-            filename=cache_filename
-    endif
-  endelse
+  if (cache_filename ne '') then begin
+    cache_dirname = file_dirname(cache_filename)
+    if (~file_test(cache_dirname, /directory)) then file_mkdir, cache_dirname
+
+    kcor_write_camera_correction_cache, cache_filename, $
+                                        float(fit_params), $
+                                        long(bad_columns), $
+                                        n_bad_columns, $
+                                        long(bad_values), $
+                                        n_bad_values, $
+                                        byte(bad_pixel_mask)
+  endif
 
   return, fit_params
 end
@@ -110,10 +121,19 @@ end
 
 basename = 'camera_calibration_MV-D1024E-CL-13890_02.5000_lut20160716-13890.ncdf'
 filename = filepath(basename, root='/home/mgalloy/Downloads')
+cache_filename = filepath(file_basename(basename, '.ncdf') + '.bin', $
+                          root=filepath('', /tmp))
 print, 'reading uncorrected camera correction...'
-uncorrected_fit = kcor_read_camera_correction(filename, bad_values=bad_values, mask=mask)
+uncorrected_fit = kcor_read_camera_correction(filename, '', $
+                                              bad_values=bad_values, $
+                                              mask=mask)
 print, 'reading corrected camera correction...'
-corrected_fit = kcor_read_camera_correction(filename, /interpolate)
+clock = tic('uncached')
+corrected_fit = kcor_read_camera_correction(filename, cache_filename, /interpolate)
+print, toc(clock), format='(%"uncached: %0.2f sec")'
+clock = tic('cached')
+corrected_fit = kcor_read_camera_correction(filename, cache_filename, /interpolate)
+print, toc(clock), format='(%"cached: %0.3f sec")'
 
 uncorrected_k0 = reform(uncorrected_fit[*, *, 4])
 corrected_k0 = reform(corrected_fit[*, *, 4])
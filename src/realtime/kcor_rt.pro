@@ -39,6 +39,8 @@ pro kcor_rt, date, config_filename=config_filename, reprocess=reprocess
   ; do not print math errors, we check for them explicitly
   !except = 0
 
+  if (run->config('database/query_stats')) then mg_mysql_stats_enable, 1
+
   version = kcor_find_code_version(revision=revision, branch=branch)
   full_hostname = mg_hostname()
   hostname_tokens = strsplit(full_hostname, '.', /extract)
@@ -84,10 +86,6 @@ pro kcor_rt, date, config_filename=config_filename, reprocess=reprocess
 
     croppedgif_dir = filepath('', subdir=date_parts, $
                               root=run->config('results/croppedgif_basedir'))
-    fullres_dir = filepath('', subdir=date_parts, $
-                           root=run->config('results/fullres_basedir'))
-    archive_dir = filepath('', subdir=date_parts, $
-                           root=run->config('results/archive_basedir'))
     nrgf_dir = filepath('', subdir=date_parts, $
                         root=run->config('results/nrgf_basedir'))
 
@@ -107,9 +105,15 @@ pro kcor_rt, date, config_filename=config_filename, reprocess=reprocess
     endelse
 
     ; need to run on machine at MLSO since data are not zipped there, should not
-    ; run or be needed in Boulder
-    unzipped_glob = '*_kcor.fts'
-    unzipped_files = file_search(unzipped_glob, count=n_unzipped_files)
+    ; run or be needed in Boulder; files still being transferred are left for
+    ; the next run, the suffixes match kcor_rt_watch so its watch is reused
+    complete_files = kcor_wait_for_files(raw_dir, ['_kcor.fts', '_kcor.fts.gz'], $
+                                         0.0, n_complete_files, $
+                                         run->epoch('raw_filesize'), $
+                                         run->config('realtime/transfer_settle'))
+    unzipped_indices = where(strmatch(complete_files, '*_kcor.fts'), $
+                             n_unzipped_files, /null)
+    unzipped_files = complete_files[unzipped_indices]
 
     ; truncate to tranche size if realtime
     if (~is_reprocessing && ~keyword_set(reprocess)) then begin
@@ -125,31 +129,7 @@ pro kcor_rt, date, config_filename=config_filename, reprocess=reprocess
 
     if (n_unzipped_files gt 0L) then begin
       mg_log, 'zipping %d FITS files...', n_unzipped_files, name='kcor/rt', /info
-      gzip_executable = run->config('externals/gzip')
-      raw_filesize = run->epoch('raw_filesize')
-      n_attempts = 45L
-      transfer_wait = 1.0
-      for f = 0L, n_unzipped_files - 1L do begin
-        ; if not the right size, wait a bit for the transfer to complete
-        for a = 0L, n_attempts - 1L do begin
-          info = file_info(unzipped_files[f])
-          if (info.size eq raw_filesize) then break else begin
-            mg_log, 'waited %0.1f secs for transfer to complete', $
-                    transfer_wait, name='kcor/rt', $
-                    /warn
-            wait, transfer_wait
-          endelse
-        endfor
-
-        gzip_cmd = string(gzip_executable, unzipped_files[f], $
-                          format='(%"%s %s")')
-        spawn, gzip_cmd, result, error_result, exit_status=status
-        if (status ne 0L) then begin
-          mg_log, 'problem zipping file with command: %s', gzip_cmd, $
-                  name='kcor/rt', /error
-          mg_log, '%s', strjoin(error_result, ' '), name='kcor/rt', /error
-        endif
-      endfor
+      kcor_zip_files, unzipped_files, run=run, log_name='kcor/rt'
     endif
 
     l0_fits_files = kcor_remove_duplicates(raw_dir, l0_dir, $
@@ -242,15 +222,43 @@ pro kcor_rt, date, config_filename=config_filename, reprocess=reprocess
       obj_destroy, db
     endif
 
+    ; the products of each file are finished by kcor_rt_products as soon as
+    ; the file is processed, while the following files are being processed
+    products_state = hash('update_gallery', ~keyword_set(reprocess), $
+                          'l2_fits_files', list(), $
+                          'nrgf_basenames', list(), $
+                          'latencies', list())
+    if (keyword_set(reprocess)) then begin
+      mg_log, 'skipping updating NRGF gallery', name='kcor/rt', /info
+    endif
+
     kcor_process_files, ok_files, run=run, mean_phase1=mean_phase1, $
                         l1_filenames=l1_filenames, $
-                        log_name='kcor/rt', error=process_errors
-    n_l1_filenames = n_elements(l1_filenames)
+                        log_name='kcor/rt', error=process_errors, $
+                        done_routine='kcor_rt_products', $
+                        done_state=products_state
+
+    latencies = (products_state['latencies'])->toArray()
+    if (n_elements(latencies) gt 0L) then begin
+      mg_log, 'L0 to products: %0.1f sec mean, %0.1f sec max', $
+              mean(latencies), max(latencies), $
+              name='kcor/rt', /info
+    endif
 
     mg_log, 'moving %d processed files to level0 dir', n_l0_fits_files, $
             name='kcor/rt', /info
     file_move, l0_fits_files, l0_dir, /overwrite
 
+    ; add the new L0 files to the header index of the level0 dir
+    !null = kcor_header_index(l0_dir, /update_only, $
+                              count=n_indexed_files, errmsg=index_errmsg)
+    if (index_errmsg ne '') then begin
+      mg_log, 'problem updating header index: %s', index_errmsg, $
+              name='kcor/rt', /warn
+    endif else begin
+      mg_log, '%d files in header index', n_indexed_files, name='kcor/rt', /debug
+    endelse
+
     if (n_elements(process_errors) eq 0L) then begin
       n_processed_files = 0L
       n_failed_files = 0L
@@ -264,17 +272,12 @@ pro kcor_rt, date, config_filename=config_filename, reprocess=reprocess
     if (file_test(l1_dir, /directory)) then begin
       cd, l1_dir
 
+      ; L1 FITS files not already zipped by kcor_rt_products
       l1_fits_glob = '*kcor_l1.fts'
       l1_fits_files = file_search(l1_fits_glob, count=n_l1_fits_files)
       if (n_l1_fits_files gt 0L) then begin
         mg_log, 'zipping %d L1 FITS files', n_l1_fits_files, name='kcor/rt', /info
-        gzip_cmd = string(run->config('externals/gzip'), l1_fits_glob, format='(%"%s %s")')
-        spawn, gzip_cmd, result, error_result, exit_status=status
-        if (status ne 0L) then begin
-          mg_log, 'problem zipping files with command: %s', gzip_cmd, $
-                  name='kcor/rt', /error
-          mg_log, '%s', strjoin(error_result, ' '), name='kcor/rt', /error
-        endif
+        kcor_zip_files, l1_fits_files, run=run, log_name='kcor/rt'
       endif else begin
         mg_log, 'no L1 FITS files to zip', name='kcor/rt', /info
       endelse
@@ -283,26 +286,25 @@ pro kcor_rt, date, config_filename=config_filename, reprocess=reprocess
     if (file_test(l2_dir, /directory)) then begin
       cd, l2_dir
 
+      ; L2 FITS files not already zipped by kcor_rt_products
       l2_fits_glob = '*kcor_l2*.fts'
       l2_fits_files = file_search(l2_fits_glob, count=n_l2_fits_files)
       if (n_l2_fits_files gt 0L) then begin
+        (products_state['l2_fits_files'])->add, l2_fits_files, /extract
         mg_log, 'zipping %d L2 FITS files', n_l2_fits_files, name='kcor/rt', /info
-        gzip_cmd = string(run->config('externals/gzip'), l2_fits_glob, format='(%"%s %s")')
-        spawn, gzip_cmd, result, error_result, exit_status=status
-        if (status ne 0L) then begin
-          mg_log, 'problem zipping files with command: %s', gzip_cmd, $
-                  name='kcor/rt', /error
-          mg_log, '%s', strjoin(error_result, ' '), name='kcor/rt', /error
-        endif
+        kcor_zip_files, l2_fits_files, run=run, log_name='kcor/rt'
       endif else begin
         mg_log, 'no L2 FITS files to zip', name='kcor/rt', /info
       endelse
     endif else begin
       file_mkdir, l2_dir
       cd, l2_dir
-      n_l2_fits_files = 0L
     endelse
 
+    ; the L2 FITS files of this run for the database
+    l2_fits_files = (products_state['l2_fits_files'])->toArray()
+    n_l2_fits_files = n_elements(l2_fits_files)
+
     if (n_processed_files eq 0L) then begin
       mg_log, 'no files to archive', name='kcor/rt', /info
     endif else begin
@@ -320,64 +322,10 @@ pro kcor_rt, date, config_filename=config_filename, reprocess=reprocess
                                   ? file_lines(failed_catalog_file) $
                                   : 0L
 
-    openw, okcgif_lun, 'okcgif.ls', /append, /get_lun
-    openw, okfgif_lun, 'okfgif.ls', /append, /get_lun
-    openw, okl1gz_lun, 'okl1gz.ls', /append, /get_lun
-    openw, ok_rg_lun, 'oknrgf.ls', /append, /get_lun
     openw, failed_lun, failed_catalog_file, /append, /get_lun
-
-    nrgf_basenames = list()
-
     for f = 0L, n_failed_files - 1L do begin
       printf, failed_lun, file_basename(ok_files[failed_indices[f]])
     endfor
-
-    for f = 0L, n_l1_filenames - 1L do begin
-      base = file_basename(l1_filenames[f], '_l1.fts')
-
-      cropped_gif_filename = base + '_l2_pb_cropped.gif'
-      printf, okcgif_lun, cropped_gif_filename
-
-      gif_filename = base + '_l2_pb.gif'
-      printf, okfgif_lun, gif_filename
-
-      l2_filename = base + '_l2_pb.fts.gz'
-      printf, okl1gz_lun, l2_filename
-
-      nrgf_filename = base + '_l2_nrgf.fts.gz'
-      if (file_test(nrgf_filename)) then begin
-        printf, ok_rg_lun, nrgf_filename
-        nrgf_basenames->add, base
-      endif
-
-      if (run->config('realtime/distribute')) then begin
-        if (file_test(nrgf_filename)) then begin
-          if (~file_test(archive_dir, /directory)) then file_mkdir, archive_dir
-          file_copy, nrgf_filename, archive_dir, /overwrite
-          mg_log, 'copying %s to archive_dir', nrgf_filename, name='kcor/rt', /debug
-        endif
-        if (file_test(cropped_gif_filename)) then begin
-          if (~file_test(croppedgif_dir, /directory)) then file_mkdir, croppedgif_dir
-          file_copy, cropped_gif_filename, croppedgif_dir, /overwrite
-          mg_log, 'copying %s to croppedgif_dir', cropped_gif_filename, name='kcor/rt', /debug
-        endif
-        if (file_test(gif_filename)) then begin
-          if (~file_test(fullres_dir, /directory)) then file_mkdir, fullres_dir
-          file_copy, gif_filename, fullres_dir, /overwrite
-          mg_log, 'copying %s to fullres_dir', gif_filename, name='kcor/rt', /debug
-        endif
-        if (file_test(l2_filename)) then begin
-          if (~file_test(archive_dir, /directory)) then file_mkdir, archive_dir
-          file_copy, l2_filename, archive_dir, /overwrite
-          mg_log, 'copying %s to archive_dir', l2_filename, name='kcor/rt', /debug
-        endif
-      endif
-    endfor
-
-    free_lun, okcgif_lun
-    free_lun, okfgif_lun
-    free_lun, okl1gz_lun
-    free_lun, ok_rg_lun
     free_lun, failed_lun
 
     mg_log, '%d failed files from previous realtime run', $
@@ -396,7 +344,9 @@ pro kcor_rt, date, config_filename=config_filename, reprocess=reprocess
                       logger_name='kcor/rt'
     endif
 
-    ; find the NRGF files now, will copy them after updating database
+    ; the NRGF GIFs were sent to the gallery by kcor_rt_products, but are
+    ; copied to the NRGF directory after updating the database
+    nrgf_basenames = products_state['nrgf_basenames']
     n_nrgf_gifs = nrgf_basenames->count()
     if (n_nrgf_gifs gt 0L) then begin
       nrgf_gif_basenames = nrgf_basenames->toArray()
@@ -404,61 +354,6 @@ pro kcor_rt, date, config_filename=config_filename, reprocess=reprocess
       cropped_nrgf_gifs = nrgf_gif_basenames + '_l2_nrgf_cropped.gif'
     endif
 
-    obj_destroy, nrgf_basenames
-
-    if (keyword_set(reprocess)) then begin
-      mg_log, 'skipping updating NRGF gallery', name='kcor/rt', /info
-    endif else begin
-      if (n_nrgf_gifs eq 0L) then begin
-        mg_log, 'no NRGF images to transfer to NRGF gallery', name='kcor/rt', /info
-      endif else begin
-        method = run->config('realtime/update_nrgf_gallery_method')
-        case strlowcase(method) of
-          'none': mg_log, 'no update NRGF gallery method', name='kcor/rt', /info
-          'cp': begin
-              mg_log, 'copying %d NRGF GIFs to local gallery', n_nrgf_gifs, $
-                      name='kcor/rt', /info
-              if (~file_test(run->config('results/nrgf_gallery_dir'), /directory)) then begin
-                mg_log, 'creating %s', run->config('results/nrgf_gallery_dir'), $
-                        name='kcor/rt', /info
-                file_mkdir, run->config('results/nrgf_gallery_dir')
-              endif
-              file_copy, '*nrgf.gif', run->config('results/nrgf_gallery_dir'), $
-                         /overwrite
-            end
-          'scp': begin
-              mg_log, 'transferring %d NRGF GIFs to remote gallery', n_nrgf_gifs, $
-                      name='kcor/rt', /info
-              gallery_server = run->config('results/nrgf_gallery_server')
-              gallery_dir    = run->config('results/nrgf_gallery_dir')
-              if (n_elements(gallery_server) eq 0L $
-                    || n_elements(gallery_dir) eq 0L) then begin
-                mg_log, 'NRGF gallery server/dir not specified', $
-                        name='kcor/rt', /warn 
-              endif else begin
-                key = run->config('results/ssh_key')
-                ssh_key_str = n_elements(key) eq 0L $
-                                ? '' $
-                                : string(key, format='(%"-i %s")')
-                spawn_cmd = string(ssh_key_str, $
-                                   gallery_server, gallery_dir, $
-                                   format='(%"scp %s -B -r -p *nrgf.gif %s:%s")')
-                spawn, spawn_cmd, result, error_result, exit_status=status
-                if (status ne 0L) then begin
-                  mg_log, 'problem scp-ing NRGF files with command: %s', spawn_cmd, $
-                          name='kcor/rt', /error
-                  mg_log, '%s', strjoin(error_result, ' '), name='kcor/rt', /error
-                endif
-              endelse
-            end
-          else: begin
-            mg_log, 'unknown update NRGF gallery method: %s', method, $
-                    name='kcor/rt', /info
-          end
-        endcase
-      endelse
-    endelse
-
     if (run->config('database/update')) then begin
       mg_log, 'updating database', name='kcor/rt', /info
 
@@ -517,6 +412,11 @@ pro kcor_rt, date, config_filename=config_filename, reprocess=reprocess
       if (~file_test(croppedgif_dir, /directory)) then file_mkdir, croppedgif_dir
       file_copy, cropped_nrgf_gifs, croppedgif_dir, /overwrite
     endif
+
+    foreach value, products_state do begin
+      if (isa(value, 'list')) then obj_destroy, value
+    endforeach
+    obj_destroy, products_state
   endif else begin
     mg_log, 'raw directory locked, quitting', name='kcor/rt', /info
   endelse
@@ -524,6 +424,12 @@ pro kcor_rt, date, config_filename=config_filename, reprocess=reprocess
   done:
   mg_log, /check_math, name='kcor/rt', /debug
 
+  if (obj_valid(run)) then begin
+    if (run->config('database/query_stats')) then begin
+      kcor_db_log_stats, log_name='kcor/rt'
+    endif
+  endif
+
   if (n_elements(available) gt 0L && available) then begin
     !null = kcor_state(/unlock, run=run)
   endif
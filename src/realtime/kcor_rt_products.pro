@@ -0,0 +1,127 @@
+; docformat = 'rst'
+
+;+
+; Finish the products of a single file as soon as its L1 and L2 processing is
+; done: zip its L1 and L2 FITS files, add it to the lists of OK products,
+; distribute its products, and send its NRGF to the NRGF gallery.
+;
+; This is the `done_routine` of `kcor_process_files` for the realtime
+; pipeline, so while it runs for one file, the workers are processing the
+; following files. The database is updated for the whole run afterward, from
+; the files collected in `state`.
+;
+; :Params:
+;   l0_filename : in, required, type=string
+;     full path of the L0 file
+;   l1_filename : in, required, type=string
+;     basename of the L1 file, '' if L1 processing failed
+;   error : in, required, type=long
+;     error status of the L1 and L2 processing of the file
+;
+; :Keywords:
+;   run : in, required, type=object
+;     `kcor_run` object
+;   log_name : in, optional, type=string
+;     name of the log to send messages to
+;   state : in, required, type=hash
+;     hash with keys "update_gallery" (boolean), and "l2_fits_files",
+;     "nrgf_basenames", and "latencies" (lists added to by each call)
+;-
+pro kcor_rt_products, l0_filename, l1_filename, error, $
+                      run=run, log_name=log_name, state=state
+  compile_opt strictarr
+
+  if (l1_filename eq '') then return
+
+  raw_dir = filepath(run.date, root=run->config('processing/raw_basedir'))
+  l1_dir = filepath('level1', root=raw_dir)
+  l2_dir = filepath('level2', root=raw_dir)
+
+  date_parts = kcor_decompose_date(run.date)
+  croppedgif_dir = filepath('', subdir=date_parts, $
+                            root=run->config('results/croppedgif_basedir'))
+  fullres_dir = filepath('', subdir=date_parts, $
+                         root=run->config('results/fullres_basedir'))
+  archive_dir = filepath('', subdir=date_parts, $
+                         root=run->config('results/archive_basedir'))
+
+  base = file_basename(l1_filename, '_l1.fts')
+
+  ; zip the L1 and L2 FITS files of this file
+  l1_fits_files = file_search(filepath(base + '_l1.fts', root=l1_dir), $
+                              count=n_l1_fits_files)
+  l2_fits_files = file_search(filepath(base + '_l2*.fts', root=l2_dir), $
+                              count=n_l2_fits_files)
+  if (n_l1_fits_files + n_l2_fits_files gt 0L) then begin
+    fits_files = [l1_fits_files, l2_fits_files]
+    fits_files = fits_files[where(fits_files ne '')]
+    kcor_zip_files, fits_files, run=run, log_name=log_name
+  endif
+  if (n_l2_fits_files gt 0L) then begin
+    (state['l2_fits_files'])->add, file_basename(l2_fits_files), /extract
+  endif
+
+  cropped_gif_filename = filepath(base + '_l2_pb_cropped.gif', root=l2_dir)
+  gif_filename = filepath(base + '_l2_pb.gif', root=l2_dir)
+  l2_filename = filepath(base + '_l2_pb.fts.gz', root=l2_dir)
+  nrgf_filename = filepath(base + '_l2_nrgf.fts.gz', root=l2_dir)
+
+  openw, lun, filepath('okcgif.ls', root=l2_dir), /append, /get_lun
+  printf, lun, file_basename(cropped_gif_filename)
+  free_lun, lun
+
+  openw, lun, filepath('okfgif.ls', root=l2_dir), /append, /get_lun
+  printf, lun, file_basename(gif_filename)
+  free_lun, lun
+
+  openw, lun, filepath('okl1gz.ls', root=l2_dir), /append, /get_lun
+  printf, lun, file_basename(l2_filename)
+  free_lun, lun
+
+  has_nrgf = file_test(nrgf_filename)
+  if (has_nrgf) then begin
+    openw, lun, filepath('oknrgf.ls', root=l2_dir), /append, /get_lun
+    printf, lun, file_basename(nrgf_filename)
+    free_lun, lun
+    (state['nrgf_basenames'])->add, base
+  endif
+
+  if (run->config('realtime/distribute')) then begin
+    if (has_nrgf) then begin
+      if (~file_test(archive_dir, /directory)) then file_mkdir, archive_dir
+      file_copy, nrgf_filename, archive_dir, /overwrite
+      mg_log, 'copying %s to archive_dir', file_basename(nrgf_filename), $
+              name=log_name, /debug
+    endif
+    if (file_test(cropped_gif_filename)) then begin
+      if (~file_test(croppedgif_dir, /directory)) then file_mkdir, croppedgif_dir
+      file_copy, cropped_gif_filename, croppedgif_dir, /overwrite
+      mg_log, 'copying %s to croppedgif_dir', file_basename(cropped_gif_filename), $
+              name=log_name, /debug
+    endif
+    if (file_test(gif_filename)) then begin
+      if (~file_test(fullres_dir, /directory)) then file_mkdir, fullres_dir
+      file_copy, gif_filename, fullres_dir, /overwrite
+      mg_log, 'copying %s to fullres_dir', file_basename(gif_filename), $
+              name=log_name, /debug
+    endif
+    if (file_test(l2_filename)) then begin
+      if (~file_test(archive_dir, /directory)) then file_mkdir, archive_dir
+      file_copy, l2_filename, archive_dir, /overwrite
+      mg_log, 'copying %s to archive_dir', file_basename(l2_filename), $
+              name=log_name, /debug
+    endif
+  endif
+
+  nrgf_gif_filename = filepath(base + '_l2_nrgf.gif', root=l2_dir)
+  if (state['update_gallery'] && file_test(nrgf_gif_filename)) then begin
+    kcor_update_nrgf_gallery, nrgf_gif_filename, run=run, log_name=log_name
+  endif
+
+  ; time from the L0 file arriving to its products being available
+  latency = systime(/seconds) - (file_info(l0_filename)).mtime
+  (state['latencies'])->add, latency
+  mg_log, '%s: %0.1f sec from L0 to products', $
+          file_basename(l0_filename), latency, $
+          name=log_name, /debug
+end
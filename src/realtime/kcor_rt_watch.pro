@@ -0,0 +1,88 @@
+; docformat = 'rst'
+
+;+
+; Watch the raw directory of a date and run the realtime pipeline as soon as
+; complete L0 files arrive, instead of waiting for the next cron run of
+; `kcor_rt`.
+;
+; Arrivals are detected by `KCOR_WAIT_FOR_FILES` in the kcor DLM, which uses
+; inotify to see files closed after writing, or polls the directory when it
+; is on a network file system such as NFS. Watching stops when the raw
+; directory is marked as processed or after the "realtime/watch_max_idle"
+; option seconds without new files.
+;
+; :Params:
+;   date : in, required, type=string
+;     date to process in the form "YYYYMMDD"
+;
+; :Keywords:
+;   config_filename : in, required, type=string
+;     configuration file specifying the parameters of the run
+;-
+pro kcor_rt_watch, date, config_filename=config_filename
+  compile_opt strictarr
+
+  ; catch and log any crashes
+  catch, error
+  if (error ne 0L) then begin
+    catch, /cancel
+    mg_log, /last_error, name='kcor/rt', /critical
+    goto, done
+  endif
+
+  valid_date = kcor_valid_date(date, msg=msg)
+  if (~valid_date) then message, msg
+
+  run = kcor_run(date, config_filename=config_filename, mode='realtime')
+  if (~obj_valid(run)) then message, 'problem creating run object'
+
+  raw_dir = filepath('', subdir=date, root=run->config('processing/raw_basedir'))
+  if (~file_test(raw_dir, /directory)) then begin
+    kcor_mkdir, raw_dir, status=status, error_message=error_message
+    if (status ne 0L) then begin
+      mg_log, error_message, name='kcor/rt', /critical
+      goto, done
+    endif
+  endif
+
+  ; same suffixes as kcor_rt, so that it reuses the watch
+  suffixes = ['_kcor.fts', '_kcor.fts.gz']
+  raw_filesize = run->epoch('raw_filesize')
+  settle = run->config('realtime/transfer_settle')
+  timeout = run->config('realtime/watch_timeout')
+  max_idle = run->config('realtime/watch_max_idle')
+  processed_file = filepath('.processed', root=raw_dir)
+
+  ; start watching before logging, to report how
+  !null = kcor_wait_for_files(raw_dir, suffixes, 0.0, n_files, $
+                              raw_filesize, settle, polling)
+  mg_log, 'watching %s by %s', raw_dir, polling ? 'polling' : 'inotify', $
+          name='kcor/rt', /info
+
+  ; kcor_rt sets up and shuts down the logging for each run
+  obj_destroy, run
+
+  ; seconds to wait before retrying when kcor_rt leaves the same files behind,
+  ; e.g., when another run has the raw directory locked
+  retry_wait = 5.0
+
+  last_files = !null
+  idle_clock = tic('idle')
+  while (~file_test(processed_file)) do begin
+    files = kcor_wait_for_files(raw_dir, suffixes, timeout, n_files, $
+                                raw_filesize, settle)
+    if (n_files eq 0L) then begin
+      if (max_idle gt 0.0 && toc(idle_clock) gt max_idle) then break
+      continue
+    endif
+
+    if (array_equal(files, last_files)) then wait, retry_wait
+    last_files = files
+
+    kcor_rt, date, config_filename=config_filename
+    idle_clock = tic('idle')
+  endwhile
+
+  done:
+  if (obj_valid(run)) then obj_destroy, run
+end
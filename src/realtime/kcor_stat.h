@@ -0,0 +1,19 @@
+#ifndef KCOR_STAT_H
+#define KCOR_STAT_H
+
+#include <sys/stat.h>
+#include <time.h>
+
+/*
+ * Access and modification times of a struct stat as a struct timespec, named
+ * st_atimespec/st_mtimespec on macOS and st_atim/st_mtim elsewhere.
+ */
+#ifdef __APPLE__
+#define KCOR_STAT_ATIME(st) ((st)->st_atimespec)
+#define KCOR_STAT_MTIME(st) ((st)->st_mtimespec)
+#else
+#define KCOR_STAT_ATIME(st) ((st)->st_atim)
+#define KCOR_STAT_MTIME(st) ((st)->st_mtim)
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+; docformat = 'rst'
+
+;+
+; Copy NRGF GIFs to the NRGF gallery, using the method given by the
+; `realtime/update_nrgf_gallery_method` option.
+;
+; :Params:
+;   nrgf_gifs : in, required, type=strarr
+;     full paths of the NRGF GIFs to copy
+;
+; :Keywords:
+;   run : in, required, type=object
+;     `kcor_run` object
+;   log_name : in, optional, type=string
+;     name of the log to send messages to
+;-
+pro kcor_update_nrgf_gallery, nrgf_gifs, run=run, log_name=log_name
+  compile_opt strictarr
+
+  n_nrgf_gifs = n_elements(nrgf_gifs)
+  if (n_nrgf_gifs eq 0L) then begin
+    mg_log, 'no NRGF images to transfer to NRGF gallery', name=log_name, /info
+    return
+  endif
+
+  method = run->config('realtime/update_nrgf_gallery_method')
+  case strlowcase(method) of
+    'none': mg_log, 'no update NRGF gallery method', name=log_name, /debug
+    'cp': begin
+        mg_log, 'copying %d NRGF GIFs to local gallery', n_nrgf_gifs, $
+                name=log_name, /info
+        if (~file_test(run->config('results/nrgf_gallery_dir'), /directory)) then begin
+          mg_log, 'creating %s', run->config('results/nrgf_gallery_dir'), $
+                  name=log_name, /info
+          file_mkdir, run->config('results/nrgf_gallery_dir')
+        endif
+        file_copy, nrgf_gifs, run->config('results/nrgf_gallery_dir'), $
+                   /overwrite
+      end
+    'scp': begin
+        mg_log, 'transferring %d NRGF GIFs to remote gallery', n_nrgf_gifs, $
+                name=log_name, /info
+        gallery_server = run->config('results/nrgf_gallery_server')
+        gallery_dir    = run->config('results/nrgf_gallery_dir')
+        if (n_elements(gallery_server) eq 0L $
+              || n_elements(gallery_dir) eq 0L) then begin
+          mg_log, 'NRGF gallery server/dir not specified', $
+                  name=log_name, /warn
+        endif else begin
+          key = run->config('results/ssh_key')
+          ssh_key_str = n_elements(key) eq 0L $
+                          ? '' $
+                          : string(key, format='(%"-i %s")')
+          spawn_cmd = string(ssh_key_str, $
+                             strjoin(nrgf_gifs, ' '), $
+                             gallery_server, gallery_dir, $
+                             format='(%"scp %s -B -r -p %s %s:%s")')
+          spawn, spawn_cmd, result, error_result, exit_status=status
+          if (status ne 0L) then begin
+            mg_log, 'problem scp-ing NRGF files with command: %s', spawn_cmd, $
+                    name=log_name, /error
+            mg_log, '%s', strjoin(error_result, ' '), name=log_name, /error
+          endif
+        endelse
+      end
+    else: begin
+      mg_log, 'unknown update NRGF gallery method: %s', method, $
+              name=log_name, /info
+    end
+  endcase
+end
@@ -0,0 +1,382 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dirent.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/vfs.h>
+#endif
+
+#include "kcor_stat.h"
+#include "kcor_watch.h"
+
+/*
+ * Files are found by scanning the directory, so that files already present
+ * when the watch starts, or written while events were lost, are not missed.
+ * inotify only records which files were closed after writing, to mark them
+ * complete at once, and wakes the wait when that happens. Network file
+ * systems do not report changes made by other hosts to inotify, so their
+ * directories are polled instead.
+ */
+
+#ifdef __linux__
+
+/* f_type of network file systems, from statfs(2) */
+#define KCOR_WATCH_NFS_MAGIC   0x6969
+#define KCOR_WATCH_SMB_MAGIC   0x517b
+#define KCOR_WATCH_CIFS_MAGIC  0xff534d42
+#define KCOR_WATCH_SMB2_MAGIC  0xfe534d42
+#define KCOR_WATCH_FUSE_MAGIC  0x65735546
+
+#define KCOR_WATCH_EVENT_BUFFER_SIZE (64 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+
+
+static int kcor_watch_is_remote(const char *dir) {
+  struct statfs fs;
+
+  if (statfs(dir, &fs) != 0) return 0;
+  switch ((unsigned long) fs.f_type) {
+    case KCOR_WATCH_NFS_MAGIC:
+    case KCOR_WATCH_SMB_MAGIC:
+    case KCOR_WATCH_CIFS_MAGIC:
+    case KCOR_WATCH_SMB2_MAGIC:
+    case KCOR_WATCH_FUSE_MAGIC:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+#endif
+
+
+static int kcor_watch_matches(const kcor_watch *watch, const char *name) {
+  size_t name_length = strlen(name);
+  int s;
+
+  if (name[0] == '.') return 0;
+  for (s = 0; s < watch->n_suffixes; s++) {
+    size_t suffix_length = strlen(watch->suffixes[s]);
+    if (name_length > suffix_length
+          && strcmp(name + name_length - suffix_length, watch->suffixes[s]) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+static void kcor_watch_remove_closed(kcor_watch *watch, int i) {
+  free(watch->closed[i].name);
+  watch->closed[i] = watch->closed[--watch->n_closed];
+}
+
+
+static int kcor_watch_find_closed(const kcor_watch *watch, const char *name) {
+  int i;
+
+  for (i = 0; i < watch->n_closed; i++) {
+    if (strcmp(watch->closed[i].name, name) == 0) return i;
+  }
+  return -1;
+}
+
+
+#ifdef __linux__
+
+static kcor_watch_status kcor_watch_add_closed(kcor_watch *watch,
+                                               const char *name) {
+  char path[PATH_MAX];
+  struct stat st;
+  int i;
+
+  snprintf(path, sizeof(path), "%s/%s", watch->dir, name);
+  if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return KCOR_WATCH_OK;
+
+  i = kcor_watch_find_closed(watch, name);
+  if (i < 0) {
+    if (watch->n_closed == watch->closed_capacity) {
+      int capacity = watch->closed_capacity == 0 ? 64 : 2 * watch->closed_capacity;
+      kcor_watch_closed_file *closed = realloc(watch->closed,
+                                               capacity * sizeof(kcor_watch_closed_file));
+      if (closed == NULL) return KCOR_WATCH_MEMORY;
+      watch->closed = closed;
+      watch->closed_capacity = capacity;
+    }
+    i = watch->n_closed;
+    watch->closed[i].name = strdup(name);
+    if (watch->closed[i].name == NULL) return KCOR_WATCH_MEMORY;
+    watch->n_closed++;
+  }
+
+  watch->closed[i].mtime = KCOR_STAT_MTIME(&st).tv_sec;
+  watch->closed[i].mtime_nsec = KCOR_STAT_MTIME(&st).tv_nsec;
+  return KCOR_WATCH_OK;
+}
+
+
+/* record the files closed after writing since the last call */
+static kcor_watch_status kcor_watch_read_events(kcor_watch *watch) {
+  char buffer[KCOR_WATCH_EVENT_BUFFER_SIZE]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  kcor_watch_status status;
+  ssize_t length;
+  char *pos;
+
+  while (watch->fd >= 0) {
+    length = read(watch->fd, buffer, sizeof(buffer));
+    if (length <= 0) break;
+
+    for (pos = buffer; pos < buffer + length;
+         pos += sizeof(struct inotify_event) + ((struct inotify_event *) pos)->len) {
+      struct inotify_event *event = (struct inotify_event *) pos;
+
+      if (event->mask & IN_IGNORED) {
+        /* the directory was removed or unmounted, fall back to polling */
+        close(watch->fd);
+        watch->fd = -1;
+        break;
+      }
+      if (event->len == 0 || !kcor_watch_matches(watch, event->name)) continue;
+      if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        status = kcor_watch_add_closed(watch, event->name);
+        if (status != KCOR_WATCH_OK) return status;
+      }
+    }
+  }
+
+  return KCOR_WATCH_OK;
+}
+
+#endif
+
+
+static double kcor_watch_now(clockid_t clock) {
+  struct timespec t;
+
+  clock_gettime(clock, &t);
+  return t.tv_sec + t.tv_nsec / 1.0e9;
+}
+
+
+static int kcor_watch_compare(const void *a, const void *b) {
+  return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+
+/*
+ * Find the complete files of the directory; wait is set to the number of
+ * seconds until the next incomplete file would settle.
+ */
+static kcor_watch_status kcor_watch_scan(kcor_watch *watch, off_t expected_size,
+                                         double settle, int *n_files,
+                                         char ***filenames, double *wait) {
+  char path[PATH_MAX];
+  struct dirent *entry;
+  struct stat st;
+  char **files = NULL, **new_files;
+  char *seen;
+  int n = 0, capacity = 0, i;
+  double now = kcor_watch_now(CLOCK_REALTIME), mtime;
+  DIR *d;
+
+  *n_files = 0;
+  *filenames = NULL;
+  *wait = settle;
+
+  d = opendir(watch->dir);
+  if (d == NULL) return KCOR_WATCH_DIR;
+
+  seen = calloc(watch->n_closed > 0 ? watch->n_closed : 1, 1);
+  if (seen == NULL) {
+    closedir(d);
+    return KCOR_WATCH_MEMORY;
+  }
+
+  while ((entry = readdir(d)) != NULL) {
+    int complete, c;
+
+    if (!kcor_watch_matches(watch, entry->d_name)) continue;
+
+    snprintf(path, sizeof(path), "%s/%s", watch->dir, entry->d_name);
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+    mtime = KCOR_STAT_MTIME(&st).tv_sec + KCOR_STAT_MTIME(&st).tv_nsec / 1.0e9;
+    complete = (expected_size > 0 && st.st_size == expected_size)
+      || now - mtime >= settle;
+
+    c = kcor_watch_find_closed(watch, entry->d_name);
+    if (c >= 0) {
+      /* written to again since it was closed if its mtime changed */
+      if (watch->closed[c].mtime == KCOR_STAT_MTIME(&st).tv_sec
+            && watch->closed[c].mtime_nsec == KCOR_STAT_MTIME(&st).tv_nsec) {
+        complete = 1;
+        seen[c] = 1;
+      }
+    }
+
+    if (!complete) {
+      if (mtime + settle - now < *wait) *wait = mtime + settle - now;
+      continue;
+    }
+
+    if (n == capacity) {
+      capacity = capacity == 0 ? 64 : 2 * capacity;
+      new_files = realloc(files, capacity * sizeof(char *));
+      if (new_files == NULL) goto memory_error;
+      files = new_files;
+    }
+    files[n] = strdup(path);
+    if (files[n] == NULL) goto memory_error;
+    n++;
+  }
+  closedir(d);
+
+  /* forget closed files that were removed or written to again */
+  for (i = watch->n_closed - 1; i >= 0; i--) {
+    if (!seen[i]) kcor_watch_remove_closed(watch, i);
+  }
+  free(seen);
+
+  if (n > 0) qsort(files, n, sizeof(char *), kcor_watch_compare);
+  *n_files = n;
+  *filenames = files;
+
+  return KCOR_WATCH_OK;
+
+ memory_error:
+  closedir(d);
+  free(seen);
+  kcor_watch_free_filenames(n, files);
+  return KCOR_WATCH_MEMORY;
+}
+
+
+kcor_watch_status kcor_watch_open(const char *dir, int n_suffixes,
+                                  const char **suffixes, kcor_watch *watch) {
+  struct stat st;
+  int s;
+
+  memset(watch, 0, sizeof(kcor_watch));
+  watch->fd = -1;
+
+  if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) return KCOR_WATCH_DIR;
+
+  watch->dir = strdup(dir);
+  watch->suffixes = calloc(n_suffixes > 0 ? n_suffixes : 1, sizeof(char *));
+  if (watch->dir == NULL || watch->suffixes == NULL) goto memory_error;
+  for (s = 0; s < n_suffixes; s++) {
+    watch->suffixes[s] = strdup(suffixes[s]);
+    if (watch->suffixes[s] == NULL) goto memory_error;
+    watch->n_suffixes++;
+  }
+
+#ifdef __linux__
+  if (!kcor_watch_is_remote(dir)) {
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->fd >= 0
+          && inotify_add_watch(watch->fd, dir,
+                               IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) < 0) {
+      close(watch->fd);
+      watch->fd = -1;
+    }
+  }
+#endif
+
+  return KCOR_WATCH_OK;
+
+ memory_error:
+  kcor_watch_close(watch);
+  return KCOR_WATCH_MEMORY;
+}
+
+
+void kcor_watch_close(kcor_watch *watch) {
+  int i;
+
+  if (watch->fd >= 0) close(watch->fd);
+  for (i = 0; i < watch->n_suffixes; i++) free(watch->suffixes[i]);
+  for (i = 0; i < watch->n_closed; i++) free(watch->closed[i].name);
+  free(watch->suffixes);
+  free(watch->closed);
+  free(watch->dir);
+  memset(watch, 0, sizeof(kcor_watch));
+  watch->fd = -1;
+}
+
+
+int kcor_watch_is_polling(const kcor_watch *watch) {
+  return watch->fd < 0;
+}
+
+
+kcor_watch_status kcor_watch_wait(kcor_watch *watch, double timeout,
+                                  off_t expected_size, double settle,
+                                  int *n_files, char ***filenames) {
+  double deadline = kcor_watch_now(CLOCK_MONOTONIC) + timeout;
+  double remaining, wait;
+  kcor_watch_status status;
+
+  if (settle < 0.0) settle = 0.0;
+
+  while (1) {
+#ifdef __linux__
+    status = kcor_watch_read_events(watch);
+    if (status != KCOR_WATCH_OK) return status;
+#endif
+
+    status = kcor_watch_scan(watch, expected_size, settle,
+                             n_files, filenames, &wait);
+    if (status != KCOR_WATCH_OK || *n_files > 0) return status;
+
+    remaining = deadline - kcor_watch_now(CLOCK_MONOTONIC);
+    if (remaining <= 0.0) return KCOR_WATCH_OK;
+
+    if (wait > remaining) wait = remaining;
+    if (kcor_watch_is_polling(watch) && wait > KCOR_WATCH_POLL_INTERVAL) {
+      wait = KCOR_WATCH_POLL_INTERVAL;
+    }
+    /* wake just after the next file settles, not just before */
+    wait += 0.001;
+
+    if (kcor_watch_is_polling(watch)) {
+      struct timespec t;
+      t.tv_sec = (time_t) wait;
+      t.tv_nsec = (long) ((wait - t.tv_sec) * 1.0e9);
+      while (nanosleep(&t, &t) != 0 && errno == EINTR);
+    } else {
+      struct pollfd p = { watch->fd, POLLIN, 0 };
+      poll(&p, 1, (int) (wait * 1000.0) + 1);
+    }
+  }
+}
+
+
+void kcor_watch_free_filenames(int n_files, char **filenames) {
+  int f;
+
+  if (filenames == NULL) return;
+  for (f = 0; f < n_files; f++) free(filenames[f]);
+  free(filenames);
+}
+
+
+const char *kcor_watch_strerror(kcor_watch_status status) {
+  switch (status) {
+    case KCOR_WATCH_OK:
+      return "no error";
+    case KCOR_WATCH_DIR:
+      return "could not read directory";
+    case KCOR_WATCH_MEMORY:
+      return "out of memory";
+    default:
+      return "unknown error";
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef KCOR_WATCH_H
+#define KCOR_WATCH_H
+
+#include <sys/types.h>
+#include <time.h>
+
+/* seconds between directory scans when polling */
+#define KCOR_WATCH_POLL_INTERVAL 0.25
+
+/*
+ * Error codes returned by the watch routines.
+ */
+typedef enum {
+  KCOR_WATCH_OK = 0,
+  KCOR_WATCH_DIR,      /* could not read the directory */
+  KCOR_WATCH_MEMORY    /* out of memory */
+} kcor_watch_status;
+
+/*
+ * A file closed after writing, with its modification time then, so that
+ * later writes to it can be noticed.
+ */
+typedef struct {
+  char *name;
+  time_t mtime;
+  long mtime_nsec;
+} kcor_watch_closed_file;
+
+/*
+ * A directory watched for files with names ending in one of a set of
+ * suffixes, with inotify when the directory is local and by polling
+ * otherwise, e.g., on NFS, where inotify does not see writes made by other
+ * hosts.
+ */
+typedef struct {
+  char *dir;
+  int n_suffixes;
+  char **suffixes;
+  int fd;                /* inotify descriptor, -1 when polling */
+  int n_closed;
+  int closed_capacity;
+  kcor_watch_closed_file *closed;   /* files closed after writing */
+} kcor_watch;
+
+kcor_watch_status kcor_watch_open(const char *dir, int n_suffixes,
+                                  const char **suffixes, kcor_watch *watch);
+void kcor_watch_close(kcor_watch *watch);
+
+/* whether the watch polls the directory instead of using inotify */
+int kcor_watch_is_polling(const kcor_watch *watch);
+
+/*
+ * Wait up to timeout seconds for complete files in the directory and return
+ * the sorted paths of all of them, or none if the timeout expired first. A
+ * file is complete when it was closed after writing, or moved into the
+ * directory, while watched, when its size is expected_size (if positive), or
+ * when it has not been modified for settle seconds.
+ */
+kcor_watch_status kcor_watch_wait(kcor_watch *watch, double timeout,
+                                  off_t expected_size, double settle,
+                                  int *n_files, char ***filenames);
+void kcor_watch_free_filenames(int n_files, char **filenames);
+
+const char *kcor_watch_strerror(kcor_watch_status status);
+
+#endif
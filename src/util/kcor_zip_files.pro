@@ -1,17 +1,48 @@
 ; docformat = 'rst'
 
-pro kcor_zip_files, glob, run=run
+;+
+; Zip files matching a glob in place, like the gzip executable does, but in
+; the IDL process with the files compressed by several threads.
+;
+; :Params:
+;   glob : in, required, type=string/strarr
+;     glob, or array of globs or filenames, of files to zip
+;
+; :Keywords:
+;   run : in, required, type=object
+;     `kcor_run` object
+;   log_name : in, optional, type=string
+;     name of the log to send messages to, defaults to the logger of `run`
+;   n_zipped_files : out, optional, type=long
+;     set to a named variable to retrieve the number of files successfully
+;     zipped
+;-
+pro kcor_zip_files, glob, run=run, log_name=log_name, $
+                    n_zipped_files=n_zipped_files
   compile_opt strictarr
 
+  _log_name = n_elements(log_name) eq 0L ? run.logger_name : log_name
+  n_zipped_files = 0L
+
   unzipped_files = file_search(glob, count=n_unzipped_files)
-  if (n_unzipped_files gt 0L) then begin
-    gzip_cmd = string(run->config('externals/gzip'), glob, $
-                      format='(%"%s %s")')
-    spawn, gzip_cmd, result, error_result, exit_status=status
-    if (status ne 0L) then begin
-      mg_log, 'problem zipping files with command: %s', gzip_cmd, $
-                name=run.logger_name, /error
-      mg_log, '%s', strjoin(error_result, ' '), name=run.logger_name, /error
-    endif
+  if (n_unzipped_files eq 0L) then return
+
+  unzipped_sizes = (file_info(unzipped_files)).size
+  sizes = kcor_gzip_files(unzipped_files, 0L, messages)
+
+  failed_indices = where(sizes lt 0L, n_failed_files, $
+                         complement=zipped_indices, ncomplement=n_zipped_files)
+  for f = 0L, n_failed_files - 1L do begin
+    mg_log, 'problem zipping %s: %s', $
+            unzipped_files[failed_indices[f]], messages[failed_indices[f]], $
+            name=_log_name, /error
+  endfor
+
+  if (n_zipped_files gt 0L) then begin
+    mg_log, 'zipped %d files, %0.1f MB to %0.1f MB', $
+            n_zipped_files, $
+            total(unzipped_sizes[zipped_indices], /preserve_type) / 1024.0 / 1024.0, $
+            total(sizes[zipped_indices], /preserve_type) / 1024.0 / 1024.0, $
+            name=_log_name, /debug
   endif
 end
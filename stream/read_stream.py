@@ -36,6 +36,92 @@ def read_raw_stream(raw_filename):
     return(im)
 
 
+# stream container format written by socketcam, see sc_core.h
+STREAM_MAGIC = b"KCORSTRM"
+STREAM_VERSION = 1
+
+STREAM_HEADER_DTYPE = np.dtype([("magic", "S8"),
+                                ("version", "<u4"),
+                                ("header_size", "<u4"),
+                                ("width", "<u4"),
+                                ("height", "<u4"),
+                                ("bytes_per_pixel", "<u4"),
+                                ("n_cameras", "<u4"),
+                                ("n_states", "<u4"),
+                                ("reserved", "<u4"),
+                                ("start_time", "<i8"),
+                                ("n_frames", "<u8"),
+                                ("data_offset", "<u8"),
+                                ("frame_size", "<u8"),
+                                ("index_offset", "<u8")])
+
+STREAM_INDEX_DTYPE = np.dtype([("time", "<i8"),
+                               ("number", "<u8"),
+                               ("camera", "u1"),
+                               ("state", "u1"),
+                               ("flags", "<u2"),
+                               ("n_behind", "<u4"),
+                               ("n_missed", "<u4"),
+                               ("reserved", "<u4")])
+
+
+def read_stream_container(stream_filename):
+    """Open a stream container, i.e., a `YYYYMMDD_hhmmss_kcor_stream.bin` file.
+    Returns the header as a structured scalar, the index as a structured array
+    with a `time` (microseconds since `header["start_time"]`), `number`,
+    `camera` and `state` for each frame, and a read-only memory map of the
+    frames of shape `n_frames, height, width`, so frames are only read when
+    used.
+    """
+    header = np.fromfile(stream_filename, dtype=STREAM_HEADER_DTYPE, count=1)
+    if header.size != 1 or header[0]["magic"] != STREAM_MAGIC:
+        raise ValueError(f"{stream_filename} is not a stream container")
+    header = header[0]
+    if header["version"] != STREAM_VERSION:
+        raise ValueError(f"unknown stream container version {header['version']}")
+    if header["index_offset"] == 0:
+        raise ValueError(f"{stream_filename} was not closed, it has no index")
+
+    n_frames = int(header["n_frames"])
+    index = np.fromfile(stream_filename, dtype=STREAM_INDEX_DTYPE,
+                        count=n_frames, offset=int(header["index_offset"]))
+    frames = np.memmap(stream_filename, dtype="<u2", mode="r",
+                       offset=int(header["data_offset"]),
+                       shape=(n_frames, int(header["height"]), int(header["width"])))
+
+    return(header, index, frames)
+
+
+def read_container_time(stream_filename, luts):
+    """Read a stream container into an array with shape
+    `(numsum, n_cameras, n_states, height, width)` like `read_time`, applying
+    the LUTs. Only complete sets of states are used, starting from the first
+    state 0 frame of each camera. Raises `ValueError` if a camera has no state
+    0 frame.
+    """
+    header, index, frames = read_stream_container(stream_filename)
+    if index.size != header["n_frames"]:
+        raise ValueError(f"{stream_filename} has a truncated index")
+
+    rows = []
+    for c in range(N_CAMERAS):
+        ind = np.where(index["camera"] == c)[0]
+        ind = ind[np.argsort(index["number"][ind], kind="stable")]
+        state0 = np.where(index["state"][ind] == 0)[0]
+        if state0.size == 0:
+            raise ValueError(f"{stream_filename} has no state 0 frame for camera {c}")
+        ind = ind[state0[0]:]
+        rows.append(ind[0:(ind.size // N_STATES) * N_STATES].reshape(-1, N_STATES))
+    numsum = min(r.shape[0] for r in rows)
+
+    shape = (numsum, N_CAMERAS, N_STATES, HEIGHT, WIDTH)
+    stream = np.empty(shape, dtype=np.uint32)
+    for c in range(N_CAMERAS):
+        stream[:, c, :, :, :] = apply_lut(frames[rows[c][0:numsum]], luts[c])
+
+    return(stream, numsum)
+
+
 def read_lut(lut_filename):
     """Read a single `.bin` LUT file, returning a 4096 element 32-bit unsigned
     integer array.